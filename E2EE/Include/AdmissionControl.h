@@ -0,0 +1,85 @@
+#pragma once
+#include "Prerequisites.h"
+#include <chrono>
+#include <cstdint>
+
+/**
+ * @brief Control de admision por tiempo de espera en colas (estilo CoDel).
+ *
+ * El nucleo le pasa cuanto esperaron los mensajes en sus colas internas
+ * (inbox entre nucleos, scheduler de cripto, pool de handshakes). Un pico
+ * corto no cuenta: solo si la espera no baja del objetivo durante un
+ * intervalo entero se sube un nivel de descarte, y mientras siga por encima
+ * se sube el siguiente cada interval / sqrt(n), como la ley de control de
+ * CoDel. Despues de un intervalo sin esperas por encima del objetivo se baja
+ * un nivel por intervalo.
+ *
+ * Cada nivel descarta una clase mas, en este orden: senales efimeras
+ * (escribiendo, presencia), handshakes nuevos y transferencias grandes. El
+ * chat de las sesiones ya abiertas nunca se descarta.
+ *
+ * Un controlador por nucleo, usado solo desde su hilo: sin atomicos.
+ */
+class
+AdmissionControl {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  // Orden de descarte: la primera clase es la primera en caer
+  enum class Class : uint8_t {
+    Signal = 0,
+    Handshake = 1,
+    Bulk = 2,
+    Chat = 3
+  };
+
+  static const int kMaxLevel = 3;   // Todo menos Chat
+
+  explicit
+  AdmissionControl(std::chrono::microseconds target = std::chrono::milliseconds(5),
+                   std::chrono::microseconds interval = std::chrono::milliseconds(100));
+
+  /**
+   * @brief Espera de un mensaje en una cola interna.
+   */
+  void
+  Observe(Clock::duration sojourn, Clock::time_point now);
+
+  /**
+   * @brief Baja de nivel sin trafico que observar; una vez por vuelta del loop.
+   */
+  void
+  Tick(Clock::time_point now);
+
+  bool
+  Admit(Class traffic) const { return static_cast<int>(traffic) >= m_level; }
+
+  /**
+   * @brief 0 = se admite todo; n = se descartan las n primeras clases.
+   */
+  int
+  Level() const { return m_level; }
+
+  /**
+   * @brief Ultima espera observada.
+   */
+  Clock::duration
+  Sojourn() const { return m_sojourn; }
+
+  /**
+   * @brief Veces que se subio de nivel.
+   */
+  uint64_t
+  Escalations() const { return m_escalations; }
+
+private:
+  const Clock::duration m_target;
+  const Clock::duration m_interval;
+  int m_level = 0;
+  uint32_t m_count = 0;               // Subidas seguidas: acelera la siguiente
+  Clock::time_point m_firstAbove;     // Fin del intervalo por encima; vacio = por debajo
+  Clock::time_point m_lastAbove;
+  Clock::time_point m_nextStep;
+  Clock::duration m_sojourn{ 0 };
+  uint64_t m_escalations = 0;
+};
@@ -0,0 +1,72 @@
+#pragma once
+#include "Prerequisites.h"
+#include "openssl/evp.h"
+#include "openssl/kdf.h"
+
+/**
+ * @brief Algoritmos de OpenSSL resueltos una sola vez por proceso.
+ *
+ * Initialize() carga los proveedores, hace fetch de los EVP_CIPHER/EVP_MD/
+ * EVP_MAC/EVP_KDF y de los metodos de clave que usamos y los mantiene
+ * referenciados mientras viva el proceso, de modo que ninguna operacion
+ * vuelve a buscar el algoritmo por nombre. Tambien precalienta los DRBG.
+ *
+ * Los getters inicializan bajo demanda si nadie llamo a Initialize().
+ */
+class
+AlgorithmCache {
+public:
+  struct StartupReport {
+    double providersMs = 0;
+    double fetchMs = 0;
+    double drbgMs = 0;
+    double totalMs = 0;
+    bool mlkemAvailable = false;
+    bool hpkeAvailable = false;
+  };
+
+  /**
+   * @brief Fase de arranque. Idempotente y segura entre hilos.
+   * @return false si falta algun algoritmo imprescindible.
+   */
+  static bool
+  Initialize(StartupReport* report = nullptr);
+
+  static const EVP_CIPHER*
+  AES256GCM();
+
+  static const EVP_CIPHER*
+  AES256CBC();
+
+  static const EVP_MD*
+  SHA256();
+
+  /**
+   * @brief Contexto HMAC-SHA256 del hilo actual, listo para EVP_MAC_init.
+   */
+  static EVP_MAC_CTX*
+  ThreadHMAC();
+
+  /**
+   * @brief Contexto HKDF-SHA256 del hilo actual con el digest ya fijado:
+   * a EVP_KDF_derive solo le faltan clave, sal e info.
+   */
+  static EVP_KDF_CTX*
+  ThreadHKDF();
+
+  /**
+   * @brief ThreadHKDF sin clave, sal ni info de derivaciones anteriores.
+   */
+  static EVP_KDF_CTX*
+  ResetThreadHKDF();
+
+  /**
+   * @brief Si el proveedor cargado tiene ML-KEM-768 (resuelto al arrancar).
+   */
+  static bool
+  HasMLKEM();
+
+private:
+  static void
+  Load();
+};
@@ -0,0 +1,133 @@
+#pragma once
+#include "Prerequisites.h"
+#include "MappedFile.h"
+#include "openssl/evp.h"
+#include <cstdint>
+
+/**
+ * @brief Formato de adjuntos cifrados por bloques con acceso aleatorio.
+ *
+ * Cabecera: "E2A1" || tamano de bloque (u32) || tamano en claro (u64) ||
+ * salt (16) || tag HMAC de la cabecera (16).
+ * De (clave, salt) se derivan la clave AES-256-GCM, la clave HMAC y un
+ * prefijo de nonce; el bloque i usa nonce = prefijo || i y la cabecera como
+ * AAD. Como el numero de bloques sale de la cabecera autenticada, truncar,
+ * reordenar o mover bloques entre adjuntos hace fallar la autenticacion.
+ *
+ * A diferencia de StreamCipher, el bloque i esta siempre en una posicion
+ * fija, asi que leer un rango solo descifra los bloques que lo cubren.
+ */
+namespace AttachmentFormat {
+  const size_t kHeaderSize = 48;
+  const size_t kTagSize = 16;
+  const size_t kDefaultChunkSize = 64 * 1024;
+  const size_t kMaxChunkSize = 16 * 1024 * 1024;
+}
+
+class
+AttachmentWriter {
+public:
+  /**
+   * @brief Tamano del adjunto cifrado para un tamano en claro dado.
+   */
+  static uint64_t
+  EncryptedSize(uint64_t plainSize, size_t chunkSize = AttachmentFormat::kDefaultChunkSize);
+
+  static bool
+  Encrypt(const unsigned char key[32], const unsigned char* data, size_t len,
+          std::vector<unsigned char>& out,
+          size_t chunkSize = AttachmentFormat::kDefaultChunkSize);
+
+  /**
+   * @brief Cifra un fichero a otro, ambos proyectados en memoria: los
+   * bloques se escriben directamente en la vista de salida.
+   */
+  static bool
+  EncryptFile(const unsigned char key[32], const std::string& inPath,
+              const std::string& outPath,
+              size_t chunkSize = AttachmentFormat::kDefaultChunkSize);
+
+  /**
+   * @brief Cifrado convergente para el almacen deduplicado (BlobStore).
+   *
+   * La clave sale del contenido: HMAC(domainKey, SHA-256(texto plano)), y el
+   * salt de esa clave, asi que el mismo contenido dentro del mismo dominio
+   * produce el mismo blob. Quien comparte el dominio puede comprobar si
+   * alguien subio un fichero concreto; por eso el dominio debe limitarse a
+   * quienes ya podrian verlo (un chat, una organizacion).
+   *
+   * @param outKey Clave con la que el destinatario abre el adjunto; viaja
+   * por el canal cifrado junto al identificador del blob.
+   */
+  static bool
+  EncryptConvergent(const unsigned char domainKey[32], const unsigned char* data, size_t len,
+                    std::vector<unsigned char>& out, unsigned char outKey[32],
+                    size_t chunkSize = AttachmentFormat::kDefaultChunkSize);
+
+private:
+  /**
+   * @param salt Salt fijo (convergente) o nullptr para uno aleatorio.
+   */
+  static bool
+  EncryptTo(const unsigned char key[32], const unsigned char* data, uint64_t len,
+            size_t chunkSize, unsigned char* out, const unsigned char* salt = nullptr);
+};
+
+/**
+ * @brief Lector de adjuntos con Read(offset, len) en tiempo independiente
+ * de la posicion.
+ */
+class
+AttachmentReader {
+public:
+  AttachmentReader();
+  ~AttachmentReader();
+
+  AttachmentReader(const AttachmentReader&) = delete;
+  AttachmentReader& operator=(const AttachmentReader&) = delete;
+
+  /**
+   * @brief Proyecta el adjunto cifrado y autentica su cabecera.
+   */
+  bool
+  Open(const unsigned char key[32], const std::string& path);
+
+  /**
+   * @brief Igual que Open() sobre un buffer que el llamador mantiene vivo.
+   */
+  bool
+  OpenBuffer(const unsigned char key[32], const unsigned char* data, size_t len);
+
+  /**
+   * @brief Tamano del contenido en claro.
+   */
+  uint64_t
+  Size() const { return m_plainSize; }
+
+  /**
+   * @brief Descifra solo los bloques que cubren [offset, offset + len).
+   *
+   * Lecturas que pasan del final se recortan.
+   * @return false si el rango empieza fuera del adjunto o un bloque no se autentica.
+   */
+  bool
+  Read(uint64_t offset, size_t len, std::vector<unsigned char>& out);
+
+private:
+  bool
+  Attach(const unsigned char key[32], const unsigned char* data, uint64_t len);
+
+  bool
+  OpenChunk(uint64_t index, unsigned char* out, size_t& outLen);
+
+  MappedFile m_file;
+  EVP_CIPHER_CTX* m_ctx;
+  const unsigned char* m_data = nullptr;
+  unsigned char m_header[AttachmentFormat::kHeaderSize];
+  uint32_t m_noncePrefix = 0;
+  size_t m_chunkSize = 0;
+  uint64_t m_plainSize = 0;
+  uint64_t m_chunkCount = 0;
+  bool m_ok = false;
+  std::vector<unsigned char> m_chunk;  // Bloque parcial descifrado
+};
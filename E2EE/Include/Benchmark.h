@@ -0,0 +1,148 @@
+#pragma once
+#include "Prerequisites.h"
+
+/**
+ * @brief Micro-benchmarks que se lanzan desde la linea de comandos:
+ *
+ *   E2EE.exe --bench <nombre> [hilos]
+ *
+ * Cada benchmark imprime una tabla simple por stdout.
+ */
+class
+Benchmark {
+public:
+  /**
+   * @brief Ejecuta el benchmark indicado en argv[2].
+   * @return Codigo de salida para main.
+   */
+  static int
+  Run(int argc, char* argv[]);
+
+private:
+  /**
+   * @brief Mensajes AEAD por segundo con 1..N hilos: nonces de contador
+   * frente a un RAND_bytes global por mensaje.
+   */
+  static void
+  AEADScaling(int maxThreads);
+
+  /**
+   * @brief Latencia, CPU y bytes por handshake: RSA actual frente a
+   * ML-KEM-768 + X25519. Falla si el hibrido supera el presupuesto.
+   */
+  static bool
+  Handshake(int iterations);
+
+  /**
+   * @brief SHA-256/HMAC de lotes de mensajes de 32 a 256 bytes: EVP uno a
+   * uno frente a MultiHash. Mide el nucleo aislado; ningun camino del
+   * servidor lo usa todavia.
+   */
+  static void
+  BatchHash(int batch);
+
+  /**
+   * @brief Adjuntos (AttachmentWriter/Reader) de megabytes MB: cifrado de
+   * fichero a fichero, lecturas de rangos sin alinear frente a descifrarlo
+   * entero, y comprobaciones: un byte cambiado en un bloque o en la
+   * cabecera, o un fichero truncado, no se autentican; el cifrado
+   * convergente es determinista por dominio.
+   */
+  static bool
+  AttachmentReads(int megabytes);
+
+  /**
+   * @brief Adjuntos convergentes compartidos a la vez por clients clientes
+   * a traves de Server (BlobRef y, si falta, BlobPut): subidas frente a
+   * aciertos de deduplicacion y bytes subidos frente a una copia por
+   * referencia. Falla si un adjunto bajado por rangos (BlobRead) no abre
+   * o si sobran o faltan referencias al soltarlas.
+   */
+  static bool
+  BlobDedup(int clients);
+
+  /**
+   * @brief Mensajes enrutados por segundo a traves de Server con 1..N
+   * nucleos, con parejas de clientes por loopback, y la parte del trafico
+   * que son acks.
+   */
+  static void
+  ServerScaling(int maxCores);
+
+  /**
+   * @brief Entregas por segundo a una sala de N miembros: una publicacion
+   * cifrada una vez y compartida frente a un Send por miembro.
+   */
+  static void
+  RoomFanOut(int members);
+
+  /**
+   * @brief Coste para el emisor de un mensaje a un grupo de 2..N miembros:
+   * un AEADEncrypt por miembro (sesiones pareadas) frente a un solo
+   * GroupSession::Encrypt (sender key). Falla si un miembro no lo descifra.
+   */
+  static bool
+  GroupFanOut(int maxMembers);
+
+  /**
+   * @brief OfflineStore: appends durables por segundo con 1..N hilos (y
+   * cuantos cubre cada volcado a disco) y velocidad de drenaje del backlog.
+   */
+  static void
+  OfflineThroughput(int maxThreads);
+
+  /**
+   * @brief Coste por trama de los token buckets de entrada: el de una
+   * conexion, el de una IP compartido por 1..N hilos y su efecto ante una
+   * inundacion.
+   */
+  static void
+  RateLimiting(int maxThreads);
+
+  /**
+   * @brief AdmissionControl ante una traza de esperas (pico corto,
+   * sobrecarga sostenida, recuperacion): cuando sube y baja cada nivel.
+   */
+  static void
+  AdmissionTrace();
+
+  /**
+   * @brief Latencia de cola con carga sesgada (rafagas de tareas cortas y
+   * algunas tareas que lanzan muchas subtareas pesadas): una cola unica con
+   * mutex frente a WorkStealingScheduler.
+   */
+  static void
+  SkewedScheduling(int threads);
+
+  /**
+   * @brief Mensajes por segundo de 1..N productores a un consumidor: cola
+   * con mutex frente a MPSCQueue con cada WaitStrategy (y SPSCQueue con un
+   * productor).
+   */
+  static void
+  QueueHandoff(int maxProducers);
+
+  /**
+   * @brief Consultas por segundo a RoutingTable con 1..N lectores mientras
+   * un escritor conecta y desconecta usuarios sin parar.
+   */
+  static void
+  RouteLookups(int maxThreads);
+
+  /**
+   * @brief Reinicio en caliente con parejas de clientes intercambiando
+   * mensajes: hueco maximo de entrega durante el traspaso y clientes que
+   * siguen sin reconectar. Falla si alguno se desconecta o se para.
+   */
+  static bool
+  RestartHandoff(int clients);
+
+  /**
+   * @brief Cluster: reparto y claves movidas al entrar un nodo (HashRing
+   * frente a hash % n), mensajes por segundo con tres nodos por loopback y
+   * mensajes por lote en los enlaces, y clientes redirigidos cuando entra
+   * un cuarto nodo.
+   */
+  static bool
+  ClusterSharding(int clients);
+};
@@ -0,0 +1,194 @@
+#pragma once
+#include "Prerequisites.h"
+#include "MappedFile.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @brief Almacen de adjuntos cifrados direccionado por contenido (lado servidor).
+ *
+ * La clave de cada blob es el SHA-256 del ciphertext. Con cifrado convergente
+ * (AttachmentWriter::EncryptConvergent) el mismo adjunto reenviado produce el
+ * mismo blob, asi que se guarda y se sube una sola vez: el cliente pregunta
+ * primero con AddRef() y solo sube si el blob no existe.
+ *
+ * Cada destinatario que referencia el blob suma una referencia. Los blobs sin
+ * referencias los borra el GC tras un periodo de gracia (por si llega un
+ * AddRef en vuelo). Las lecturas de rangos van sobre el fichero proyectado.
+ *
+ * Las referencias son durables: Put, AddRef y Release anaden una linea a un
+ * journal y no vuelven hasta que esta en disco. El volcado es un group
+ * commit: el primero que llega vuelca todo lo escrito hasta entonces y los
+ * que esperan detras quedan cubiertos por ese mismo fsync, asi que con
+ * muchos clientes a la vez hay muchos menos volcados que cambios, y nadie
+ * retiene el lock del journal mientras dura. SaveIndex compacta: escribe
+ * el indice con una generacion nueva y empieza un journal vacio para ella;
+ * al arrancar se carga el indice y se reaplica solo el journal de su
+ * generacion, asi que un corte a mitad de compactacion no cuenta dos veces.
+ */
+class
+BlobStore {
+public:
+  using BlobId = std::array<unsigned char, 32>;
+
+  struct Stats {
+    uint64_t blobs = 0;
+    uint64_t storedBytes = 0;    // Bytes en disco
+    uint64_t logicalBytes = 0;   // Bytes si cada referencia tuviera su copia
+    uint64_t dedupHits = 0;      // Subidas o AddRef resueltos sin escribir
+    uint64_t collected = 0;      // Blobs borrados por el GC
+    uint64_t changes = 0;        // Lineas de journal (Put, AddRef, Release)
+    uint64_t syncs = 0;          // Volcados del journal que las cubren
+  };
+
+  /**
+   * @param directory Directorio de los blobs; se crea si no existe. Los
+   * temporales que una caida dejo a medias se borran al abrir.
+   * @param gracePeriod Tiempo que un blob sin referencias sobrevive al GC.
+   */
+  explicit
+  BlobStore(const std::string& directory,
+            std::chrono::milliseconds gracePeriod = std::chrono::minutes(10));
+  ~BlobStore();
+
+  BlobStore(const BlobStore&) = delete;
+  BlobStore& operator=(const BlobStore&) = delete;
+
+  static BlobId
+  ComputeId(const unsigned char* data, size_t len);
+
+  static std::string
+  ToHex(const BlobId& id);
+
+  static bool
+  FromHex(const std::string& hex, BlobId& outId);
+
+  /**
+   * @brief Guarda un blob (o suma una referencia si ya existe).
+   *
+   * @param outDeduplicated true si el blob ya estaba y no se escribio nada.
+   */
+  bool
+  Put(const unsigned char* data, size_t len, BlobId& outId, bool& outDeduplicated);
+
+  /**
+   * @brief Suma una referencia a un blob existente sin subirlo de nuevo.
+   * @return false si el blob no existe (hay que usar Put).
+   */
+  bool
+  AddRef(const BlobId& id);
+
+  /**
+   * @brief Quita una referencia. Con cero referencias el blob pasa al GC.
+   */
+  bool
+  Release(const BlobId& id);
+
+  uint64_t
+  RefCount(const BlobId& id) const;
+
+  uint64_t
+  BlobSize(const BlobId& id) const;
+
+  /**
+   * @brief Lee [offset, offset + len) del blob sin cargarlo entero.
+   */
+  bool
+  Read(const BlobId& id, uint64_t offset, size_t len, std::vector<unsigned char>& out);
+
+  /**
+   * @brief Borra los blobs sin referencias cuyo periodo de gracia vencio.
+   * @return Numero de blobs borrados.
+   */
+  size_t
+  CollectGarbage();
+
+  void
+  StartBackgroundGC(std::chrono::milliseconds interval);
+
+  void
+  StopBackgroundGC();
+
+  /**
+   * @brief Compacta el journal en el indice (fichero temporal volcado a
+   * disco + rename) y empieza un journal nuevo.
+   */
+  bool
+  SaveIndex();
+
+  Stats
+  GetStats() const;
+
+private:
+  struct BlobIdHash {
+    size_t
+    operator()(const BlobId& id) const {
+      size_t h;
+      std::memcpy(&h, id.data(), sizeof(h));
+      return h;
+    }
+  };
+
+  struct Entry {
+    uint64_t size = 0;
+    uint64_t refs = 0;
+    std::chrono::steady_clock::time_point unreferencedSince;
+    std::shared_ptr<MappedFile> mapping;  // Se abre en la primera lectura
+  };
+
+  std::string
+  PathFor(const BlobId& id) const;
+
+  void
+  LoadIndex();
+
+  // Con m_journalLock tomado: anade "+ id" o "- id" al journal (sin volcar)
+  // y devuelve el ticket que hay que pasar a Commit
+  bool
+  LogChange(char op, const BlobId& id, uint64_t& outTicket);
+
+  // Sin locks: espera a que el journal este en disco hasta ticket
+  bool
+  Commit(uint64_t ticket);
+
+  // Quita una referencia en memoria (Release y deshacer un "+" que no se pudo escribir)
+  bool
+  Unref(const BlobId& id);
+
+  std::string
+  JournalPath(uint64_t generation) const;
+
+  void
+  GCLoop(std::chrono::milliseconds interval);
+
+  std::string m_directory;
+  std::chrono::milliseconds m_gracePeriod;
+
+  // Orden de locks: m_journalLock antes que m_lock
+  std::mutex m_journalLock;
+  std::FILE* m_journal = nullptr;
+  uint64_t m_generation = 0;
+
+  // Group commit (con m_journalLock): cada linea recibe un ticket creciente
+  uint64_t m_written = 0;
+  uint64_t m_durable = 0;
+  bool m_syncing = false;          // Un hilo vuelca fuera del lock
+  std::condition_variable m_synced;
+
+  mutable std::mutex m_lock;
+  std::unordered_map<BlobId, Entry, BlobIdHash> m_blobs;
+  Stats m_stats;
+  bool m_dirty = false;
+
+  std::thread m_gcThread;
+  std::mutex m_gcLock;
+  std::condition_variable m_gcWake;
+  bool m_gcRunning = false;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include "Prerequisites.h"
+
+/**
+ * @brief Reserva de buffers de un solo hilo (sin locks).
+ *
+ * Cada nucleo del servidor tiene la suya: los buffers de las conexiones que
+ * se cierran se reutilizan en las nuevas en lugar de volver al heap.
+ */
+class
+BufferPool {
+public:
+  explicit
+  BufferPool(size_t bufferSize = 16 * 1024, size_t maxPooled = 1024)
+    : m_bufferSize(bufferSize), m_maxPooled(maxPooled) {}
+
+  std::vector<unsigned char>
+  Acquire() {
+    if (m_free.empty()) {
+      std::vector<unsigned char> buffer;
+      buffer.reserve(m_bufferSize);
+      return buffer;
+    }
+    std::vector<unsigned char> buffer = std::move(m_free.back());
+    m_free.pop_back();
+    return buffer;
+  }
+
+  /**
+   * @brief Devuelve un buffer. Los que crecieron mucho se liberan para no
+   * retener memoria de un pico puntual.
+   */
+  void
+  Release(std::vector<unsigned char>&& buffer) {
+    if (m_free.size() >= m_maxPooled || buffer.capacity() > 4 * m_bufferSize) {
+      return;
+    }
+    buffer.clear();
+    m_free.push_back(std::move(buffer));
+  }
+
+  size_t
+  Pooled() const { return m_free.size(); }
+
+private:
+  size_t m_bufferSize;
+  size_t m_maxPooled;
+  std::vector<std::vector<unsigned char>> m_free;
+};
@@ -0,0 +1,295 @@
+#pragma once
+#include "NetworkHelper.h"
+#include "HashRing.h"
+#include "ReliableChannel.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @brief Un nodo del cluster: donde conectan sus clientes y sus pares.
+ */
+struct ClusterNode {
+  std::string name;
+  std::string host;      // IPv4
+  int clientPort = 0;    // El que reciben los clientes en un Redirect
+  int linkPort = 0;      // Enlaces entre nodos
+};
+
+/**
+ * @brief Reparto de usuarios entre varios procesos Server (shards).
+ *
+ * Cada usuario es de un nodo, el que indica el HashRing sobre su id; todos
+ * los nodos calculan lo mismo con la misma lista de miembros y el mismo
+ * secreto. Un mensaje para un usuario de otro nodo viaja por un enlace TCP
+ * persistente hacia ese nodo, uno por par (origen, destino).
+ *
+ * Envio por lotes: Forward solo deja el mensaje en la cola sin locks del
+ * enlace y despierta al hilo de enlaces. Ese hilo junta todo lo que haya en
+ * la cola (hasta kMaxBatchBytes, y cifrado nunca mayor que una trama de
+ * FrameCodec) en un lote con una secuencia, lo cifra una vez y lo escribe
+ * mientras el socket no tenga otro lote pendiente: con poco trafico sale un
+ * lote por mensaje, con mucho se agrupan solos.
+ *
+ * Protocolo del enlace (tramas de FrameCodec con tipos propios):
+ *   Challenge  R->E  [32 bytes aleatorios]
+ *   Hello      E->R  [len nodo][nodo][encarnacion u64][sal 32][HMAC 32]
+ *   Batch      E->R  AEAD sobre [seq u64][n u32][n x ([tipo u8][len destino]
+ *                    [destino][len origen][origen][len u32][payload])]
+ *   Ack        R->E  AEAD sobre el ack de AckTracker (acumulado + SACK)
+ * Las claves salen del secreto con la sal del emisor y el reto del
+ * receptor, asi que un Hello o un lote grabados no valen en otra conexion.
+ * El emisor guarda cada lote hasta su ack y, al reconectar, reenvia lo que
+ * el primer ack no cubre; el receptor descarta lotes repetidos por
+ * secuencia mientras la encarnacion (el arranque del proceso) del emisor
+ * sea la misma.
+ *
+ * Cambio de miembros (SetNodes): nuevo anillo y nueva version. Solo cambian
+ * de dueno los usuarios de los tramos afectados; lo que quedaba en la cola
+ * de un nodo que sale se reparte con el anillo nuevo, menos las
+ * publicaciones de sala, que no tienen dueno y se pierden, y las claves
+ * fijadas, que el emisor vuelve a enviar con la version nueva.
+ */
+class
+Cluster {
+public:
+  enum class Kind : unsigned char {
+    Message = 0,   // Deliver, con almacen offline en el nodo dueno
+    Signal = 1,    // Senal efimera
+    Room = 2,      // Publicacion en la sala destino; va a todos los nodos
+    Identity = 3   // Claves fijadas (IdentityRegistry::Export) para el nodo dueno
+  };
+
+  /**
+   * @brief Mensaje de otro nodo para un usuario de este. Desde el hilo de
+   * enlaces: hay que devolver rapido.
+   * @return false si ahora no cabe (sin tocar los argumentos): el enlace lo
+   * guarda, deja de leer de los otros nodos y lo reintenta en cada vuelta.
+   */
+  using Receiver = std::function<bool(Kind kind, std::string&& destination,
+                                      std::string&& source, std::string&& payload)>;
+
+  /**
+   * @brief Aviso de Forward desde el hilo de enlaces: el nodo destino
+   * confirmo el lote del mensaje (o el mensaje acabo en el Receiver de este
+   * nodo porque el dueno cambio). Hasta entonces quien lo envio lo guarda.
+   */
+  using Delivered = std::function<void()>;
+
+  struct Link;   // Enlace saliente hacia un nodo
+
+  /**
+   * @brief Miembros en una version: inmutable, se comparte por puntero.
+   */
+  struct Topology {
+    explicit
+    Topology(const uint64_t key[2]) : ring(key) {}
+
+    uint64_t version = 0;
+    HashRing ring;
+    std::unordered_map<std::string, std::shared_ptr<Link>> links;   // Sin el propio nodo
+    std::unordered_map<std::string, std::string> clients;           // Nodo -> "host:puerto"
+  };
+
+  struct Stats {
+    uint64_t forwarded = 0;   // Mensajes que salieron por los enlaces
+    uint64_t received = 0;    // Mensajes de otros nodos entregados aqui
+    uint64_t batches = 0;     // Lotes enviados, reenvios incluidos
+    uint64_t resent = 0;      // Lotes reenviados al reconectar
+    uint64_t duplicates = 0;  // Lotes repetidos descartados al recibir
+    uint64_t linkBytes = 0;   // Bytes escritos en los enlaces
+    uint64_t connects = 0;    // Enlaces salientes establecidos
+    uint64_t links = 0;       // Enlaces salientes activos ahora
+    uint64_t queued = 0;      // Mensajes en cola o sin ack (aproximado)
+    uint64_t deferred = 0;    // Rechazados por el Receiver y reintentados
+  };
+
+  static const size_t kQueueDepth = 65536;           // Mensajes por nodo destino
+  static const size_t kMaxBatchBytes = 256 * 1024;
+  static const size_t kMaxUnackedBatches = 256;      // Por enlace; despues la cola espera
+
+  /**
+   * @param self Nombre de este nodo en la lista de miembros.
+   * @param secret Compartido por todos los nodos: clave del anillo y de los enlaces.
+   */
+  Cluster(const std::string& self, const std::string& secret, Receiver receiver);
+  ~Cluster();
+
+  Cluster(const Cluster&) = delete;
+  Cluster& operator=(const Cluster&) = delete;
+
+  /**
+   * @brief "a=127.0.0.1:9000:9100,b=..." (nombre=host:puertoClientes:puertoEnlaces).
+   */
+  static bool
+  Parse(const std::string& spec, std::vector<ClusterNode>& out);
+
+  /**
+   * @brief Escucha en el puerto de enlaces de este nodo y conecta con el resto.
+   */
+  bool
+  Start(const std::vector<ClusterNode>& nodes);
+
+  void
+  Stop();
+
+  /**
+   * @brief Cambia los miembros. Si este nodo no esta en la lista, no es
+   * dueno de nadie (salida ordenada).
+   */
+  void
+  SetNodes(const std::vector<ClusterNode>& nodes);
+
+  const std::string&
+  Self() const { return m_self; }
+
+  /**
+   * @brief Sube con cada SetNodes; sin locks, para comprobar en cada vuelta
+   * si la copia de Current() sigue valida.
+   */
+  uint64_t
+  Version() const { return m_version.load(std::memory_order_acquire); }
+
+  std::shared_ptr<const Topology>
+  Current() const;
+
+  /**
+   * @brief Encola un mensaje para un usuario de node.
+   * @param delivered Opcional; no se llama si devuelve false ni tras Stop().
+   * @return false si el enlace no existe, su cola esta llena o el mensaje
+   * no cabe en un lote: quien llama decide (normalmente, guardarlo offline).
+   */
+  bool
+  Forward(const Topology& topology, const std::string& node, Kind kind,
+          const std::string& destination, const std::string& source,
+          const std::string& payload, Delivered delivered = nullptr);
+
+  Stats
+  GetStats() const;
+
+private:
+  struct Envelope;
+  struct Incoming;
+
+  // Estado de recepcion de cada emisor; sobrevive a sus reconexiones
+  struct Peer {
+    uint64_t incarnation = 0;
+    AckTracker acks;
+  };
+
+  static bool
+  ParseBatch(const unsigned char* data, size_t len, uint64_t& seq, std::vector<Envelope>& out);
+
+  bool
+  OpenSockets(int linkPort);
+
+  void
+  Wake();
+
+  void
+  Run();
+
+  void
+  Connect(Link& link);
+
+  void
+  Disconnect(Link& link);
+
+  void
+  OnConnected(Link& link);
+
+  bool
+  ReadLink(Link& link);
+
+  bool
+  OnLinkFrame(Link& link, unsigned char type, const unsigned char* body, size_t len);
+
+  void
+  Pump(Link& link);
+
+  void
+  SendBatch(Link& link, const std::vector<unsigned char>& batch);
+
+  bool
+  FlushLink(Link& link);
+
+  void
+  Retire(Link& link, const Topology& topology);
+
+  void
+  Redistribute(Link& link, const Topology& topology);
+
+  void
+  Dispatch(Envelope& envelope, const Topology& topology);
+
+  // Al Receiver, o a m_rejected detras de lo que ya espera
+  void
+  Receive(Envelope& envelope);
+
+  void
+  RetryRejected();
+
+  void
+  Accept();
+
+  bool
+  ReadIncoming(Incoming& incoming);
+
+  bool
+  OnIncomingFrame(Incoming& incoming, unsigned char type, const unsigned char* body,
+                  size_t len);
+
+  bool
+  OnHello(Incoming& incoming, const unsigned char* body, size_t len);
+
+  bool
+  OnBatch(Incoming& incoming, const unsigned char* body, size_t len);
+
+  void
+  SendAck(Incoming& incoming);
+
+  void
+  DeriveLinkKeys(const unsigned char salt[32], const unsigned char challenge[32],
+                 unsigned char out[64]) const;
+
+  std::string m_self;
+  unsigned char m_linkSecret[32];
+  uint64_t m_ringKey[2];
+  Receiver m_receiver;
+  uint64_t m_incarnation = 0;
+  bool m_keyed = false;
+
+  mutable std::mutex m_lock;
+  std::shared_ptr<const Topology> m_topology;
+  std::vector<std::shared_ptr<Link>> m_retired;   // Fuera del anillo; los suelta el hilo
+  std::atomic<uint64_t> m_version{ 0 };
+
+  SOCKET m_listener = INVALID_SOCKET;
+  SOCKET m_wakeSocket = INVALID_SOCKET;
+  std::atomic<bool> m_wakePending{ false };
+  std::atomic<bool> m_stop{ false };
+  std::thread m_thread;
+
+  // Solo el hilo de enlaces
+  std::vector<std::shared_ptr<Link>> m_active;
+  std::vector<std::pair<std::shared_ptr<Link>, std::chrono::steady_clock::time_point>> m_draining;
+  std::vector<std::unique_ptr<Incoming>> m_incoming;
+  std::unordered_map<std::string, Peer> m_peers;
+  std::vector<unsigned char> m_recvBuffer;
+  std::vector<Envelope> m_batch;
+  std::vector<Envelope> m_rejected;   // Rechazados por el Receiver, en orden
+
+  // Un solo escritor: el hilo de enlaces
+  std::atomic<uint64_t> m_forwarded{ 0 };
+  std::atomic<uint64_t> m_received{ 0 };
+  std::atomic<uint64_t> m_batches{ 0 };
+  std::atomic<uint64_t> m_resent{ 0 };
+  std::atomic<uint64_t> m_duplicates{ 0 };
+  std::atomic<uint64_t> m_linkBytes{ 0 };
+  std::atomic<uint64_t> m_connects{ 0 };
+  std::atomic<uint64_t> m_links{ 0 };
+  std::atomic<uint64_t> m_deferred{ 0 };
+};
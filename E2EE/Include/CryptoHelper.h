@@ -1,7 +1,11 @@
 #pragma once
 #include "Prerequisites.h"
+#include "NonceSequence.h"
+#include "ReplayWindow.h"
+#include "MessageCompressor.h"
 #include "openssl\rsa.h"
 #include "openssl\aes.h"
+#include "openssl/evp.h"
 
 class
 CryptoHelper {
@@ -9,6 +13,11 @@ public:
   CryptoHelper();
   ~CryptoHelper();
 
+  CryptoHelper(const CryptoHelper&) = delete;
+  CryptoHelper& operator=(const CryptoHelper&) = delete;
+
+  static const size_t kKeySize = 32;
+
   // RSA
   void
   GenerateRSAKeys();
@@ -19,6 +28,20 @@ public:
   void
   LoadPeerPublicKey(const std::string& pemKey);
 
+  /**
+   * @brief Clave publica propia en DER (SubjectPublicKeyInfo), formato
+   * binario de intercambio: mas compacto que PEM y sin base64.
+   */
+  const std::vector<unsigned char>&
+  GetPublicKeyDER() const;
+
+  /**
+   * @brief Carga la clave del peer desde DER. Las claves ya vistas salen del
+   * PeerKeyCache global sin volver a parsear.
+   */
+  bool
+  LoadPeerPublicKeyDER(const std::vector<unsigned char>& derKey);
+
   // AES
   void
   GenerateAESKey();
@@ -29,6 +52,25 @@ public:
   void
   DecryptAESKey(const std::vector<unsigned char>& encryptedKey);
 
+  /**
+   * @brief Descifra una clave AES envuelta con nuestra clave RSA sin tocar
+   * el estado de esta instancia.
+   *
+   * Un servidor comparte asi una sola identidad (de solo lectura) entre
+   * hilos e instala la clave en la sesion de cada conexion con SetSessionKey.
+   */
+  bool
+  UnwrapAESKey(const std::vector<unsigned char>& encryptedKey, unsigned char out[32]) const;
+
+  /**
+   * @brief Instala una clave AES acordada por otro mecanismo
+   * (por ejemplo HybridKeyExchange) en lugar del intercambio RSA.
+   *
+   * @param initiator true en el lado que inicio el handshake.
+   */
+  void
+  SetSessionKey(const unsigned char key[32], bool initiator);
+
   std::vector<unsigned char>
   AESEncrypt(const std::string& plaintext, std::vector<unsigned char>& outIV);
 
@@ -36,8 +78,177 @@ public:
   AESDecrypt(const std::vector<unsigned char>& ciphertext,
       const std::vector<unsigned char>& iv);
 
+  // AEAD con nonces de contador
+
+  /**
+   * @brief Cifra con AES-256-GCM usando la clave de envio de la sesion.
+   *
+   * El nonce es un contador por sesion y direccion, no se pide aleatoriedad
+   * por mensaje. Salida: secuencia (8 bytes) || ciphertext || tag.
+   */
+  std::vector<unsigned char>
+  AEADEncrypt(const std::string& plaintext);
+
+  /**
+   * @brief Igual, sobre un buffer que no es un string (p. ej. una proyeccion).
+   */
+  std::vector<unsigned char>
+  AEADEncrypt(const unsigned char* plaintext, size_t len);
+
+  /**
+   * @brief Aparta count secuencias de envio para cifrarlas con AEADEncryptAt.
+   * @return false si no quedan o si la sesion comprime (el compresor no se
+   * puede usar desde varios hilos a la vez).
+   */
+  bool
+  ReserveSequences(size_t count, uint64_t& outFirst);
+
+  /**
+   * @brief Cifra con una secuencia apartada por ReserveSequences. No toca el
+   * estado de la sesion: varios hilos pueden cifrar secuencias distintas a la
+   * vez mientras nadie mas use la sesion.
+   */
+  std::vector<unsigned char>
+  AEADEncryptAt(uint64_t sequence, const unsigned char* plaintext, size_t len) const;
+
+  /**
+   * @brief Activa la compresion previa al cifrado en AEADEncrypt/AEADDecrypt.
+   *
+   * Opt-in y negociado por sesion: ambos extremos deben activarla con el
+   * mismo diccionario. Ver MessageCompressor sobre la fuga de longitud.
+   */
+  void
+  SetCompressor(std::shared_ptr<MessageCompressor> messageCompressor);
+
+  /**
+   * @brief Descifra un mensaje producido por AEADEncrypt del peer.
+   *
+   * Las secuencias repetidas o fuera de la ventana anti-replay se rechazan
+   * antes de descifrar.
+   * @return false si la autenticacion falla o el mensaje es un replay.
+   */
+  bool
+  AEADDecrypt(const std::vector<unsigned char>& message, std::string& outPlaintext);
+
+  /**
+   * @brief Igual, sobre un mensaje que ya esta en un buffer de recepcion.
+   */
+  bool
+  AEADDecrypt(const unsigned char* message, size_t len, std::string& outPlaintext);
+
+  /**
+   * @brief Serializa la sesion AEAD (claves por direccion, contador de nonces
+   * y ventana anti-replay) para continuarla en otro proceso sin renegociar.
+   *
+   * out lleva claves en claro: el llamador lo borra con OPENSSL_cleanse.
+   * @return false si la sesion comprime (el diccionario no se exporta).
+   */
+  bool
+  ExportSession(std::string& out) const;
+
+  /**
+   * @brief Continua una sesion exportada con ExportSession.
+   */
+  bool
+  ImportSession(const unsigned char* data, size_t len);
+
+  // HPKE (RFC 9180): mensajes sellados para destinatarios sin conexion
+
+  /**
+   * @brief Genera nuestro par de claves HPKE (X25519) para publicarlo.
+   */
+  bool
+  GenerateHPKEKeys();
+
+  std::vector<unsigned char>
+  GetHPKEPublicKey() const;
+
+  /**
+   * @brief Sella un mensaje para la clave publica del destinatario en una
+   * sola pasada, sin handshake. Salida: enc (32 bytes) || ciphertext.
+   */
+  static std::vector<unsigned char>
+  HPKESeal(const std::vector<unsigned char>& recipientPublicKey,
+           const std::string& plaintext);
+
+  bool
+  HPKEOpen(const std::vector<unsigned char>& sealed, std::string& outPlaintext);
+
+  /**
+   * @brief Sella varios mensajes para el mismo destinatario con una unica
+   * encapsulacion; cada ciphertext usa el siguiente numero de secuencia.
+   */
+  static bool
+  HPKESealBatch(const std::vector<unsigned char>& recipientPublicKey,
+                const std::vector<std::string>& plaintexts,
+                std::vector<unsigned char>& outEnc,
+                std::vector<std::vector<unsigned char>>& outCiphertexts);
+
+  /**
+   * @brief Abre un lote sellado con HPKESealBatch (una sola decapsulacion).
+   * @return false si algun mensaje no se autentica.
+   */
+  bool
+  HPKEOpenBatch(const std::vector<unsigned char>& enc,
+                const std::vector<std::vector<unsigned char>>& ciphertexts,
+                std::vector<std::string>& outPlaintexts);
+
+  // Primitivas compartidas (sesiones de grupo, KDF, AEAD)
+
+  /**
+   * @brief Cifra con AES-256-GCM. La salida es ciphertext || tag (16 bytes).
+   */
+  static bool
+  AESGCMEncrypt(const unsigned char* key,
+                const unsigned char* iv, size_t ivLen,
+                const unsigned char* aad, size_t aadLen,
+                const unsigned char* plaintext, size_t len,
+                std::vector<unsigned char>& out);
+
+  /**
+   * @brief Descifra y autentica ciphertext || tag con AES-256-GCM.
+   * @return false si el tag no coincide.
+   */
+  static bool
+  AESGCMDecrypt(const unsigned char* key,
+                const unsigned char* iv, size_t ivLen,
+                const unsigned char* aad, size_t aadLen,
+                const unsigned char* input, size_t len,
+                std::vector<unsigned char>& out);
+
+  static void
+  HMACSHA256(const unsigned char* key, size_t keyLen,
+             const unsigned char* data, size_t len,
+             unsigned char out[32]);
+
+  static bool
+  HKDFSHA256(const unsigned char* ikm, size_t ikmLen,
+             const unsigned char* salt, size_t saltLen,
+             const std::string& info,
+             unsigned char* out, size_t outLen);
+
 private:
-  RSA* rsaKeyPair;        // Par de claves propia
-  RSA* peerPublicKey;     // Clave pblica del peer
-  unsigned char aesKey[32]; // Clave AES-256
+  EVP_PKEY* rsaKeyPair;     // Par de claves propia
+  EVP_PKEY* peerPublicKey;  // Clave pblica del peer
+  EVP_PKEY* hpkeKeyPair;    // Clave HPKE publicada para mensajes offline
+  std::vector<unsigned char> hpkePublicKey;
+  std::string publicKeyPEM;                 // Serializaciones de nuestra clave,
+  std::vector<unsigned char> publicKeyDER;  // calculadas una vez al generarla
+  // Las tres claves viven en un bloque de SecureArena (memoria bloqueada)
+  unsigned char* keyBlock;
+  unsigned char* aesKey;    // Clave AES-256
+
+  // Claves por direccion derivadas de aesKey para el modo AEAD
+  void
+  DeriveSessionKeys(bool initiator);
+
+  // Cifra con la clave de envio y un nonce ya decidido
+  std::vector<unsigned char>
+  Seal(const unsigned char* nonce, const unsigned char* plaintext, size_t len) const;
+
+  unsigned char* sendKey;
+  unsigned char* recvKey;
+  NonceSequence sendNonces;
+  ReplayWindow<1024> recvWindow;  // Secuencias ya aceptadas en recepcion
+  std::shared_ptr<MessageCompressor> compressor;
 };
\ No newline at end of file
@@ -0,0 +1,126 @@
+#pragma once
+#include "Prerequisites.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Cola de resultados que pertenece a un event loop.
+ *
+ * Los hilos de cripto publican aqui la continuacion de cada trabajo y el
+ * loop las ejecuta en su propio hilo con Drain(), asi que el estado de la
+ * conexion solo lo toca su loop.
+ */
+class
+CompletionQueue {
+public:
+  explicit
+  CompletionQueue(size_t capacity = 4096);
+
+  /**
+   * @brief Funcion que despierta al loop cuando llega un resultado
+   * (por ejemplo, escribir en su socket de aviso).
+   */
+  void
+  SetNotifier(std::function<void()> notifier);
+
+  /**
+   * @brief Publica una continuacion. Llamado desde los hilos de cripto.
+   */
+  void
+  Post(std::function<void()>&& completion);
+
+  /**
+   * @brief Ejecuta hasta max continuaciones pendientes en el hilo actual.
+   * @return Numero de continuaciones ejecutadas.
+   */
+  size_t
+  Drain(size_t max = SIZE_MAX);
+
+private:
+  MPSCQueue<std::function<void()>> m_queue;  // Consumidor: solo el loop
+  std::function<void()> m_notifier;
+  std::atomic<bool> m_notified;
+};
+
+enum class CryptoJobKind {
+  Handshake,  // Operaciones de clave privada: milisegundos
+  Bulk        // Cifrado/descifrado de mensajes: microsegundos
+};
+
+/**
+ * @brief Pool de hilos dedicado a cripto para no bloquear los loops de red.
+ *
+ * Los trabajos entran por colas sin locks acotadas (una por tipo, para que
+ * una rafaga de handshakes no ocupe la capacidad del trafico normal). Si la
+ * cola esta llena Submit() devuelve false y el llamador decide (rechazar o
+ * reintentar): la latencia de I/O no crece con la rafaga.
+ */
+class
+CryptoWorkerPool {
+public:
+  struct Stats {
+    uint64_t submitted = 0;
+    uint64_t rejected = 0;
+    uint64_t completed = 0;
+  };
+
+  /**
+   * @param threads Hilos de trabajo (0 = numero de nucleos).
+   * @param handshakeDepth Maximo de handshakes en cola.
+   * @param bulkDepth Maximo de trabajos de cifrado en cola.
+   */
+  CryptoWorkerPool(size_t threads = 0, size_t handshakeDepth = 256, size_t bulkDepth = 4096);
+  ~CryptoWorkerPool();
+
+  CryptoWorkerPool(const CryptoWorkerPool&) = delete;
+  CryptoWorkerPool& operator=(const CryptoWorkerPool&) = delete;
+
+  /**
+   * @brief Encola work para un hilo de cripto; al terminar, completion se
+   * publica en owner y la ejecuta el loop propietario.
+   *
+   * @return false si la cola de ese tipo esta llena.
+   */
+  bool
+  Submit(CryptoJobKind kind,
+         std::function<void()> work,
+         std::function<void()> completion,
+         CompletionQueue& owner);
+
+  Stats
+  GetStats() const;
+
+  size_t
+  Pending() const;
+
+private:
+  struct Job {
+    std::function<void()> work;
+    std::function<void()> completion;
+    CompletionQueue* owner = nullptr;
+  };
+
+  void
+  WorkerLoop();
+
+  bool
+  TakeJob(Job& job);
+
+  MPMCQueue<Job> m_handshakes;
+  MPMCQueue<Job> m_bulk;
+  std::vector<std::thread> m_workers;
+
+  // Solo para dormir cuando no hay trabajo; el camino de datos no lo usa
+  std::mutex m_sleepLock;
+  std::condition_variable m_wakeup;
+  std::atomic<int> m_sleeping;
+  std::atomic<bool> m_stop;
+
+  std::atomic<uint64_t> m_submitted;
+  std::atomic<uint64_t> m_rejected;
+  std::atomic<uint64_t> m_completed;
+};
@@ -0,0 +1,170 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief Tipos de trama del protocolo cliente <-> servidor.
+ *
+ *   ServerKey  S->C  [reto 32][clave publica DER del servidor], al conectar
+ *   Hello      C->S  [len id][id][clave de identidad Ed25519 32][n u8]
+ *                    [n modos (HandshakeMode)][len u16][clave envuelta con la
+ *                    clave del servidor][share de HybridKeyExchange, solo si
+ *                    ofrece HybridPQ][firma Ed25519 64 de reto + lo anterior]
+ *   Welcome    S->C  [modo elegido][respuesta de HybridKeyExchange, solo en
+ *                    HybridPQ]: sesion de transporte lista
+ *   Send       C->S  AEAD de transporte sobre [seq u64][len destino][destino][payload]
+ *   Deliver    S->C  AEAD de transporte sobre [seq u64][len origen][origen][payload]
+ *   Join       C->S  AEAD de transporte sobre [len sala][sala]
+ *   Leave      C->S  AEAD de transporte sobre [len sala][sala]
+ *   Publish    C->S  AEAD de transporte sobre [len sala][sala][payload]
+ *   RoomKey    S->C  AEAD de transporte sobre [len sala][sala][epoch u32][clave 32]
+ *   RoomDeliver S->C [len sala][sala][epoch u32][AEAD de sala sobre
+ *                    [len origen][origen][payload]], igual para todos
+ *   Stored     S->C  AEAD de transporte sobre [seq u64][len origen][origen][payload],
+ *                    guardado mientras el destinatario no tenia conexion
+ *   Ack        C<->S AEAD de transporte sobre [flujo u8][acumulado u64][n u8]
+ *                    [n x (first u64, last u64)]; flujo 0 = Stored (solo
+ *                    C->S), flujo 1 = Send (S->C) o Deliver (C->S)
+ *   Signal     C<->S AEAD de transporte sobre [len destino|origen][id][payload]:
+ *                    escribiendo, presencia; sin secuencia ni almacen, lo
+ *                    primero que se descarta con sobrecarga
+ *   Redirect   S->C  AEAD de transporte sobre ["host:puerto"]: el usuario es
+ *                    de otro nodo del cluster (tras Welcome, en lugar del
+ *                    primer Ack); el servidor cierra despues
+ *   BlobPut    C->S  AEAD de transporte sobre [blob]: sube un adjunto cifrado
+ *                    (AttachmentCipher); el id es el SHA-256 del blob
+ *   BlobRef    C->S  AEAD de transporte sobre [id 32]: suma una referencia a
+ *                    un blob que ya esta, sin subirlo
+ *   BlobRelease C->S AEAD de transporte sobre [id 32]: quita una referencia
+ *   BlobRead   C->S  AEAD de transporte sobre [id 32][offset u64][len u32]
+ *   BlobStatus S->C  AEAD de transporte sobre [id 32][estado u8 (BlobState)]:
+ *                    respuesta a BlobPut, BlobRef, BlobRelease y a un
+ *                    BlobRead de un blob que no existe
+ *   BlobData   S->C  AEAD de transporte sobre [id 32][tamano del blob u64]
+ *                    [offset u64][datos]
+ *
+ * Las secuencias de Send y Deliver empiezan en 1 y son del usuario, no de la
+ * conexion: justo despues de Welcome el servidor envia un Ack del flujo 1
+ * con lo que ya recibio, y el cliente reenvia los Send que no cubre. El
+ * primer Ack del flujo 1 del cliente hace que el servidor reenvie los
+ * Deliver que le faltan. Un Send repetido se descarta y solo se confirma.
+ *
+ * La firma del Hello prueba que el cliente tiene la clave de identidad del
+ * usuario: el servidor la fija la primera vez (IdentityRegistry) y cierra
+ * la conexion si llega otra.
+ *
+ * El servidor elige el modo con HybridKeyExchange::Negotiate. La clave
+ * envuelta con RSA va siempre (es lo que autentica al servidor); la de
+ * transporte sale de HybridKeyExchange::DeriveSessionKey con ella, el
+ * secreto hibrido si lo hay y la lista de modos ofrecidos.
+ *
+ * La clave de sala se usa como la de transporte (el cliente con el rol de
+ * iniciador). Cada RoomDeliver llega despues del RoomKey de su epoch.
+ *
+ * El payload es el ciphertext extremo a extremo: el servidor solo quita y
+ * pone la capa de transporte para enrutarlo.
+ *
+ * Los blobs se direccionan por contenido (BlobStore): con cifrado
+ * convergente el mismo adjunto da el mismo id, asi que el cliente manda
+ * primero BlobRef y solo sube con BlobPut si la respuesta es Missing. Las
+ * respuestas llevan el id y pueden llegar en otro orden que las peticiones.
+ */
+namespace FrameType {
+  const unsigned char ServerKey = 0;
+  const unsigned char Hello = 1;
+  const unsigned char Welcome = 2;
+  const unsigned char Send = 3;
+  const unsigned char Deliver = 4;
+  const unsigned char Join = 5;
+  const unsigned char Leave = 6;
+  const unsigned char Publish = 7;
+  const unsigned char RoomKey = 8;
+  const unsigned char RoomDeliver = 9;
+  const unsigned char Stored = 10;
+  const unsigned char Ack = 11;
+  const unsigned char Signal = 12;
+  const unsigned char Redirect = 13;
+  const unsigned char BlobPut = 14;
+  const unsigned char BlobRef = 15;
+  const unsigned char BlobRelease = 16;
+  const unsigned char BlobRead = 17;
+  const unsigned char BlobStatus = 18;
+  const unsigned char BlobData = 19;
+}
+
+namespace BlobState {
+  const unsigned char Missing = 0;       // No existe (BlobRef: hay que subirlo)
+  const unsigned char Stored = 1;        // Subido y escrito
+  const unsigned char Deduplicated = 2;  // Ya estaba: una referencia mas, nada escrito
+  const unsigned char Released = 3;
+  const unsigned char Failed = 4;        // Sin almacen, peticion invalida o error de disco
+}
+
+/**
+ * @brief Tramas con prefijo de longitud: [longitud u32][tipo][cuerpo].
+ * La longitud cuenta tipo + cuerpo.
+ */
+class
+FrameCodec {
+public:
+  static const size_t kHeaderSize = 5;
+  static const size_t kMaxFrameSize = 16 * 1024 * 1024;
+
+  enum class Result {
+    Frame,       // Hay una trama completa
+    Incomplete,  // Faltan bytes
+    Invalid      // Longitud imposible: hay que cerrar la conexion
+  };
+
+  static void
+  Append(unsigned char type, const unsigned char* body, size_t len,
+         std::vector<unsigned char>& out) {
+    uint32_t length = static_cast<uint32_t>(len + 1);
+    out.push_back(static_cast<unsigned char>(length >> 24));
+    out.push_back(static_cast<unsigned char>(length >> 16));
+    out.push_back(static_cast<unsigned char>(length >> 8));
+    out.push_back(static_cast<unsigned char>(length));
+    out.push_back(type);
+    out.insert(out.end(), body, body + len);
+  }
+
+  /**
+   * @brief Intenta extraer la siguiente trama de data sin copiarla.
+   * @param consumed Bytes que ocupa la trama (solo si devuelve Frame).
+   */
+  static Result
+  Next(const unsigned char* data, size_t len, unsigned char& type,
+       const unsigned char*& body, size_t& bodyLen, size_t& consumed) {
+    if (len < kHeaderSize) {
+      return Result::Incomplete;
+    }
+    uint32_t length = (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) |
+                      (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+    if (length == 0 || length > kMaxFrameSize) {
+      return Result::Invalid;
+    }
+    if (len < 4 + size_t(length)) {
+      return Result::Incomplete;
+    }
+    type = data[4];
+    body = data + kHeaderSize;
+    bodyLen = length - 1;
+    consumed = 4 + size_t(length);
+    return Result::Frame;
+  }
+
+  /**
+   * @brief [len u8][id][resto]: el formato de Hello, Send y Deliver.
+   */
+  static bool
+  SplitId(const unsigned char* data, size_t len, std::string& outId,
+          const unsigned char*& rest, size_t& restLen) {
+    if (len < 1 || len < 1 + size_t(data[0])) {
+      return false;
+    }
+    outId.assign(reinterpret_cast<const char*>(data + 1), data[0]);
+    rest = data + 1 + data[0];
+    restLen = len - 1 - data[0];
+    return true;
+  }
+};
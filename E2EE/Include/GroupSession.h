@@ -0,0 +1,112 @@
+#pragma once
+#include "Prerequisites.h"
+#include "CryptoHelper.h"
+#include <map>
+#include <array>
+#include <cstdint>
+
+/**
+ * @brief Sesion de grupo basada en sender keys.
+ *
+ * Cada miembro genera una cadena propia (chain key + clave de firma Ed25519)
+ * y la reparte una sola vez por los canales pareados, cifrada con la sesion
+ * AEAD del par (CryptoHelper::AEADEncrypt).
+ * A partir de ahi cada mensaje de grupo se cifra una unica vez y el mismo
+ * ciphertext se reenvia a todos los miembros, asi que el coste por mensaje
+ * no depende del tamano del grupo.
+ */
+class
+GroupSession {
+public:
+  GroupSession(const std::string& groupId, const std::string& selfId);
+  ~GroupSession();
+
+  GroupSession(const GroupSession&) = delete;
+  GroupSession& operator=(const GroupSession&) = delete;
+
+  /**
+   * @brief Genera (o rota) nuestra sender key. Tras rotar hay que volver
+   * a distribuirla a los miembros restantes.
+   */
+  void
+  CreateSenderKey();
+
+  /**
+   * @brief Serializa nuestra sender key para enviarla a un miembro.
+   *
+   * Contiene la chain key actual, asi que SOLO debe viajar cifrada por el
+   * canal pareado con ese miembro.
+   */
+  std::vector<unsigned char>
+  GetSenderKeyDistribution() const;
+
+  /**
+   * @brief Registra la sender key de otro miembro.
+   *
+   * @param senderId Identidad autenticada por el canal pareado del que llego.
+   * @return false si el mensaje esta mal formado.
+   */
+  bool
+  ProcessSenderKeyDistribution(const std::string& senderId,
+                               const std::vector<unsigned char>& distribution);
+
+  /**
+   * @brief Olvida el estado de un miembro que abandona el grupo.
+   * El llamador debe rotar su propia sender key con CreateSenderKey().
+   */
+  void
+  RemoveMember(const std::string& memberId);
+
+  /**
+   * @brief Cifra un mensaje de grupo una sola vez. El resultado se
+   * reenvia tal cual a todos los miembros.
+   */
+  std::vector<unsigned char>
+  Encrypt(const std::string& plaintext);
+
+  /**
+   * @brief Verifica la firma y descifra un mensaje de grupo.
+   *
+   * @param outSenderId Miembro que envio el mensaje.
+   * @return false si el emisor es desconocido, la firma no es valida o el
+   * mensaje ya se descifro antes.
+   */
+  bool
+  Decrypt(const std::vector<unsigned char>& message,
+          std::string& outSenderId,
+          std::string& outPlaintext);
+
+  const std::string&
+  GetGroupId() const { return m_groupId; }
+
+private:
+  using Key32 = std::array<unsigned char, 32>;
+
+  struct SenderState {
+    uint32_t iteration = 0;
+    unsigned char* chainKey = nullptr;  // Bloque de SecureArena (32 bytes)
+    EVP_PKEY* signingKey = nullptr;     // Privada para nosotros, publica para el resto
+    std::map<uint32_t, Key32> skippedKeys; // Claves de mensajes recibidos fuera de orden
+  };
+
+  static void
+  StepChain(SenderState& state, Key32& outMessageSeed);
+
+  static bool
+  InitState(SenderState& state);
+
+  static void
+  ClearState(SenderState& state);
+
+  std::vector<unsigned char>
+  BuildHeader(const std::string& senderId, uint32_t iteration) const;
+
+  // [len grupo u32][grupo]: prefijo de la AAD y de lo firmado
+  std::vector<unsigned char>
+  BuildGroupPrefix() const;
+
+  std::string m_groupId;
+  std::string m_selfId;
+  SenderState m_self;
+  std::map<std::string, SenderState> m_members;
+};
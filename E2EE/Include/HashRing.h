@@ -0,0 +1,58 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief Anillo de hash consistente con nodos virtuales: id de usuario ->
+ * nodo del cluster.
+ *
+ * Cada nodo aparece vnodes veces en el anillo (SipHash de "nodo#i") y un
+ * usuario es del primer punto en sentido horario desde el hash de su id.
+ * Con muchos puntos por nodo el reparto es uniforme, y al entrar o salir un
+ * nodo solo cambian de dueno los usuarios de los tramos que gana o pierde:
+ * alrededor de 1/n de ellos, no casi todos como con hash % n.
+ *
+ * La clave del hash es la misma en todos los nodos (sale del secreto del
+ * cluster): todos calculan el mismo dueno sin coordinarse. Inmutable una vez
+ * construido; para cambiar de miembros se construye otro.
+ */
+class
+HashRing {
+public:
+  static const uint32_t kDefaultVnodes = 160;
+
+  explicit
+  HashRing(const uint64_t key[2]);
+
+  void
+  Add(const std::string& node, uint32_t vnodes = kDefaultVnodes);
+
+  bool
+  Remove(const std::string& node);
+
+  /**
+   * @brief Nodo dueno de key; vacio si el anillo no tiene nodos.
+   */
+  const std::string&
+  Owner(const std::string& key) const;
+
+  const std::vector<std::string>&
+  Nodes() const { return m_nodes; }
+
+  bool
+  Empty() const { return m_points.empty(); }
+
+private:
+  struct Point {
+    uint64_t hash;
+    uint32_t node;   // Indice en m_nodes
+  };
+
+  uint64_t
+  Hash(const std::string& value) const;
+
+  uint64_t m_key[2];
+  std::vector<std::string> m_nodes;
+  std::vector<uint32_t> m_vnodes;
+  std::vector<Point> m_points;   // Ordenados por hash
+};
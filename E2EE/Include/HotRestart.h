@@ -0,0 +1,89 @@
+#pragma once
+#include "NetworkHelper.h"
+#include <cstdint>
+
+/**
+ * @brief Canal de control entre un servidor en marcha y el proceso que lo
+ * sustituye en un despliegue (reinicio en caliente).
+ *
+ * El proceso viejo escucha en un endpoint local (un socket Unix o, en
+ * Windows, un named pipe) y el nuevo se conecta. Por el canal viajan
+ * mensajes [bytes][sockets]: los sockets pasan de un proceso a otro sin
+ * cerrarse, con SCM_RIGHTS en POSIX o con WSADuplicateSocket y el
+ * WSAPROTOCOL_INFO de cada uno en Windows. Para eso el nuevo proceso se
+ * presenta primero con su pid.
+ *
+ * Solo transporta; que se envia y en que orden lo decide Server.
+ */
+class
+HotRestart {
+public:
+  static const size_t kMaxSockets = 64;   // Por mensaje
+
+  HotRestart() = default;
+  ~HotRestart();
+
+  HotRestart(const HotRestart&) = delete;
+  HotRestart& operator=(const HotRestart&) = delete;
+
+  /**
+   * @brief Lado viejo: crea el endpoint (una ruta de fichero en POSIX, un
+   * nombre de pipe en Windows).
+   */
+  bool
+  Listen(const std::string& endpoint);
+
+  /**
+   * @brief Lado viejo: espera a un sucesor hasta timeoutMs y lee su saludo.
+   * @return false si no llego ninguno a tiempo o el saludo no es valido.
+   */
+  bool
+  Accept(int timeoutMs);
+
+  /**
+   * @brief Lado nuevo: se conecta al proceso viejo y se presenta.
+   */
+  bool
+  Connect(const std::string& endpoint);
+
+  /**
+   * @brief Plazo de cada Send y Receive (y del saludo de Accept y Connect);
+   * vencido, devuelven false. 0 o negativo = sin plazo.
+   */
+  void
+  SetTimeout(int timeoutMs);
+
+  /**
+   * @brief Envia payload y hasta kMaxSockets sockets. Los sockets siguen
+   * abiertos en este proceso: quien los envia los cierra despues.
+   */
+  bool
+  Send(const std::string& payload, const std::vector<SOCKET>& sockets);
+
+  /**
+   * @brief Recibe un mensaje de Send; los sockets ya son de este proceso.
+   */
+  bool
+  Receive(std::string& payload, std::vector<SOCKET>& sockets);
+
+  void
+  Close();
+
+private:
+  bool
+  WriteAll(const void* data, size_t len);
+
+  bool
+  ReadAll(void* data, size_t len);
+
+  std::string m_endpoint;
+  uint32_t m_peerProcess = 0;   // Pid del sucesor (WSADuplicateSocket)
+  int m_timeoutMs = -1;
+#ifdef _WIN32
+  void* m_pipe = nullptr;
+  bool m_server = false;
+#else
+  int m_listen = -1;
+  int m_peer = -1;
+#endif
+};
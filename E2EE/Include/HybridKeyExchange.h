@@ -0,0 +1,112 @@
+#pragma once
+#include "Prerequisites.h"
+#include "openssl/evp.h"
+
+/**
+ * @brief Modos de handshake que se anuncian al conectar.
+ * El valor numerico es el que viaja en el mensaje de negociacion.
+ */
+enum class HandshakeMode : unsigned char {
+  RSA = 1,        // CryptoHelper: clave AES cifrada con RSA-OAEP
+  HybridPQ = 2    // ML-KEM-768 + X25519
+};
+
+/**
+ * @brief Acuerdo de clave hibrido post-cuantico ML-KEM-768 + X25519.
+ *
+ * El iniciador publica ambas claves publicas; el respondedor encapsula
+ * contra ML-KEM, hace ECDH con X25519 y devuelve ciphertext + su clave
+ * X25519. El secreto de sesion es HKDF(ss_mlkem || ss_x25519) ligado a
+ * ambos mensajes, asi que sigue siendo seguro mientras uno de los dos
+ * algoritmos lo sea.
+ */
+class
+HybridKeyExchange {
+public:
+  static const size_t kX25519Size = 32;
+  static const size_t kMLKEMPublicSize = 1184;
+  static const size_t kMLKEMCiphertextSize = 1088;
+  static const size_t kShareSize = kX25519Size + kMLKEMPublicSize;          // Iniciador -> respondedor
+  static const size_t kResponseSize = kX25519Size + kMLKEMCiphertextSize;   // Respondedor -> iniciador
+
+  HybridKeyExchange();
+  ~HybridKeyExchange();
+
+  HybridKeyExchange(const HybridKeyExchange&) = delete;
+  HybridKeyExchange& operator=(const HybridKeyExchange&) = delete;
+
+  /**
+   * @brief Indica si el proveedor de OpenSSL cargado soporta ML-KEM-768.
+   */
+  static bool
+  IsAvailable();
+
+  /**
+   * @brief Modos que soportamos, de mas a menos preferido.
+   */
+  static std::vector<unsigned char>
+  SupportedModes();
+
+  /**
+   * @brief Elige el modo preferido comun con la lista del peer.
+   * Si no hay ninguno en comun se vuelve a RSA.
+   */
+  static HandshakeMode
+  Negotiate(const std::vector<unsigned char>& peerModes);
+
+  /**
+   * @brief Clave de sesion cliente-servidor del modo negociado.
+   *
+   * transportKey es la clave que el cliente envuelve con RSA y autentica al
+   * servidor; en HybridPQ se combina con hybridSecret (nullptr en RSA).
+   * offeredModes va como sal: si alguien quita modos de la lista del Hello,
+   * cada lado deriva una clave distinta y la sesion no abre nada.
+   */
+  static bool
+  DeriveSessionKey(HandshakeMode mode, const unsigned char transportKey[32],
+                   const unsigned char* hybridSecret,
+                   const std::vector<unsigned char>& offeredModes,
+                   unsigned char outKey[32]);
+
+  // Iniciador
+
+  bool
+  GenerateKeyPair();
+
+  /**
+   * @brief X25519 publica (32) || clave de encapsulado ML-KEM (1184).
+   */
+  std::vector<unsigned char>
+  GetPublicShare() const;
+
+  /**
+   * @brief Completa el acuerdo con la respuesta del peer.
+   */
+  bool
+  Decapsulate(const std::vector<unsigned char>& response, unsigned char outSecret[32]);
+
+  // Respondedor
+
+  /**
+   * @brief Responde al share del iniciador.
+   * @param outResponse X25519 publica (32) || ciphertext ML-KEM (1088).
+   */
+  bool
+  Encapsulate(const std::vector<unsigned char>& peerShare,
+              std::vector<unsigned char>& outResponse,
+              unsigned char outSecret[32]);
+
+private:
+  static bool
+  Combine(const unsigned char mlkemSecret[32], const unsigned char x25519Secret[32],
+          const std::vector<unsigned char>& share,
+          const std::vector<unsigned char>& response,
+          unsigned char outSecret[32]);
+
+  static bool
+  X25519Derive(EVP_PKEY* self, const unsigned char* peerPublic, unsigned char out[32]);
+
+  EVP_PKEY* m_x25519;
+  EVP_PKEY* m_mlkem;
+  std::vector<unsigned char> m_share;
+};
@@ -0,0 +1,91 @@
+#pragma once
+#include "Prerequisites.h"
+#include <array>
+#include <cstdio>
+#include <shared_mutex>
+#include <unordered_map>
+
+/**
+ * @brief Clave de identidad Ed25519 de cada usuario, fijada la primera vez
+ * que se presenta (o registrada de antemano en el fichero).
+ *
+ * El Hello del cliente va firmado con esa clave sobre el reto de su
+ * ServerKey: solo quien tiene la privada puede ocupar la ruta, la sesion
+ * fiable y el backlog offline del usuario. Con fichero, cada usuario nuevo
+ * se anade y se vuelca a disco antes de aceptarlo, asi que un reinicio no
+ * deja reclamar de nuevo un usuario ya fijado.
+ */
+class
+IdentityRegistry {
+public:
+  using Key = std::array<unsigned char, 32>;
+  static const size_t kSignatureSize = 64;
+
+  IdentityRegistry() = default;
+  ~IdentityRegistry();
+
+  IdentityRegistry(const IdentityRegistry&) = delete;
+  IdentityRegistry& operator=(const IdentityRegistry&) = delete;
+
+  /**
+   * @brief Carga las claves de path (si existe) y anade ahi las nuevas.
+   * Un registro cortado al final (caida a mitad de escritura) se descarta.
+   */
+  bool
+  Open(const std::string& path);
+
+  /**
+   * @brief Fija key para user si aun no tiene clave.
+   * @return true si user queda con esta clave; false si ya tenia otra o no
+   * se pudo guardar.
+   */
+  bool
+  Bind(const std::string& user, const Key& key);
+
+  bool
+  Find(const std::string& user, Key& out) const;
+
+  size_t
+  Size() const;
+
+  void
+  Users(std::vector<std::string>& out) const;
+
+  /**
+   * @brief Todas las claves, para el reinicio en caliente.
+   */
+  void
+  Export(std::string& out) const;
+
+  /**
+   * @brief Las claves de users (las que haya), en el formato de Export.
+   */
+  void
+  Export(const std::vector<std::string>& users, std::string& out) const;
+
+  /**
+   * @brief Claves de Export; solo en memoria (el fichero ya las tiene).
+   */
+  bool
+  Import(const std::string& state);
+
+  /**
+   * @brief Claves de Export de otro nodo: fija las de usuarios que aun no
+   * tienen, con un solo volcado a disco. Las que ya tienen otra se ignoran.
+   * @return false si state no es valido o no se pudo guardar.
+   */
+  bool
+  Merge(const std::string& state);
+
+  /**
+   * @brief Comprueba una firma Ed25519 de data con key.
+   */
+  static bool
+  Verify(const Key& key, const unsigned char* data, size_t len,
+         const unsigned char signature[kSignatureSize]);
+
+private:
+  mutable std::shared_mutex m_lock;
+  std::unordered_map<std::string, Key> m_keys;
+  std::FILE* m_file = nullptr;   // Registros [len usuario u8][usuario][clave 32]
+};
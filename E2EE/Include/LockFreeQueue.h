@@ -0,0 +1,385 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+// Tamano de linea de cache para separar indices escritos por hilos distintos
+#define E2EE_CACHE_LINE 64
+
+/**
+ * @brief Cola acotada sin locks multi-productor / multi-consumidor.
+ *
+ * Anillo de celdas con numero de secuencia (esquema de D. Vyukov): cada
+ * push/pop es un CAS sobre su indice y nunca bloquea. La capacidad se
+ * redondea a potencia de dos.
+ */
+template<typename T>
+class
+MPMCQueue {
+public:
+  explicit
+  MPMCQueue(size_t capacity)
+    : m_mask(RoundUp(capacity) - 1),
+      m_cells(new Cell[m_mask + 1]) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPMCQueue(const MPMCQueue&) = delete;
+  MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+  /**
+   * @return false si la cola esta llena.
+   */
+  bool
+  TryPush(T&& value) {
+    Cell* cell;
+    size_t pos = m_enqueue.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = m_enqueue.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(value);
+    cell->sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @return false si la cola esta vacia.
+   */
+  bool
+  TryPop(T& out) {
+    Cell* cell;
+    size_t pos = m_dequeue.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &m_cells[pos & m_mask];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if (diff < 0) {
+        return false;
+      }
+      else {
+        pos = m_dequeue.load(std::memory_order_relaxed);
+      }
+    }
+    out = std::move(cell->value);
+    cell->value = T();
+    cell->sequence.store(pos + m_mask + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * @brief Numero aproximado de elementos (solo para metricas).
+   */
+  size_t
+  SizeApprox() const {
+    size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+    size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+  }
+
+  size_t
+  Capacity() const { return m_mask + 1; }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  static size_t
+  RoundUp(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  alignas(E2EE_CACHE_LINE) std::atomic<size_t> m_enqueue{ 0 };
+  alignas(E2EE_CACHE_LINE) std::atomic<size_t> m_dequeue{ 0 };
+};
+
+/**
+ * @brief Cola acotada sin locks de un productor y un consumidor.
+ *
+ * Anillo de Lamport: cada lado escribe solo su indice y guarda una copia
+ * del indice del otro, que solo relee cuando la copia dice lleno/vacio. En
+ * el caso normal push y pop no tocan la linea de cache del otro hilo.
+ */
+template<typename T>
+class
+SPSCQueue {
+public:
+  explicit
+  SPSCQueue(size_t capacity)
+    : m_mask(RoundUp(capacity) - 1),
+      m_slots(new T[m_mask + 1]) {
+  }
+
+  SPSCQueue(const SPSCQueue&) = delete;
+  SPSCQueue& operator=(const SPSCQueue&) = delete;
+
+  /**
+   * @brief Solo el productor.
+   * @return false si la cola esta llena.
+   */
+  bool
+  TryPush(T&& value) {
+    return PushBatch(&value, 1) == 1;
+  }
+
+  /**
+   * @brief Solo el productor. Mueve los primeros elementos que quepan y los
+   * publica con una sola escritura del indice.
+   * @return Numero de elementos encolados.
+   */
+  size_t
+  PushBatch(T* values, size_t count) {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail - m_headCache + count > m_mask + 1) {
+      m_headCache = m_head.load(std::memory_order_acquire);
+    }
+    size_t room = m_mask + 1 - (tail - m_headCache);
+    size_t pushed = count < room ? count : room;
+    for (size_t i = 0; i < pushed; ++i) {
+      m_slots[(tail + i) & m_mask] = std::move(values[i]);
+    }
+    if (pushed > 0) {
+      m_tail.store(tail + pushed, std::memory_order_release);
+    }
+    return pushed;
+  }
+
+  /**
+   * @brief Solo el consumidor.
+   * @return false si la cola esta vacia.
+   */
+  bool
+  TryPop(T& out) {
+    return PopBatch(&out, 1) == 1;
+  }
+
+  /**
+   * @brief Solo el consumidor. Saca hasta max elementos y libera sus huecos
+   * con una sola escritura del indice.
+   * @return Numero de elementos sacados.
+   */
+  size_t
+  PopBatch(T* out, size_t max) {
+    size_t head = m_head.load(std::memory_order_relaxed);
+    if (m_tailCache - head < max) {
+      m_tailCache = m_tail.load(std::memory_order_acquire);
+    }
+    size_t available = m_tailCache - head;
+    size_t popped = max < available ? max : available;
+    for (size_t i = 0; i < popped; ++i) {
+      T& slot = m_slots[(head + i) & m_mask];
+      out[i] = std::move(slot);
+      slot = T();
+    }
+    if (popped > 0) {
+      m_head.store(head + popped, std::memory_order_release);
+    }
+    return popped;
+  }
+
+  /**
+   * @brief true si no hay nada publicado (valido en cualquier hilo).
+   */
+  bool
+  Empty() const {
+    return m_tail.load(std::memory_order_acquire) == m_head.load(std::memory_order_acquire);
+  }
+
+  size_t
+  SizeApprox() const {
+    size_t tail = m_tail.load(std::memory_order_relaxed);
+    size_t head = m_head.load(std::memory_order_relaxed);
+    return tail > head ? tail - head : 0;
+  }
+
+  size_t
+  Capacity() const { return m_mask + 1; }
+
+private:
+  static size_t
+  RoundUp(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const size_t m_mask;
+  std::unique_ptr<T[]> m_slots;
+  // Linea del productor: su indice y su copia del indice del consumidor
+  alignas(E2EE_CACHE_LINE) std::atomic<size_t> m_tail{ 0 };
+  size_t m_headCache = 0;
+  // Linea del consumidor
+  alignas(E2EE_CACHE_LINE) std::atomic<size_t> m_head{ 0 };
+  size_t m_tailCache = 0;
+};
+
+/**
+ * @brief Cola acotada sin locks de varios productores y un consumidor.
+ *
+ * Mismas celdas con secuencia que MPMCQueue, pero el consumidor es unico:
+ * saca sin CAS y puede vaciar un lote de una vez. Un productor puede
+ * reservar varias celdas seguidas con un solo CAS (PushBatch).
+ */
+template<typename T>
+class
+MPSCQueue {
+public:
+  explicit
+  MPSCQueue(size_t capacity)
+    : m_mask(RoundUp(capacity) - 1),
+      m_cells(new Cell[m_mask + 1]) {
+    for (size_t i = 0; i <= m_mask; ++i) {
+      m_cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  MPSCQueue(const MPSCQueue&) = delete;
+  MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+  /**
+   * @return false si la cola esta llena.
+   */
+  bool
+  TryPush(T&& value) {
+    return PushBatch(&value, 1) == 1;
+  }
+
+  /**
+   * @brief Reserva count celdas consecutivas con un CAS y las publica.
+   * Todo o nada: si no caben, no encola ninguno.
+   * @return count, o 0 si la cola no tiene sitio para todos.
+   */
+  size_t
+  PushBatch(T* values, size_t count) {
+    if (count == 0 || count > m_mask + 1) {
+      return 0;
+    }
+    size_t pos = m_enqueue.load(std::memory_order_relaxed);
+    for (;;) {
+      // El consumidor libera en orden: si la ultima celda esta libre, todas lo estan
+      Cell& last = m_cells[(pos + count - 1) & m_mask];
+      size_t sequence = last.sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + count - 1);
+      if (diff == 0) {
+        if (m_enqueue.compare_exchange_weak(pos, pos + count, std::memory_order_relaxed)) {
+          break;
+        }
+      }
+      else if (diff < 0) {
+        return 0;
+      }
+      else {
+        pos = m_enqueue.load(std::memory_order_relaxed);
+      }
+    }
+    for (size_t i = 0; i < count; ++i) {
+      Cell& cell = m_cells[(pos + i) & m_mask];
+      cell.value = std::move(values[i]);
+      cell.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return count;
+  }
+
+  /**
+   * @brief Solo el consumidor.
+   * @return false si la cola esta vacia.
+   */
+  bool
+  TryPop(T& out) {
+    return PopBatch(&out, 1) == 1;
+  }
+
+  /**
+   * @brief Solo el consumidor. Saca hasta max elementos ya publicados; para
+   * en la primera celda reservada que su productor aun no ha escrito.
+   */
+  size_t
+  PopBatch(T* out, size_t max) {
+    size_t pos = m_dequeue.load(std::memory_order_relaxed);
+    size_t popped = 0;
+    while (popped < max) {
+      Cell& cell = m_cells[(pos + popped) & m_mask];
+      if (cell.sequence.load(std::memory_order_acquire) != pos + popped + 1) {
+        break;
+      }
+      out[popped] = std::move(cell.value);
+      cell.value = T();
+      cell.sequence.store(pos + popped + m_mask + 1, std::memory_order_release);
+      ++popped;
+    }
+    if (popped > 0) {
+      m_dequeue.store(pos + popped, std::memory_order_relaxed);
+    }
+    return popped;
+  }
+
+  /**
+   * @brief Solo el consumidor: true si su siguiente celda no esta publicada.
+   */
+  bool
+  Empty() const {
+    size_t pos = m_dequeue.load(std::memory_order_relaxed);
+    return m_cells[pos & m_mask].sequence.load(std::memory_order_acquire) != pos + 1;
+  }
+
+  size_t
+  SizeApprox() const {
+    size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+    size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+    return enqueue > dequeue ? enqueue - dequeue : 0;
+  }
+
+  size_t
+  Capacity() const { return m_mask + 1; }
+
+private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  static size_t
+  RoundUp(size_t value) {
+    size_t result = 2;
+    while (result < value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  const size_t m_mask;
+  std::unique_ptr<Cell[]> m_cells;
+  alignas(E2EE_CACHE_LINE) std::atomic<size_t> m_enqueue{ 0 };
+  alignas(E2EE_CACHE_LINE) std::atomic<size_t> m_dequeue{ 0 };
+};
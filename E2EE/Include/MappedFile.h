@@ -0,0 +1,77 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief Fichero proyectado en memoria (CreateFileMapping/MapViewOfFile en
+ * Windows, mmap en el resto).
+ *
+ * Lo usan los adjuntos, el almacen de blobs y los segmentos de OfflineStore
+ * para leer rangos sin copiar el fichero entero: el sistema solo trae las
+ * paginas que se tocan.
+ */
+class
+MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  /**
+   * @brief Proyecta un fichero existente en solo lectura.
+   */
+  bool
+  Open(const std::string& path);
+
+  /**
+   * @brief Crea (o trunca) un fichero del tamano dado y lo proyecta en
+   * lectura/escritura.
+   */
+  bool
+  Create(const std::string& path, uint64_t size);
+
+  /**
+   * @brief Vuelca a disco las paginas modificadas (solo con Create).
+   */
+  bool
+  Flush();
+
+  /**
+   * @brief Vuelca solo [offset, offset + len) y los metadatos del fichero:
+   * el commit de un log que crece dentro de una proyeccion grande.
+   */
+  bool
+  Flush(uint64_t offset, uint64_t len);
+
+  void
+  Close();
+
+  const unsigned char*
+  Data() const { return m_data; }
+
+  unsigned char*
+  MutableData() { return m_writable ? m_data : nullptr; }
+
+  uint64_t
+  Size() const { return m_size; }
+
+  bool
+  IsOpen() const { return m_open; }
+
+private:
+  bool
+  Map(const std::string& path, uint64_t size, bool writable);
+
+  unsigned char* m_data = nullptr;
+  uint64_t m_size = 0;
+  bool m_open = false;
+  bool m_writable = false;
+#ifdef _WIN32
+  void* m_file = nullptr;
+  void* m_mapping = nullptr;
+#else
+  int m_fd = -1;
+#endif
+};
@@ -0,0 +1,94 @@
+#pragma once
+#include "Prerequisites.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+/**
+ * @brief Diccionario de compresion entrenado para un tipo de conversacion
+ * (por ejemplo "json" o "text").
+ *
+ * Ambos extremos deben tener el mismo contenido bajo el mismo id; el id
+ * es lo que se negocia al abrir la sesion.
+ */
+struct CompressionDictionary {
+  static constexpr size_t kMaxSize = 32 * 1024;
+
+  uint32_t id = 0;
+  std::string type;
+  std::vector<unsigned char> content;
+  std::vector<uint32_t> hashTable;  // Precalculado: posiciones del diccionario
+
+  /**
+   * @brief Entrena un diccionario con mensajes de ejemplo: elige los
+   * fragmentos que mas se repiten entre muestras (estilo COVER).
+   */
+  static std::shared_ptr<CompressionDictionary>
+  Train(uint32_t id, const std::string& type,
+        const std::vector<std::string>& samples,
+        size_t maxSize = 16 * 1024);
+
+  /**
+   * @brief Crea un diccionario a partir de un contenido ya entrenado.
+   */
+  static std::shared_ptr<CompressionDictionary>
+  Load(uint32_t id, const std::string& type, const std::vector<unsigned char>& content);
+};
+
+/**
+ * @brief Compresion opcional antes de cifrar (formato de bloque LZ4).
+ *
+ * Los mensajes por debajo del umbral, o los que no se reducen, viajan sin
+ * comprimir con un byte de cabecera.
+ *
+ * AVISO: comprimir antes de cifrar hace que la longitud del ciphertext
+ * dependa del contenido. Si un atacante puede inyectar texto en el mismo
+ * mensaje que un secreto y observar tamanos (CRIME/BREACH), puede deducir
+ * el secreto. Solo debe activarse en conversaciones donde no se mezcle
+ * contenido controlado por terceros con secretos, y por eso es opt-in.
+ */
+class
+MessageCompressor {
+public:
+  static constexpr size_t kDefaultThreshold = 128;
+  static constexpr size_t kMaxMessageSize = 16 * 1024 * 1024;
+
+  explicit
+  MessageCompressor(size_t threshold = kDefaultThreshold);
+
+  /**
+   * @brief Fija el diccionario negociado para esta sesion (nullptr = sin diccionario).
+   */
+  void
+  SetDictionary(std::shared_ptr<const CompressionDictionary> dictionary);
+
+  /**
+   * @brief Elige el primer diccionario ofrecido por el peer que tengamos.
+   * @return Id elegido o 0 si no hay ninguno en comun.
+   */
+  static uint32_t
+  Negotiate(const std::vector<uint32_t>& offered, const std::vector<uint32_t>& supported);
+
+  std::vector<unsigned char>
+  Compress(const unsigned char* data, size_t len);
+
+  /**
+   * @return false si el formato no es valido, el diccionario no coincide o
+   * el resultado supera kMaxMessageSize.
+   */
+  bool
+  Decompress(const unsigned char* data, size_t len, std::vector<unsigned char>& out) const;
+
+  // Bytes antes y despues de Compress(), para medir el ahorro
+  uint64_t
+  RawBytes() const { return m_rawBytes.load(std::memory_order_relaxed); }
+
+  uint64_t
+  CompressedBytes() const { return m_compressedBytes.load(std::memory_order_relaxed); }
+
+private:
+  size_t m_threshold;
+  std::shared_ptr<const CompressionDictionary> m_dictionary;
+  std::atomic<uint64_t> m_rawBytes;
+  std::atomic<uint64_t> m_compressedBytes;
+};
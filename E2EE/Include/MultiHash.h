@@ -0,0 +1,57 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief SHA-256 y HMAC-SHA256 multi-buffer para lotes de mensajes cortos.
+ *
+ * Calcula varios hashes independientes a la vez, uno por carril SIMD:
+ * 16 con AVX-512, 8 con AVX2 y 4 con el camino portable. El backend se
+ * elige una vez segun la CPU. Solo compensa con lotes grandes de entradas
+ * cortas e independientes; con dos o tres, EVP uno a uno es mas rapido.
+ *
+ * Solo biblioteca: ningun camino del cliente ni del servidor lo usa, porque
+ * ninguno tiene esos lotes (las cadenas de GroupSession son secuenciales,
+ * las claves de sala salen de SecureRandom y el resto hashea entradas
+ * grandes o una sola vez por conexion).
+ *
+ * Las entradas se agrupan por numero de bloques antes de repartirlas en
+ * carriles, asi que mezclar longitudes apenas desperdicia carriles.
+ */
+class
+MultiHash {
+public:
+  struct Input {
+    const unsigned char* data;
+    size_t len;
+  };
+
+  /**
+   * @brief out[i] = SHA-256(inputs[i]).
+   */
+  static void
+  SHA256(const Input* inputs, size_t count, unsigned char (*out)[32]);
+
+  /**
+   * @brief out[i] = HMAC-SHA256(key, inputs[i]) con la misma clave para todo el lote.
+   */
+  static void
+  HMACSHA256(const unsigned char* key, size_t keyLen,
+             const Input* inputs, size_t count, unsigned char (*out)[32]);
+
+  /**
+   * @brief out[i] = HMAC-SHA256(keys[i], inputs[i]).
+   */
+  static void
+  HMACSHA256(const Input* keys, const Input* inputs, size_t count,
+             unsigned char (*out)[32]);
+
+  /**
+   * @brief Carriles del backend activo (4, 8 o 16).
+   */
+  static size_t
+  Lanes();
+
+  static const char*
+  Backend();
+};
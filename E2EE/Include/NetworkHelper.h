@@ -1,5 +1,8 @@
 #pragma once
 #include "Prerequisites.h"
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <winsock2.h>
 #include <ws2tcpip.h>
 #pragma comment(lib, "Ws2_32.lib")
@@ -28,6 +31,40 @@ public:
 	SOCKET
 	AcceptClient();
 
+	/**
+	 * @brief Cierra el socket de escucha; un AcceptClient() bloqueado retorna.
+	 */
+	void
+	StopServer();
+
+	/**
+	 * @brief Espera hasta timeoutMs a que haya un cliente que aceptar.
+	 *
+	 * Permite parar un bucle de accept sin cerrar el socket de escucha (que
+	 * en un reinicio en caliente pasa a otro proceso).
+	 */
+	bool
+	WaitForClient(int timeoutMs);
+
+	/**
+	 * @brief Socket de escucha, para pasarlo a otro proceso.
+	 */
+	SOCKET
+	ListenSocket() const { return m_serverSocket; }
+
+	/**
+	 * @brief Usa un socket de escucha recibido de otro proceso en lugar de StartServer.
+	 */
+	void
+	AdoptServer(SOCKET socket);
+
+	/**
+	 * @brief Cierra el socket de escucha sin shutdown: otra copia en otro
+	 * proceso sigue aceptando.
+	 */
+	void
+	ReleaseServer();
+
 	// Modo cliente
 	/**
 	 * @brief Conecta al servidor especificado por IP y puerto.
@@ -0,0 +1,84 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief Nonces de 96 bits deterministas para AEAD (prefijo fijo || contador).
+ *
+ * Cada sesion y direccion tiene su propia clave, asi que basta con un
+ * contador que nunca se repite: no hace falta pedir aleatoriedad por mensaje.
+ * El contador viaja en claro y sirve tambien como numero de secuencia.
+ */
+class
+NonceSequence {
+public:
+  static const size_t kNonceSize = 12;
+
+  NonceSequence() = default;
+
+  explicit
+  NonceSequence(uint32_t prefix) : m_prefix(prefix) {}
+
+  void
+  Reset(uint32_t prefix = 0) {
+    m_prefix = prefix;
+    m_counter = 0;
+  }
+
+  /**
+   * @brief Escribe el siguiente nonce y devuelve su numero de secuencia.
+   * @return false si el contador se agoto (hay que renegociar la clave).
+   */
+  bool
+  Next(unsigned char out[kNonceSize], uint64_t& outSequence) {
+    if (m_counter == UINT64_MAX) {
+      return false;
+    }
+    outSequence = m_counter++;
+    Build(m_prefix, outSequence, out);
+    return true;
+  }
+
+  /**
+   * @brief Aparta count secuencias seguidas, [outFirst, outFirst + count).
+   * @return false si no quedan tantas; el contador no se mueve.
+   */
+  bool
+  Reserve(uint64_t count, uint64_t& outFirst) {
+    if (count == 0 || UINT64_MAX - m_counter < count) {
+      return false;
+    }
+    outFirst = m_counter;
+    m_counter += count;
+    return true;
+  }
+
+  static void
+  Build(uint32_t prefix, uint64_t sequence, unsigned char out[kNonceSize]) {
+    for (int i = 0; i < 4; ++i) {
+      out[i] = static_cast<unsigned char>(prefix >> (24 - 8 * i));
+    }
+    for (int i = 0; i < 8; ++i) {
+      out[4 + i] = static_cast<unsigned char>(sequence >> (56 - 8 * i));
+    }
+  }
+
+  uint64_t
+  Sent() const { return m_counter; }
+
+  uint32_t
+  Prefix() const { return m_prefix; }
+
+  /**
+   * @brief Continua una secuencia exportada: el siguiente nonce es counter.
+   */
+  void
+  Restore(uint32_t prefix, uint64_t counter) {
+    m_prefix = prefix;
+    m_counter = counter;
+  }
+
+private:
+  uint32_t m_prefix = 0;
+  uint64_t m_counter = 0;
+};
@@ -0,0 +1,200 @@
+#pragma once
+#include "Prerequisites.h"
+#include "MappedFile.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+/**
+ * @brief Cola persistente de mensajes para destinatarios sin conexion.
+ *
+ * Todos los destinatarios comparten un log de solo escritura al final,
+ * dividido en segmentos de tamano fijo que se reservan y se proyectan en
+ * memoria al crearlos. Cada registro lleva [seq][len origen][origen][payload]
+ * tal cual lo cifra la trama Stored, asi que al reconectar el backlog se
+ * cifra directamente desde la proyeccion: lectura secuencial y ninguna copia
+ * intermedia.
+ *
+ * Durabilidad por group commit: Append copia el registro al segmento y
+ * vuelve; un hilo de commit vuelca de una vez todo lo escrito desde el
+ * anterior (FlushFileBuffers / msync) y avisa a quien lo pidio. Con muchos
+ * escritores a la vez una sola escritura a disco cubre a todos.
+ *
+ * El indice en memoria es, por destinatario, una lista de entradas
+ * {segmento, offset, longitud, seq}. Los acks son acumulativos y tambien van
+ * al log; un segmento se borra cuando ya no le queda ningun registro sin
+ * confirmar. Al abrir cada segmento nuevo se escribe el ultimo ack de cada
+ * destinatario, asi que borrar un segmento viejo nunca pierde acks que otro
+ * segmento todavia necesite al recuperar. De los que ya no tienen nada en
+ * disco solo se guarda ese seq, para que la numeracion siga donde iba y un
+ * seq ya confirmado nunca se reutilice.
+ */
+class
+OfflineStore {
+public:
+  using Durable = std::function<void(bool ok)>;
+
+  /**
+   * @brief Un mensaje pendiente, leido sin copiar de su segmento.
+   */
+  struct Record {
+    uint64_t seq = 0;
+    const unsigned char* data = nullptr;    // [seq u64][len origen][origen][payload]
+    size_t len = 0;
+    std::shared_ptr<const MappedFile> segment;  // Mantiene la proyeccion viva
+  };
+
+  struct Stats {
+    uint64_t users = 0;          // Destinatarios con estado en memoria
+    uint64_t idle = 0;           // De ellos, sin nada en disco: solo su ultimo seq
+    uint64_t pending = 0;        // Mensajes sin confirmar
+    uint64_t segments = 0;
+    uint64_t diskBytes = 0;      // Tamano reservado de los segmentos vivos
+    uint64_t appended = 0;
+    uint64_t acked = 0;
+    uint64_t commits = 0;        // Volcados a disco
+    uint64_t committed = 0;      // Registros cubiertos por esos volcados
+    uint64_t deletedSegments = 0;
+  };
+
+  /**
+   * @param directory Directorio de los segmentos; se crea si no existe y se
+   * recupera lo que haya.
+   * @param segmentSize Tamano reservado de cada segmento.
+   * @param maxBytes Tope de disco: Append falla por encima.
+   */
+  explicit
+  OfflineStore(const std::string& directory, uint64_t segmentSize = 64ull * 1024 * 1024,
+               uint64_t maxBytes = 4ull * 1024 * 1024 * 1024);
+  ~OfflineStore();
+
+  OfflineStore(const OfflineStore&) = delete;
+  OfflineStore& operator=(const OfflineStore&) = delete;
+
+  bool
+  IsOpen() const { return m_open; }
+
+  /**
+   * @brief Guarda un mensaje para user.
+   * @param done Se llama desde el hilo de commit cuando el registro esta en
+   * disco (o no se pudo volcar). Opcional.
+   * @return false si no cabe (tope de disco o de mensajes por usuario).
+   */
+  bool
+  Append(const std::string& user, const std::string& source, const unsigned char* payload,
+         size_t len, Durable done = nullptr);
+
+  /**
+   * @brief Bloquea hasta que todo lo anadido hasta ahora este en disco.
+   */
+  bool
+  Flush();
+
+  /**
+   * @brief Mensajes de user con seq > after, en orden.
+   * @return Numero de registros anadidos a out.
+   */
+  size_t
+  Read(const std::string& user, uint64_t after, size_t maxRecords, size_t maxBytes,
+       std::vector<Record>& out);
+
+  /**
+   * @brief Confirma todos los mensajes de user con seq <= seq.
+   * @return Mensajes que deja de guardar.
+   */
+  size_t
+  Ack(const std::string& user, uint64_t seq);
+
+  size_t
+  Pending(const std::string& user) const;
+
+  /**
+   * @brief Destinatarios con algun mensaje sin confirmar.
+   */
+  void
+  Users(std::vector<std::string>& out) const;
+
+  Stats
+  GetStats() const;
+
+private:
+  // 24 bytes por mensaje pendiente
+  struct Entry {
+    uint32_t segment;
+    uint32_t offset;   // Del cuerpo (desde seq) dentro del segmento
+    uint32_t length;
+    uint64_t seq;
+  };
+
+  struct Queue {
+    std::deque<Entry> entries;
+    uint64_t nextSeq = 1;
+    uint64_t acked = 0;
+    uint32_t lastSegment = 0;   // Ultimo segmento con un registro suyo
+  };
+
+  struct Segment {
+    std::shared_ptr<MappedFile> file;
+    uint64_t used = 0;       // Bytes escritos
+    uint64_t flushed = 0;    // Bytes ya en disco
+    uint64_t live = 0;       // Mensajes sin confirmar
+  };
+
+  struct Waiter {
+    uint64_t ticket;
+    Durable done;
+  };
+
+  std::string
+  PathFor(uint32_t id) const;
+
+  void
+  Recover();
+
+  // Con m_lock
+  bool
+  Roll();
+
+  bool
+  WriteCheckpoint(const std::string& user, uint64_t acked);
+
+  bool
+  WriteRecord(unsigned char kind, const std::string& user, const unsigned char* head,
+              size_t headLen, const unsigned char* body, size_t bodyLen, Entry* outEntry);
+
+  void
+  Release(const Entry& entry);
+
+  void
+  DropSegments();
+
+  void
+  CommitLoop();
+
+  std::string m_directory;
+  const uint64_t m_segmentSize;
+  const uint64_t m_maxBytes;
+  bool m_open = false;
+
+  mutable std::mutex m_lock;
+  std::map<uint32_t, Segment> m_segments;   // Ordenados: el ultimo es el activo
+  uint32_t m_active = 0;
+  std::unordered_map<std::string, Queue> m_queues;
+  std::unordered_map<std::string, uint64_t> m_idle;   // Ultimo seq de colas ya vacias
+  std::vector<std::string> m_undeleted;     // Aun proyectados (Windows): se reintenta
+  Stats m_stats;
+
+  // Group commit: cada escritura recibe un ticket creciente
+  uint64_t m_written = 0;
+  uint64_t m_durable = 0;
+  std::deque<Waiter> m_waiters;
+  std::condition_variable m_commitWake;
+  std::condition_variable m_durableWake;
+  bool m_running = false;
+  std::thread m_committer;
+};
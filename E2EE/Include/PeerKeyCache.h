@@ -0,0 +1,93 @@
+#pragma once
+#include "Prerequisites.h"
+#include "openssl/evp.h"
+#include <array>
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * @brief Cache concurrente de claves publicas ya parseadas.
+ *
+ * La clave del cache es el SHA-256 del DER (SubjectPublicKeyInfo), asi que
+ * un contacto repetido no vuelve a pasar por el parser ASN.1. Esta
+ * particionado en shards con su propio mutex y LRU para que los hilos
+ * casi nunca compitan por el mismo lock.
+ */
+class
+PeerKeyCache {
+public:
+  using Fingerprint = std::array<unsigned char, 32>;
+
+  explicit
+  PeerKeyCache(size_t capacity = 65536);
+  ~PeerKeyCache();
+
+  PeerKeyCache(const PeerKeyCache&) = delete;
+  PeerKeyCache& operator=(const PeerKeyCache&) = delete;
+
+  /**
+   * @brief Cache compartido por todas las sesiones del proceso.
+   */
+  static PeerKeyCache&
+  Global();
+
+  static Fingerprint
+  ComputeFingerprint(const unsigned char* der, size_t len);
+
+  /**
+   * @brief Devuelve la clave para este DER, parseandola solo si no esta.
+   *
+   * @return Referencia propia (liberar con EVP_PKEY_free) o nullptr si el
+   * DER no es una clave valida.
+   */
+  EVP_PKEY*
+  Acquire(const unsigned char* der, size_t len);
+
+  /**
+   * @brief Busca por huella sin parsear nada.
+   * @return Referencia propia o nullptr si no esta en cache.
+   */
+  EVP_PKEY*
+  Find(const Fingerprint& fingerprint);
+
+  void
+  Clear();
+
+  uint64_t
+  Hits() const { return m_hits.load(std::memory_order_relaxed); }
+
+  uint64_t
+  Misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+private:
+  static const size_t kShards = 16;
+
+  struct FingerprintHash {
+    size_t
+    operator()(const Fingerprint& fp) const {
+      size_t hash;
+      std::memcpy(&hash, fp.data(), sizeof(hash));
+      return hash;
+    }
+  };
+
+  struct Shard {
+    std::mutex lock;
+    std::list<std::pair<Fingerprint, EVP_PKEY*>> lru;  // Mas reciente al principio
+    std::unordered_map<Fingerprint,
+                       std::list<std::pair<Fingerprint, EVP_PKEY*>>::iterator,
+                       FingerprintHash> index;
+  };
+
+  Shard&
+  ShardFor(const Fingerprint& fingerprint) {
+    return m_shards[fingerprint[31] % kShards];
+  }
+
+  size_t m_capacityPerShard;
+  Shard m_shards[kShards];
+  std::atomic<uint64_t> m_hits;
+  std::atomic<uint64_t> m_misses;
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include "Prerequisites.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+/**
+ * @brief Como espera el consumidor de una cola sin locks cuando esta vacia.
+ */
+enum class WaitStrategy {
+  Spin,   // Bucle con pausa de CPU: minima latencia, un nucleo al 100%
+  Yield,  // Cede el nucleo en cada vuelta: barato si hay otros hilos listos
+  Futex   // Unas vueltas y luego duerme en el kernel (WaitOnAddress / futex)
+};
+
+/**
+ * @brief Contador de eventos para dormir al consumidor de una cola sin locks.
+ *
+ * El productor llama a Notify() despues de publicar; con Spin/Yield no hace
+ * nada y con Futex solo entra en el kernel si hay alguien durmiendo. El
+ * consumidor llama a Wait() con una condicion (normalmente "la cola no esta
+ * vacia o hay que parar"). La cola sigue sin locks: el waiter solo decide
+ * que hacer cuando no hay nada que sacar. Pensado para un solo consumidor,
+ * como SPSCQueue y MPSCQueue.
+ */
+class
+QueueWaiter {
+public:
+  explicit
+  QueueWaiter(WaitStrategy strategy = WaitStrategy::Futex)
+    : m_strategy(strategy), m_epoch(0), m_waiters(0), m_signaled(false) {}
+
+  QueueWaiter(const QueueWaiter&) = delete;
+  QueueWaiter& operator=(const QueueWaiter&) = delete;
+
+  WaitStrategy
+  Strategy() const { return m_strategy; }
+
+  /**
+   * @brief Bloquea hasta que ready() devuelva true.
+   */
+  template<typename Ready>
+  void
+  Wait(Ready ready) {
+    const int kSpins = 128;
+    for (int spin = 0; !ready(); ++spin) {
+      if (m_strategy == WaitStrategy::Spin ||
+          (m_strategy == WaitStrategy::Futex && spin < kSpins)) {
+        CpuRelax();
+        continue;
+      }
+      if (m_strategy == WaitStrategy::Yield) {
+        std::this_thread::yield();
+        continue;
+      }
+
+      // Se anuncia el durmiente antes de comprobar por ultima vez: o el
+      // productor ve m_waiters > 0, o esta comprobacion ve su elemento
+      uint32_t epoch = m_epoch.load(std::memory_order_acquire);
+      m_waiters.fetch_add(1, std::memory_order_seq_cst);
+      m_signaled.store(false, std::memory_order_seq_cst);
+      if (!ready()) {
+        WaitOnEpoch(epoch);
+      }
+      m_waiters.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+
+  /**
+   * @brief Despierta al consumidor si esta dormido. Llamar despues de publicar.
+   */
+  void
+  Notify() {
+    if (m_strategy != WaitStrategy::Futex) {
+      return;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    // Solo el primer productor que lo ve dormido entra en el kernel
+    if (m_waiters.load(std::memory_order_seq_cst) > 0 &&
+        !m_signaled.exchange(true, std::memory_order_seq_cst)) {
+      m_epoch.fetch_add(1, std::memory_order_release);
+      WakeEpoch();
+    }
+  }
+
+  /**
+   * @brief Pausa de espera activa (PAUSE en x86): no satura el pipeline ni
+   * roba ciclos al otro hilo del nucleo.
+   */
+  static void
+  CpuRelax();
+
+private:
+  // Duerme mientras m_epoch siga valiendo expected (puede volver antes)
+  void
+  WaitOnEpoch(uint32_t expected);
+
+  void
+  WakeEpoch();
+
+  const WaitStrategy m_strategy;
+  alignas(E2EE_CACHE_LINE) std::atomic<uint32_t> m_epoch;
+  std::atomic<int> m_waiters;
+  std::atomic<bool> m_signaled;
+};
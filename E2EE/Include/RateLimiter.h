@@ -0,0 +1,158 @@
+#pragma once
+#include "Prerequisites.h"
+#include "LockFreeQueue.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+/**
+ * @brief Limite de un token bucket: rate tokens por segundo con rafagas de
+ * hasta burst. rate = 0 desactiva el limite.
+ */
+struct RateLimit {
+  double rate = 0;
+  double burst = 0;
+};
+
+/**
+ * @brief Token bucket sin locks (GCRA).
+ *
+ * En lugar de {tokens, ultima recarga} guarda un solo instante: cuando el
+ * bucket volveria a estar lleno (TAT). Tomar tokens es adelantar ese
+ * instante con un CAS, y la recarga es implicita al compararlo con el reloj:
+ * no hay hilo de recarga ni estado que actualizar cuando no llega trafico.
+ * Sin contencion cuesta una carga, una comparacion y un CAS.
+ *
+ * El reloj lo pasa el llamador: el servidor lo lee una vez por lectura del
+ * socket y lo usa para todas las tramas de esa lectura.
+ */
+class
+TokenBucket {
+public:
+  using Tick = int64_t;   // Nanosegundos de steady_clock
+
+  static Tick
+  Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  /**
+   * @brief Fija el limite; solo antes de compartir el bucket.
+   */
+  void
+  Configure(const RateLimit& limit);
+
+  /**
+   * @return false si no quedan cost tokens: la trama se descarta. Una trama
+   * que cuesta mas que la rafaga entera pasa si el bucket esta lleno.
+   */
+  bool
+  TryTake(Tick now, uint32_t cost = 1) {
+    if (m_interval == 0) {
+      return true;
+    }
+    Tick charge = std::min(m_interval * static_cast<Tick>(cost), m_tolerance);
+    Tick tat = m_tat.load(std::memory_order_relaxed);
+    for (;;) {
+      Tick next = std::max(tat, now) + charge;
+      if (next - now > m_tolerance) {
+        return false;
+      }
+      if (m_tat.compare_exchange_weak(tat, next, std::memory_order_relaxed)) {
+        return true;
+      }
+    }
+  }
+
+  /**
+   * @brief TryTake para un bucket con un solo hilo que lo usa (el de una
+   * conexion, en su nucleo): carga y almacenamiento sin CAS, como Bump.
+   */
+  bool
+  TryTakeOwned(Tick now, uint32_t cost = 1) {
+    if (m_interval == 0) {
+      return true;
+    }
+    Tick charge = std::min(m_interval * static_cast<Tick>(cost), m_tolerance);
+    Tick next = std::max(m_tat.load(std::memory_order_relaxed), now) + charge;
+    if (next - now > m_tolerance) {
+      return false;
+    }
+    m_tat.store(next, std::memory_order_relaxed);
+    return true;
+  }
+
+  /**
+   * @brief Sin deuda: olvidarlo no regala tokens a nadie.
+   */
+  bool
+  Full(Tick now) const { return m_tat.load(std::memory_order_relaxed) <= now; }
+
+private:
+  // Una linea de cache por bucket: el de una IP lo comparten varios nucleos
+  alignas(E2EE_CACHE_LINE) std::atomic<Tick> m_tat{ 0 };
+  Tick m_interval = 0;    // Nanosegundos por token; 0 = sin limite
+  Tick m_tolerance = 0;   // burst * m_interval
+};
+
+/**
+ * @brief Limites de entrada del servidor: un bucket por conexion y uno
+ * compartido por todas las conexiones de la misma IP.
+ *
+ * La tabla de IPs solo se toca al aceptar (Address) y en Sweep; cada
+ * conexion guarda su puntero al bucket de su IP, asi que comprobar una
+ * trama no toma ningun lock. Un bucket de IP se guarda mientras tenga
+ * conexiones o deuda: cerrar y reconectar no lo vacia.
+ */
+class
+RateLimiter {
+public:
+  /**
+   * @brief Coste en tokens de una trama: 1 + bytes / kCostBytes, para que una
+   * trama grande (mas descifrado) pese mas que una pequena.
+   */
+  static const size_t kCostBytes = 16 * 1024;
+
+  struct Limits {
+    RateLimit connection{ 2000, 4000 };   // Tramas/s por conexion
+    RateLimit address{ 20000, 40000 };    // Tramas/s por IP
+  };
+
+  RateLimiter();
+
+  explicit
+  RateLimiter(const Limits& limits);
+
+  RateLimiter(const RateLimiter&) = delete;
+  RateLimiter& operator=(const RateLimiter&) = delete;
+
+  const Limits&
+  GetLimits() const { return m_limits; }
+
+  static uint32_t
+  Cost(size_t bytes) { return 1 + static_cast<uint32_t>(bytes / kCostBytes); }
+
+  /**
+   * @brief Bucket de la IP (bytes crudos de la direccion); nulo si el limite
+   * por IP esta desactivado.
+   */
+  std::shared_ptr<TokenBucket>
+  Address(const std::string& address);
+
+  /**
+   * @brief Olvida las IPs sin conexiones y sin deuda.
+   * @return IPs que quedan.
+   */
+  size_t
+  Sweep();
+
+private:
+  const Limits m_limits;
+  std::mutex m_lock;
+  std::unordered_map<std::string, std::shared_ptr<TokenBucket>> m_addresses;
+};
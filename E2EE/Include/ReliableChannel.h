@@ -0,0 +1,174 @@
+#pragma once
+#include "Prerequisites.h"
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+
+/**
+ * @brief Rango [first, last] recibido por encima del ack acumulado (SACK).
+ */
+struct AckBlock {
+  uint64_t first;
+  uint64_t last;
+};
+
+/**
+ * @brief Lado receptor de un flujo con secuencias: detecta duplicados y
+ * decide cuando enviar un ack.
+ *
+ * Un ack es [acumulado u64][n u8][n x (first u64, last u64)]: todo hasta el
+ * acumulado esta recibido, y ademas los n rangos. Sobre TCP solo aparecen
+ * huecos al reconectar (reenvios mezclados con mensajes nuevos), asi que
+ * casi siempre n = 0.
+ *
+ * Los acks se agrupan: uno cada kAckEvery mensajes o, si el trafico es
+ * escaso, kAckDelay despues del primer mensaje sin confirmar.
+ */
+class
+AckTracker {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  static constexpr size_t kMaxBlocks = 8;    // Rangos que caben en un ack
+  static constexpr size_t kMaxRanges = 64;   // Rangos que se recuerdan
+  static constexpr uint32_t kAckEvery = 32;
+  static constexpr std::chrono::milliseconds kAckDelay{ 20 };
+
+  /**
+   * @return false si seq ya se habia recibido (duplicado).
+   */
+  bool
+  Receive(uint64_t seq, Clock::time_point now = Clock::now());
+
+  /**
+   * @brief Receive(seq) lo aceptaria como nuevo. No cambia nada.
+   */
+  bool
+  Accepts(uint64_t seq) const;
+
+  uint64_t
+  Cumulative() const { return m_cumulative; }
+
+  /**
+   * @brief Anade el ack actual a out y reinicia la cuenta de pendientes.
+   */
+  void
+  Encode(std::string& out);
+
+  static bool
+  Decode(const unsigned char* data, size_t len, uint64_t& cumulative,
+         std::vector<AckBlock>& blocks);
+
+  bool
+  AckPending() const { return m_unacked > 0; }
+
+  /**
+   * @brief Hay que enviar el ack ya (por numero de mensajes o por tiempo).
+   */
+  bool
+  AckDue(Clock::time_point now) const {
+    return m_unacked >= kAckEvery || (m_unacked > 0 && now >= Deadline());
+  }
+
+  Clock::time_point
+  Deadline() const { return m_firstUnacked + kAckDelay; }
+
+  /**
+   * @brief Anade el estado (acumulado y rangos) a out, para continuar el
+   * flujo en otro proceso. Los acks pendientes no viajan: se envian antes.
+   */
+  void
+  Save(std::string& out) const;
+
+  /**
+   * @brief Lee lo escrito por Save y avanza data.
+   */
+  bool
+  Load(const unsigned char*& data, const unsigned char* end);
+
+private:
+  uint64_t m_cumulative = 0;
+  std::vector<AckBlock> m_ranges;   // Ordenados, disjuntos, por encima de m_cumulative + 1
+  uint32_t m_unacked = 0;
+  Clock::time_point m_firstUnacked;
+};
+
+/**
+ * @brief Lado emisor: asigna secuencias y guarda cada mensaje hasta que el
+ * otro extremo lo confirma, para reenviar solo lo que falta al reconectar.
+ */
+class
+RetransmitBuffer {
+public:
+  using Payload = std::shared_ptr<const std::vector<unsigned char>>;
+
+  struct Pending {
+    uint64_t seq;
+    Payload payload;
+  };
+
+  /**
+   * @brief Secuencia del siguiente mensaje (empiezan en 1).
+   */
+  uint64_t
+  Next() const { return m_base + m_entries.size(); }
+
+  /**
+   * @brief Guarda el mensaje con secuencia Next().
+   */
+  void
+  Push(Payload payload);
+
+  /**
+   * @brief Aplica un ack acumulado + SACK.
+   * @return Mensajes que se liberan.
+   */
+  size_t
+  OnAck(uint64_t cumulative, const std::vector<AckBlock>& blocks);
+
+  /**
+   * @brief seq ya se envio y el otro extremo lo confirmo.
+   */
+  bool
+  Acked(uint64_t seq) const {
+    return seq < m_base || (seq < Next() && !m_entries[static_cast<size_t>(seq - m_base)].payload);
+  }
+
+  /**
+   * @brief Mensajes sin confirmar, en orden: lo que hay que reenviar.
+   */
+  void
+  Unacked(std::vector<Pending>& out) const;
+
+  size_t
+  Count() const { return m_count; }
+
+  size_t
+  Bytes() const { return m_bytes; }
+
+  /**
+   * @brief Anade la secuencia base y los mensajes sin confirmar a out.
+   */
+  void
+  Save(std::string& out) const;
+
+  /**
+   * @brief Lee lo escrito por Save y avanza data; solo sobre un buffer vacio.
+   */
+  bool
+  Load(const unsigned char*& data, const unsigned char* end);
+
+private:
+  struct Entry {
+    Payload payload;   // Nulo una vez confirmado por SACK
+  };
+
+  void
+  Release(Entry& entry);
+
+  uint64_t m_base = 1;              // Secuencia de m_entries.front()
+  std::deque<Entry> m_entries;
+  size_t m_count = 0;
+  size_t m_bytes = 0;
+};
@@ -0,0 +1,146 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief Ventana deslizante anti-replay (estilo IPsec/RFC 6479) sobre
+ * numeros de secuencia de 64 bits.
+ *
+ * El bitmap es un anillo de palabras de 64 bits: avanzar la ventana solo
+ * limpia las palabras que quedan atras, nunca desplaza el bitmap entero.
+ * Check() y Update() no reservan memoria y su coste esta acotado por el
+ * tamano fijo de la ventana.
+ *
+ * Uso: Check() antes de descifrar (rechaza sin gastar AES) y Update()
+ * solo cuando la autenticacion ha tenido exito.
+ */
+template <size_t kBits = 1024>
+class
+ReplayWindow {
+  static_assert(kBits >= 64 && kBits <= 1024 && kBits % 64 == 0,
+                "La ventana debe ser de 64 a 1024 bits, multiplo de 64");
+
+public:
+  static const size_t kWindowSize = kBits;
+
+  void
+  Reset() {
+    for (size_t i = 0; i < kWords; ++i) {
+      m_bitmap[i] = 0;
+    }
+    m_top = 0;
+  }
+
+  /**
+   * @brief Indica si la secuencia es nueva y esta dentro de la ventana.
+   * No modifica el estado.
+   */
+  bool
+  Check(uint64_t sequence) const {
+    if (sequence > m_top) {
+      return true;
+    }
+    if (m_top - sequence >= kBits) {
+      return false;  // Demasiado antigua
+    }
+    return (m_bitmap[WordIndex(sequence)] & BitMask(sequence)) == 0;
+  }
+
+  /**
+   * @brief Marca la secuencia como recibida, avanzando la ventana si hace falta.
+   * @return false si ya estaba marcada o quedo fuera de la ventana.
+   */
+  bool
+  Update(uint64_t sequence) {
+    if (sequence > m_top) {
+      uint64_t current = m_top >> 6;
+      uint64_t target = sequence >> 6;
+      uint64_t advance = target - current;
+      if (advance > kWords) {
+        advance = kWords;
+      }
+      for (uint64_t i = 1; i <= advance; ++i) {
+        m_bitmap[(current + i) & (kWords - 1)] = 0;
+      }
+      m_top = sequence;
+    }
+    else if (m_top - sequence >= kBits) {
+      return false;
+    }
+
+    uint64_t& word = m_bitmap[WordIndex(sequence)];
+    uint64_t mask = BitMask(sequence);
+    if (word & mask) {
+      return false;
+    }
+    word |= mask;
+    return true;
+  }
+
+  uint64_t
+  Highest() const { return m_top; }
+
+  /**
+   * @brief Bytes de Save(): la secuencia mas alta y el bitmap.
+   */
+  static size_t
+  StateSize() { return 8 * (kWords + 1); }
+
+  /**
+   * @brief Anade el estado a out, para continuar la ventana en otro proceso.
+   */
+  void
+  Save(std::string& out) const {
+    AppendU64(out, m_top);
+    for (size_t i = 0; i < kWords; ++i) {
+      AppendU64(out, m_bitmap[i]);
+    }
+  }
+
+  /**
+   * @param data StateSize() bytes escritos por Save().
+   */
+  void
+  Load(const unsigned char* data) {
+    m_top = ReadU64(data);
+    for (size_t i = 0; i < kWords; ++i) {
+      m_bitmap[i] = ReadU64(data + 8 * (i + 1));
+    }
+  }
+
+private:
+  // Una palabra extra para que la ventana completa quepa al avanzar;
+  // redondeado a potencia de dos para indexar con mascara
+  static const size_t kWords =
+    kBits / 64 + 1 <= 2 ? 2 : kBits / 64 + 1 <= 4 ? 4 : kBits / 64 + 1 <= 8 ? 8 :
+    kBits / 64 + 1 <= 16 ? 16 : 32;
+
+  static size_t
+  WordIndex(uint64_t sequence) {
+    return static_cast<size_t>((sequence >> 6) & (kWords - 1));
+  }
+
+  static uint64_t
+  BitMask(uint64_t sequence) {
+    return uint64_t(1) << (sequence & 63);
+  }
+
+  static void
+  AppendU64(std::string& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  static uint64_t
+  ReadU64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | in[i];
+    }
+    return value;
+  }
+
+  uint64_t m_bitmap[kWords] = {};
+  uint64_t m_top = 0;
+};
@@ -0,0 +1,121 @@
+#pragma once
+#include "Prerequisites.h"
+#include "CryptoHelper.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+/**
+ * @brief Salas de difusion (pub/sub) del servidor.
+ *
+ * Cada sala tiene una clave de transporte propia que sus miembros reciben
+ * por su sesion al unirse (trama RoomKey). Una publicacion se cifra una sola
+ * vez con esa clave y el resultado (una trama RoomDeliver completa) es un
+ * buffer inmutable compartido: cada suscriptor lo encola por referencia, sin
+ * copiar ni volver a cifrar.
+ *
+ * La clave se rota en la primera publicacion despues de que alguien salga.
+ * Cada publicacion lleva la clave de su epoch y el nucleo de cada miembro se
+ * la envia antes de la trama si aun no la tenia: publicaciones de nucleos
+ * distintos pueden llegar en cualquier orden sin que falte la clave. El
+ * contenido ya va cifrado extremo a extremo (GroupSession); la clave de sala
+ * protege el origen y el resto de metadatos en el cable.
+ *
+ * Los miembros son una lista ordenada de ids de conexion con copia en
+ * escritura: la publicacion toma una instantanea sin copiar y, como el id
+ * lleva el nucleo dueno en los bits altos, queda agrupada por nucleo.
+ */
+class
+RoomRegistry {
+public:
+  using Members = std::vector<uint64_t>;
+  using Frame = std::shared_ptr<const std::vector<unsigned char>>;
+
+  static const size_t kMaxRoomName = 255;
+  static const uint64_t kRemotePublisher = 0;   // Publish de otro nodo: sin comprobar miembro
+
+  struct RoomKey {
+    uint32_t epoch = 0;
+    unsigned char key[32];
+
+    ~RoomKey() {
+      OPENSSL_cleanse(key, sizeof(key));
+    }
+  };
+
+  /**
+   * @brief Resultado de Publish: lo que hay que encolar a cada miembro.
+   */
+  struct Broadcast {
+    Frame frame;                              // Trama RoomDeliver completa
+    std::shared_ptr<const Members> members;
+    RoomKey key;                              // Con la que se cifro frame
+  };
+
+  struct Stats {
+    uint64_t rooms = 0;
+    uint64_t memberships = 0;
+    uint64_t broadcasts = 0;
+    uint64_t fanout = 0;       // Suma de miembros de todas las publicaciones
+    uint64_t rekeys = 0;
+  };
+
+  RoomRegistry();
+
+  RoomRegistry(const RoomRegistry&) = delete;
+  RoomRegistry& operator=(const RoomRegistry&) = delete;
+
+  /**
+   * @brief Anade connection a room (la crea si no existe).
+   * @param outKey Clave actual de la sala para enviarla al nuevo miembro.
+   */
+  bool
+  Join(const std::string& room, uint64_t connection, RoomKey& outKey);
+
+  /**
+   * @brief Quita connection de room; la sala se borra al quedarse vacia.
+   */
+  bool
+  Leave(const std::string& room, uint64_t connection);
+
+  /**
+   * @brief Cifra una vez [len origen][origen][payload] para toda la sala.
+   * Solo puede publicar un miembro, salvo kRemotePublisher (la publicacion
+   * llega de otro nodo del cluster, que ya lo comprobo).
+   */
+  bool
+  Publish(const std::string& room, uint64_t publisher, const std::string& source,
+          const unsigned char* payload, size_t len, Broadcast& out);
+
+  Stats
+  GetStats() const;
+
+private:
+  struct Room {
+    std::mutex lock;
+    std::shared_ptr<const Members> members;
+    RoomKey key;
+    std::unique_ptr<CryptoHelper> sealer;   // Nonces de la sala: bajo lock
+    bool rotate = false;
+    bool closed = false;                    // Vacia y fuera del mapa
+  };
+
+  std::shared_ptr<Room>
+  Find(const std::string& room) const;
+
+  std::shared_ptr<Room>
+  FindOrCreate(const std::string& room);
+
+  static bool
+  Rekey(Room& room);
+
+  mutable std::shared_mutex m_lock;  // Solo el mapa; cada sala tiene el suyo
+  std::unordered_map<std::string, std::shared_ptr<Room>> m_rooms;
+
+  std::atomic<uint64_t> m_memberships;
+  std::atomic<uint64_t> m_broadcasts;
+  std::atomic<uint64_t> m_fanout;
+  std::atomic<uint64_t> m_rekeys;
+};
@@ -0,0 +1,141 @@
+#pragma once
+#include "Prerequisites.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+/**
+ * @brief Tabla de rutas concurrente: id de usuario -> conexion viva.
+ *
+ * Dividida en shards por los bits altos de una huella de 64 bits del id
+ * (SipHash con clave aleatoria del proceso). Cada shard es un array de
+ * direccionamiento abierto de huecos {huella, conexion} de 16 bytes:
+ *
+ *   - Lookup no toma locks ni escribe memoria compartida: calcula la huella
+ *     y en el caso normal lee un solo hueco (un fallo de cache).
+ *   - Insert/Remove toman el mutex de su shard, que solo excluye a otros
+ *     escritores del mismo shard; los lectores nunca esperan.
+ *   - Al crecer, el array viejo se retira y se libera cuando todos los
+ *     lectores registrados han pasado por Quiescent() (QSBR): los lectores
+ *     son los loops del servidor, que lo llaman en cada vuelta.
+ *
+ * La tabla guarda huellas, no ids: quien usa la conexion debe comprobar que
+ * pertenece al usuario esperado (una colision solo puede descartar un
+ * mensaje, nunca entregarlo a otro).
+ */
+class
+RoutingTable {
+public:
+  struct ShardLoad {
+    size_t live = 0;
+    size_t tombstones = 0;
+    size_t capacity = 0;
+    uint64_t inserts = 0;
+    uint64_t removes = 0;
+    uint64_t resizes = 0;
+  };
+
+  /**
+   * @param readers Hilos lectores, cada uno con su indice para Quiescent().
+   * @param shards Numero de shards (se redondea a potencia de dos).
+   */
+  explicit
+  RoutingTable(size_t readers, size_t shards = 64);
+  ~RoutingTable();
+
+  RoutingTable(const RoutingTable&) = delete;
+  RoutingTable& operator=(const RoutingTable&) = delete;
+
+  /**
+   * @brief Sin locks. Solo desde un hilo lector registrado.
+   * @return false si el usuario no tiene conexion.
+   */
+  bool
+  Lookup(const std::string& user, uint64_t& connection) const;
+
+  /**
+   * @brief Asocia user a connection, sustituyendo la anterior si la habia.
+   */
+  void
+  Insert(const std::string& user, uint64_t connection);
+
+  /**
+   * @brief Quita user solo si sigue apuntando a connection (una sesion nueva
+   * del mismo usuario no se borra al cerrar la vieja).
+   */
+  bool
+  Remove(const std::string& user, uint64_t connection);
+
+  /**
+   * @brief El lector reader no tiene ningun puntero de la tabla en uso.
+   * Una escritura en su propia linea de cache.
+   */
+  void
+  Quiescent(size_t reader) {
+    m_readers[reader].seen.store(m_epoch.load(std::memory_order_acquire),
+                                 std::memory_order_release);
+  }
+
+  size_t
+  Size() const;
+
+  std::vector<ShardLoad>
+  GetLoad() const;
+
+private:
+  struct Slot {
+    std::atomic<uint64_t> key;    // Huella; 0 = libre, 1 = borrado
+    std::atomic<uint64_t> value;
+  };
+
+  struct Array {
+    explicit
+    Array(size_t size);
+
+    const size_t mask;
+    std::unique_ptr<Slot[]> slots;
+  };
+
+  struct Shard {
+    // Linea de los lectores: solo cambia al redimensionar
+    alignas(E2EE_CACHE_LINE) std::atomic<Array*> array{ nullptr };
+    // Linea de los escritores
+    alignas(E2EE_CACHE_LINE) mutable std::mutex lock;
+    ShardLoad load;
+  };
+
+  struct Reader {
+    alignas(E2EE_CACHE_LINE) std::atomic<uint64_t> seen{ 0 };
+  };
+
+  struct Retired {
+    Array* array;
+    uint64_t epoch;
+  };
+
+  uint64_t
+  Fingerprint(const std::string& user) const;
+
+  Shard&
+  ShardFor(uint64_t key) const;
+
+  // Con el lock del shard: reconstruye con el tamano indicado, sin borrados
+  void
+  Rebuild(Shard& shard, size_t size);
+
+  void
+  Retire(Array* array);
+
+  uint64_t m_sipKey[2];
+  size_t m_shardMask;
+  int m_shardShift;
+  std::unique_ptr<Shard[]> m_shards;
+  std::unique_ptr<Reader[]> m_readers;
+  size_t m_readerCount;
+
+  std::atomic<uint64_t> m_epoch;
+  std::mutex m_retireLock;
+  std::vector<Retired> m_retired;
+};
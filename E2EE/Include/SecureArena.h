@@ -0,0 +1,87 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+#include <mutex>
+
+/**
+ * @brief Arena tipo slab para material de claves.
+ *
+ * Reserva memoria en slabs de paginas bloqueadas en RAM (no van al fichero
+ * de paginacion) y rodeadas de paginas guarda sin acceso, y reparte bloques
+ * de tamano fijo desde una lista libre: reservar y liberar son O(1) y no
+ * hacen ninguna llamada al sistema salvo cuando hace falta un slab nuevo.
+ * Los bloques se ponen a cero al liberarlos.
+ */
+class
+SecureArena {
+public:
+  struct Stats {
+    size_t blockSize = 0;
+    size_t blocksPerSlab = 0;
+    size_t slabs = 0;
+    size_t inUse = 0;             // Bloques entregados ahora mismo
+    size_t peakInUse = 0;
+    uint64_t totalAllocations = 0;
+    size_t lockedBytes = 0;       // Bytes bloqueados con exito en RAM
+    size_t lockFailures = 0;      // Slabs que no se pudieron bloquear
+  };
+
+  /**
+   * @param blockSize Tamano de cada bloque (se redondea a multiplo de 16).
+   * @param blocksPerSlab Bloques por slab; cada slab nuevo cuesta una reserva.
+   */
+  explicit
+  SecureArena(size_t blockSize, size_t blocksPerSlab = 1024);
+  ~SecureArena();
+
+  SecureArena(const SecureArena&) = delete;
+  SecureArena& operator=(const SecureArena&) = delete;
+
+  /**
+   * @brief Arena compartida del proceso para bloques de hasta 32, 64, 128
+   * o 256 bytes.
+   * @return nullptr si blockSize es mayor que 256.
+   */
+  static SecureArena*
+  Shared(size_t blockSize);
+
+  /**
+   * @brief Devuelve un bloque a cero, o nullptr si no hay memoria.
+   */
+  void*
+  Allocate();
+
+  /**
+   * @brief Pone el bloque a cero y lo devuelve a la lista libre.
+   */
+  void
+  Free(void* block);
+
+  Stats
+  GetStats() const;
+
+  size_t
+  BlockSize() const { return m_blockSize; }
+
+private:
+  struct Slab {
+    Slab* next;
+    unsigned char* base;   // Inicio de la reserva (incluye las paginas guarda)
+    size_t reserved;
+  };
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  bool
+  AddSlab();
+
+  size_t m_blockSize;
+  size_t m_blocksPerSlab;
+  size_t m_pageSize;
+  Slab* m_slabs = nullptr;
+  FreeBlock* m_freeList = nullptr;
+  mutable std::mutex m_lock;
+  Stats m_stats;
+};
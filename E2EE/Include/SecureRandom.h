@@ -0,0 +1,34 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief Generador aleatorio con buffer por hilo.
+ *
+ * Cada hilo mantiene su propio bloque de bytes sacado del DRBG privado de
+ * OpenSSL y solo vuelve a llamar a RAND cuando lo agota, asi que pedir un
+ * IV o una clave no pasa por el RAND global en cada mensaje. Los bytes ya
+ * entregados se borran del buffer.
+ */
+class
+SecureRandom {
+public:
+  /**
+   * @brief Rellena out con len bytes aleatorios.
+   * @return false si el DRBG de OpenSSL fallo al recargar.
+   */
+  static bool
+  Fill(unsigned char* out, size_t len);
+
+  static uint64_t
+  NextU64();
+
+  /**
+   * @brief Fuerza la carga del buffer del hilo actual (para precalentar).
+   */
+  static bool
+  Prime();
+
+  // Tamano del bloque que se pide a OpenSSL en cada recarga
+  static const size_t kBlockSize = 4096;
+};
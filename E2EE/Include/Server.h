@@ -1,14 +1,275 @@
 #pragma once
 #include "NetworkHelper.h"
+#include "CryptoHelper.h"
+#include "CryptoWorkerPool.h"
+#include "WorkStealingScheduler.h"
+#include "RoutingTable.h"
+#include "RoomRegistry.h"
+#include "OfflineStore.h"
+#include "SessionTable.h"
+#include "RateLimiter.h"
+#include "HotRestart.h"
+#include "IdentityRegistry.h"
+#include "BlobStore.h"
+#include "Cluster.h"
+#include <atomic>
+#include <memory>
+#include <thread>
 
+/**
+ * @brief Servidor de mensajeria con un event loop por nucleo (thread-per-core).
+ *
+ * Un hilo acepta conexiones y reparte cada socket a un nucleo. A partir de
+ * ahi ese nucleo es el unico dueno de la conexion: su socket, su sesion de
+ * transporte, sus buffers y su estado solo los toca su hilo. Los nucleos se
+ * comunican solo con mensajes por colas sin locks, asi que en el camino de
+ * datos no hay locks compartidos. Nadie espera a que haya sitio en la cola
+ * de un nucleo: un mensaje que no cabe va al almacen offline, una senal se
+ * descarta y una conexion nueva se rechaza.
+ *
+ * Directorio de usuarios: RoutingTable compartida, con lecturas sin locks.
+ * El id de conexion lleva el nucleo dueno en sus bits altos, asi que enviar
+ * a un usuario es una consulta en el nucleo origen y, si la conexion es de
+ * otro nucleo, un mensaje directo a ese nucleo.
+ *
+ * Los handshakes (RSA y, si el cliente lo ofrece, ML-KEM + X25519; ver
+ * FrameCodec) van al CryptoWorkerPool para no bloquear los loops.
+ * El descifrado y el cifrado de mensajes grandes van al WorkStealingScheduler:
+ * un nucleo con una conexion que sube mucho trafico reparte ese trabajo entre
+ * todos los workers en lugar de retrasar al resto de sus conexiones. Cada
+ * conexion tiene como mucho un paso de cripto en vuelo, asi que el estado de
+ * su sesion no se usa desde dos hilos a la vez y el orden de sus mensajes se
+ * mantiene. La excepcion son los sellos seguidos (el backlog Stored al
+ * reconectar): el nucleo les aparta las secuencias AEAD y el paso lanza un
+ * tramo por subtarea, que los workers libres roban de su deque.
+ *
+ * Identidad (IdentityRegistry): el Hello va firmado con la clave Ed25519
+ * del usuario sobre el reto de su ServerKey. El nodo dueno del usuario fija
+ * la clave la primera vez y rechaza cualquier otra, asi que solo quien tiene
+ * la privada ocupa su ruta, su sesion fiable y su backlog offline. Con
+ * directorio offline las claves fijadas se guardan en el.
+ *
+ * Salas (RoomRegistry): una publicacion se cifra una vez con la clave de la
+ * sala y la misma trama se reparte por referencia; el nucleo que publica
+ * manda un mensaje por cada nucleo con miembros, no uno por miembro.
+ *
+ * Con un directorio de OfflineStore, los mensajes a usuarios sin conexion
+ * se guardan y se entregan como tramas Stored al reconectar, con una ventana
+ * de mensajes sin confirmar; cada Ack del cliente libera su parte del log.
+ * En el mismo directorio va el BlobStore de adjuntos (BlobPut, BlobRef,
+ * BlobRead): se suben una vez y cada destinatario suma una referencia.
+ *
+ * Entrega fiable: Send y Deliver llevan una secuencia por usuario que vive
+ * en SessionTable, no en la conexion. Cada lado confirma con acks
+ * acumulativos + SACK agrupados (uno cada pocos mensajes o tras un plazo
+ * corto), el servidor descarta Send repetidos y guarda cada Deliver hasta su
+ * ack. Al reconectar dentro de la ventana de reanudacion cada lado reenvia
+ * solo lo que el ack del otro no cubre; pasada la ventana, lo pendiente va
+ * al OfflineStore.
+ *
+ * Limites de entrada (RateLimiter): cada trama recien separada del flujo
+ * paga tokens del bucket de su conexion y del de su IP antes de cualquier
+ * trabajo de cripto; sin tokens se descarta. Los buckets son un CAS sin
+ * locks y el reloj se lee una vez por lectura del socket.
+ *
+ * Sobrecarga (AdmissionControl, uno por nucleo): se mide cuanto esperan los
+ * mensajes en el inbox, el scheduler y el pool de handshakes; si la espera
+ * se mantiene por encima del objetivo se descartan en la entrada, por
+ * orden, senales, handshakes nuevos y transferencias grandes. El chat de
+ * las sesiones abiertas siempre pasa.
+ *
+ * Reinicio en caliente (HotRestart): el proceso viejo deja de aceptar,
+ * congela la lectura de sus nucleos hasta que no queda cripto en vuelo y
+ * pasa al nuevo el socket de escucha, las sesiones fiables y cada conexion
+ * con su socket, su sesion AEAD y sus buffers. Los clientes no reconectan;
+ * solo las conexiones que aun no completaron el handshake se cierran (la
+ * identidad RSA no se traspasa) y las salas se reabren con claves nuevas.
+ *
+ * Cluster (EnableCluster): varios Server se reparten los usuarios con un
+ * HashRing. Un cliente que se identifica en un nodo que no es el suyo recibe
+ * Redirect con la direccion del bueno; los Send, Signal y el backlog offline
+ * para usuarios de otro nodo viajan por los enlaces por lotes de Cluster y
+ * alli siguen el camino normal (Route local, almacen offline). Un Send
+ * reenviado se confirma al cliente, y un mensaje migrado se borra del
+ * almacen de aqui, solo cuando el ack del enlace cubre su lote. Al cambiar los
+ * miembros solo se mueven los usuarios de los tramos afectados, con su clave
+ * de identidad fijada (IdentityRegistry::Merge en el dueno nuevo). Cada nodo
+ * guarda los miembros de sala que tiene conectados; una publicacion sale a
+ * todos los demas nodos y cada uno la reparte, con su clave de sala, entre
+ * los suyos. El reinicio en caliente no traspasa los enlaces.
+ */
 class
 Server {
 public:
-	Server() = default;
-	Server(int port);
+  struct Stats {
+    uint64_t accepted = 0;
+    uint64_t connections = 0;   // Abiertas ahora mismo
+    uint64_t framesIn = 0;
+    uint64_t framesOut = 0;
+    uint64_t routed = 0;        // Mensajes entregados a su destino
+    uint64_t dropped = 0;       // Destino desconocido o sesion invalida
+    uint64_t bytesIn = 0;
+    uint64_t bytesOut = 0;
+    uint64_t routes = 0;        // Usuarios en la tabla de rutas
+    uint64_t broadcasts = 0;    // Publicaciones en salas
+    uint64_t rooms = 0;         // Salas con algun miembro
+    uint64_t stored = 0;        // Mensajes guardados para usuarios sin conexion
+    uint64_t storedOut = 0;     // Tramas Stored enviadas al reconectar
+    uint64_t acks = 0;          // Tramas Ack enviadas y recibidas
+    uint64_t ackBytes = 0;      // Bytes en el cable de esas tramas
+    uint64_t retransmitted = 0; // Deliver reenviados al reanudar una sesion
+    uint64_t duplicates = 0;    // Send repetidos descartados
+    uint64_t sessions = 0;      // Sesiones fiables (con o sin conexion)
+    uint64_t limited = 0;       // Tramas descartadas por los limites de entrada
+    uint64_t shedSignals = 0;   // Descartes por sobrecarga, por clase
+    uint64_t shedHandshakes = 0;
+    uint64_t shedBulk = 0;
+    uint64_t escalations = 0;   // Subidas de nivel de descarte
+    uint64_t shedLevel = 0;     // Nivel actual del nucleo mas cargado (0 = nada)
+    uint64_t sojournMicros = 0; // Ultima espera en colas internas, la mayor
+    uint64_t forwarded = 0;     // Mensajes y senales enviados a otro nodo del cluster
+    uint64_t fromCluster = 0;   // Recibidos de otros nodos
+    uint64_t redirected = 0;    // Clientes enviados a su nodo con Redirect
+    uint64_t migrated = 0;      // Mensajes offline pasados a su nodo
+    uint64_t linkBatches = 0;   // Lotes escritos en los enlaces (reenvios incluidos)
+    uint64_t blobRequests = 0;  // BlobPut, BlobRef, BlobRelease y BlobRead atendidos
+    uint64_t blobDedupHits = 0; // BlobPut o BlobRef de un blob que ya estaba
+    uint64_t blobBytesIn = 0;   // Bytes de blob escritos de verdad
+    uint64_t inboxFull = 0;     // Mensajes que no cupieron en la cola de un nucleo
+    uint64_t refused = 0;       // Conexiones cerradas al aceptar: todos los nucleos llenos
+    uint64_t sealBatches = 0;   // Lotes de sellos repartidos entre workers (backlog Stored)
+    uint64_t stolenTasks = 0;   // Tareas del scheduler que ejecuto un worker distinto
+  };
 
-	~Server();
+  Server();
+
+  /**
+   * @brief Arranca el servidor en el puerto indicado.
+   * @param cores Nucleos con event loop propio (0 = todos).
+   * @param offlineDirectory Segmentos de OfflineStore; vacio = los mensajes a
+   * usuarios sin conexion se descartan y no hay almacen de blobs.
+   * @param limits Tramas por segundo por conexion y por IP.
+   * @param takeoverEndpoint Endpoint de HotRestart de un servidor en marcha:
+   * en lugar de abrir el puerto se le piden su socket de escucha y sus
+   * conexiones. Vacio = arranque normal.
+   */
+  Server(int port, size_t cores = 0, const std::string& offlineDirectory = std::string(),
+         const RateLimiter::Limits& limits = RateLimiter::Limits(),
+         const std::string& takeoverEndpoint = std::string());
+
+  ~Server();
+
+  Server(const Server&) = delete;
+  Server& operator=(const Server&) = delete;
+
+  bool
+  IsRunning() const { return m_running.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Deja de aceptar, cierra todas las conexiones y para los loops.
+   */
+  void
+  Stop();
+
+  /**
+   * @brief Espera en endpoint a un sucesor (un Server creado con ese
+   * takeoverEndpoint) y le traspasa el servicio. Si el traspaso falla, este
+   * proceso sigue sirviendo.
+   */
+  bool
+  EnableHotRestart(const std::string& endpoint);
+
+  /**
+   * @brief El servicio ya es del sucesor: este proceso puede terminar.
+   */
+  bool
+  HandedOff() const { return m_handedOff.load(std::memory_order_acquire); }
+
+  /**
+   * @brief Entra en un cluster: desde aqui cada usuario se atiende solo en
+   * el nodo que le asigna el anillo.
+   * @param self Nombre de este nodo en nodes.
+   * @param secret El mismo en todos los nodos.
+   */
+  bool
+  EnableCluster(const std::string& self, const std::vector<ClusterNode>& nodes,
+                const std::string& secret);
+
+  /**
+   * @brief Nuevos miembros (un nodo entra o sale), igual en todos los nodos.
+   */
+  bool
+  SetClusterNodes(const std::vector<ClusterNode>& nodes);
+
+  size_t
+  Cores() const { return m_cores.size(); }
+
+  /**
+   * @brief Suma de los contadores de todos los nucleos (aproximada en vivo).
+   */
+  Stats
+  GetStats() const;
+
+  /**
+   * @brief Clave publica DER que reciben los clientes en la trama ServerKey.
+   */
+  const std::vector<unsigned char>&
+  GetPublicKey() const { return m_publicKey; }
+
+  /**
+   * @brief Ocupacion de cada shard de la tabla de rutas.
+   */
+  std::vector<RoutingTable::ShardLoad>
+  GetRouteLoad() const { return m_routes.GetLoad(); }
 
 private:
+  class Core;
+  friend class Core;
+
+  void
+  AcceptLoop();
+
+  bool
+  OpenOffline();
+
+  void
+  RestartLoop();
+
+  bool
+  HandOff();
+
+  bool
+  TakeOver(const std::string& endpoint);
+
+  bool
+  OnClusterMessage(Cluster::Kind kind, std::string&& destination, std::string&& source,
+                   std::string&& payload);
+
+  static size_t
+  ResolveCores(size_t cores);
 
-};
\ No newline at end of file
+  NetworkHelper m_network;
+  CryptoHelper m_identity;            // Solo lectura una vez arrancado
+  IdentityRegistry m_identities;      // Clave Ed25519 fijada de cada usuario
+  std::vector<unsigned char> m_publicKey;   // DER (SubjectPublicKeyInfo)
+  RoutingTable m_routes;              // Lectores: los nucleos, por indice
+  RoomRegistry m_rooms;
+  std::string m_offlineDirectory;
+  std::unique_ptr<OfflineStore> m_offline;
+  std::shared_ptr<BlobStore> m_blobs;  // En el directorio offline; lo usan trabajos del pool
+  SessionTable m_sessions;
+  RateLimiter m_limiter;
+  std::unique_ptr<CryptoWorkerPool> m_handshakes;
+  std::unique_ptr<WorkStealingScheduler> m_scheduler;
+  std::vector<std::unique_ptr<Core>> m_cores;
+  std::thread m_acceptor;
+  HotRestart m_restart;
+  std::thread m_restarter;
+  std::unique_ptr<Cluster> m_cluster;
+  std::atomic<Cluster*> m_clusterActive;  // Lo leen los nucleos; nulo sin cluster
+  std::atomic<bool> m_running;
+  std::atomic<bool> m_accepting;      // El acceptor para solo, sin cerrar el socket
+  std::atomic<bool> m_handedOff;
+  std::atomic<uint64_t> m_accepted;
+  std::atomic<uint64_t> m_refused;
+};
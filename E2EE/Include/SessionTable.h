@@ -0,0 +1,75 @@
+#pragma once
+#include "Prerequisites.h"
+#include "ReliableChannel.h"
+#include <functional>
+#include <mutex>
+#include <set>
+#include <unordered_map>
+
+/**
+ * @brief Estado de entrega fiable de un usuario, que sobrevive a sus
+ * conexiones: al reconectar se sigue con las mismas secuencias.
+ */
+struct ReliableSession {
+  std::mutex lock;             // Dos conexiones del mismo usuario pueden solaparse
+  AckTracker inbound;          // Send del cliente: duplicados y acks
+  std::set<uint64_t> storing;  // Send camino del disco offline: sin ack hasta el volcado
+  RetransmitBuffer outbound;   // Deliver al cliente sin confirmar
+  int attached = 0;            // Conexiones que la usan
+  std::chrono::steady_clock::time_point detachedAt;
+};
+
+/**
+ * @brief Sesiones fiables por usuario. Una sesion sin conexiones se guarda
+ * durante la ventana de reanudacion; despues Sweep() la entrega al llamador
+ * (para pasar lo pendiente al almacen offline) y la olvida.
+ */
+class
+SessionTable {
+public:
+  using Expired = std::function<void(const std::string& user, ReliableSession& session)>;
+
+  explicit
+  SessionTable(std::chrono::milliseconds resumeWindow = std::chrono::seconds(60));
+
+  SessionTable(const SessionTable&) = delete;
+  SessionTable& operator=(const SessionTable&) = delete;
+
+  /**
+   * @brief Sesion de user (la existente si aun no expiro, o una nueva).
+   */
+  std::shared_ptr<ReliableSession>
+  Attach(const std::string& user);
+
+  void
+  Detach(const std::shared_ptr<ReliableSession>& session);
+
+  /**
+   * @brief Quita las sesiones sin conexion mas antiguas que la ventana.
+   * @return Sesiones expiradas.
+   */
+  size_t
+  Sweep(const Expired& expired);
+
+  size_t
+  Size() const;
+
+  /**
+   * @brief Anade todas las sesiones a out (reinicio en caliente). La tabla
+   * no cambia: si el traspaso falla se sigue con ella.
+   */
+  void
+  Export(std::string& out) const;
+
+  /**
+   * @brief Sesiones de Export, sin conexiones: la ventana de reanudacion
+   * empieza ahora.
+   */
+  bool
+  Import(const std::string& state);
+
+private:
+  const std::chrono::milliseconds m_resumeWindow;
+  mutable std::mutex m_lock;
+  std::unordered_map<std::string, std::shared_ptr<ReliableSession>> m_sessions;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include "Prerequisites.h"
+#include <cstdint>
+
+/**
+ * @brief SipHash-2-4: hash de 64 bits con clave de 128 bits. Con clave
+ * secreta, quien elige los ids no puede fabricar colisiones.
+ */
+namespace SipHash {
+  inline uint64_t
+  Rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+  }
+
+  inline void
+  Round(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+    v0 += v1; v1 = Rotl(v1, 13); v1 ^= v0; v0 = Rotl(v0, 32);
+    v2 += v3; v3 = Rotl(v3, 16); v3 ^= v2;
+    v0 += v3; v3 = Rotl(v3, 21); v3 ^= v0;
+    v2 += v1; v1 = Rotl(v1, 17); v1 ^= v2; v2 = Rotl(v2, 32);
+  }
+
+  inline uint64_t
+  Hash24(const uint64_t key[2], const unsigned char* data, size_t len) {
+    uint64_t v0 = key[0] ^ 0x736f6d6570736575ull;
+    uint64_t v1 = key[1] ^ 0x646f72616e646f6dull;
+    uint64_t v2 = key[0] ^ 0x6c7967656e657261ull;
+    uint64_t v3 = key[1] ^ 0x7465646279746573ull;
+
+    size_t words = len / 8;
+    for (size_t i = 0; i < words; ++i) {
+      uint64_t m = 0;
+      for (int b = 7; b >= 0; --b) {
+        m = (m << 8) | data[i * 8 + b];
+      }
+      v3 ^= m;
+      Round(v0, v1, v2, v3);
+      Round(v0, v1, v2, v3);
+      v0 ^= m;
+    }
+
+    uint64_t last = uint64_t(len & 0xff) << 56;
+    for (size_t b = 0; b < (len & 7); ++b) {
+      last |= uint64_t(data[words * 8 + b]) << (8 * b);
+    }
+    v3 ^= last;
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    v0 ^= last;
+    v2 ^= 0xff;
+    for (int i = 0; i < 4; ++i) {
+      Round(v0, v1, v2, v3);
+    }
+    return v0 ^ v1 ^ v2 ^ v3;
+  }
+}
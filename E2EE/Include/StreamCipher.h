@@ -0,0 +1,119 @@
+#pragma once
+#include "Prerequisites.h"
+#include "openssl/evp.h"
+#include <cstdint>
+
+/**
+ * @brief Formato de registros AEAD encadenados (estilo STREAM).
+ *
+ * Cabecera: "E2S1" || tamano de bloque (u32) || salt (16 bytes).
+ * Cada bloque de texto plano se cifra con AES-256-GCM bajo una clave
+ * derivada de (clave, salt) y nonce = prefijo(7) || indice(4) || final(1).
+ * El ultimo registro lleva la marca final, asi que truncar o reordenar
+ * registros hace fallar la autenticacion.
+ */
+namespace StreamFormat {
+  const size_t kHeaderSize = 24;
+  const size_t kTagSize = 16;
+  const size_t kDefaultChunkSize = 64 * 1024;
+  const size_t kMaxChunkSize = 16 * 1024 * 1024;
+}
+
+/**
+ * @brief Cifrado incremental Init/Update/Final con memoria constante.
+ *
+ * Update() acepta cualquier cantidad de datos y solo retiene, como mucho,
+ * un bloque de texto plano pendiente.
+ */
+class
+StreamEncryptor {
+public:
+  /**
+   * @param key Clave de 32 bytes (por ejemplo, la clave de sesion).
+   * @param chunkSize Tamano de bloque de texto plano por registro.
+   */
+  StreamEncryptor(const unsigned char key[32],
+                  size_t chunkSize = StreamFormat::kDefaultChunkSize);
+  ~StreamEncryptor();
+
+  StreamEncryptor(const StreamEncryptor&) = delete;
+  StreamEncryptor& operator=(const StreamEncryptor&) = delete;
+
+  /**
+   * @brief Cifra datos y anade a out los registros completos (y la cabecera
+   * en la primera llamada).
+   */
+  bool
+  Update(const unsigned char* data, size_t len, std::vector<unsigned char>& out);
+
+  /**
+   * @brief Emite el registro final. Despues no se puede seguir cifrando.
+   */
+  bool
+  Finalize(std::vector<unsigned char>& out);
+
+private:
+  bool
+  EmitHeader(std::vector<unsigned char>& out);
+
+  bool
+  SealChunk(const unsigned char* data, size_t len, bool last,
+            std::vector<unsigned char>& out);
+
+  EVP_CIPHER_CTX* m_ctx;
+  unsigned char m_header[StreamFormat::kHeaderSize];
+  unsigned char m_noncePrefix[7];
+  size_t m_chunkSize;
+  uint32_t m_counter = 0;
+  bool m_headerSent = false;
+  bool m_finished = false;
+  bool m_ok = true;
+  std::vector<unsigned char> m_pending;
+};
+
+/**
+ * @brief Descifrado incremental: entrega texto plano en cuanto un registro
+ * esta completo, sin esperar al final del flujo.
+ *
+ * Un registro solo se descifra cuando llegan bytes posteriores a el (asi se
+ * sabe que no es el final). Finalize() autentica el registro final; hasta
+ * entonces el llamador no debe dar el flujo por completo.
+ */
+class
+StreamDecryptor {
+public:
+  explicit
+  StreamDecryptor(const unsigned char key[32]);
+  ~StreamDecryptor();
+
+  StreamDecryptor(const StreamDecryptor&) = delete;
+  StreamDecryptor& operator=(const StreamDecryptor&) = delete;
+
+  /**
+   * @return false si la cabecera o algun registro no se autentica.
+   */
+  bool
+  Update(const unsigned char* data, size_t len, std::vector<unsigned char>& out);
+
+  /**
+   * @return false si el flujo esta truncado o el registro final no es valido.
+   */
+  bool
+  Finalize(std::vector<unsigned char>& out);
+
+private:
+  bool
+  OpenChunk(const unsigned char* record, size_t len, bool last,
+            std::vector<unsigned char>& out);
+
+  EVP_CIPHER_CTX* m_ctx;
+  unsigned char m_key[32];
+  unsigned char m_header[StreamFormat::kHeaderSize];
+  unsigned char m_noncePrefix[7];
+  size_t m_headerLen = 0;
+  size_t m_chunkSize = 0;
+  uint32_t m_counter = 0;
+  bool m_finished = false;
+  bool m_ok = true;
+  std::vector<unsigned char> m_pending;
+};
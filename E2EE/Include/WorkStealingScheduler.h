@@ -0,0 +1,243 @@
+#pragma once
+#include "Prerequisites.h"
+#include "LockFreeQueue.h"
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/**
+ * @brief Deque de trabajo de Chase-Lev (version de Le, Pop, Cohen y Nardelli
+ * con el modelo de memoria de C11).
+ *
+ * Solo el hilo dueno hace Push/Pop por el extremo inferior (LIFO, sin CAS
+ * salvo con un unico elemento); cualquier otro hilo roba por el superior con
+ * un CAS. Crece sin limite; los arrays viejos se conservan hasta destruir la
+ * deque porque un ladron puede estar leyendo de ellos.
+ *
+ * T debe ser un tipo trivial (el scheduler guarda punteros).
+ */
+template<typename T>
+class
+ChaseLevDeque {
+public:
+  explicit
+  ChaseLevDeque(size_t capacity = 256) {
+    size_t size = 2;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    m_arrays.emplace_back(new Array(size));
+    m_array.store(m_arrays.back().get(), std::memory_order_relaxed);
+  }
+
+  ChaseLevDeque(const ChaseLevDeque&) = delete;
+  ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+  /**
+   * @brief Solo el dueno.
+   */
+  void
+  Push(T value) {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_acquire);
+    Array* array = m_array.load(std::memory_order_relaxed);
+    if (bottom - top > static_cast<int64_t>(array->mask)) {
+      array = Grow(array, top, bottom);
+    }
+    array->Put(bottom, value);
+    std::atomic_thread_fence(std::memory_order_release);
+    m_bottom.store(bottom + 1, std::memory_order_relaxed);
+  }
+
+  /**
+   * @brief Solo el dueno. Saca el ultimo elemento metido.
+   */
+  bool
+  Pop(T& out) {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed) - 1;
+    Array* array = m_array.load(std::memory_order_relaxed);
+    m_bottom.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);  // Vacia
+      return false;
+    }
+    out = array->Get(bottom);
+    if (top == bottom) {
+      // Ultimo elemento: se compite con los ladrones por el
+      bool won = m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                               std::memory_order_relaxed);
+      m_bottom.store(bottom + 1, std::memory_order_relaxed);
+      return won;
+    }
+    return true;
+  }
+
+  /**
+   * @brief Cualquier hilo. Saca el elemento mas antiguo.
+   * @return false si esta vacia o si otro hilo gano la carrera.
+   */
+  bool
+  Steal(T& out) {
+    int64_t top = m_top.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = m_bottom.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return false;
+    }
+    Array* array = m_array.load(std::memory_order_acquire);
+    T value = array->Get(top);
+    if (!m_top.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                       std::memory_order_relaxed)) {
+      return false;
+    }
+    out = value;
+    return true;
+  }
+
+  /**
+   * @brief Numero aproximado de elementos (solo para metricas).
+   */
+  size_t
+  SizeApprox() const {
+    int64_t bottom = m_bottom.load(std::memory_order_relaxed);
+    int64_t top = m_top.load(std::memory_order_relaxed);
+    return bottom > top ? static_cast<size_t>(bottom - top) : 0;
+  }
+
+private:
+  struct Array {
+    explicit
+    Array(size_t size) : mask(size - 1), slots(new std::atomic<T>[size]) {}
+
+    T
+    Get(int64_t index) const {
+      return slots[static_cast<size_t>(index) & mask].load(std::memory_order_relaxed);
+    }
+
+    void
+    Put(int64_t index, T value) {
+      slots[static_cast<size_t>(index) & mask].store(value, std::memory_order_relaxed);
+    }
+
+    const size_t mask;
+    std::unique_ptr<std::atomic<T>[]> slots;
+  };
+
+  Array*
+  Grow(Array* array, int64_t top, int64_t bottom) {
+    m_arrays.emplace_back(new Array((array->mask + 1) * 2));
+    Array* grown = m_arrays.back().get();
+    for (int64_t i = top; i < bottom; ++i) {
+      grown->Put(i, array->Get(i));
+    }
+    m_array.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  alignas(E2EE_CACHE_LINE) std::atomic<int64_t> m_top{ 0 };
+  alignas(E2EE_CACHE_LINE) std::atomic<int64_t> m_bottom{ 0 };
+  std::atomic<Array*> m_array{ nullptr };
+  std::vector<std::unique_ptr<Array>> m_arrays;  // Solo el dueno
+};
+
+/**
+ * @brief Pool de hilos con robo de trabajo.
+ *
+ * Cada worker tiene su deque de Chase-Lev: las tareas que lanza una tarea
+ * (por ejemplo, un cifrado por destinatario) se quedan en la deque local y
+ * se ejecutan LIFO con la cache caliente. Las tareas que llegan desde fuera
+ * (los loops del servidor) entran por una cola sin locks por worker,
+ * repartidas en round-robin. Cada worker atiende primero su cola de entrada,
+ * asi que una tarea corta de un loop no espera detras de las subtareas de
+ * una tarea pesada. Un worker sin trabajo roba de una victima elegida al
+ * azar (primero su cola de entrada, luego lo mas antiguo de su deque): una
+ * rafaga pesada en un worker no deja a los demas parados, y no hay una cola
+ * unica en la que compitan todos los hilos.
+ */
+class
+WorkStealingScheduler {
+public:
+  using Task = std::function<void()>;
+
+  struct Stats {
+    uint64_t submitted = 0;   // Desde fuera de los workers
+    uint64_t spawned = 0;     // Desde un worker, a su deque local
+    uint64_t rejected = 0;
+    uint64_t executed = 0;
+    uint64_t stolen = 0;
+  };
+
+  /**
+   * @param threads Workers (0 = numero de nucleos).
+   * @param injectDepth Capacidad de la cola de entrada de cada worker.
+   */
+  explicit
+  WorkStealingScheduler(size_t threads = 0, size_t injectDepth = 4096);
+  ~WorkStealingScheduler();
+
+  WorkStealingScheduler(const WorkStealingScheduler&) = delete;
+  WorkStealingScheduler& operator=(const WorkStealingScheduler&) = delete;
+
+  /**
+   * @brief Encola una tarea. Desde un worker de este scheduler va a su deque
+   * (nunca falla); desde cualquier otro hilo, a una cola de entrada.
+   *
+   * @return false si todas las colas de entrada estan llenas.
+   */
+  bool
+  Submit(Task task);
+
+  size_t
+  Threads() const { return m_workers.size(); }
+
+  /**
+   * @brief true si el hilo actual es un worker de este scheduler.
+   */
+  bool
+  InWorker() const;
+
+  Stats
+  GetStats() const;
+
+private:
+  struct Worker {
+    explicit
+    Worker(size_t injectDepth) : inbox(injectDepth) {}
+
+    ChaseLevDeque<Task*> deque;
+    MPMCQueue<Task*> inbox;
+    std::thread thread;
+    uint64_t random = 0;
+
+    // Un solo escritor (el worker)
+    std::atomic<uint64_t> spawned{ 0 };
+    std::atomic<uint64_t> executed{ 0 };
+    std::atomic<uint64_t> stolen{ 0 };
+  };
+
+  void
+  WorkerLoop(size_t index);
+
+  Task*
+  FindTask(size_t index);
+
+  void
+  WakeOne();
+
+  std::vector<std::unique_ptr<Worker>> m_workers;
+  std::atomic<size_t> m_nextInbox;
+
+  // Solo para dormir cuando no hay trabajo; el camino de datos no lo usa
+  std::mutex m_sleepLock;
+  std::condition_variable m_wakeup;
+  std::atomic<int> m_sleeping;
+  std::atomic<bool> m_stop;
+
+  std::atomic<uint64_t> m_submitted;
+  std::atomic<uint64_t> m_rejected;
+};
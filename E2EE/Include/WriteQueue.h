@@ -0,0 +1,153 @@
+#pragma once
+#include "NetworkHelper.h"
+#include <deque>
+#include <memory>
+
+/**
+ * @brief Cola de escritura de una conexion (un solo hilo, sin locks).
+ *
+ * Mezcla bytes propios (tramas cifradas solo para esta conexion, que se
+ * agrupan en un buffer) con buffers compartidos inmutables: una trama de
+ * sala se cifra una vez y cada suscriptor guarda solo una referencia. Flush
+ * envia varios segmentos con un unico WSASend (escritura con gather).
+ */
+class
+WriteQueue {
+public:
+  using Shared = std::shared_ptr<const std::vector<unsigned char>>;
+
+  /**
+   * @brief Buffer que se reutiliza para los bytes propios (de un BufferPool).
+   */
+  void
+  Adopt(std::vector<unsigned char>&& buffer) {
+    buffer.clear();
+    m_spare = std::move(buffer);
+  }
+
+  /**
+   * @brief Devuelve el buffer reutilizable y vacia la cola.
+   */
+  std::vector<unsigned char>
+  Release() {
+    m_segments.clear();
+    m_pending = 0;
+    m_spare.clear();
+    return std::move(m_spare);
+  }
+
+  /**
+   * @brief Buffer propio al final de la cola donde anadir tramas. Llamar a
+   * Commit con los bytes anadidos.
+   */
+  std::vector<unsigned char>&
+  Tail() {
+    if (m_segments.empty() || m_segments.back().shared) {
+      m_segments.emplace_back();
+      m_segments.back().owned = std::move(m_spare);
+      m_spare = std::vector<unsigned char>();
+    }
+    return m_segments.back().owned;
+  }
+
+  void
+  Commit(size_t bytes) { m_pending += bytes; }
+
+  void
+  AppendShared(const Shared& buffer) {
+    Segment segment;
+    segment.shared = buffer;
+    m_segments.push_back(std::move(segment));
+    m_pending += buffer->size();
+  }
+
+  bool
+  Empty() const { return m_pending == 0; }
+
+  /**
+   * @brief Bytes pendientes de enviar.
+   */
+  size_t
+  Pending() const { return m_pending; }
+
+  /**
+   * @brief Anade a out los bytes pendientes, en orden (para pasar la cola a
+   * otro proceso). No consume nada.
+   */
+  void
+  CopyPending(std::string& out) const {
+    out.reserve(out.size() + m_pending);
+    for (const Segment& segment : m_segments) {
+      const std::vector<unsigned char>& data = segment.Data();
+      out.append(reinterpret_cast<const char*>(data.data() + segment.offset),
+                 data.size() - segment.offset);
+    }
+  }
+
+  /**
+   * @brief Envia lo que acepte el socket sin bloquear.
+   * @param sent Bytes enviados.
+   * @return false si hubo un error distinto de "bloquearia".
+   */
+  bool
+  Flush(SOCKET socket, size_t& sent) {
+    const size_t kMaxBuffers = 64;
+    sent = 0;
+    while (m_pending > 0) {
+      WSABUF buffers[kMaxBuffers];
+      DWORD count = 0;
+      for (auto it = m_segments.begin(); it != m_segments.end() && count < kMaxBuffers; ++it) {
+        const std::vector<unsigned char>& data = it->Data();
+        buffers[count].buf = const_cast<char*>(reinterpret_cast<const char*>(data.data() + it->offset));
+        buffers[count].len = static_cast<ULONG>(data.size() - it->offset);
+        ++count;
+      }
+
+      DWORD written = 0;
+      if (WSASend(socket, buffers, count, &written, 0, nullptr, nullptr) == SOCKET_ERROR) {
+        int error = WSAGetLastError();
+        return error == WSAEWOULDBLOCK || error == WSAEINTR;
+      }
+      sent += written;
+      Consume(written);
+      if (written == 0) {
+        break;
+      }
+    }
+    return true;
+  }
+
+private:
+  struct Segment {
+    std::vector<unsigned char> owned;
+    Shared shared;
+    size_t offset = 0;
+
+    const std::vector<unsigned char>&
+    Data() const { return shared ? *shared : owned; }
+  };
+
+  void
+  Consume(size_t bytes) {
+    m_pending -= bytes;
+    while (bytes > 0) {
+      Segment& front = m_segments.front();
+      size_t left = front.Data().size() - front.offset;
+      if (bytes < left) {
+        front.offset += bytes;
+        return;
+      }
+      bytes -= left;
+      // El buffer propio vuelve a ser el de reserva: sin reservar memoria otra vez
+      if (!front.shared && m_spare.capacity() < front.owned.capacity()) {
+        front.owned.clear();
+        m_spare = std::move(front.owned);
+      }
+      m_segments.pop_front();
+    }
+  }
+
+  std::deque<Segment> m_segments;
+  std::vector<unsigned char> m_spare;
+  size_t m_pending = 0;
+};
@@ -0,0 +1,44 @@
+#include "AdmissionControl.h"
+#include <cmath>
+
+AdmissionControl::AdmissionControl(std::chrono::microseconds target,
+                                   std::chrono::microseconds interval)
+  : m_target(target), m_interval(interval) {
+}
+
+void
+AdmissionControl::Observe(Clock::duration sojourn, Clock::time_point now) {
+  m_sojourn = sojourn;
+  if (sojourn < m_target) {
+    m_firstAbove = Clock::time_point();
+    return;
+  }
+
+  m_lastAbove = now;
+  if (m_firstAbove == Clock::time_point()) {
+    m_firstAbove = now + m_interval;
+    return;
+  }
+  if (now < m_firstAbove || now < m_nextStep || m_level >= kMaxLevel) {
+    return;
+  }
+  // Un intervalo entero sin bajar del objetivo: no es una rafaga
+  ++m_level;
+  ++m_escalations;
+  ++m_count;
+  m_nextStep = now + std::chrono::duration_cast<Clock::duration>(
+    m_interval / std::sqrt(static_cast<double>(m_count)));
+}
+
+void
+AdmissionControl::Tick(Clock::time_point now) {
+  if (m_level == 0 || now < m_lastAbove + m_interval || now < m_nextStep) {
+    return;
+  }
+  --m_level;
+  m_firstAbove = Clock::time_point();   // Una nueva subida vuelve a esperar un intervalo
+  m_nextStep = now + m_interval;
+  if (m_level == 0) {
+    m_count = 0;
+  }
+}
@@ -0,0 +1,169 @@
+#include "AlgorithmCache.h"
+#include "SecureRandom.h"
+#include "openssl/core_names.h"
+#include "openssl/err.h"
+#include "openssl/provider.h"
+#include "openssl/rand.h"
+#include <chrono>
+#include <mutex>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  struct Algorithms {
+    bool ok = false;
+    AlgorithmCache::StartupReport report;
+
+    OSSL_PROVIDER* defaultProvider = nullptr;
+    EVP_CIPHER* aes256gcm = nullptr;
+    EVP_CIPHER* aes256cbc = nullptr;
+    EVP_MD* sha256 = nullptr;
+    EVP_MAC* hmac = nullptr;
+    EVP_KDF* hkdf = nullptr;
+
+    // Metodos de clave: se fijan para que el store de OpenSSL no los suelte
+    std::vector<EVP_KEYMGMT*> keyManagers;
+    EVP_SIGNATURE* ed25519 = nullptr;
+    EVP_KEYEXCH* x25519 = nullptr;
+    EVP_KEM* mlkem = nullptr;
+    EVP_ASYM_CIPHER* rsa = nullptr;
+  };
+
+  Algorithms g_algorithms;
+  std::once_flag g_once;
+
+  double
+  ElapsedMs(Clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(Clock::now() - since).count();
+  }
+
+  struct ThreadContexts {
+    EVP_MAC_CTX* hmac = nullptr;
+    EVP_KDF_CTX* hkdf = nullptr;
+
+    ~ThreadContexts() {
+      EVP_MAC_CTX_free(hmac);
+      EVP_KDF_CTX_free(hkdf);
+    }
+  };
+
+  thread_local ThreadContexts t_contexts;
+
+  void
+  SetHKDFDigest(EVP_KDF_CTX* ctx) {
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_utf8_string(OSSL_KDF_PARAM_DIGEST, digest, 0),
+      OSSL_PARAM_construct_end()
+    };
+    EVP_KDF_CTX_set_params(ctx, params);
+  }
+}
+
+void
+AlgorithmCache::Load() {
+  Algorithms& a = g_algorithms;
+  auto start = Clock::now();
+
+  auto step = Clock::now();
+  a.defaultProvider = OSSL_PROVIDER_load(nullptr, "default");
+  a.report.providersMs = ElapsedMs(step);
+
+  step = Clock::now();
+  a.aes256gcm = EVP_CIPHER_fetch(nullptr, "AES-256-GCM", nullptr);
+  a.aes256cbc = EVP_CIPHER_fetch(nullptr, "AES-256-CBC", nullptr);
+  a.sha256 = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+  a.hmac = EVP_MAC_fetch(nullptr, "HMAC", nullptr);
+  a.hkdf = EVP_KDF_fetch(nullptr, "HKDF", nullptr);
+
+  for (const char* name : { "RSA", "X25519", "ED25519", "ML-KEM-768" }) {
+    if (EVP_KEYMGMT* manager = EVP_KEYMGMT_fetch(nullptr, name, nullptr)) {
+      a.keyManagers.push_back(manager);
+    }
+  }
+  a.ed25519 = EVP_SIGNATURE_fetch(nullptr, "ED25519", nullptr);
+  a.x25519 = EVP_KEYEXCH_fetch(nullptr, "X25519", nullptr);
+  a.rsa = EVP_ASYM_CIPHER_fetch(nullptr, "RSA", nullptr);
+  a.mlkem = EVP_KEM_fetch(nullptr, "ML-KEM-768", nullptr);
+  ERR_clear_error();  // ML-KEM puede faltar en builds antiguos
+  a.report.fetchMs = ElapsedMs(step);
+  a.report.mlkemAvailable = a.mlkem != nullptr;
+  a.report.hpkeAvailable = a.x25519 != nullptr && a.hkdf != nullptr;
+
+  // El primer RAND instancia los DRBG global y del hilo principal
+  step = Clock::now();
+  unsigned char warm[32];
+  bool drbg = RAND_bytes(warm, sizeof(warm)) == 1 && SecureRandom::Prime();
+  OPENSSL_cleanse(warm, sizeof(warm));
+  a.report.drbgMs = ElapsedMs(step);
+
+  a.ok = a.defaultProvider && a.aes256gcm && a.aes256cbc && a.sha256 &&
+         a.hmac && a.hkdf && drbg;
+  a.report.totalMs = ElapsedMs(start);
+}
+
+bool
+AlgorithmCache::Initialize(StartupReport* report) {
+  std::call_once(g_once, &AlgorithmCache::Load);
+  if (report) {
+    *report = g_algorithms.report;
+  }
+  return g_algorithms.ok;
+}
+
+const EVP_CIPHER*
+AlgorithmCache::AES256GCM() {
+  Initialize();
+  return g_algorithms.aes256gcm;
+}
+
+const EVP_CIPHER*
+AlgorithmCache::AES256CBC() {
+  Initialize();
+  return g_algorithms.aes256cbc;
+}
+
+const EVP_MD*
+AlgorithmCache::SHA256() {
+  Initialize();
+  return g_algorithms.sha256;
+}
+
+bool
+AlgorithmCache::HasMLKEM() {
+  Initialize();
+  return g_algorithms.mlkem != nullptr;
+}
+
+EVP_MAC_CTX*
+AlgorithmCache::ThreadHMAC() {
+  if (!t_contexts.hmac) {
+    Initialize();
+    t_contexts.hmac = EVP_MAC_CTX_new(g_algorithms.hmac);
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+      OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+      OSSL_PARAM_construct_end()
+    };
+    EVP_MAC_CTX_set_params(t_contexts.hmac, params);
+  }
+  return t_contexts.hmac;
+}
+
+EVP_KDF_CTX*
+AlgorithmCache::ThreadHKDF() {
+  if (!t_contexts.hkdf) {
+    Initialize();
+    t_contexts.hkdf = EVP_KDF_CTX_new(g_algorithms.hkdf);
+    SetHKDFDigest(t_contexts.hkdf);
+  }
+  return t_contexts.hkdf;
+}
+
+EVP_KDF_CTX*
+AlgorithmCache::ResetThreadHKDF() {
+  EVP_KDF_CTX* ctx = ThreadHKDF();
+  EVP_KDF_CTX_reset(ctx);
+  SetHKDFDigest(ctx);
+  return ctx;
+}
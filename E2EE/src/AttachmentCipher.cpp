@@ -0,0 +1,308 @@
+#include "AttachmentCipher.h"
+#include "CryptoHelper.h"
+#include "SecureRandom.h"
+#include "AlgorithmCache.h"
+#include "NonceSequence.h"
+#include <algorithm>
+
+namespace {
+  const unsigned char kMagic[4] = { 'E', '2', 'A', '1' };
+  const size_t kSignedHeaderSize = AttachmentFormat::kHeaderSize - 16;
+
+  // Clave AES (32) || clave HMAC (32) || prefijo de nonce (4)
+  const size_t kDerivedSize = 68;
+
+  bool
+  DeriveAttachmentKeys(const unsigned char key[32], const unsigned char* salt,
+                       unsigned char out[kDerivedSize]) {
+    return CryptoHelper::HKDFSHA256(key, 32, salt, 16, "E2EE-Attachment", out, kDerivedSize);
+  }
+
+  void
+  PutU64(unsigned char* p, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      p[i] = static_cast<unsigned char>(value >> (56 - 8 * i));
+    }
+  }
+
+  uint64_t
+  GetU64(const unsigned char* p) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | p[i];
+    }
+    return value;
+  }
+
+  uint32_t
+  GetU32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+  }
+
+  uint64_t
+  ChunkCount(uint64_t plainSize, size_t chunkSize) {
+    return (plainSize + chunkSize - 1) / chunkSize;
+  }
+
+  size_t
+  ClampChunkSize(size_t chunkSize) {
+    return std::min(std::max<size_t>(chunkSize, 1), AttachmentFormat::kMaxChunkSize);
+  }
+}
+
+uint64_t
+AttachmentWriter::EncryptedSize(uint64_t plainSize, size_t chunkSize) {
+  chunkSize = ClampChunkSize(chunkSize);
+  return AttachmentFormat::kHeaderSize + plainSize +
+         ChunkCount(plainSize, chunkSize) * AttachmentFormat::kTagSize;
+}
+
+bool
+AttachmentWriter::Encrypt(const unsigned char key[32], const unsigned char* data, size_t len,
+                          std::vector<unsigned char>& out, size_t chunkSize) {
+  out.resize(static_cast<size_t>(EncryptedSize(len, chunkSize)));
+  if (!EncryptTo(key, data, len, ClampChunkSize(chunkSize), out.data())) {
+    out.clear();
+    return false;
+  }
+  return true;
+}
+
+bool
+AttachmentWriter::EncryptConvergent(const unsigned char domainKey[32], const unsigned char* data,
+                                    size_t len, std::vector<unsigned char>& out,
+                                    unsigned char outKey[32], size_t chunkSize) {
+  unsigned char digest[32];
+  if (EVP_Digest(data, len, digest, nullptr, AlgorithmCache::SHA256(), nullptr) != 1) {
+    return false;
+  }
+  CryptoHelper::HMACSHA256(domainKey, 32, digest, sizeof(digest), outKey);
+
+  // Clave unica por contenido: un salt fijo derivado de ella no repite nonces
+  static const char kSaltLabel[] = "E2EE-Convergent-Salt";
+  unsigned char salt[32];
+  CryptoHelper::HMACSHA256(outKey, 32, reinterpret_cast<const unsigned char*>(kSaltLabel),
+                           sizeof(kSaltLabel) - 1, salt);
+
+  out.resize(static_cast<size_t>(EncryptedSize(len, chunkSize)));
+  bool ok = EncryptTo(outKey, data, len, ClampChunkSize(chunkSize), out.data(), salt);
+  OPENSSL_cleanse(digest, sizeof(digest));
+  if (!ok) {
+    OPENSSL_cleanse(outKey, 32);
+    out.clear();
+  }
+  return ok;
+}
+
+bool
+AttachmentWriter::EncryptFile(const unsigned char key[32], const std::string& inPath,
+                              const std::string& outPath, size_t chunkSize) {
+  MappedFile in;
+  if (!in.Open(inPath)) {
+    return false;
+  }
+  chunkSize = ClampChunkSize(chunkSize);
+
+  MappedFile out;
+  if (!out.Create(outPath, EncryptedSize(in.Size(), chunkSize))) {
+    return false;
+  }
+  bool ok = EncryptTo(key, in.Data(), in.Size(), chunkSize, out.MutableData()) && out.Flush();
+  if (!ok) {
+    std::cerr << "Error encrypting attachment " << inPath << std::endl;
+  }
+  return ok;
+}
+
+bool
+AttachmentWriter::EncryptTo(const unsigned char key[32], const unsigned char* data, uint64_t len,
+                            size_t chunkSize, unsigned char* out,
+                            const unsigned char* salt) {
+  unsigned char* header = out;
+  std::memcpy(header, kMagic, 4);
+  header[4] = static_cast<unsigned char>(chunkSize >> 24);
+  header[5] = static_cast<unsigned char>(chunkSize >> 16);
+  header[6] = static_cast<unsigned char>(chunkSize >> 8);
+  header[7] = static_cast<unsigned char>(chunkSize);
+  PutU64(header + 8, len);
+
+  unsigned char derived[kDerivedSize];
+  if (salt) {
+    std::memcpy(header + 16, salt, 16);
+  }
+  else if (!SecureRandom::Fill(header + 16, 16)) {
+    return false;
+  }
+  if (!DeriveAttachmentKeys(key, header + 16, derived)) {
+    return false;
+  }
+
+  unsigned char mac[32];
+  CryptoHelper::HMACSHA256(derived + 32, 32, header, kSignedHeaderSize, mac);
+  std::memcpy(header + kSignedHeaderSize, mac, 16);
+  uint32_t prefix = GetU32(derived + 64);
+
+  // Un solo contexto: por bloque solo cambia el nonce
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  bool ok = EVP_EncryptInit_ex(ctx, AlgorithmCache::AES256GCM(), nullptr, derived, nullptr) == 1;
+  OPENSSL_cleanse(derived, sizeof(derived));
+
+  unsigned char* cursor = out + AttachmentFormat::kHeaderSize;
+  uint64_t chunks = ChunkCount(len, chunkSize);
+  for (uint64_t i = 0; ok && i < chunks; ++i) {
+    size_t chunkLen = static_cast<size_t>(std::min<uint64_t>(chunkSize, len - i * chunkSize));
+    unsigned char nonce[NonceSequence::kNonceSize];
+    NonceSequence::Build(prefix, i, nonce);
+
+    int outLen = 0;
+    ok = EVP_EncryptInit_ex(ctx, nullptr, nullptr, nullptr, nonce) == 1 &&
+         EVP_EncryptUpdate(ctx, nullptr, &outLen, header,
+                           static_cast<int>(kSignedHeaderSize)) == 1 &&
+         EVP_EncryptUpdate(ctx, cursor, &outLen, data + i * chunkSize,
+                           static_cast<int>(chunkLen)) == 1 &&
+         EVP_EncryptFinal_ex(ctx, cursor + outLen, &outLen) == 1 &&
+         EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG,
+                             static_cast<int>(AttachmentFormat::kTagSize),
+                             cursor + chunkLen) == 1;
+    cursor += chunkLen + AttachmentFormat::kTagSize;
+  }
+  EVP_CIPHER_CTX_free(ctx);
+  return ok;
+}
+
+AttachmentReader::AttachmentReader()
+  : m_ctx(EVP_CIPHER_CTX_new()) {
+}
+
+AttachmentReader::~AttachmentReader() {
+  OPENSSL_cleanse(m_chunk.data(), m_chunk.size());
+  EVP_CIPHER_CTX_free(m_ctx);
+}
+
+bool
+AttachmentReader::Open(const unsigned char key[32], const std::string& path) {
+  if (!m_file.Open(path)) {
+    return false;
+  }
+  return Attach(key, m_file.Data(), m_file.Size());
+}
+
+bool
+AttachmentReader::OpenBuffer(const unsigned char key[32], const unsigned char* data, size_t len) {
+  m_file.Close();
+  return Attach(key, data, len);
+}
+
+bool
+AttachmentReader::Attach(const unsigned char key[32], const unsigned char* data, uint64_t len) {
+  m_ok = false;
+  if (!data || len < AttachmentFormat::kHeaderSize || std::memcmp(data, kMagic, 4) != 0) {
+    return false;
+  }
+
+  size_t chunkSize = GetU32(data + 4);
+  uint64_t plainSize = GetU64(data + 8);
+  if (chunkSize == 0 || chunkSize > AttachmentFormat::kMaxChunkSize || plainSize > len ||
+      AttachmentWriter::EncryptedSize(plainSize, chunkSize) != len) {
+    return false;
+  }
+
+  unsigned char derived[kDerivedSize];
+  if (!DeriveAttachmentKeys(key, data + 16, derived)) {
+    return false;
+  }
+  unsigned char mac[32];
+  CryptoHelper::HMACSHA256(derived + 32, 32, data, kSignedHeaderSize, mac);
+  bool ok = CRYPTO_memcmp(mac, data + kSignedHeaderSize, 16) == 0 &&
+            EVP_DecryptInit_ex(m_ctx, AlgorithmCache::AES256GCM(), nullptr, derived,
+                               nullptr) == 1;
+  m_noncePrefix = GetU32(derived + 64);
+  OPENSSL_cleanse(derived, sizeof(derived));
+  if (!ok) {
+    return false;
+  }
+
+  std::memcpy(m_header, data, AttachmentFormat::kHeaderSize);
+  m_data = data;
+  m_chunkSize = chunkSize;
+  m_plainSize = plainSize;
+  m_chunkCount = ChunkCount(plainSize, chunkSize);
+  m_ok = true;
+  return true;
+}
+
+bool
+AttachmentReader::OpenChunk(uint64_t index, unsigned char* out, size_t& outLen) {
+  size_t chunkLen = static_cast<size_t>(
+    std::min<uint64_t>(m_chunkSize, m_plainSize - index * m_chunkSize));
+  const unsigned char* record = m_data + AttachmentFormat::kHeaderSize +
+                                index * (m_chunkSize + AttachmentFormat::kTagSize);
+
+  unsigned char nonce[NonceSequence::kNonceSize];
+  NonceSequence::Build(m_noncePrefix, index, nonce);
+
+  // El tag se copia: la vista proyectada es de solo lectura
+  unsigned char tag[AttachmentFormat::kTagSize];
+  std::memcpy(tag, record + chunkLen, sizeof(tag));
+
+  int len = 0;
+  int finalLen = 0;
+  bool ok = EVP_DecryptInit_ex(m_ctx, nullptr, nullptr, nullptr, nonce) == 1 &&
+            EVP_DecryptUpdate(m_ctx, nullptr, &len, m_header,
+                              static_cast<int>(kSignedHeaderSize)) == 1 &&
+            EVP_DecryptUpdate(m_ctx, out, &len, record, static_cast<int>(chunkLen)) == 1 &&
+            EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_GCM_SET_TAG, sizeof(tag), tag) == 1 &&
+            EVP_DecryptFinal_ex(m_ctx, out + len, &finalLen) == 1;
+  if (!ok) {
+    OPENSSL_cleanse(out, chunkLen);
+    return false;
+  }
+  outLen = chunkLen;
+  return true;
+}
+
+bool
+AttachmentReader::Read(uint64_t offset, size_t len, std::vector<unsigned char>& out) {
+  out.clear();
+  if (!m_ok || offset > m_plainSize) {
+    return false;
+  }
+  len = static_cast<size_t>(std::min<uint64_t>(len, m_plainSize - offset));
+  if (len == 0) {
+    return true;
+  }
+  out.resize(len);
+
+  uint64_t first = offset / m_chunkSize;
+  uint64_t last = (offset + len - 1) / m_chunkSize;
+  size_t written = 0;
+  for (uint64_t index = first; index <= last; ++index) {
+    uint64_t chunkStart = index * m_chunkSize;
+    size_t skip = static_cast<size_t>(offset + written - chunkStart);
+    size_t chunkLen = 0;
+
+    // Los bloques cubiertos enteros se descifran directamente en la salida
+    if (skip == 0 && len - written >= std::min<uint64_t>(m_chunkSize, m_plainSize - chunkStart)) {
+      if (!OpenChunk(index, out.data() + written, chunkLen)) {
+        OPENSSL_cleanse(out.data(), out.size());
+        out.clear();
+        return false;
+      }
+      written += chunkLen;
+      continue;
+    }
+
+    m_chunk.resize(m_chunkSize);
+    if (!OpenChunk(index, m_chunk.data(), chunkLen)) {
+      OPENSSL_cleanse(out.data(), out.size());
+      out.clear();
+      return false;
+    }
+    size_t take = std::min(chunkLen - skip, len - written);
+    std::memcpy(out.data() + written, m_chunk.data() + skip, take);
+    OPENSSL_cleanse(m_chunk.data(), chunkLen);
+    written += take;
+  }
+  return true;
+}
@@ -0,0 +1,2026 @@
+#include "Benchmark.h"
+#include "AttachmentCipher.h"
+#include "BlobStore.h"
+#include "CryptoHelper.h"
+#include "GroupSession.h"
+#include "HybridKeyExchange.h"
+#include "MultiHash.h"
+#include "Server.h"
+#include "WorkStealingScheduler.h"
+#include "QueueWaiter.h"
+#include "RoutingTable.h"
+#include "OfflineStore.h"
+#include "ReliableChannel.h"
+#include "RateLimiter.h"
+#include "AdmissionControl.h"
+#include "FrameCodec.h"
+#include "AlgorithmCache.h"
+#include "HashRing.h"
+#include "openssl/rand.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <functional>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <unordered_map>
+
+namespace {
+  using Clock = std::chrono::steady_clock;
+
+  const auto kDuration = std::chrono::milliseconds(1000);
+  const size_t kMessageSize = 256;
+
+  // Ejecuta body en threads hilos durante kDuration y devuelve operaciones/segundo
+  double
+  RunThreads(int threads, const std::function<uint64_t(const std::atomic<bool>&)>& body) {
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> total(0);
+    std::vector<std::thread> workers;
+
+    auto start = Clock::now();
+    for (int i = 0; i < threads; ++i) {
+      workers.emplace_back([&]() { total += body(stop); });
+    }
+    std::this_thread::sleep_for(kDuration);
+    stop = true;
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return total.load() / seconds;
+  }
+
+  // 1, 2, 4, ... y siempre maxThreads como ultima fila
+  std::vector<int>
+  ThreadSteps(int maxThreads) {
+    std::vector<int> steps;
+    for (int threads = 1; threads < maxThreads; threads *= 2) {
+      steps.push_back(threads);
+    }
+    steps.push_back(maxThreads);
+    return steps;
+  }
+
+  // Todos los clientes del benchmark salen de 127.0.0.1: sin limites de entrada
+  RateLimiter::Limits
+  Unlimited() {
+    RateLimiter::Limits limits;
+    limits.connection = RateLimit();
+    limits.address = RateLimit();
+    return limits;
+  }
+}
+
+int
+Benchmark::Run(int argc, char* argv[]) {
+  std::string name = argc > 2 ? argv[2] : "";
+  int threads = argc > 3 ? std::atoi(argv[3]) : 0;
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  if (name == "aead") {
+    AEADScaling(threads);
+    return 0;
+  }
+  if (name == "handshake") {
+    return Handshake(argc > 3 ? std::atoi(argv[3]) : 200) ? 0 : 1;
+  }
+  if (name == "server") {
+    ServerScaling(threads);
+    return 0;
+  }
+  if (name == "steal") {
+    SkewedScheduling(threads);
+    return 0;
+  }
+  if (name == "routes") {
+    RouteLookups(threads);
+    return 0;
+  }
+  if (name == "queue") {
+    QueueHandoff(argc > 3 ? std::atoi(argv[3]) : 64);
+    return 0;
+  }
+  if (name == "rooms") {
+    RoomFanOut(argc > 3 ? std::atoi(argv[3]) : 256);
+    return 0;
+  }
+  if (name == "attachments") {
+    return AttachmentReads(argc > 3 ? std::atoi(argv[3]) : 64) ? 0 : 1;
+  }
+  if (name == "blobs") {
+    return BlobDedup(argc > 3 ? std::atoi(argv[3]) : 16) ? 0 : 1;
+  }
+  if (name == "group") {
+    return GroupFanOut(argc > 3 ? std::atoi(argv[3]) : 256) ? 0 : 1;
+  }
+  if (name == "offline") {
+    OfflineThroughput(threads);
+    return 0;
+  }
+  if (name == "admission") {
+    AdmissionTrace();
+    return 0;
+  }
+  if (name == "limits") {
+    RateLimiting(threads);
+    return 0;
+  }
+  if (name == "restart") {
+    return RestartHandoff(argc > 3 ? std::atoi(argv[3]) : 32) ? 0 : 1;
+  }
+  if (name == "cluster") {
+    return ClusterSharding(argc > 3 ? std::atoi(argv[3]) : 48) ? 0 : 1;
+  }
+  if (name == "hash") {
+    BatchHash(argc > 3 ? std::atoi(argv[3]) : 4096);
+    return 0;
+  }
+
+  std::cerr << "Unknown benchmark: " << name << std::endl;
+  std::cerr << "Available: admission, aead, attachments, blobs, cluster, group, handshake, hash, limits, offline, queue, restart, rooms, routes, server, steal" << std::endl;
+  return 1;
+}
+
+void
+Benchmark::AEADScaling(int maxThreads) {
+  std::string payload(kMessageSize, 'x');
+  std::cout << "threads  counter-nonce msg/s  rand-iv msg/s  counter speedup vs 1 thread" << std::endl;
+
+  double base = 0;
+  for (int threads : ThreadSteps(maxThreads)) {
+    double counter = RunThreads(threads, [&](const std::atomic<bool>& stop) {
+      CryptoHelper session;
+      session.GenerateAESKey();
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        session.AEADEncrypt(payload);
+        ++count;
+      }
+      return count;
+    });
+
+    double randomIV = RunThreads(threads, [&](const std::atomic<bool>& stop) {
+      unsigned char key[32];
+      unsigned char iv[12];
+      RAND_bytes(key, sizeof(key));
+      std::vector<unsigned char> out;
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        RAND_bytes(iv, sizeof(iv));
+        CryptoHelper::AESGCMEncrypt(key, iv, sizeof(iv), nullptr, 0,
+                                    reinterpret_cast<const unsigned char*>(payload.data()),
+                                    payload.size(), out);
+        ++count;
+      }
+      return count;
+    });
+
+    if (threads == 1) {
+      base = counter;
+    }
+    std::cout << threads << "\t " << static_cast<uint64_t>(counter)
+              << "\t\t      " << static_cast<uint64_t>(randomIV)
+              << "\t     " << (base > 0 ? counter / base : 0) << "x" << std::endl;
+  }
+}
+
+namespace {
+  struct HandshakeStats {
+    double latencyUs = 0;   // Tiempo real por handshake
+    double cpuUs = 0;       // CPU de proceso por handshake
+    size_t wireBytes = 0;   // Bytes de handshake en ambas direcciones
+  };
+
+  HandshakeStats
+  MeasureHandshake(int iterations, const std::function<size_t()>& handshake) {
+    HandshakeStats stats;
+    std::clock_t cpuStart = std::clock();
+    auto start = Clock::now();
+    for (int i = 0; i < iterations; ++i) {
+      stats.wireBytes = handshake();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    stats.latencyUs = seconds * 1e6 / iterations;
+    stats.cpuUs = double(std::clock() - cpuStart) * 1e6 / CLOCKS_PER_SEC / iterations;
+    return stats;
+  }
+
+  void
+  PrintHandshake(const char* name, const HandshakeStats& stats) {
+    std::cout << name << "\t" << stats.latencyUs << " us\t" << stats.cpuUs << " us\t"
+              << stats.wireBytes << " B\t" << (stats.latencyUs > 0 ? 1e6 / stats.latencyUs : 0)
+              << " hs/s" << std::endl;
+  }
+}
+
+bool
+Benchmark::Handshake(int iterations) {
+  iterations = std::max(1, iterations);
+
+  // RSA: el servidor tiene un par de claves de larga duracion
+  CryptoHelper server;
+  server.GenerateRSAKeys();
+  const std::vector<unsigned char> serverDER = server.GetPublicKeyDER();
+
+  // Como en ServerKey: DER, que el cliente parsea una vez (PeerKeyCache)
+  HandshakeStats rsa = MeasureHandshake(iterations, [&]() {
+    CryptoHelper client;
+    client.LoadPeerPublicKeyDER(serverDER);
+    client.GenerateAESKey();
+    std::vector<unsigned char> wrapped = client.EncryptAESKeyWithPeer();
+    server.DecryptAESKey(wrapped);
+    return serverDER.size() + wrapped.size();
+  });
+
+  std::cout << "mode\t\tlatency\t\tcpu\t\twire\trate" << std::endl;
+  PrintHandshake("rsa-2048", rsa);
+
+  if (!HybridKeyExchange::IsAvailable()) {
+    std::cout << "hybrid-pq\tML-KEM-768 not available in this OpenSSL build" << std::endl;
+    return true;
+  }
+
+  bool agreed = true;
+  HandshakeStats hybrid = MeasureHandshake(iterations, [&]() {
+    HybridKeyExchange initiator;
+    HybridKeyExchange responder;
+    unsigned char initiatorSecret[32];
+    unsigned char responderSecret[32];
+    std::vector<unsigned char> response;
+
+    initiator.GenerateKeyPair();
+    std::vector<unsigned char> share = initiator.GetPublicShare();
+    agreed &= responder.Encapsulate(share, response, responderSecret) &&
+              initiator.Decapsulate(response, initiatorSecret) &&
+              std::memcmp(initiatorSecret, responderSecret, 32) == 0;
+    return share.size() + response.size();
+  });
+  PrintHandshake("hybrid-pq", hybrid);
+
+  // Presupuesto: el modo hibrido no puede bajar la tasa de handshakes de RSA
+  bool withinBudget = agreed && hybrid.cpuUs <= rsa.cpuUs;
+  std::cout << "budget (hybrid cpu <= rsa cpu): " << (withinBudget ? "OK" : "REGRESSION")
+            << std::endl;
+  return withinBudget;
+}
+
+void
+Benchmark::BatchHash(int batch) {
+  const size_t sizes[] = { 32, 64, 128, 256 };
+  const int kRounds = 50;
+  unsigned char key[32];
+  RAND_bytes(key, sizeof(key));
+
+  std::cout << "backend " << MultiHash::Backend() << " (" << MultiHash::Lanes()
+            << " lanes), batch " << batch << std::endl;
+  std::cout << "bytes  SHA-256 EVP MB/s  multi MB/s  speedup  HMAC EVP MB/s  multi MB/s  speedup"
+            << std::endl;
+
+  for (size_t size : sizes) {
+    std::vector<unsigned char> data(size * batch);
+    RAND_bytes(data.data(), static_cast<int>(data.size()));
+    std::vector<MultiHash::Input> inputs(batch);
+    for (int i = 0; i < batch; ++i) {
+      inputs[i] = { data.data() + i * size, size };
+    }
+    std::vector<unsigned char[32]> out(batch);
+    double megabytes = double(data.size()) * kRounds / (1024.0 * 1024.0);
+
+    auto measure = [&](const std::function<void()>& body) {
+      auto start = Clock::now();
+      for (int round = 0; round < kRounds; ++round) {
+        body();
+      }
+      return megabytes / std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    const EVP_MD* sha256 = AlgorithmCache::SHA256();
+    double shaEVP = measure([&]() {
+      for (int i = 0; i < batch; ++i) {
+        EVP_Digest(inputs[i].data, size, out[i], nullptr, sha256, nullptr);
+      }
+    });
+    double shaMulti = measure([&]() { MultiHash::SHA256(inputs.data(), batch, out.data()); });
+    double hmacEVP = measure([&]() {
+      for (int i = 0; i < batch; ++i) {
+        CryptoHelper::HMACSHA256(key, sizeof(key), inputs[i].data, size, out[i]);
+      }
+    });
+    double hmacMulti = measure([&]() {
+      MultiHash::HMACSHA256(key, sizeof(key), inputs.data(), batch, out.data());
+    });
+
+    std::cout << size << "\t " << static_cast<uint64_t>(shaEVP)
+              << "\t\t    " << static_cast<uint64_t>(shaMulti)
+              << "\t\t" << shaMulti / shaEVP << "x"
+              << "\t " << static_cast<uint64_t>(hmacEVP)
+              << "\t\t" << static_cast<uint64_t>(hmacMulti)
+              << "\t    " << hmacMulti / hmacEVP << "x" << std::endl;
+  }
+}
+
+bool
+Benchmark::AttachmentReads(int megabytes) {
+  const std::string kDirectory = "bench-attachments";
+  const size_t kChunk = AttachmentFormat::kDefaultChunkSize;
+  const int kReads = 2000;
+  // Un bloque final parcial: el tamano no es multiplo del bloque
+  size_t size = std::max(1, megabytes) * size_t(1024 * 1024) + 12345;
+
+  std::filesystem::remove_all(kDirectory);
+  std::filesystem::create_directories(kDirectory);
+  const std::string plainPath = kDirectory + "/plain";
+  const std::string sealedPath = kDirectory + "/sealed";
+  std::vector<unsigned char> plain(size);
+  RAND_bytes(plain.data(), static_cast<int>(plain.size()));
+  {
+    std::ofstream file(plainPath, std::ios::binary);
+    file.write(reinterpret_cast<const char*>(plain.data()), plain.size());
+  }
+  unsigned char key[32];
+  RAND_bytes(key, sizeof(key));
+
+  bool ok = true;
+  auto check = [&](const char* what, bool passed) {
+    std::cout << (passed ? "ok    " : "FAILED") << "  " << what << std::endl;
+    ok = ok && passed;
+  };
+  auto seconds = [](Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+  };
+
+  // El lector proyecta el fichero: se cierra antes de borrar el directorio
+  double encryptSeconds = 0;
+  double rangeUs = 0;
+  double wholeUs = 0;
+  size_t readBytes = 0;
+  std::vector<unsigned char> out;
+  {
+    auto start = Clock::now();
+    bool encrypted = AttachmentWriter::EncryptFile(key, plainPath, sealedPath, kChunk);
+    encryptSeconds = seconds(start);
+    check("encrypt file", encrypted);
+    AttachmentReader reader;
+    check("open", encrypted && reader.Open(key, sealedPath) && reader.Size() == size);
+
+    // Rangos de 1 byte a 3 bloques en posiciones cualquiera: cruzan fronteras
+    std::mt19937_64 random(42);
+    bool matches = ok;
+    start = Clock::now();
+    for (int i = 0; i < kReads && matches; ++i) {
+      uint64_t offset = random() % size;
+      size_t len = 1 + random() % (3 * kChunk);
+      matches = reader.Read(offset, len, out) &&
+                out.size() == std::min<uint64_t>(len, size - offset) &&
+                std::memcmp(out.data(), plain.data() + offset, out.size()) == 0;
+      readBytes += out.size();
+    }
+    rangeUs = seconds(start) * 1e6 / kReads;
+    check("unaligned range reads match the plaintext", matches);
+    check("range across the last chunk boundary",
+          reader.Read(size - kChunk / 2 - 7, kChunk, out) &&
+          out.size() == kChunk / 2 + 7 &&
+          std::memcmp(out.data(), plain.data() + size - out.size(), out.size()) == 0);
+    start = Clock::now();
+    check("whole file read", reader.Read(0, size, out) && out == plain);
+    wholeUs = seconds(start) * 1e6;
+  }
+
+  std::vector<unsigned char> sealed;
+  check("buffer encrypt", AttachmentWriter::Encrypt(key, plain.data(), size, sealed, kChunk));
+  std::vector<unsigned char> tampered = sealed;
+  size_t chunkRecord = kChunk + AttachmentFormat::kTagSize;
+  tampered[AttachmentFormat::kHeaderSize + 2 * chunkRecord + 100] ^= 0x01;
+  AttachmentReader damaged;
+  check("flipped chunk byte is rejected",
+        damaged.OpenBuffer(key, tampered.data(), tampered.size()) &&
+        !damaged.Read(2 * kChunk + 50, 100, out) && damaged.Read(0, kChunk, out));
+  tampered = sealed;
+  tampered[20] ^= 0x01;   // Salt
+  check("flipped header byte is rejected",
+        !damaged.OpenBuffer(key, tampered.data(), tampered.size()));
+  check("truncated file is rejected",
+        !damaged.OpenBuffer(key, sealed.data(), sealed.size() - chunkRecord));
+  tampered.assign(sealed.begin(), sealed.end() - chunkRecord);
+  uint64_t shorter = size - (size - 1) % kChunk - 1;   // Sin el ultimo bloque
+  for (int i = 0; i < 8; ++i) {
+    tampered[8 + i] = static_cast<unsigned char>(shorter >> (56 - 8 * i));
+  }
+  check("truncated file with a rewritten size is rejected",
+        !damaged.OpenBuffer(key, tampered.data(), tampered.size()));
+  unsigned char wrongKey[32];
+  RAND_bytes(wrongKey, sizeof(wrongKey));
+  check("wrong key is rejected", !damaged.OpenBuffer(wrongKey, sealed.data(), sealed.size()));
+
+  unsigned char domain[32];
+  unsigned char otherDomain[32];
+  RAND_bytes(domain, sizeof(domain));
+  RAND_bytes(otherDomain, sizeof(otherDomain));
+  std::vector<unsigned char> first;
+  std::vector<unsigned char> second;
+  std::vector<unsigned char> other;
+  unsigned char firstKey[32];
+  unsigned char secondKey[32];
+  unsigned char otherKey[32];
+  bool convergent =
+    AttachmentWriter::EncryptConvergent(domain, plain.data(), size, first, firstKey, kChunk) &&
+    AttachmentWriter::EncryptConvergent(domain, plain.data(), size, second, secondKey, kChunk) &&
+    AttachmentWriter::EncryptConvergent(otherDomain, plain.data(), size, other, otherKey, kChunk);
+  check("convergent: same content and domain, same blob",
+        convergent && first == second && std::memcmp(firstKey, secondKey, 32) == 0);
+  check("convergent: other domain, other blob", convergent && first != other);
+  check("convergent blob opens with its key",
+        convergent && damaged.OpenBuffer(firstKey, first.data(), first.size()) &&
+        damaged.Read(kChunk - 3, 6, out) && std::memcmp(out.data(), plain.data() + kChunk - 3, 6) == 0);
+
+  std::cout << "size " << size / (1024 * 1024) << " MiB, chunk " << kChunk / 1024 << " KiB" << std::endl;
+  std::cout << "encrypt file: " << size / (1024.0 * 1024.0) / encryptSeconds << " MB/s" << std::endl;
+  std::cout << "range read (avg " << readBytes / kReads << " B): " << rangeUs
+            << " us   whole file: " << wholeUs << " us" << std::endl;
+  OPENSSL_cleanse(key, sizeof(key));
+  std::filesystem::remove_all(kDirectory);
+  return ok;
+}
+
+namespace {
+  // Cliente bloqueante minimo del protocolo de Server, solo para medir
+  class
+  BenchClient {
+  public:
+    ~BenchClient() {
+      if (m_socket != INVALID_SOCKET) {
+        closesocket(m_socket);
+      }
+    }
+
+    bool
+    Connect(int port, const std::string& user) {
+      m_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+      sockaddr_in address{};
+      address.sin_family = AF_INET;
+      address.sin_port = htons(static_cast<u_short>(port));
+      address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+      if (connect(m_socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+        return false;
+      }
+      int noDelay = 1;
+      setsockopt(m_socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay),
+                 sizeof(noDelay));
+
+      unsigned char type = 0;
+      std::vector<unsigned char> body;
+      if (!ReadFrame(type, body) || type != FrameType::ServerKey || body.size() <= kChallengeSize) {
+        return false;
+      }
+      // El DER de un servidor ya visto sale del PeerKeyCache sin parsear
+      if (!m_session.LoadPeerPublicKeyDER(
+            std::vector<unsigned char>(body.begin() + kChallengeSize, body.end()))) {
+        return false;
+      }
+      std::vector<unsigned char> challenge(body.begin(), body.begin() + kChallengeSize);
+      EVP_PKEY* identity = IdentityKey(user);
+      if (!identity) {
+        return false;
+      }
+      // La clave de transporte se envuelve con RSA; la de sesion sale de ella y,
+      // si el servidor elige HybridPQ, del secreto hibrido
+      unsigned char transportKey[32];
+      RAND_bytes(transportKey, sizeof(transportKey));
+      m_session.SetSessionKey(transportKey, true);
+      std::vector<unsigned char> wrapped = m_session.EncryptAESKeyWithPeer();
+      std::vector<unsigned char> offered = HybridKeyExchange::SupportedModes();
+      HybridKeyExchange exchange;
+      bool offersHybrid = offered.front() == static_cast<unsigned char>(HandshakeMode::HybridPQ);
+      if (offersHybrid && !exchange.GenerateKeyPair()) {
+        offered.erase(offered.begin());
+        offersHybrid = false;
+      }
+
+      std::vector<unsigned char> hello(1, static_cast<unsigned char>(user.size()));
+      hello.insert(hello.end(), user.begin(), user.end());
+      size_t publicLen = IdentityRegistry::Key().size();
+      hello.resize(hello.size() + publicLen);
+      EVP_PKEY_get_raw_public_key(identity, hello.data() + hello.size() - publicLen, &publicLen);
+      hello.push_back(static_cast<unsigned char>(offered.size()));
+      hello.insert(hello.end(), offered.begin(), offered.end());
+      hello.push_back(static_cast<unsigned char>(wrapped.size() >> 8));
+      hello.push_back(static_cast<unsigned char>(wrapped.size()));
+      hello.insert(hello.end(), wrapped.begin(), wrapped.end());
+      if (offersHybrid) {
+        std::vector<unsigned char> share = exchange.GetPublicShare();
+        hello.insert(hello.end(), share.begin(), share.end());
+      }
+      bool signedHello = SignHello(identity, challenge, hello);
+      EVP_PKEY_free(identity);
+      bool welcomed = signedHello && WriteFrame(FrameType::Hello, hello) && ReadFrame(type, body) &&
+                      type == FrameType::Welcome && !body.empty() &&
+                      InstallSessionKey(exchange, transportKey, offered, body);
+      OPENSSL_cleanse(transportKey, sizeof(transportKey));
+      if (!welcomed) {
+        return false;
+      }
+      // Despues el Ack de lo que el servidor ya tiene de esta sesion (nada) o,
+      // si el usuario es de otro nodo del cluster, un Redirect: se guarda a donde ir
+      if (!ReadFrame(type, body)) {
+        return false;
+      }
+      if (type == FrameType::Redirect) {
+        std::string address;
+        if (m_session.AEADDecrypt(body, address)) {
+          m_redirect = address;
+        }
+        return false;
+      }
+      if (type != FrameType::Ack) {
+        return false;
+      }
+
+      // A partir de aqui recv vuelve cada 200 ms para poder parar
+#ifdef _WIN32
+      DWORD timeout = 200;
+#else
+      timeval timeout{ 0, 200000 };
+#endif
+      setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout),
+                 sizeof(timeout));
+      return true;
+    }
+
+    bool
+    Send(const std::string& destination, const std::string& payload) {
+      std::string plaintext;
+      uint64_t seq = m_nextSeq++;
+      for (int shift = 56; shift >= 0; shift -= 8) {
+        plaintext.push_back(static_cast<char>(seq >> shift));
+      }
+      plaintext.push_back(static_cast<char>(destination.size()));
+      plaintext += destination;
+      plaintext += payload;
+      return WriteFrame(FrameType::Send, m_session.AEADEncrypt(plaintext));
+    }
+
+    /**
+     * Se une a room y espera su RoomKey (la clave no se usa: el benchmark
+     * cuenta tramas sin abrirlas).
+     */
+    bool
+    Join(const std::string& room) {
+      std::string plaintext(1, static_cast<char>(room.size()));
+      plaintext += room;
+      unsigned char type = 0;
+      std::vector<unsigned char> body;
+      if (!WriteFrame(FrameType::Join, m_session.AEADEncrypt(plaintext))) {
+        return false;
+      }
+      while (ReadFrame(type, body)) {
+        if (type != FrameType::Ack) {
+          return type == FrameType::RoomKey;
+        }
+      }
+      return false;
+    }
+
+    bool
+    Publish(const std::string& room, const std::string& payload) {
+      std::string plaintext(1, static_cast<char>(room.size()));
+      plaintext += room;
+      plaintext += payload;
+      return WriteFrame(FrameType::Publish, m_session.AEADEncrypt(plaintext));
+    }
+
+    SOCKET
+    Socket() const { return m_socket; }
+
+    /**
+     * El servidor cerro la conexion (no un simple plazo de recv vencido).
+     */
+    bool
+    Closed() const { return m_closed; }
+
+    /**
+     * "host:puerto" de un Redirect recibido en Connect; vacio si no hubo.
+     */
+    const std::string&
+    Redirected() const { return m_redirect; }
+
+    /**
+     * Espera un Deliver; los Ack del servidor se saltan y los Deliver se
+     * confirman agrupados, como haria un cliente real.
+     */
+    bool
+    Receive() {
+      unsigned char type = 0;
+      std::vector<unsigned char> body;
+      std::string plaintext;
+      do {
+        if (!ReadFrame(type, body)) {
+          return false;
+        }
+      } while (type == FrameType::Ack);
+      if (type != FrameType::Deliver || !m_session.AEADDecrypt(body, plaintext) ||
+          plaintext.size() < 8) {
+        return false;
+      }
+      uint64_t seq = 0;
+      for (int i = 0; i < 8; ++i) {
+        seq = (seq << 8) | static_cast<unsigned char>(plaintext[i]);
+      }
+      auto now = AckTracker::Clock::now();
+      m_acks.Receive(seq, now);
+      if (m_acks.AckDue(now)) {
+        std::string ack(1, '\x01');
+        m_acks.Encode(ack);
+        return WriteFrame(FrameType::Ack, m_session.AEADEncrypt(ack));
+      }
+      return true;
+    }
+
+    /**
+     * Peticion de blob (BlobPut, BlobRef, BlobRelease o BlobRead) y su
+     * respuesta abierta: [id 32][estado] o [id 32][tamano u64][offset u64]
+     * [datos]. Una peticion cada vez, asi que no hay que emparejar ids.
+     */
+    bool
+    Blob(unsigned char type, const unsigned char* body, size_t len, unsigned char& outType,
+         std::string& outReply) {
+      if (!WriteFrame(type, m_session.AEADEncrypt(body, len))) {
+        return false;
+      }
+      std::vector<unsigned char> frame;
+      auto deadline = Clock::now() + std::chrono::seconds(10);
+      while (!m_closed && Clock::now() < deadline) {
+        if (!ReadFrame(outType, frame) || outType == FrameType::Ack) {
+          continue;
+        }
+        return (outType == FrameType::BlobStatus || outType == FrameType::BlobData) &&
+               m_session.AEADDecrypt(frame, outReply) && outReply.size() > 32;
+      }
+      return false;
+    }
+
+  private:
+    static const size_t kChallengeSize = 32;
+
+    // Siempre la misma clave por usuario: al reconectar coincide con la fijada
+    static EVP_PKEY*
+    IdentityKey(const std::string& user) {
+      std::string label = "bench:" + user;
+      unsigned char seed[32];
+      EVP_Digest(label.data(), label.size(), seed, nullptr, AlgorithmCache::SHA256(), nullptr);
+      return EVP_PKEY_new_raw_private_key(EVP_PKEY_ED25519, nullptr, seed, sizeof(seed));
+    }
+
+    // Anade la firma del reto + hello
+    static bool
+    SignHello(EVP_PKEY* identity, const std::vector<unsigned char>& challenge,
+              std::vector<unsigned char>& hello) {
+      std::vector<unsigned char> signedData(challenge);
+      signedData.insert(signedData.end(), hello.begin(), hello.end());
+      size_t sigLen = IdentityRegistry::kSignatureSize;
+      hello.resize(hello.size() + sigLen);
+      EVP_MD_CTX* md = EVP_MD_CTX_new();
+      bool ok = EVP_DigestSignInit(md, nullptr, nullptr, nullptr, identity) == 1 &&
+                EVP_DigestSign(md, hello.data() + hello.size() - sigLen, &sigLen,
+                               signedData.data(), signedData.size()) == 1;
+      EVP_MD_CTX_free(md);
+      return ok;
+    }
+
+    // welcome: [modo][respuesta hibrida si HybridPQ]
+    bool
+    InstallSessionKey(HybridKeyExchange& exchange, const unsigned char transportKey[32],
+                      const std::vector<unsigned char>& offered,
+                      const std::vector<unsigned char>& welcome) {
+      HandshakeMode mode = static_cast<HandshakeMode>(welcome[0]);
+      unsigned char hybridSecret[32];
+      unsigned char key[32];
+      bool ok = std::find(offered.begin(), offered.end(), welcome[0]) != offered.end();
+      if (ok && mode == HandshakeMode::HybridPQ) {
+        ok = exchange.Decapsulate(std::vector<unsigned char>(welcome.begin() + 1, welcome.end()),
+                                  hybridSecret);
+      }
+      ok = ok && HybridKeyExchange::DeriveSessionKey(mode, transportKey, hybridSecret, offered,
+                                                     key);
+      if (ok) {
+        m_session.SetSessionKey(key, true);
+      }
+      OPENSSL_cleanse(hybridSecret, sizeof(hybridSecret));
+      OPENSSL_cleanse(key, sizeof(key));
+      return ok;
+    }
+
+    bool
+    WriteFrame(unsigned char type, const std::vector<unsigned char>& body) {
+      std::vector<unsigned char> frame;
+      FrameCodec::Append(type, body.data(), body.size(), frame);
+      return send(m_socket, reinterpret_cast<const char*>(frame.data()),
+                  static_cast<int>(frame.size()), 0) == static_cast<int>(frame.size());
+    }
+
+    bool
+    ReadFrame(unsigned char& type, std::vector<unsigned char>& body) {
+      for (;;) {
+        const unsigned char* start = nullptr;
+        size_t len = 0;
+        size_t consumed = 0;
+        FrameCodec::Result result = FrameCodec::Next(m_in.data(), m_in.size(), type, start,
+                                                     len, consumed);
+        if (result == FrameCodec::Result::Invalid) {
+          return false;
+        }
+        if (result == FrameCodec::Result::Frame) {
+          body.assign(start, start + len);
+          m_in.erase(m_in.begin(), m_in.begin() + consumed);
+          return true;
+        }
+        char buffer[16 * 1024];
+        int received = recv(m_socket, buffer, sizeof(buffer), 0);
+        if (received == 0 || (received == SOCKET_ERROR && WSAGetLastError() != WSAEWOULDBLOCK &&
+                              WSAGetLastError() != WSAETIMEDOUT && WSAGetLastError() != WSAEINTR)) {
+          m_closed = true;
+        }
+        if (received <= 0) {
+          return false;
+        }
+        m_in.insert(m_in.end(), buffer, buffer + received);
+      }
+    }
+
+    SOCKET m_socket = INVALID_SOCKET;
+    CryptoHelper m_session;
+    std::vector<unsigned char> m_in;
+    uint64_t m_nextSeq = 1;
+    AckTracker m_acks;
+    bool m_closed = false;
+    std::string m_redirect;
+  };
+
+  // Conecta por el nodo de port y, si el usuario es de otro, sigue el Redirect
+  bool
+  ConnectToOwner(std::unique_ptr<BenchClient>& client, int port, const std::string& user,
+                 int& redirects) {
+    client.reset(new BenchClient());
+    if (client->Connect(port, user)) {
+      return true;
+    }
+    std::string address = client->Redirected();
+    size_t colon = address.rfind(':');
+    if (colon == std::string::npos) {
+      return false;
+    }
+    ++redirects;
+    client.reset(new BenchClient());
+    return client->Connect(std::atoi(address.c_str() + colon + 1), user);
+  }
+}
+
+namespace {
+  // Cuenta tramas de un tipo en muchos sockets a la vez, sin abrirlas
+  uint64_t
+  CountFrames(const std::vector<SOCKET>& sockets, unsigned char type, uint64_t expected) {
+    std::vector<WSAPOLLFD> fds(sockets.size());
+    std::vector<std::vector<unsigned char>> pending(sockets.size());
+    for (size_t i = 0; i < sockets.size(); ++i) {
+      fds[i].fd = sockets[i];
+      fds[i].events = POLLRDNORM;
+    }
+
+    std::vector<char> buffer(64 * 1024);
+    uint64_t count = 0;
+    auto deadline = Clock::now() + std::chrono::seconds(30);
+    while (count < expected && Clock::now() < deadline) {
+      if (WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), 100) <= 0) {
+        continue;
+      }
+      for (size_t i = 0; i < fds.size(); ++i) {
+        if (!fds[i].revents) {
+          continue;
+        }
+        int received = recv(fds[i].fd, buffer.data(), static_cast<int>(buffer.size()), 0);
+        if (received <= 0) {
+          continue;
+        }
+        std::vector<unsigned char>& in = pending[i];
+        in.insert(in.end(), buffer.data(), buffer.data() + received);
+        size_t offset = 0;
+        unsigned char found = 0;
+        const unsigned char* body = nullptr;
+        size_t len = 0;
+        size_t consumed = 0;
+        while (FrameCodec::Next(in.data() + offset, in.size() - offset, found, body, len,
+                                consumed) == FrameCodec::Result::Frame) {
+          count += found == type ? 1 : 0;
+          offset += consumed;
+        }
+        in.erase(in.begin(), in.begin() + offset);
+      }
+    }
+    return count;
+  }
+}
+
+void
+Benchmark::RoomFanOut(int members) {
+  const int kPort = 27250;
+  const int kMessages = 200;
+  const std::string kRoom = "bench";
+  std::string payload(kMessageSize, 'x');
+
+  Server server(kPort, 0, std::string(), Unlimited());
+  if (!server.IsRunning()) {
+    return;
+  }
+
+  // El publicador tambien es miembro: solo un miembro puede publicar
+  BenchClient publisher;
+  std::vector<std::unique_ptr<BenchClient>> clients;
+  std::vector<SOCKET> sockets;
+  if (!publisher.Connect(kPort, "publisher") || !publisher.Join(kRoom)) {
+    std::cerr << "Benchmark client failed to connect" << std::endl;
+    return;
+  }
+  for (int i = 0; i < members; ++i) {
+    clients.emplace_back(new BenchClient());
+    if (!clients.back()->Connect(kPort, "member" + std::to_string(i)) ||
+        !clients.back()->Join(kRoom)) {
+      std::cerr << "Benchmark client failed to connect" << std::endl;
+      return;
+    }
+    sockets.push_back(clients.back()->Socket());
+  }
+
+  std::cout << members << " members, " << kMessages << " messages of " << kMessageSize
+            << " bytes, " << server.Cores() << " cores" << std::endl;
+  std::cout << "mode     deliveries/s  server bytes out/delivery" << std::endl;
+  for (int mode = 0; mode < 2; ++mode) {
+    bool room = mode == 0;
+    uint64_t expected = uint64_t(kMessages) * members;
+    uint64_t bytesBefore = server.GetStats().bytesOut;
+    auto start = Clock::now();
+
+    std::thread sender([&]() {
+      for (int i = 0; i < kMessages; ++i) {
+        if (room) {
+          publisher.Publish(kRoom, payload);
+          continue;
+        }
+        // Sin salas: el emisor cifra y sube una copia por miembro
+        for (int member = 0; member < members; ++member) {
+          publisher.Send("member" + std::to_string(member), payload);
+        }
+      }
+    });
+    uint64_t delivered = CountFrames(sockets, room ? FrameType::RoomDeliver : FrameType::Deliver,
+                                     expected);
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    sender.join();
+
+    uint64_t bytes = server.GetStats().bytesOut - bytesBefore;
+    std::cout << (room ? "room   " : "unicast") << "\t " << static_cast<uint64_t>(delivered / seconds)
+              << "\t       " << (delivered > 0 ? bytes / delivered : 0);
+    if (delivered < expected) {
+      std::cout << "  (" << expected - delivered << " lost)";
+    }
+    std::cout << std::endl;
+  }
+  server.Stop();
+}
+
+bool
+Benchmark::BlobDedup(int clients) {
+  const int kPort = 27270;
+  const int kAttachments = 4;
+  const size_t kAttachmentSize = 1024 * 1024;
+  const uint32_t kReadChunk = 256 * 1024;
+  const std::string kDirectory = "bench-blobs";
+  std::filesystem::remove_all(kDirectory);
+
+  // Todos comparten el dominio (un chat): el mismo adjunto da el mismo blob
+  unsigned char domainKey[32];
+  RAND_bytes(domainKey, sizeof(domainKey));
+  std::vector<std::vector<unsigned char>> plain(kAttachments,
+                                                std::vector<unsigned char>(kAttachmentSize));
+  std::vector<std::vector<unsigned char>> blobs(kAttachments);
+  std::vector<std::array<unsigned char, 32>> keys(kAttachments);
+  std::vector<BlobStore::BlobId> ids(kAttachments);
+  bool ok = true;
+  for (int i = 0; i < kAttachments; ++i) {
+    RAND_bytes(plain[i].data(), static_cast<int>(plain[i].size()));
+    ok = ok && AttachmentWriter::EncryptConvergent(domainKey, plain[i].data(), plain[i].size(),
+                                                   blobs[i], keys[i].data());
+    ids[i] = BlobStore::ComputeId(blobs[i].data(), blobs[i].size());
+  }
+
+  bool served = false;
+  {
+    Server server(kPort, 0, kDirectory, Unlimited());
+    std::vector<std::unique_ptr<BenchClient>> senders;
+    for (int i = 0; ok && server.IsRunning() && i < clients; ++i) {
+      senders.emplace_back(new BenchClient());
+      ok = senders.back()->Connect(kPort, "uploader" + std::to_string(i));
+    }
+    BenchClient reader;
+    ok = ok && server.IsRunning() && reader.Connect(kPort, "reader");
+    if (!ok) {
+      std::cerr << "Benchmark client failed to connect" << std::endl;
+      server.Stop();
+      std::filesystem::remove_all(kDirectory);
+      return false;
+    }
+
+    // Cada cliente comparte los mismos adjuntos a la vez: BlobRef primero y
+    // BlobPut solo si el servidor no lo tiene
+    std::atomic<uint64_t> uploadedBytes(0);
+    std::atomic<uint64_t> puts(0);
+    std::atomic<uint64_t> failures(0);
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int c = 0; c < clients; ++c) {
+      threads.emplace_back([&, c]() {
+        for (int n = 0; n < kAttachments; ++n) {
+          int i = (c + n) % kAttachments;
+          unsigned char type = 0;
+          std::string reply;
+          if (!senders[c]->Blob(FrameType::BlobRef, ids[i].data(), ids[i].size(), type, reply)) {
+            ++failures;
+            continue;
+          }
+          if (static_cast<unsigned char>(reply[32]) != BlobState::Missing) {
+            continue;
+          }
+          ++puts;
+          uploadedBytes += blobs[i].size();
+          if (!senders[c]->Blob(FrameType::BlobPut, blobs[i].data(), blobs[i].size(), type,
+                                reply) ||
+              static_cast<unsigned char>(reply[32]) == BlobState::Failed) {
+            ++failures;
+          }
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    Server::Stats stats = server.GetStats();
+
+    // El destinatario baja un adjunto por rangos y lo abre con su clave
+    std::vector<unsigned char> fetched;
+    uint64_t size = 1;
+    while (ok && fetched.size() < size) {
+      std::vector<unsigned char> request(ids[0].begin(), ids[0].end());
+      for (int shift = 56; shift >= 0; shift -= 8) {
+        request.push_back(static_cast<unsigned char>(uint64_t(fetched.size()) >> shift));
+      }
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        request.push_back(static_cast<unsigned char>(kReadChunk >> shift));
+      }
+      unsigned char type = 0;
+      std::string reply;
+      ok = reader.Blob(FrameType::BlobRead, request.data(), request.size(), type, reply) &&
+           type == FrameType::BlobData && reply.size() > 48;
+      if (ok) {
+        size = 0;
+        for (int b = 32; b < 40; ++b) {
+          size = (size << 8) | static_cast<unsigned char>(reply[b]);
+        }
+        fetched.insert(fetched.end(), reply.begin() + 48, reply.end());
+      }
+    }
+    AttachmentReader attachment;
+    std::vector<unsigned char> opened;
+    bool readBack = ok && attachment.OpenBuffer(keys[0].data(), fetched.data(), fetched.size()) &&
+                    attachment.Read(0, kAttachmentSize, opened) && opened == plain[0];
+
+    // Cada cliente suelta sus referencias; una de mas ya no encuentra nada
+    uint64_t released = 0;
+    for (int c = 0; c < clients; ++c) {
+      for (int i = 0; i < kAttachments; ++i) {
+        unsigned char type = 0;
+        std::string reply;
+        released += senders[c]->Blob(FrameType::BlobRelease, ids[i].data(), ids[i].size(), type,
+                                     reply) &&
+                    static_cast<unsigned char>(reply[32]) == BlobState::Released ? 1 : 0;
+      }
+    }
+    unsigned char type = 0;
+    std::string reply;
+    bool extra = reader.Blob(FrameType::BlobRelease, ids[0].data(), ids[0].size(), type, reply) &&
+                 static_cast<unsigned char>(reply[32]) == BlobState::Missing;
+    uint64_t expected = uint64_t(clients) * kAttachments;
+    served = failures.load() == 0 && readBack && released == expected && extra;
+
+    uint64_t naive = expected * blobs[0].size();
+    std::cout << clients << " clients x " << kAttachments << " attachments of "
+              << kAttachmentSize / 1024 << " KiB, " << server.Cores() << " cores" << std::endl;
+    std::cout << "references: " << expected << "   uploads: " << puts.load()
+              << "   dedup hits: " << stats.blobDedupHits << std::endl;
+    std::cout << "uploaded: " << uploadedBytes.load() / 1024 << " KiB of " << naive / 1024
+              << " KiB naive   written: " << stats.blobBytesIn / 1024 << " KiB   "
+              << static_cast<uint64_t>(expected / seconds) << " references/s" << std::endl;
+    std::cout << "read back by range: " << (readBack ? "ok" : "FAILED")
+              << "   released: " << released << "/" << expected
+              << (extra ? "" : "   (extra release not refused)") << std::endl;
+    server.Stop();
+  }
+  OPENSSL_cleanse(domainKey, sizeof(domainKey));
+  std::filesystem::remove_all(kDirectory);
+  if (!served) {
+    std::cerr << "Blob benchmark failed" << std::endl;
+  }
+  return served;
+}
+
+bool
+Benchmark::GroupFanOut(int maxMembers) {
+  const int kMessages = 200;
+  std::string payload(kMessageSize, 'x');
+  auto perMessage = [&](Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / kMessages;
+  };
+
+  std::cout << "members  pairwise us/msg  sender-key us/msg  pairwise B/msg  sender-key B/msg"
+            << std::endl;
+  bool ok = true;
+  for (int members : ThreadSteps(std::max(2, maxMembers))) {
+    if (members < 2) {
+      continue;
+    }
+    // Pareado: una sesion y un cifrado por cada otro miembro
+    std::vector<std::unique_ptr<CryptoHelper>> sessions(members - 1);
+    for (auto& session : sessions) {
+      session.reset(new CryptoHelper());
+      session->GenerateAESKey();
+    }
+    size_t pairwiseBytes = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < kMessages; ++i) {
+      for (auto& session : sessions) {
+        pairwiseBytes += session->AEADEncrypt(payload).size();
+      }
+    }
+    double pairwise = perMessage(start);
+
+    // Sender key: un cifrado y una firma, el mismo mensaje para todos
+    GroupSession sender("bench", "m0");
+    GroupSession receiver("bench", "m1");
+    sender.CreateSenderKey();
+    ok = receiver.ProcessSenderKeyDistribution("m0", sender.GetSenderKeyDistribution()) && ok;
+    std::vector<unsigned char> message;
+    size_t groupBytes = 0;
+    start = Clock::now();
+    for (int i = 0; i < kMessages; ++i) {
+      message = sender.Encrypt(payload);
+      groupBytes += message.size();
+    }
+    double group = perMessage(start);
+
+    // El ultimo lo abre un miembro, saltando la cadena hasta el
+    std::string from;
+    std::string plaintext;
+    ok = receiver.Decrypt(message, from, plaintext) && from == "m0" && plaintext == payload && ok;
+
+    std::cout << members << "\t " << pairwise << "\t\t  " << group << "\t\t     "
+              << pairwiseBytes / kMessages << "\t\t     " << groupBytes / kMessages << std::endl;
+  }
+  if (!ok) {
+    std::cerr << "Group message did not decrypt" << std::endl;
+  }
+  return ok;
+}
+
+void
+Benchmark::ServerScaling(int maxCores) {
+  const int kBasePort = 27150;
+  const int kClientsPerCore = 4;
+  const int kWindow = 16;   // Mensajes en vuelo por cliente
+  std::string payload(kMessageSize, 'x');
+
+  std::cout << "cores  clients  routed msg/s  speedup vs 1 core  ack bytes" << std::endl;
+  double base = 0;
+  for (int cores : ThreadSteps(maxCores)) {
+    Server server(kBasePort + cores, cores, std::string(), Unlimited());
+    if (!server.IsRunning()) {
+      return;
+    }
+
+    // Los handshakes quedan fuera de la medida
+    int clientCount = cores * kClientsPerCore;
+    std::vector<std::unique_ptr<BenchClient>> clients;
+    for (int i = 0; i < clientCount; ++i) {
+      clients.emplace_back(new BenchClient());
+      if (!clients.back()->Connect(kBasePort + cores, "user" + std::to_string(i))) {
+        std::cerr << "Benchmark client failed to connect" << std::endl;
+        return;
+      }
+    }
+
+    // Parejas (2k, 2k+1) que se reenvian mensajes sin parar
+    std::atomic<int> nextClient(0);
+    double rate = RunThreads(clientCount, [&](const std::atomic<bool>& stop) {
+      int index = nextClient++;
+      BenchClient& client = *clients[index];
+      std::string partner = "user" + std::to_string(index ^ 1);
+      uint64_t count = 0;
+      for (int i = 0; i < kWindow; ++i) {
+        client.Send(partner, payload);
+      }
+      while (!stop.load(std::memory_order_relaxed)) {
+        if (client.Receive()) {
+          ++count;
+          client.Send(partner, payload);
+        }
+      }
+      return count;
+    });
+
+    if (cores == 1) {
+      base = rate;
+    }
+    // Acks en ambos sentidos frente a todo el trafico del servidor
+    Server::Stats stats = server.GetStats();
+    double traffic = double(stats.bytesIn + stats.bytesOut);
+    std::cout << cores << "\t" << clientCount << "\t " << static_cast<uint64_t>(rate)
+              << "\t       " << (base > 0 ? rate / base : 0) << "x"
+              << "\t\t    " << (traffic > 0 ? 100.0 * stats.ackBytes / traffic : 0) << "%"
+              << std::endl;
+    clients.clear();
+    server.Stop();
+  }
+}
+
+namespace {
+  // Pool clasico con una sola cola y un mutex: la referencia del benchmark
+  class
+  SharedQueuePool {
+  public:
+    explicit
+    SharedQueuePool(size_t threads) {
+      for (size_t i = 0; i < threads; ++i) {
+        m_workers.emplace_back([this]() {
+          for (;;) {
+            std::function<void()> task;
+            {
+              std::unique_lock<std::mutex> lock(m_lock);
+              m_ready.wait(lock, [this]() { return m_stop || !m_tasks.empty(); });
+              if (m_tasks.empty()) {
+                return;
+              }
+              task = std::move(m_tasks.front());
+              m_tasks.pop_front();
+            }
+            task();
+          }
+        });
+      }
+    }
+
+    ~SharedQueuePool() {
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_stop = true;
+      }
+      m_ready.notify_all();
+      for (auto& worker : m_workers) {
+        worker.join();
+      }
+    }
+
+    bool
+    Submit(std::function<void()> task) {
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        m_tasks.push_back(std::move(task));
+      }
+      m_ready.notify_one();
+      return true;
+    }
+
+  private:
+    std::mutex m_lock;
+    std::condition_variable m_ready;
+    std::deque<std::function<void()>> m_tasks;
+    std::vector<std::thread> m_workers;
+    bool m_stop = false;
+  };
+
+  struct SkewReport {
+    std::vector<double> shortUs;   // Encolar -> terminar, tareas cortas
+    std::vector<double> fanOutUs;  // Encolar -> ultima subtarea terminada
+    double seconds = 0;
+    uint64_t tasks = 0;
+  };
+
+  /**
+   * Cada productor (un loop del servidor) encola rafagas de HMAC de 256 bytes;
+   * el productor 0 ademas encola cada pocas rafagas una tarea de grupo que
+   * lanza kFanOut HMAC de 16 KiB. El trabajo pesado nace siempre en el mismo
+   * sitio: es el caso que desequilibra a los workers.
+   */
+  template<typename Pool>
+  SkewReport
+  RunSkewed(Pool& pool, int producers) {
+    static const int kRounds = 400;
+    static const int kBatch = 32;
+    static const int kFanOutEvery = 4;
+    static const int kFanOut = 64;
+    static const int kMaxOutstanding = 4 * kBatch;
+
+    static unsigned char key[32];
+    static std::vector<unsigned char> small(256, 0x5a);
+    static std::vector<unsigned char> large(16 * 1024, 0xa5);
+
+    SkewReport report;
+    std::vector<std::vector<double>> shortUs(producers);
+    std::vector<double> fanOutUs(kRounds / kFanOutEvery);
+    std::unique_ptr<std::atomic<int>[]> outstanding(new std::atomic<int>[producers]);
+    std::atomic<uint64_t> tasks(0);
+    for (int i = 0; i < producers; ++i) {
+      outstanding[i].store(0);
+      shortUs[i].resize(kRounds * kBatch);
+    }
+
+    auto start = Clock::now();
+    std::vector<std::thread> threads;
+    for (int producer = 0; producer < producers; ++producer) {
+      threads.emplace_back([&, producer]() {
+        std::atomic<int>& pending = outstanding[producer];
+        for (int round = 0; round < kRounds; ++round) {
+          while (pending.load(std::memory_order_acquire) > kMaxOutstanding) {
+            std::this_thread::yield();
+          }
+
+          if (producer == 0 && round % kFanOutEvery == 0) {
+            double* slot = &fanOutUs[round / kFanOutEvery];
+            auto submitted = Clock::now();
+            pending.fetch_add(1, std::memory_order_relaxed);
+            pool.Submit([&pool, &pending, &tasks, slot, submitted]() {
+              auto remaining = std::make_shared<std::atomic<int>>(kFanOut);
+              for (int i = 0; i < kFanOut; ++i) {
+                pool.Submit([&pending, &tasks, slot, submitted, remaining]() {
+                  unsigned char mac[32];
+                  CryptoHelper::HMACSHA256(key, sizeof(key), large.data(), large.size(), mac);
+                  tasks.fetch_add(1, std::memory_order_relaxed);
+                  if (remaining->fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                    *slot = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+                    pending.fetch_sub(1, std::memory_order_release);
+                  }
+                });
+              }
+            });
+          }
+
+          for (int i = 0; i < kBatch; ++i) {
+            double* slot = &shortUs[producer][round * kBatch + i];
+            auto submitted = Clock::now();
+            pending.fetch_add(1, std::memory_order_relaxed);
+            pool.Submit([&pending, &tasks, slot, submitted]() {
+              unsigned char mac[32];
+              CryptoHelper::HMACSHA256(key, sizeof(key), small.data(), small.size(), mac);
+              tasks.fetch_add(1, std::memory_order_relaxed);
+              *slot = std::chrono::duration<double, std::micro>(Clock::now() - submitted).count();
+              pending.fetch_sub(1, std::memory_order_release);
+            });
+          }
+        }
+        while (pending.load(std::memory_order_acquire) > 0) {
+          std::this_thread::yield();
+        }
+      });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    report.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    report.tasks = tasks.load();
+    for (auto& latencies : shortUs) {
+      report.shortUs.insert(report.shortUs.end(), latencies.begin(), latencies.end());
+    }
+    report.fanOutUs = std::move(fanOutUs);
+    std::sort(report.shortUs.begin(), report.shortUs.end());
+    std::sort(report.fanOutUs.begin(), report.fanOutUs.end());
+    return report;
+  }
+
+  double
+  Percentile(const std::vector<double>& sorted, double fraction) {
+    if (sorted.empty()) {
+      return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted.size() - 1));
+    return sorted[index];
+  }
+
+  void
+  PrintSkew(const char* name, const SkewReport& report) {
+    std::cout << name
+              << "\t" << static_cast<uint64_t>(Percentile(report.shortUs, 0.50))
+              << "\t" << static_cast<uint64_t>(Percentile(report.shortUs, 0.99))
+              << "\t" << static_cast<uint64_t>(Percentile(report.shortUs, 0.999))
+              << "\t  " << static_cast<uint64_t>(Percentile(report.fanOutUs, 0.50))
+              << "\t  " << static_cast<uint64_t>(Percentile(report.fanOutUs, 0.99))
+              << "\t  " << static_cast<uint64_t>(report.tasks / report.seconds) << std::endl;
+  }
+}
+
+void
+Benchmark::SkewedScheduling(int threads) {
+  int producers = std::max(1, threads / 2);
+  std::cout << threads << " workers, " << producers << " producers" << std::endl;
+  std::cout << "scheduler\tshort us p50\tp99\tp99.9\t  fan-out us p50  p99\t  tasks/s"
+            << std::endl;
+
+  {
+    SharedQueuePool pool(threads);
+    PrintSkew("shared queue", RunSkewed(pool, producers));
+  }
+  {
+    WorkStealingScheduler scheduler(threads);
+    PrintSkew("work stealing", RunSkewed(scheduler, producers));
+    WorkStealingScheduler::Stats stats = scheduler.GetStats();
+    std::cout << "stolen " << stats.stolen << " of " << stats.executed << " tasks" << std::endl;
+  }
+}
+
+namespace {
+  const size_t kHandoffDepth = 64 * 1024;
+  const size_t kHandoffBatch = 16;    // Elementos por push de productor
+  const size_t kHandoffDrain = 256;   // Maximo por pop del consumidor
+  const auto kHandoffDuration = std::chrono::milliseconds(250);
+
+  // Cola con mutex y variable de condicion: la referencia del benchmark
+  class
+  MutexQueue {
+  public:
+    bool
+    PushBatch(const uint64_t* values, size_t count) {
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        if (m_items.size() + count > kHandoffDepth) {
+          return false;
+        }
+        m_items.insert(m_items.end(), values, values + count);
+      }
+      m_ready.notify_one();
+      return true;
+    }
+
+    size_t
+    PopBatch(uint64_t* out, size_t max, const std::atomic<bool>& stop) {
+      std::unique_lock<std::mutex> lock(m_lock);
+      m_ready.wait(lock, [&]() { return !m_items.empty() || stop.load(); });
+      size_t popped = 0;
+      while (popped < max && !m_items.empty()) {
+        out[popped++] = m_items.front();
+        m_items.pop_front();
+      }
+      return popped;
+    }
+
+    void
+    WakeAll() {
+      std::lock_guard<std::mutex> guard(m_lock);
+      m_ready.notify_all();
+    }
+
+  private:
+    std::mutex m_lock;
+    std::condition_variable m_ready;
+    std::deque<uint64_t> m_items;
+  };
+
+  /**
+   * producers hilos llaman a push(valores, n) sin parar y un consumidor a
+   * pop(salida, max, stop); wake despierta al consumidor al final.
+   * @return Elementos consumidos por segundo.
+   */
+  template<typename Push, typename Pop, typename Wake>
+  double
+  MeasureHandoff(int producers, Push push, Pop pop, Wake wake) {
+    std::atomic<bool> stop(false);
+    uint64_t consumed = 0;
+
+    std::thread consumer([&]() {
+      uint64_t out[kHandoffDrain];
+      while (!stop.load(std::memory_order_relaxed)) {
+        consumed += pop(out, kHandoffDrain, stop);
+      }
+    });
+
+    std::vector<std::thread> threads;
+    auto start = Clock::now();
+    for (int producer = 0; producer < producers; ++producer) {
+      threads.emplace_back([&, producer]() {
+        uint64_t values[kHandoffBatch];
+        for (size_t i = 0; i < kHandoffBatch; ++i) {
+          values[i] = (uint64_t(producer) << 32) | i;
+        }
+        while (!stop.load(std::memory_order_relaxed)) {
+          if (!push(values, kHandoffBatch)) {
+            std::this_thread::yield();  // Llena: el consumidor no da abasto
+          }
+        }
+      });
+    }
+    std::this_thread::sleep_for(kHandoffDuration);
+    stop = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    wake();
+    consumer.join();
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    return consumed / seconds;
+  }
+
+  double
+  MeasureMPSC(int producers, WaitStrategy strategy) {
+    MPSCQueue<uint64_t> queue(kHandoffDepth);
+    QueueWaiter waiter(strategy);
+    return MeasureHandoff(
+      producers,
+      [&](uint64_t* values, size_t count) {
+        if (queue.PushBatch(values, count) == 0) {
+          return false;
+        }
+        waiter.Notify();
+        return true;
+      },
+      [&](uint64_t* out, size_t max, const std::atomic<bool>& stop) {
+        waiter.Wait([&]() { return !queue.Empty() || stop.load(std::memory_order_relaxed); });
+        return queue.PopBatch(out, max);
+      },
+      [&]() { waiter.Notify(); });
+  }
+
+  double
+  MeasureSPSC(WaitStrategy strategy) {
+    SPSCQueue<uint64_t> queue(kHandoffDepth);
+    QueueWaiter waiter(strategy);
+    return MeasureHandoff(
+      1,
+      [&](uint64_t* values, size_t count) {
+        if (queue.PushBatch(values, count) == 0) {
+          return false;
+        }
+        waiter.Notify();
+        return true;
+      },
+      [&](uint64_t* out, size_t max, const std::atomic<bool>& stop) {
+        waiter.Wait([&]() { return !queue.Empty() || stop.load(std::memory_order_relaxed); });
+        return queue.PopBatch(out, max);
+      },
+      [&]() { waiter.Notify(); });
+  }
+
+  double
+  MeasureMutex(int producers) {
+    MutexQueue queue;
+    return MeasureHandoff(
+      producers,
+      [&](uint64_t* values, size_t count) { return queue.PushBatch(values, count); },
+      [&](uint64_t* out, size_t max, const std::atomic<bool>& stop) {
+        return queue.PopBatch(out, max, stop);
+      },
+      [&]() { queue.WakeAll(); });
+  }
+}
+
+void
+Benchmark::QueueHandoff(int maxProducers) {
+  const WaitStrategy strategies[] = { WaitStrategy::Spin, WaitStrategy::Yield, WaitStrategy::Futex };
+
+  std::cout << "M msg/s, batch " << kHandoffBatch << " per push" << std::endl;
+  std::cout << "producers  mutex\tspin\tyield\tfutex" << std::endl;
+  std::cout << "SPSC 1\t   " << MeasureMutex(1) / 1e6;
+  for (WaitStrategy strategy : strategies) {
+    std::cout << "\t" << MeasureSPSC(strategy) / 1e6;
+  }
+  std::cout << std::endl;
+
+  for (int producers : ThreadSteps(maxProducers)) {
+    std::cout << "MPSC " << producers << "\t   " << MeasureMutex(producers) / 1e6;
+    for (WaitStrategy strategy : strategies) {
+      std::cout << "\t" << MeasureMPSC(producers, strategy) / 1e6;
+    }
+    std::cout << std::endl;
+  }
+}
+
+void
+Benchmark::RouteLookups(int maxThreads) {
+  const int kUsers = 200000;
+  const int kChurn = 1000;   // Usuarios que entran y salen sin parar
+
+  std::vector<std::string> users(kUsers);
+  for (int i = 0; i < kUsers; ++i) {
+    users[i] = "user" + std::to_string(i);
+  }
+
+  std::cout << kUsers << " users, writer churning " << kChurn << std::endl;
+  std::cout << "readers  lookups/s  per reader  writes/s" << std::endl;
+  for (int threads : ThreadSteps(maxThreads)) {
+    RoutingTable table(threads);
+    for (int i = 0; i < kUsers; ++i) {
+      table.Insert(users[i], uint64_t(i) + 1);
+    }
+
+    std::atomic<bool> stop(false);
+    std::atomic<uint64_t> writes(0);
+    std::thread writer([&]() {
+      uint64_t count = 0;
+      for (uint64_t round = 0; !stop.load(std::memory_order_relaxed); ++round) {
+        const std::string& user = users[round % kChurn];
+        table.Remove(user, (round % kChurn) + 1);
+        table.Insert(user, (round % kChurn) + 1);
+        count += 2;
+      }
+      writes = count;
+    });
+
+    std::atomic<int> nextReader(0);
+    double rate = RunThreads(threads, [&](const std::atomic<bool>& done) {
+      size_t reader = static_cast<size_t>(nextReader++);
+      uint64_t state = 0x9E3779B97F4A7C15ull * (reader + 1);
+      uint64_t count = 0;
+      uint64_t connection = 0;
+      while (!done.load(std::memory_order_relaxed)) {
+        for (int i = 0; i < 1024; ++i) {
+          state ^= state << 13;
+          state ^= state >> 7;
+          state ^= state << 17;
+          table.Lookup(users[state % kUsers], connection);
+        }
+        count += 1024;
+        table.Quiescent(reader);
+      }
+      return count;
+    });
+    stop = true;
+    writer.join();
+
+    std::cout << threads << "\t " << static_cast<uint64_t>(rate)
+              << "\t    " << static_cast<uint64_t>(rate / threads)
+              << "\t" << static_cast<uint64_t>(writes.load() * 1000 / kDuration.count())
+              << std::endl;
+    if (threads == maxThreads) {
+      size_t low = SIZE_MAX;
+      size_t high = 0;
+      for (const RoutingTable::ShardLoad& load : table.GetLoad()) {
+        low = std::min(low, load.live);
+        high = std::max(high, load.live);
+      }
+      std::cout << "shard load min " << low << " max " << high << std::endl;
+    }
+  }
+}
+
+void
+Benchmark::OfflineThroughput(int maxThreads) {
+  const std::string kDirectory = "bench-offline";
+  const int kBacklog = 100000;
+  std::string payload(kMessageSize, 'x');
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(payload.data());
+
+  // Cada append espera a estar en disco: sin group commit seria un volcado por mensaje
+  std::cout << "threads  durable appends/s  appends per flush" << std::endl;
+  for (int threads : ThreadSteps(maxThreads)) {
+    std::filesystem::remove_all(kDirectory);
+    OfflineStore store(kDirectory);
+    if (!store.IsOpen()) {
+      return;
+    }
+    std::atomic<int> nextThread(0);
+    double rate = RunThreads(threads, [&](const std::atomic<bool>& stop) {
+      std::string user = "user" + std::to_string(nextThread++);
+      std::mutex lock;
+      std::condition_variable wake;
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        bool done = false;
+        bool appended = store.Append(user, "source", data, payload.size(), [&](bool) {
+          std::lock_guard<std::mutex> guard(lock);
+          done = true;
+          wake.notify_one();
+        });
+        if (!appended) {
+          break;
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        wake.wait(guard, [&]() { return done; });
+        ++count;
+      }
+      return count;
+    });
+    OfflineStore::Stats stats = store.GetStats();
+    std::cout << threads << "\t " << static_cast<uint64_t>(rate) << "\t\t    "
+              << (stats.commits > 0 ? double(stats.committed) / stats.commits : 0) << std::endl;
+  }
+
+  // Backlog de un usuario que reconecta: lectura de la proyeccion + ack por ventana
+  std::filesystem::remove_all(kDirectory);
+  {
+    OfflineStore store(kDirectory);
+    for (int i = 0; i < kBacklog; ++i) {
+      store.Append("user", "source", data, payload.size());
+    }
+    store.Flush();
+
+    std::vector<OfflineStore::Record> records;
+    uint64_t bytes = 0;
+    uint64_t checksum = 0;
+    auto start = Clock::now();
+    while (store.Read("user", 0, 256, 1024 * 1024, records) > 0) {
+      for (const OfflineStore::Record& record : records) {
+        bytes += record.len;
+        checksum += record.data[record.len - 1];
+      }
+      store.Ack("user", records.back().seq);
+      records.clear();
+    }
+    double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    std::cout << "drain " << kBacklog << " records: " << static_cast<uint64_t>(kBacklog / seconds)
+              << " records/s, " << static_cast<uint64_t>(bytes / seconds / (1024 * 1024))
+              << " MB/s" << (checksum == 0 ? " (empty)" : "") << std::endl;
+  }
+  std::filesystem::remove_all(kDirectory);
+}
+
+void
+Benchmark::RateLimiting(int maxThreads) {
+  const uint64_t kChecks = 10000000;
+
+  // Limite que nunca se alcanza: se mide el coste de la comprobacion
+  RateLimit generous{ 1e12, 1e12 };
+  TokenBucket::Tick now = TokenBucket::Now();
+  uint64_t passed = 0;
+  {
+    TokenBucket bucket;
+    bucket.Configure(generous);
+    auto start = Clock::now();
+    for (uint64_t i = 0; i < kChecks; ++i) {
+      passed += bucket.TryTakeOwned(now + static_cast<TokenBucket::Tick>(i)) ? 1 : 0;
+    }
+    double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kChecks;
+    std::cout << "own bucket (connection): " << ns << " ns/check" << std::endl;
+  }
+
+  // Bucket de una IP con conexiones en todos los nucleos
+  std::cout << "threads  shared bucket (IP) ns/check" << std::endl;
+  for (int threads : ThreadSteps(maxThreads)) {
+    TokenBucket bucket;
+    bucket.Configure(generous);
+    double rate = RunThreads(threads, [&](const std::atomic<bool>& stop) {
+      uint64_t count = 0;
+      while (!stop.load(std::memory_order_relaxed)) {
+        TokenBucket::Tick batch = TokenBucket::Now();
+        for (int i = 0; i < 1024; ++i) {
+          bucket.TryTake(batch);
+        }
+        count += 1024;
+      }
+      return count;
+    });
+    std::cout << threads << "\t " << 1e9 * threads / rate << std::endl;
+  }
+
+  // Un cliente que inunda: lo que pasa se ajusta al limite configurado
+  TokenBucket flood;
+  flood.Configure(RateLimit{ 1000, 100 });
+  uint64_t admitted = 0;
+  TokenBucket::Tick start = TokenBucket::Now();
+  for (uint64_t i = 0; i < kChecks; ++i) {
+    admitted += flood.TryTake(start + static_cast<TokenBucket::Tick>(i * 100)) ? 1 : 0;
+  }
+  std::cout << "flood at 10M frames/s, limit 1000/s burst 100: " << admitted << " admitted in 1 s"
+            << (passed == kChecks ? "" : " (own bucket rejected)") << std::endl;
+}
+
+void
+Benchmark::AdmissionTrace() {
+  using Clock = AdmissionControl::Clock;
+  const auto kStep = std::chrono::milliseconds(1);
+
+  // Espera simulada en colas internas: normal, un pico de 50 ms, una
+  // sobrecarga sostenida de 1 s y la recuperacion
+  struct Phase {
+    const char* name;
+    int millis;
+    int sojournMicros;
+  };
+  const Phase phases[] = {
+    { "normal", 500, 800 },
+    { "spike", 50, 30000 },
+    { "normal", 500, 800 },
+    { "overload", 1000, 20000 },
+    { "recovery", 1000, 800 },
+  };
+
+  AdmissionControl admission;
+  Clock::time_point now = Clock::time_point() + std::chrono::hours(1);
+  int elapsed = 0;
+  int level = 0;
+  std::cout << "time ms  phase     sojourn  level  sheds" << std::endl;
+  for (const Phase& phase : phases) {
+    for (int ms = 0; ms < phase.millis; ++ms, ++elapsed) {
+      now += kStep;
+      admission.Observe(std::chrono::microseconds(phase.sojournMicros), now);
+      admission.Tick(now);
+      if (admission.Level() == level) {
+        continue;
+      }
+      level = admission.Level();
+      const char* sheds[] = { "nothing", "signals", "signals+handshakes", "signals+handshakes+bulk" };
+      std::cout << elapsed << "\t " << phase.name << "\t   " << phase.sojournMicros / 1000.0
+                << " ms\t" << level << "    " << sheds[level] << std::endl;
+    }
+  }
+
+  // Coste por observacion en el loop del nucleo
+  const int kObservations = 10000000;
+  auto start = Clock::now();
+  for (int i = 0; i < kObservations; ++i) {
+    now += std::chrono::microseconds(10);
+    admission.Observe(std::chrono::microseconds(i & 8191), now);
+  }
+  double ns = std::chrono::duration<double, std::nano>(Clock::now() - start).count() / kObservations;
+  std::cout << "Observe: " << ns << " ns (" << admission.Escalations() << " escalations)" << std::endl;
+}
+
+bool
+Benchmark::RestartHandoff(int clientCount) {
+  const int kPort = 27350;
+  const int kWindow = 16;
+  const size_t kCores = 2;
+#ifdef _WIN32
+  const std::string kEndpoint = "e2ee-bench-restart";
+#else
+  const std::string kEndpoint = "bench-restart.sock";
+#endif
+  std::string payload(kMessageSize, 'x');
+  clientCount += clientCount % 2;
+
+  std::unique_ptr<Server> old(new Server(kPort, kCores, std::string(), Unlimited()));
+  if (!old->IsRunning() || !old->EnableHotRestart(kEndpoint)) {
+    return false;
+  }
+  std::vector<std::unique_ptr<BenchClient>> clients;
+  for (int i = 0; i < clientCount; ++i) {
+    clients.emplace_back(new BenchClient());
+    if (!clients.back()->Connect(kPort, "user" + std::to_string(i))) {
+      std::cerr << "Benchmark client failed to connect" << std::endl;
+      return false;
+    }
+  }
+
+  // Parejas que se reenvian mensajes sin parar; cada una mide su mayor hueco
+  // entre dos entregas, que incluye el tiempo congelado del traspaso
+  std::atomic<bool> stop(false);
+  std::vector<std::atomic<uint64_t>> received(clientCount);
+  std::vector<std::atomic<int64_t>> stallMicros(clientCount);
+  std::vector<std::thread> threads;
+  for (int index = 0; index < clientCount; ++index) {
+    threads.emplace_back([&, index]() {
+      BenchClient& client = *clients[index];
+      std::string partner = "user" + std::to_string(index ^ 1);
+      for (int i = 0; i < kWindow; ++i) {
+        client.Send(partner, payload);
+      }
+      auto last = Clock::now();
+      while (!stop.load(std::memory_order_relaxed) && !client.Closed()) {
+        if (!client.Receive()) {
+          continue;
+        }
+        auto now = Clock::now();
+        int64_t gap = std::chrono::duration_cast<std::chrono::microseconds>(now - last).count();
+        stallMicros[index].store(std::max(stallMicros[index].load(), gap));
+        last = now;
+        received[index].fetch_add(1, std::memory_order_relaxed);
+        client.Send(partner, payload);
+      }
+    });
+  }
+  auto total = [&]() {
+    uint64_t sum = 0;
+    for (const auto& count : received) {
+      sum += count.load(std::memory_order_relaxed);
+    }
+    return sum;
+  };
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  uint64_t before = total();
+  for (auto& stall : stallMicros) {
+    stall.store(0);
+  }
+  std::vector<uint64_t> atHandoff;
+  for (const auto& count : received) {
+    atHandoff.push_back(count.load());
+  }
+
+  // La clave RSA del sucesor se genera antes de conectar: el viejo sigue
+  // sirviendo mientras tanto
+  auto start = Clock::now();
+  Server successor(kPort, kCores, std::string(), Unlimited(), kEndpoint);
+  double handoffMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  for (int i = 0; i < 100 && !old->HandedOff(); ++i) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  bool handedOff = old->HandedOff();
+  old.reset();
+
+  std::this_thread::sleep_for(std::chrono::seconds(1));
+  stop.store(true);
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  uint64_t after = total() - before;
+
+  int alive = 0;
+  int closed = 0;
+  int64_t stall = 0;
+  for (int i = 0; i < clientCount; ++i) {
+    alive += received[i].load() > atHandoff[i] ? 1 : 0;
+    closed += clients[i]->Closed() ? 1 : 0;
+    stall = std::max(stall, stallMicros[i].load());
+  }
+  Server::Stats stats = successor.GetStats();
+  std::cout << clientCount << " clients, " << kCores << " cores" << std::endl;
+  std::cout << "successor start (incl. RSA keygen): " << handoffMs << " ms" << std::endl;
+  std::cout << "max delivery gap across handoff:    " << stall / 1000.0 << " ms" << std::endl;
+  std::cout << "msg/s before: " << before << "  from handoff on: "
+            << static_cast<uint64_t>(after / seconds) << std::endl;
+  std::cout << "connections in successor: " << stats.connections << "  still exchanging: "
+            << alive << "/" << clientCount << "  disconnected: " << closed << std::endl;
+  clients.clear();
+  successor.Stop();
+  return handedOff && closed == 0 && alive == clientCount;
+}
+
+bool
+Benchmark::ClusterSharding(int clientCount) {
+  const int kUsers = 100000;
+  const int kWindow = 16;
+  const size_t kCores = 2;
+  const int kClientPort = 27400;
+  const int kLinkPort = 27420;
+  const std::string kSecret = "bench-cluster-secret";
+
+  // Reparto y movimiento de claves: anillo con nodos virtuales frente a hash % n
+  uint64_t key[2] = { 0x0123456789abcdefull, 0xfedcba9876543210ull };
+  std::cout << "nodes\tmax/avg load\tmoved on join (ring)\tmoved (hash % n)\tideal" << std::endl;
+  for (int nodes = 2; nodes <= 8; nodes *= 2) {
+    HashRing before(key);
+    HashRing after(key);
+    for (int i = 0; i < nodes; ++i) {
+      before.Add("node" + std::to_string(i));
+      after.Add("node" + std::to_string(i));
+    }
+    after.Add("node" + std::to_string(nodes));
+    std::unordered_map<std::string, int> load;
+    int moved = 0;
+    int movedModulo = 0;
+    for (int i = 0; i < kUsers; ++i) {
+      std::string user = "user" + std::to_string(i);
+      const std::string& owner = before.Owner(user);
+      ++load[owner];
+      moved += owner != after.Owner(user) ? 1 : 0;
+      size_t hash = std::hash<std::string>()(user);
+      movedModulo += hash % nodes != hash % (nodes + 1) ? 1 : 0;
+    }
+    int heaviest = 0;
+    for (const auto& entry : load) {
+      heaviest = std::max(heaviest, entry.second);
+    }
+    std::cout << nodes << "->" << nodes + 1 << "\t" << heaviest * nodes / double(kUsers)
+              << "\t\t" << 100.0 * moved / kUsers << "%\t\t\t"
+              << 100.0 * movedModulo / kUsers << "%\t\t\t" << 100.0 / (nodes + 1) << "%"
+              << std::endl;
+  }
+
+  // Tres nodos en este proceso por loopback (como tres procesos --serve)
+  auto node = [&](int index) {
+    ClusterNode entry;
+    entry.name = "n" + std::to_string(index);
+    entry.host = "127.0.0.1";
+    entry.clientPort = kClientPort + index;
+    entry.linkPort = kLinkPort + index;
+    return entry;
+  };
+  std::vector<ClusterNode> members = { node(0), node(1), node(2) };
+  std::vector<std::unique_ptr<Server>> servers;
+  for (const ClusterNode& member : members) {
+    servers.emplace_back(new Server(member.clientPort, kCores, std::string(), Unlimited()));
+    if (!servers.back()->IsRunning() ||
+        !servers.back()->EnableCluster(member.name, members, kSecret)) {
+      std::cerr << "Cluster node " << member.name << " failed to start" << std::endl;
+      return false;
+    }
+  }
+
+  // Cada cliente entra por un nodo cualquiera y sigue el Redirect al suyo
+  clientCount += clientCount % 2;
+  std::string payload(kMessageSize, 'x');
+  int redirects = 0;
+  std::vector<std::unique_ptr<BenchClient>> clients(clientCount);
+  for (int i = 0; i < clientCount; ++i) {
+    if (!ConnectToOwner(clients[i], kClientPort + i % 3, "user" + std::to_string(i), redirects)) {
+      std::cerr << "Benchmark client failed to connect" << std::endl;
+      return false;
+    }
+  }
+
+  std::atomic<bool> stop(false);
+  std::vector<std::atomic<uint64_t>> received(clientCount);
+  std::vector<std::thread> threads;
+  for (int index = 0; index < clientCount; ++index) {
+    threads.emplace_back([&, index]() {
+      BenchClient& client = *clients[index];
+      std::string partner = "user" + std::to_string(index ^ 1);
+      for (int i = 0; i < kWindow; ++i) {
+        client.Send(partner, payload);
+      }
+      while (!stop.load(std::memory_order_relaxed) && !client.Closed()) {
+        if (client.Receive()) {
+          received[index].fetch_add(1, std::memory_order_relaxed);
+          client.Send(partner, payload);
+        }
+      }
+    });
+  }
+  auto total = [&]() {
+    uint64_t sum = 0;
+    for (const auto& count : received) {
+      sum += count.load(std::memory_order_relaxed);
+    }
+    return sum;
+  };
+  auto sum = [&]() {
+    Server::Stats stats;
+    for (const auto& server : servers) {
+      Server::Stats one = server->GetStats();
+      stats.forwarded += one.forwarded;
+      stats.fromCluster += one.fromCluster;
+      stats.linkBatches += one.linkBatches;
+      stats.redirected += one.redirected;
+      stats.routed += one.routed;
+    }
+    return stats;
+  };
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  uint64_t startCount = total();
+  Server::Stats startStats = sum();
+  auto start = Clock::now();
+  std::this_thread::sleep_for(kDuration);
+  double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  uint64_t exchanged = total() - startCount;
+  Server::Stats stats = sum();
+  uint64_t forwarded = stats.forwarded - startStats.forwarded;
+  uint64_t batches = stats.linkBatches - startStats.linkBatches;
+
+  std::cout << std::endl << "3 nodes x " << kCores << " cores, " << clientCount
+            << " clients (" << redirects << " redirected at login)" << std::endl;
+  std::cout << "msg/s: " << static_cast<uint64_t>(exchanged / seconds)
+            << "  cross-node: " << 100.0 * forwarded / std::max<uint64_t>(1, exchanged) << "%"
+            << "  msgs per link batch: " << forwarded / double(std::max<uint64_t>(1, batches))
+            << std::endl;
+
+  // Entra un cuarto nodo: solo los usuarios de sus tramos reciben Redirect
+  members.push_back(node(3));
+  servers.emplace_back(new Server(members.back().clientPort, kCores, std::string(), Unlimited()));
+  bool joined = servers.back()->IsRunning() &&
+                servers.back()->EnableCluster(members.back().name, members, kSecret);
+  for (size_t i = 0; joined && i + 1 < servers.size(); ++i) {
+    servers[i]->SetClusterNodes(members);
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(1500));
+  stop.store(true);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  int moved = 0;
+  for (const auto& client : clients) {
+    moved += client->Closed() ? 1 : 0;
+  }
+  std::cout << "node join: " << moved << "/" << clientCount << " clients redirected ("
+            << 100.0 * moved / clientCount << "%, ideal 25%)" << std::endl;
+
+  clients.clear();
+  for (auto& server : servers) {
+    server->Stop();
+  }
+  return joined && exchanged > 0 && forwarded > 0;
+}
@@ -0,0 +1,545 @@
+#include "BlobStore.h"
+#include "AlgorithmCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+  const char kIndexName[] = "refs.idx";
+  const char kJournalPrefix[] = "refs.";
+  const char kJournalSuffix[] = ".log";
+  const char kBlobSuffix[] = ".blob";
+  const char kTempSuffix[] = ".tmp";   // Put: "<id>.blob.tmp<hilo>"; SaveIndex: "refs.idx.tmp"
+
+  // Lo que ya llego al sistema (fflush) llega al disco
+  bool
+  SyncDescriptor(std::FILE* file) {
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+  }
+
+  bool
+  SyncFile(std::FILE* file) {
+    return std::fflush(file) == 0 && SyncDescriptor(file);
+  }
+
+  // Escribe el fichero entero y lo vuelca a disco antes de cerrarlo
+  bool
+  WriteSynced(const std::string& path, const void* data, size_t len) {
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+      return false;
+    }
+    bool ok = std::fwrite(data, 1, len, file) == len && SyncFile(file);
+    return std::fclose(file) == 0 && ok;
+  }
+}
+
+BlobStore::BlobStore(const std::string& directory, std::chrono::milliseconds gracePeriod)
+  : m_directory(directory), m_gracePeriod(gracePeriod) {
+  std::error_code ec;
+  fs::create_directories(m_directory, ec);
+  LoadIndex();
+  // Compacta lo reaplicado y abre el journal de la generacion nueva
+  SaveIndex();
+}
+
+BlobStore::~BlobStore() {
+  StopBackgroundGC();
+  SaveIndex();
+  if (m_journal) {
+    std::fclose(m_journal);
+  }
+}
+
+BlobStore::BlobId
+BlobStore::ComputeId(const unsigned char* data, size_t len) {
+  BlobId id{};
+  EVP_Digest(data, len, id.data(), nullptr, AlgorithmCache::SHA256(), nullptr);
+  return id;
+}
+
+std::string
+BlobStore::ToHex(const BlobId& id) {
+  static const char kDigits[] = "0123456789abcdef";
+  std::string hex(id.size() * 2, '0');
+  for (size_t i = 0; i < id.size(); ++i) {
+    hex[2 * i] = kDigits[id[i] >> 4];
+    hex[2 * i + 1] = kDigits[id[i] & 0x0F];
+  }
+  return hex;
+}
+
+bool
+BlobStore::FromHex(const std::string& hex, BlobId& outId) {
+  if (hex.size() != outId.size() * 2) {
+    return false;
+  }
+  auto nibble = [](char c) -> int {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+  };
+  for (size_t i = 0; i < outId.size(); ++i) {
+    int hi = nibble(hex[2 * i]);
+    int lo = nibble(hex[2 * i + 1]);
+    if (hi < 0 || lo < 0) {
+      return false;
+    }
+    outId[i] = static_cast<unsigned char>((hi << 4) | lo);
+  }
+  return true;
+}
+
+std::string
+BlobStore::PathFor(const BlobId& id) const {
+  return (fs::path(m_directory) / (ToHex(id) + kBlobSuffix)).string();
+}
+
+std::string
+BlobStore::JournalPath(uint64_t generation) const {
+  return (fs::path(m_directory) /
+          (kJournalPrefix + std::to_string(generation) + kJournalSuffix)).string();
+}
+
+void
+BlobStore::LoadIndex() {
+  // Primero los blobs en disco (sin referencias), luego las referencias
+  // guardadas. Un temporal es una escritura que una caida dejo a medias:
+  // nunca llego al rename que lo publica
+  auto now = std::chrono::steady_clock::now();
+  std::error_code ec;
+  const std::string blobTemp = std::string(kBlobSuffix) + kTempSuffix;
+  const std::string indexTemp = std::string(kIndexName) + kTempSuffix;
+  std::vector<fs::path> stray;
+  for (const auto& file : fs::directory_iterator(m_directory, ec)) {
+    const fs::path& path = file.path();
+    std::string name = path.filename().string();
+    if (name == indexTemp || name.find(blobTemp) != std::string::npos) {
+      stray.push_back(path);
+      continue;
+    }
+    BlobId id;
+    if (path.extension() != kBlobSuffix || !FromHex(path.stem().string(), id)) {
+      continue;
+    }
+    Entry& entry = m_blobs[id];
+    entry.size = file.file_size(ec);
+    entry.unreferencedSince = now;
+    m_stats.storedBytes += entry.size;
+  }
+  for (const fs::path& path : stray) {
+    fs::remove(path, ec);
+  }
+
+  std::ifstream index((fs::path(m_directory) / kIndexName).string());
+  std::string hex;
+  uint64_t refs = 0;
+  while (index >> hex >> refs) {
+    BlobId id;
+    if (hex == "gen") {
+      m_generation = refs;
+      continue;
+    }
+    auto it = FromHex(hex, id) ? m_blobs.find(id) : m_blobs.end();
+    if (it != m_blobs.end()) {
+      it->second.refs = refs;
+      m_stats.logicalBytes += refs * it->second.size;
+    }
+  }
+
+  // Cambios posteriores al indice. Una linea cortada al final no llego a
+  // confirmarse y no casa con ningun blob
+  std::ifstream journal(JournalPath(m_generation));
+  std::string op;
+  while (journal >> op >> hex) {
+    BlobId id;
+    auto it = FromHex(hex, id) ? m_blobs.find(id) : m_blobs.end();
+    if (it == m_blobs.end()) {
+      continue;
+    }
+    Entry& entry = it->second;
+    if (op == "+") {
+      ++entry.refs;
+      m_stats.logicalBytes += entry.size;
+    }
+    else if (op == "-" && entry.refs > 0) {
+      --entry.refs;
+      m_stats.logicalBytes -= entry.size;
+    }
+    m_dirty = true;
+  }
+  journal.close();
+
+  // Journals de otras generaciones: un corte entre el rename del indice y su borrado
+  std::string current = fs::path(JournalPath(m_generation)).filename().string();
+  for (const auto& file : fs::directory_iterator(m_directory, ec)) {
+    std::string name = file.path().filename().string();
+    if (name != current && name.compare(0, sizeof(kJournalPrefix) - 1, kJournalPrefix) == 0 &&
+        file.path().extension() == kJournalSuffix) {
+      fs::remove(file.path(), ec);
+    }
+  }
+  m_stats.blobs = m_blobs.size();
+}
+
+bool
+BlobStore::SaveIndex() {
+  // Nadie escribe en el journal mientras tanto: todo lo que tiene queda en
+  // el indice. Un volcado en curso usa el fichero: se espera a que acabe
+  std::unique_lock<std::mutex> journalGuard(m_journalLock);
+  m_synced.wait(journalGuard, [this]() { return !m_syncing; });
+  std::string content;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    if (!m_dirty && m_journal) {
+      return true;
+    }
+    content = "gen " + std::to_string(m_generation + 1) + "\n";
+    for (const auto& blob : m_blobs) {
+      if (blob.second.refs > 0) {
+        content += ToHex(blob.first) + ' ' + std::to_string(blob.second.refs) + '\n';
+      }
+    }
+    m_dirty = false;
+  }
+
+  fs::path final = fs::path(m_directory) / kIndexName;
+  fs::path temp = final;
+  temp += kTempSuffix;
+  std::error_code ec;
+  if (WriteSynced(temp.string(), content.data(), content.size())) {
+    fs::rename(temp, final, ec);
+  }
+  else {
+    ec = std::make_error_code(std::errc::io_error);
+  }
+  if (ec) {
+    std::cerr << "Error writing blob index" << std::endl;
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_dirty = true;
+    return false;
+  }
+
+  // El indice nuevo ya cuenta todo el journal anterior, y esta en disco
+  if (m_journal) {
+    std::fclose(m_journal);
+  }
+  m_durable = m_written;
+  m_synced.notify_all();
+  std::remove(JournalPath(m_generation).c_str());
+  ++m_generation;
+  m_journal = std::fopen(JournalPath(m_generation).c_str(), "wb");
+  if (!m_journal) {
+    std::cerr << "Error opening blob journal" << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool
+BlobStore::LogChange(char op, const BlobId& id, uint64_t& outTicket) {
+  std::string line(1, op);
+  line += ' ';
+  line += ToHex(id);
+  line += '\n';
+  if (!m_journal || std::fwrite(line.data(), 1, line.size(), m_journal) != line.size()) {
+    std::cerr << "Error writing blob journal" << std::endl;
+    return false;
+  }
+  outTicket = ++m_written;
+  return true;
+}
+
+// El primero que llega vuelca todo lo escrito hasta ese momento; los demas
+// esperan a ese volcado o al siguiente. El fsync va sin lock: mientras dura
+// se siguen anadiendo lineas (al buffer del FILE, no al descriptor)
+bool
+BlobStore::Commit(uint64_t ticket) {
+  std::unique_lock<std::mutex> guard(m_journalLock);
+  while (m_durable < ticket) {
+    if (m_syncing) {
+      m_synced.wait(guard);
+      continue;
+    }
+    uint64_t target = m_written;
+    std::FILE* journal = m_journal;
+    if (!journal || std::fflush(journal) != 0) {
+      std::cerr << "Error writing blob journal" << std::endl;
+      return false;
+    }
+    m_syncing = true;
+    guard.unlock();
+    bool ok = SyncDescriptor(journal);
+    guard.lock();
+    m_syncing = false;
+    if (ok) {
+      m_durable = std::max(m_durable, target);
+      std::lock_guard<std::mutex> statsGuard(m_lock);
+      ++m_stats.syncs;
+    }
+    m_synced.notify_all();
+    if (!ok) {
+      std::cerr << "Error syncing blob journal" << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+bool
+BlobStore::Put(const unsigned char* data, size_t len, BlobId& outId, bool& outDeduplicated) {
+  outId = ComputeId(data, len);
+  outDeduplicated = false;
+  if (AddRef(outId)) {
+    outDeduplicated = true;
+    return true;
+  }
+
+  // Se escribe fuera del lock en un temporal unico, ya en disco cuando el
+  // rename lo publica
+  std::string path = PathFor(outId);
+  std::string temp = path + kTempSuffix + std::to_string(
+    std::hash<std::thread::id>()(std::this_thread::get_id()));
+  if (!WriteSynced(temp, data, len)) {
+    std::cerr << "Error writing blob " << ToHex(outId) << std::endl;
+    std::remove(temp.c_str());
+    return false;
+  }
+
+  uint64_t ticket = 0;
+  {
+    std::lock_guard<std::mutex> journalGuard(m_journalLock);
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto it = m_blobs.find(outId);
+    if (it != m_blobs.end()) {
+      // Otro hilo subio el mismo blob mientras escribiamos
+      std::remove(temp.c_str());
+      outDeduplicated = true;
+      ++m_stats.dedupHits;
+    }
+    else {
+      std::error_code ec;
+      fs::rename(temp, path, ec);
+      if (ec) {
+        std::remove(temp.c_str());
+        return false;
+      }
+      it = m_blobs.emplace(outId, Entry()).first;
+      it->second.size = len;
+      m_stats.storedBytes += len;
+      ++m_stats.blobs;
+    }
+    ++it->second.refs;
+    ++m_stats.changes;
+    m_stats.logicalBytes += it->second.size;
+    m_dirty = true;
+    if (!LogChange('+', outId, ticket)) {
+      ticket = 0;
+    }
+  }
+  if (ticket == 0 || !Commit(ticket)) {
+    // Sin referencia durable el blob queda para el GC
+    Unref(outId);
+    return false;
+  }
+  return true;
+}
+
+bool
+BlobStore::AddRef(const BlobId& id) {
+  uint64_t ticket = 0;
+  {
+    std::lock_guard<std::mutex> journalGuard(m_journalLock);
+    {
+      std::lock_guard<std::mutex> guard(m_lock);
+      auto it = m_blobs.find(id);
+      if (it == m_blobs.end()) {
+        return false;
+      }
+      ++it->second.refs;
+      ++m_stats.dedupHits;
+      ++m_stats.changes;
+      m_stats.logicalBytes += it->second.size;
+      m_dirty = true;
+    }
+    if (!LogChange('+', id, ticket)) {
+      ticket = 0;
+    }
+  }
+  if (ticket == 0 || !Commit(ticket)) {
+    Unref(id);
+    return false;
+  }
+  return true;
+}
+
+bool
+BlobStore::Release(const BlobId& id) {
+  uint64_t ticket = 0;
+  {
+    std::lock_guard<std::mutex> journalGuard(m_journalLock);
+    if (!Unref(id)) {
+      return false;
+    }
+    if (!LogChange('-', id, ticket)) {
+      ticket = 0;
+    }
+  }
+  if (ticket == 0 || !Commit(ticket)) {
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto it = m_blobs.find(id);
+    if (it != m_blobs.end()) {
+      ++it->second.refs;
+      m_stats.logicalBytes += it->second.size;
+    }
+    return false;
+  }
+  std::lock_guard<std::mutex> guard(m_lock);
+  ++m_stats.changes;
+  return true;
+}
+
+bool
+BlobStore::Unref(const BlobId& id) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto it = m_blobs.find(id);
+  if (it == m_blobs.end() || it->second.refs == 0) {
+    return false;
+  }
+  m_stats.logicalBytes -= it->second.size;
+  if (--it->second.refs == 0) {
+    it->second.unreferencedSince = std::chrono::steady_clock::now();
+  }
+  m_dirty = true;
+  return true;
+}
+
+uint64_t
+BlobStore::RefCount(const BlobId& id) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto it = m_blobs.find(id);
+  return it == m_blobs.end() ? 0 : it->second.refs;
+}
+
+uint64_t
+BlobStore::BlobSize(const BlobId& id) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto it = m_blobs.find(id);
+  return it == m_blobs.end() ? 0 : it->second.size;
+}
+
+bool
+BlobStore::Read(const BlobId& id, uint64_t offset, size_t len, std::vector<unsigned char>& out) {
+  out.clear();
+  std::shared_ptr<MappedFile> mapping;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    auto it = m_blobs.find(id);
+    if (it == m_blobs.end()) {
+      return false;
+    }
+    if (!it->second.mapping) {
+      auto file = std::make_shared<MappedFile>();
+      if (!file->Open(PathFor(id))) {
+        return false;
+      }
+      it->second.mapping = file;
+    }
+    mapping = it->second.mapping;
+  }
+
+  // La copia del shared_ptr mantiene la vista aunque el GC quite la entrada
+  if (offset > mapping->Size()) {
+    return false;
+  }
+  len = static_cast<size_t>(std::min<uint64_t>(len, mapping->Size() - offset));
+  if (len > 0) {
+    out.assign(mapping->Data() + offset, mapping->Data() + offset + len);
+  }
+  return true;
+}
+
+size_t
+BlobStore::CollectGarbage() {
+  auto now = std::chrono::steady_clock::now();
+  size_t collected = 0;
+
+  // El borrado va bajo el lock para que un Put concurrente del mismo blob
+  // no publique su fichero justo antes de que lo borremos
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (auto it = m_blobs.begin(); it != m_blobs.end();) {
+    Entry& entry = it->second;
+    if (entry.refs != 0 || now - entry.unreferencedSince < m_gracePeriod) {
+      ++it;
+      continue;
+    }
+    // En Windows un fichero que un lector aun tiene proyectado no se puede
+    // borrar; queda sin entrada y se recoge al recargar el indice
+    entry.mapping.reset();
+    std::remove(PathFor(it->first).c_str());
+    m_stats.storedBytes -= entry.size;
+    --m_stats.blobs;
+    ++collected;
+    it = m_blobs.erase(it);
+  }
+  m_stats.collected += collected;
+  return collected;
+}
+
+void
+BlobStore::StartBackgroundGC(std::chrono::milliseconds interval) {
+  std::lock_guard<std::mutex> guard(m_gcLock);
+  if (m_gcRunning) {
+    return;
+  }
+  m_gcRunning = true;
+  m_gcThread = std::thread(&BlobStore::GCLoop, this, interval);
+}
+
+void
+BlobStore::StopBackgroundGC() {
+  {
+    std::lock_guard<std::mutex> guard(m_gcLock);
+    if (!m_gcRunning) {
+      return;
+    }
+    m_gcRunning = false;
+  }
+  m_gcWake.notify_all();
+  m_gcThread.join();
+}
+
+void
+BlobStore::GCLoop(std::chrono::milliseconds interval) {
+  std::unique_lock<std::mutex> guard(m_gcLock);
+  while (m_gcRunning) {
+    m_gcWake.wait_for(guard, interval, [this] { return !m_gcRunning; });
+    if (!m_gcRunning) {
+      break;
+    }
+    guard.unlock();
+    CollectGarbage();
+    SaveIndex();
+    guard.lock();
+  }
+}
+
+BlobStore::Stats
+BlobStore::GetStats() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_stats;
+}
@@ -0,0 +1,1081 @@
+#include "Cluster.h"
+#include "CryptoHelper.h"
+#include "FrameCodec.h"
+#include "LockFreeQueue.h"
+#include "SecureRandom.h"
+#include "WriteQueue.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace {
+  // Tramas del enlace entre nodos; no se mezclan con las de los clientes
+  const unsigned char kLinkChallenge = 1;
+  const unsigned char kLinkHello = 2;
+  const unsigned char kLinkBatch = 3;
+  const unsigned char kLinkAck = 4;
+
+  const size_t kRecvChunk = 64 * 1024;
+  const int kReadsPerWakeup = 4;
+  const int kPollMs = 200;
+  const int kAckPollMs = 5;                          // Con acks aplazados
+  const size_t kMaxIncoming = 256;
+  const size_t kChallengeSize = 32;
+  const std::chrono::milliseconds kMinBackoff(100);  // Reconexion de un enlace
+  const std::chrono::milliseconds kMaxBackoff(2000);
+  const std::chrono::seconds kHandshakeTimeout(2);   // connect + Challenge + Hello + Ack
+  const std::chrono::seconds kRetireGrace(2);        // Nucleos aun con la version anterior
+  const size_t kBatchHeader = 12;                    // [seq u64][n u32]
+  const size_t kEnvelopeHeader = 7;                  // [tipo][len destino][len origen][len u32]
+  const size_t kSealOverhead = 8 + 16;               // AEADEncrypt: contador del nonce + tag
+  // Un lote cifrado cabe en una trama (tipo + cuerpo): el receptor rechaza las mayores
+  const size_t kMaxBatchPlain = FrameCodec::kMaxFrameSize - 1 - kSealOverhead;
+
+  using SteadyClock = std::chrono::steady_clock;
+
+  // Contador con un solo escritor: sin instruccion atomica de lectura-modificacion
+  void
+  Bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  void
+  AppendU32(std::string& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  void
+  AppendU64(std::string& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  uint64_t
+  ReadU64(const unsigned char* data) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | data[i];
+    }
+    return value;
+  }
+
+  bool
+  WouldBlock() {
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINTR;
+  }
+
+  void
+  QueueFrame(WriteQueue& out, unsigned char type, const unsigned char* body, size_t len) {
+    std::vector<unsigned char>& tail = out.Tail();
+    size_t before = tail.size();
+    FrameCodec::Append(type, body, len, tail);
+    out.Commit(tail.size() - before);
+  }
+
+  // Lee lo que haya en el socket y pasa cada trama completa a handler
+  // (false = cerrar). Devuelve false si el otro extremo cerro o hubo error
+  template <typename Handler>
+  bool
+  ReadFrames(SOCKET socket, std::vector<unsigned char>& in, std::vector<unsigned char>& chunk,
+             Handler handler) {
+    for (int round = 0; round < kReadsPerWakeup; ++round) {
+      int received = recv(socket, reinterpret_cast<char*>(chunk.data()),
+                          static_cast<int>(chunk.size()), 0);
+      if (received == 0) {
+        return false;
+      }
+      if (received == SOCKET_ERROR) {
+        return WouldBlock();
+      }
+      in.insert(in.end(), chunk.data(), chunk.data() + received);
+
+      size_t offset = 0;
+      while (true) {
+        unsigned char type = 0;
+        const unsigned char* body = nullptr;
+        size_t len = 0;
+        size_t consumed = 0;
+        FrameCodec::Result result = FrameCodec::Next(in.data() + offset, in.size() - offset,
+                                                     type, body, len, consumed);
+        if (result == FrameCodec::Result::Invalid) {
+          return false;
+        }
+        if (result == FrameCodec::Result::Incomplete) {
+          break;
+        }
+        if (!handler(type, body, len)) {
+          return false;
+        }
+        offset += consumed;
+      }
+      in.erase(in.begin(), in.begin() + offset);
+      if (static_cast<size_t>(received) < chunk.size()) {
+        break;
+      }
+    }
+    return true;
+  }
+
+  bool
+  ParsePort(const std::string& text, int& out) {
+    if (text.empty() || text.size() > 5 ||
+        !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; })) {
+      return false;
+    }
+    out = std::atoi(text.c_str());
+    return out > 0 && out < 65536;
+  }
+}
+
+struct Cluster::Envelope {
+  Kind kind = Kind::Message;
+  std::string destination;
+  std::string source;
+  std::string payload;
+  Delivered delivered;   // Solo en este nodo: no viaja en el lote
+};
+
+struct Cluster::Link {
+  enum class State {
+    Down,         // Sin socket; reintenta en retryAt
+    Connecting,   // connect sin bloquear en curso
+    Handshake,    // Conectado: Challenge -> Hello -> primer Ack
+    Ready
+  };
+
+  explicit
+  Link(const ClusterNode& peer) : node(peer), queue(kQueueDepth) {}
+
+  ClusterNode node;
+  MPSCQueue<Envelope> queue;   // Productores: los nucleos; consume el hilo de enlaces
+
+  // Solo el hilo de enlaces
+  State state = State::Down;
+  SOCKET socket = INVALID_SOCKET;
+  std::unique_ptr<CryptoHelper> session;
+  RetransmitBuffer unacked;    // Lotes en claro hasta su ack
+  std::map<uint64_t, std::vector<Delivered>> waiting;   // Lote sin ack -> avisos, en su orden
+  std::unique_ptr<Envelope> next;   // Sacado de la cola sin sitio en el lote anterior
+  std::vector<unsigned char> in;
+  WriteQueue out;
+  SteadyClock::time_point retryAt;   // Down: proximo intento; si no, plazo del handshake
+  std::chrono::milliseconds backoff = kMinBackoff;
+};
+
+struct Cluster::Incoming {
+  SOCKET socket = INVALID_SOCKET;
+  std::string node;            // Vacio hasta un Hello valido
+  unsigned char challenge[kChallengeSize];
+  std::unique_ptr<CryptoHelper> session;
+  std::vector<unsigned char> in;
+  WriteQueue out;
+  SteadyClock::time_point deadline;  // Para el Hello
+  bool closed = false;
+};
+
+Cluster::Cluster(const std::string& self, const std::string& secret, Receiver receiver)
+  : m_self(self), m_receiver(std::move(receiver)) {
+  // Dos claves independientes del mismo secreto: la del anillo no cifra nada
+  unsigned char ringKey[16];
+  const unsigned char* ikm = reinterpret_cast<const unsigned char*>(secret.data());
+  m_keyed = !secret.empty() &&
+            CryptoHelper::HKDFSHA256(ikm, secret.size(), nullptr, 0, "E2EE-ClusterLink",
+                                     m_linkSecret, sizeof(m_linkSecret)) &&
+            CryptoHelper::HKDFSHA256(ikm, secret.size(), nullptr, 0, "E2EE-ClusterRing",
+                                     ringKey, sizeof(ringKey));
+  std::memcpy(m_ringKey, ringKey, sizeof(ringKey));
+  OPENSSL_cleanse(ringKey, sizeof(ringKey));
+  SecureRandom::Fill(reinterpret_cast<unsigned char*>(&m_incarnation), sizeof(m_incarnation));
+  m_recvBuffer.resize(kRecvChunk);
+}
+
+Cluster::~Cluster() {
+  Stop();
+  OPENSSL_cleanse(m_linkSecret, sizeof(m_linkSecret));
+}
+
+bool
+Cluster::Parse(const std::string& spec, std::vector<ClusterNode>& out) {
+  out.clear();
+  size_t begin = 0;
+  while (begin <= spec.size()) {
+    size_t end = spec.find(',', begin);
+    if (end == std::string::npos) {
+      end = spec.size();
+    }
+    std::string item = spec.substr(begin, end - begin);
+    begin = end + 1;
+
+    // nombre=host:puertoClientes:puertoEnlaces
+    ClusterNode node;
+    size_t equals = item.find('=');
+    size_t linkColon = item.rfind(':');
+    size_t clientColon = linkColon == std::string::npos || linkColon == 0
+                           ? std::string::npos : item.rfind(':', linkColon - 1);
+    if (equals == std::string::npos || clientColon == std::string::npos ||
+        clientColon <= equals + 1) {
+      std::cerr << "Invalid cluster node: " << item << std::endl;
+      return false;
+    }
+    node.name = item.substr(0, equals);
+    node.host = item.substr(equals + 1, clientColon - equals - 1);
+    if (node.name.empty() || node.name.size() > 255 ||
+        !ParsePort(item.substr(clientColon + 1, linkColon - clientColon - 1), node.clientPort) ||
+        !ParsePort(item.substr(linkColon + 1), node.linkPort)) {
+      std::cerr << "Invalid cluster node: " << item << std::endl;
+      return false;
+    }
+    for (const ClusterNode& other : out) {
+      if (other.name == node.name) {
+        std::cerr << "Duplicate cluster node: " << node.name << std::endl;
+        return false;
+      }
+    }
+    out.push_back(node);
+  }
+  return !out.empty();
+}
+
+bool
+Cluster::Start(const std::vector<ClusterNode>& nodes) {
+  if (!m_keyed) {
+    std::cerr << "Cluster needs a shared secret" << std::endl;
+    return false;
+  }
+  auto self = std::find_if(nodes.begin(), nodes.end(),
+                           [this](const ClusterNode& node) { return node.name == m_self; });
+  if (self == nodes.end()) {
+    std::cerr << "Node " << m_self << " is not in the cluster" << std::endl;
+    return false;
+  }
+  if (m_thread.joinable() || !OpenSockets(self->linkPort)) {
+    return false;
+  }
+  SetNodes(nodes);
+  m_stop.store(false, std::memory_order_release);
+  m_thread = std::thread(&Cluster::Run, this);
+  return true;
+}
+
+void
+Cluster::Stop() {
+  m_stop.store(true, std::memory_order_release);
+  if (m_thread.joinable()) {
+    Wake();
+    m_thread.join();
+  }
+  if (m_listener != INVALID_SOCKET) {
+    closesocket(m_listener);
+    m_listener = INVALID_SOCKET;
+  }
+  if (m_wakeSocket != INVALID_SOCKET) {
+    closesocket(m_wakeSocket);
+    m_wakeSocket = INVALID_SOCKET;
+  }
+}
+
+void
+Cluster::SetNodes(const std::vector<ClusterNode>& nodes) {
+  auto topology = std::make_shared<Topology>(m_ringKey);
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::unordered_map<std::string, std::shared_ptr<Link>> previous;
+  if (m_topology) {
+    previous = m_topology->links;
+  }
+  for (const ClusterNode& node : nodes) {
+    topology->ring.Add(node.name);
+    topology->clients[node.name] = node.host + ":" + std::to_string(node.clientPort);
+    if (node.name == m_self) {
+      continue;
+    }
+    // El mismo nodo en la misma direccion conserva su enlace, su cola y sus lotes sin ack
+    auto it = previous.find(node.name);
+    if (it != previous.end() && it->second->node.host == node.host &&
+        it->second->node.linkPort == node.linkPort) {
+      topology->links[node.name] = it->second;
+      previous.erase(it);
+      continue;
+    }
+    topology->links[node.name] = std::make_shared<Link>(node);
+  }
+  for (auto& entry : previous) {
+    m_retired.push_back(entry.second);
+  }
+  topology->version = m_version.load(std::memory_order_relaxed) + 1;
+  m_topology = topology;
+  m_version.store(topology->version, std::memory_order_release);
+  if (m_wakeSocket != INVALID_SOCKET) {
+    Wake();
+  }
+}
+
+std::shared_ptr<const Cluster::Topology>
+Cluster::Current() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_topology;
+}
+
+bool
+Cluster::Forward(const Topology& topology, const std::string& node, Kind kind,
+                 const std::string& destination, const std::string& source,
+                 const std::string& payload, Delivered delivered) {
+  auto it = topology.links.find(node);
+  // Uno que no cabe solo en un lote no saldria nunca: se queda en este nodo
+  if (it == topology.links.end() || destination.size() > 255 || source.size() > 255 ||
+      kBatchHeader + kEnvelopeHeader + destination.size() + source.size() + payload.size() >
+        kMaxBatchPlain) {
+    return false;
+  }
+  Envelope envelope;
+  envelope.kind = kind;
+  envelope.destination = destination;
+  envelope.source = source;
+  envelope.payload = payload;
+  envelope.delivered = std::move(delivered);
+  if (!it->second->queue.TryPush(std::move(envelope))) {
+    return false;
+  }
+  Wake();
+  return true;
+}
+
+Cluster::Stats
+Cluster::GetStats() const {
+  Stats stats;
+  stats.forwarded = m_forwarded.load(std::memory_order_relaxed);
+  stats.received = m_received.load(std::memory_order_relaxed);
+  stats.batches = m_batches.load(std::memory_order_relaxed);
+  stats.resent = m_resent.load(std::memory_order_relaxed);
+  stats.duplicates = m_duplicates.load(std::memory_order_relaxed);
+  stats.linkBytes = m_linkBytes.load(std::memory_order_relaxed);
+  stats.connects = m_connects.load(std::memory_order_relaxed);
+  stats.links = m_links.load(std::memory_order_relaxed);
+  stats.deferred = m_deferred.load(std::memory_order_relaxed);
+  std::shared_ptr<const Topology> topology = Current();
+  if (topology) {
+    for (const auto& entry : topology->links) {
+      stats.queued += entry.second->queue.SizeApprox();
+    }
+  }
+  return stats;
+}
+
+bool
+Cluster::OpenSockets(int linkPort) {
+  m_listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  if (m_listener == INVALID_SOCKET) {
+    std::cerr << "Error creating cluster socket: " << WSAGetLastError() << std::endl;
+    return false;
+  }
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = htons(static_cast<u_short>(linkPort));
+  u_long nonBlocking = 1;
+#ifndef _WIN32
+  // Un nodo que se reinicia vuelve a su puerto aunque queden enlaces en TIME_WAIT
+  int reuse = 1;
+  setsockopt(m_listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse),
+             sizeof(reuse));
+#endif
+  if (bind(m_listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR ||
+      listen(m_listener, SOMAXCONN) == SOCKET_ERROR ||
+      ioctlsocket(m_listener, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+    std::cerr << "Error listening on cluster port " << linkPort << ": " << WSAGetLastError()
+              << std::endl;
+    closesocket(m_listener);
+    m_listener = INVALID_SOCKET;
+    return false;
+  }
+
+  // Socket UDP conectado a si mismo: Forward despierta a WSAPoll
+  m_wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (m_wakeSocket == INVALID_SOCKET) {
+    std::cerr << "Error creating wake socket: " << WSAGetLastError() << std::endl;
+    return false;
+  }
+  sockaddr_in wake{};
+  wake.sin_family = AF_INET;
+  wake.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t length = sizeof(wake);
+  if (bind(m_wakeSocket, reinterpret_cast<sockaddr*>(&wake), sizeof(wake)) == SOCKET_ERROR ||
+      getsockname(m_wakeSocket, reinterpret_cast<sockaddr*>(&wake), &length) == SOCKET_ERROR ||
+      connect(m_wakeSocket, reinterpret_cast<sockaddr*>(&wake), sizeof(wake)) == SOCKET_ERROR ||
+      ioctlsocket(m_wakeSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+    std::cerr << "Error configuring wake socket: " << WSAGetLastError() << std::endl;
+    return false;
+  }
+  return true;
+}
+
+void
+Cluster::Wake() {
+  if (!m_wakePending.exchange(true)) {
+    char signal = 1;
+    send(m_wakeSocket, &signal, 1, 0);
+  }
+}
+
+void
+Cluster::Run() {
+  SecureRandom::Prime();
+  std::shared_ptr<const Topology> topology;
+  std::vector<WSAPOLLFD> fds;
+  std::vector<Link*> polledLinks;
+  std::vector<Incoming*> polledIncoming;
+  while (!m_stop.load(std::memory_order_acquire)) {
+    SteadyClock::time_point now = SteadyClock::now();
+    if (!topology || topology->version != Version()) {
+      topology = Current();
+      m_active.clear();
+      for (const auto& entry : topology->links) {
+        m_active.push_back(entry.second);
+      }
+      std::vector<std::shared_ptr<Link>> retired;
+      {
+        std::lock_guard<std::mutex> guard(m_lock);
+        retired.swap(m_retired);
+      }
+      for (auto& link : retired) {
+        Retire(*link, *topology);
+        m_draining.emplace_back(link, now + kRetireGrace);
+      }
+    }
+    // Un nucleo con la version anterior aun puede encolar en un enlace retirado
+    for (auto it = m_draining.begin(); it != m_draining.end();) {
+      Redistribute(*it->first, *topology);
+      it = now >= it->second ? m_draining.erase(it) : it + 1;
+    }
+
+    RetryRejected();
+
+    for (auto& link : m_active) {
+      if (link->state == Link::State::Down && now >= link->retryAt) {
+        Connect(*link);
+      }
+      else if (link->state != Link::State::Down && link->state != Link::State::Ready &&
+               now >= link->retryAt) {
+        Disconnect(*link);   // Sin respuesta a tiempo
+      }
+    }
+    for (auto& incoming : m_incoming) {
+      if (incoming->node.empty() && now >= incoming->deadline) {
+        incoming->closed = true;
+      }
+    }
+    m_incoming.erase(std::remove_if(m_incoming.begin(), m_incoming.end(),
+                                    [](const std::unique_ptr<Incoming>& incoming) {
+                                      if (incoming->closed) {
+                                        closesocket(incoming->socket);
+                                      }
+                                      return incoming->closed;
+                                    }),
+                     m_incoming.end());
+
+    fds.clear();
+    polledLinks.clear();
+    polledIncoming.clear();
+    WSAPOLLFD wake{};
+    wake.fd = m_wakeSocket;
+    wake.events = POLLRDNORM;
+    fds.push_back(wake);
+    WSAPOLLFD listener{};
+    listener.fd = m_listener;
+    listener.events = POLLRDNORM;
+    fds.push_back(listener);
+    for (auto& link : m_active) {
+      if (link->socket == INVALID_SOCKET) {
+        continue;
+      }
+      WSAPOLLFD fd{};
+      fd.fd = link->socket;
+      fd.events = link->state == Link::State::Connecting ? POLLWRNORM : POLLRDNORM;
+      if (!link->out.Empty()) {
+        fd.events |= POLLWRNORM;
+      }
+      fds.push_back(fd);
+      polledLinks.push_back(link.get());
+    }
+    // Con mensajes rechazados no se lee mas: TCP frena al nodo que los envia
+    bool acksPending = false;
+    for (auto& incoming : m_incoming) {
+      WSAPOLLFD fd{};
+      fd.fd = incoming->socket;
+      fd.events = m_rejected.empty() ? POLLRDNORM : 0;
+      if (!incoming->out.Empty()) {
+        fd.events |= POLLWRNORM;
+      }
+      fds.push_back(fd);
+      polledIncoming.push_back(incoming.get());
+      if (!incoming->node.empty() && m_peers[incoming->node].acks.AckPending()) {
+        acksPending = true;
+      }
+    }
+
+    int ready = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()),
+                        acksPending || !m_rejected.empty() ? kAckPollMs : kPollMs);
+    if (ready == SOCKET_ERROR) {
+      std::cerr << "WSAPoll failed: " << WSAGetLastError() << std::endl;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      continue;
+    }
+    if (fds[0].revents) {
+      char scratch[64];
+      while (recv(m_wakeSocket, scratch, sizeof(scratch), 0) > 0) {
+      }
+    }
+    // Se rearma antes de vaciar las colas: un Forward posterior vuelve a avisar
+    m_wakePending.store(false);
+    if (fds[1].revents) {
+      Accept();
+    }
+
+    size_t index = 2;
+    for (Link* link : polledLinks) {
+      short events = fds[index++].revents;
+      if (!events) {
+        continue;
+      }
+      if (link->state == Link::State::Connecting) {
+        OnConnected(*link);
+        continue;
+      }
+      if ((events & (POLLRDNORM | POLLHUP | POLLERR | POLLNVAL)) && !ReadLink(*link)) {
+        Disconnect(*link);
+        continue;
+      }
+      if ((events & POLLWRNORM) && !FlushLink(*link)) {
+        Disconnect(*link);
+      }
+    }
+    for (Incoming* incoming : polledIncoming) {
+      short events = fds[index++].revents;
+      if (!events || incoming->closed) {
+        continue;
+      }
+      if (events & (POLLRDNORM | POLLHUP | POLLERR | POLLNVAL)) {
+        incoming->closed = !ReadIncoming(*incoming);
+      }
+    }
+
+    // Un lote por enlace con todo lo encolado desde la vuelta anterior
+    for (auto& link : m_active) {
+      if (link->state != Link::State::Ready) {
+        continue;
+      }
+      Pump(*link);
+      if (!link->out.Empty() && !FlushLink(*link)) {
+        Disconnect(*link);
+      }
+    }
+
+    now = SteadyClock::now();
+    for (auto& incoming : m_incoming) {
+      if (incoming->closed) {
+        continue;
+      }
+      if (!incoming->node.empty() && m_peers[incoming->node].acks.AckDue(now)) {
+        SendAck(*incoming);
+      }
+      size_t sent = 0;
+      if (!incoming->out.Empty() && !incoming->out.Flush(incoming->socket, sent)) {
+        incoming->closed = true;
+      }
+      Bump(m_linkBytes, sent);
+    }
+  }
+
+  for (auto& link : m_active) {
+    Disconnect(*link);
+  }
+  for (auto& incoming : m_incoming) {
+    closesocket(incoming->socket);
+  }
+  m_incoming.clear();
+}
+
+void
+Cluster::Connect(Link& link) {
+  SteadyClock::time_point now = SteadyClock::now();
+  sockaddr_in address{};
+  address.sin_family = AF_INET;
+  address.sin_port = htons(static_cast<u_short>(link.node.linkPort));
+  if (inet_pton(AF_INET, link.node.host.c_str(), &address.sin_addr) != 1) {
+    std::cerr << "Invalid address for node " << link.node.name << ": " << link.node.host
+              << std::endl;
+    link.retryAt = now + kMaxBackoff;
+    return;
+  }
+  SOCKET socket = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+  u_long nonBlocking = 1;
+  int noDelay = 1;
+  if (socket == INVALID_SOCKET || ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+    if (socket != INVALID_SOCKET) {
+      closesocket(socket);
+    }
+    link.retryAt = now + link.backoff;
+    return;
+  }
+  setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay),
+             sizeof(noDelay));
+  if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR) {
+    int error = WSAGetLastError();
+    if (error != WSAEWOULDBLOCK && error != WSAEINPROGRESS) {
+      closesocket(socket);
+      link.retryAt = now + link.backoff;
+      link.backoff = std::min(link.backoff * 2, kMaxBackoff);
+      return;
+    }
+  }
+  // Aunque conecte al momento, WSAPoll lo da por escribible y sigue OnConnected
+  link.socket = socket;
+  link.state = Link::State::Connecting;
+  link.retryAt = now + kHandshakeTimeout;
+}
+
+void
+Cluster::Disconnect(Link& link) {
+  if (link.socket != INVALID_SOCKET) {
+    closesocket(link.socket);
+    link.socket = INVALID_SOCKET;
+  }
+  if (link.state == Link::State::Ready) {
+    m_links.store(m_links.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+  }
+  // Los lotes sin ack se quedan: se reenvian tras el primer ack de la proxima conexion
+  link.state = Link::State::Down;
+  link.session.reset();
+  link.in.clear();
+  link.out.Release();
+  link.retryAt = SteadyClock::now() + link.backoff;
+  link.backoff = std::min(link.backoff * 2, kMaxBackoff);
+}
+
+void
+Cluster::OnConnected(Link& link) {
+  int error = 0;
+  socklen_t length = sizeof(error);
+  if (getsockopt(link.socket, SOL_SOCKET, SO_ERROR, reinterpret_cast<char*>(&error),
+                 &length) == SOCKET_ERROR || error != 0) {
+    Disconnect(link);
+    return;
+  }
+  link.state = Link::State::Handshake;   // El receptor habla primero (Challenge)
+}
+
+bool
+Cluster::ReadLink(Link& link) {
+  return ReadFrames(link.socket, link.in, m_recvBuffer,
+                    [this, &link](unsigned char type, const unsigned char* body, size_t len) {
+                      return OnLinkFrame(link, type, body, len);
+                    });
+}
+
+bool
+Cluster::OnLinkFrame(Link& link, unsigned char type, const unsigned char* body, size_t len) {
+  if (type == kLinkChallenge) {
+    if (link.state != Link::State::Handshake || link.session || len != kChallengeSize) {
+      return false;
+    }
+    unsigned char salt[32];
+    unsigned char keys[64];
+    SecureRandom::Fill(salt, sizeof(salt));
+    DeriveLinkKeys(salt, body, keys);
+
+    std::string hello(1, static_cast<char>(m_self.size()));
+    hello += m_self;
+    AppendU64(hello, m_incarnation);
+    hello.append(reinterpret_cast<const char*>(salt), sizeof(salt));
+    unsigned char mac[32];
+    CryptoHelper::HMACSHA256(keys + 32, 32, reinterpret_cast<const unsigned char*>(hello.data()),
+                             hello.size(), mac);
+    hello.append(reinterpret_cast<const char*>(mac), sizeof(mac));
+
+    link.session.reset(new CryptoHelper());
+    link.session->SetSessionKey(keys, true);
+    OPENSSL_cleanse(keys, sizeof(keys));
+    QueueFrame(link.out, kLinkHello, reinterpret_cast<const unsigned char*>(hello.data()),
+               hello.size());
+    return FlushLink(link);
+  }
+
+  if (type != kLinkAck || !link.session) {
+    return false;
+  }
+  std::string plaintext;
+  uint64_t cumulative = 0;
+  std::vector<AckBlock> blocks;
+  if (!link.session->AEADDecrypt(body, len, plaintext) ||
+      !AckTracker::Decode(reinterpret_cast<const unsigned char*>(plaintext.data()),
+                          plaintext.size(), cumulative, blocks)) {
+    return false;
+  }
+  link.unacked.OnAck(cumulative, blocks);
+  for (auto it = link.waiting.begin(); it != link.waiting.end();) {
+    if (!link.unacked.Acked(it->first)) {
+      ++it;
+      continue;
+    }
+    for (const Delivered& delivered : it->second) {
+      if (delivered) {
+        delivered();
+      }
+    }
+    it = link.waiting.erase(it);
+  }
+  if (link.state == Link::State::Handshake) {
+    // Primer ack de esta conexion: lo que no cubre se perdio con la anterior
+    link.state = Link::State::Ready;
+    link.backoff = kMinBackoff;
+    Bump(m_connects);
+    Bump(m_links);
+    std::vector<RetransmitBuffer::Pending> pending;
+    link.unacked.Unacked(pending);
+    for (const RetransmitBuffer::Pending& entry : pending) {
+      SendBatch(link, *entry.payload);
+      Bump(m_resent);
+    }
+  }
+  return true;
+}
+
+void
+Cluster::Pump(Link& link) {
+  Envelope envelope;
+  while (link.unacked.Count() < kMaxUnackedBatches && link.out.Pending() < kMaxBatchBytes) {
+    if (link.next) {
+      envelope = std::move(*link.next);
+      link.next.reset();
+    }
+    else if (!link.queue.TryPop(envelope)) {
+      break;
+    }
+    std::string batch;
+    uint64_t seq = link.unacked.Next();
+    AppendU64(batch, seq);
+    AppendU32(batch, 0);
+    uint32_t count = 0;
+    std::vector<Delivered> waiting;
+    bool notify = false;
+    for (;;) {
+      notify = notify || envelope.delivered;
+      waiting.push_back(std::move(envelope.delivered));
+      batch.push_back(static_cast<char>(envelope.kind));
+      batch.push_back(static_cast<char>(envelope.destination.size()));
+      batch += envelope.destination;
+      batch.push_back(static_cast<char>(envelope.source.size()));
+      batch += envelope.source;
+      AppendU32(batch, static_cast<uint32_t>(envelope.payload.size()));
+      batch += envelope.payload;
+      ++count;
+      if (batch.size() >= kMaxBatchBytes || !link.queue.TryPop(envelope)) {
+        break;
+      }
+      // kMaxBatchBytes es solo el objetivo; el tope real es la trama
+      if (batch.size() + kEnvelopeHeader + envelope.destination.size() + envelope.source.size() +
+            envelope.payload.size() > kMaxBatchPlain) {
+        link.next.reset(new Envelope(std::move(envelope)));
+        break;
+      }
+    }
+    for (int i = 0; i < 4; ++i) {
+      batch[8 + i] = static_cast<char>(count >> (24 - 8 * i));
+    }
+
+    auto record = std::make_shared<std::vector<unsigned char>>(batch.begin(), batch.end());
+    link.unacked.Push(record);
+    if (notify) {
+      link.waiting[seq] = std::move(waiting);
+    }
+    SendBatch(link, *record);
+    Bump(m_forwarded, count);
+  }
+}
+
+void
+Cluster::SendBatch(Link& link, const std::vector<unsigned char>& batch) {
+  std::vector<unsigned char> sealed = link.session->AEADEncrypt(batch.data(), batch.size());
+  QueueFrame(link.out, kLinkBatch, sealed.data(), sealed.size());
+  Bump(m_batches);
+}
+
+bool
+Cluster::FlushLink(Link& link) {
+  size_t sent = 0;
+  bool ok = link.out.Flush(link.socket, sent);
+  Bump(m_linkBytes, sent);
+  return ok;
+}
+
+bool
+Cluster::ParseBatch(const unsigned char* data, size_t len, uint64_t& seq,
+                    std::vector<Envelope>& out) {
+  if (len < 12) {
+    return false;
+  }
+  seq = ReadU64(data);
+  uint32_t count = (uint32_t(data[8]) << 24) | (uint32_t(data[9]) << 16) |
+                   (uint32_t(data[10]) << 8) | uint32_t(data[11]);
+  const unsigned char* cursor = data + 12;
+  const unsigned char* end = data + len;
+  for (uint32_t i = 0; i < count; ++i) {
+    Envelope envelope;
+    if (end - cursor < 2 || *cursor > static_cast<unsigned char>(Kind::Identity)) {
+      return false;
+    }
+    envelope.kind = static_cast<Kind>(*cursor++);
+    size_t destinationLen = *cursor++;
+    if (static_cast<size_t>(end - cursor) < destinationLen + 1) {
+      return false;
+    }
+    envelope.destination.assign(reinterpret_cast<const char*>(cursor), destinationLen);
+    cursor += destinationLen;
+    size_t sourceLen = *cursor++;
+    if (static_cast<size_t>(end - cursor) < sourceLen + 4) {
+      return false;
+    }
+    envelope.source.assign(reinterpret_cast<const char*>(cursor), sourceLen);
+    cursor += sourceLen;
+    size_t payloadLen = (size_t(cursor[0]) << 24) | (size_t(cursor[1]) << 16) |
+                        (size_t(cursor[2]) << 8) | size_t(cursor[3]);
+    cursor += 4;
+    if (static_cast<size_t>(end - cursor) < payloadLen) {
+      return false;
+    }
+    envelope.payload.assign(reinterpret_cast<const char*>(cursor), payloadLen);
+    cursor += payloadLen;
+    out.push_back(std::move(envelope));
+  }
+  return cursor == end;
+}
+
+// El nodo salio del anillo: lo enviado sin ack y lo encolado va al dueno nuevo
+void
+Cluster::Retire(Link& link, const Topology& topology) {
+  std::vector<RetransmitBuffer::Pending> pending;
+  link.unacked.Unacked(pending);
+  for (const RetransmitBuffer::Pending& entry : pending) {
+    uint64_t seq = 0;
+    m_batch.clear();
+    ParseBatch(entry.payload->data(), entry.payload->size(), seq, m_batch);
+    // Cada mensaje se lleva su aviso al dueno nuevo
+    auto waiting = link.waiting.find(entry.seq);
+    for (size_t i = 0; i < m_batch.size(); ++i) {
+      if (waiting != link.waiting.end() && i < waiting->second.size()) {
+        m_batch[i].delivered = std::move(waiting->second[i]);
+      }
+      Dispatch(m_batch[i], topology);
+    }
+  }
+  m_batch.clear();
+  link.unacked = RetransmitBuffer();
+  link.waiting.clear();
+  Disconnect(link);
+  Redistribute(link, topology);
+}
+
+void
+Cluster::Redistribute(Link& link, const Topology& topology) {
+  if (link.next) {
+    Dispatch(*link.next, topology);
+    link.next.reset();
+  }
+  Envelope envelope;
+  while (link.queue.TryPop(envelope)) {
+    Dispatch(envelope, topology);
+  }
+}
+
+// Si el dueno nuevo es este nodo, o su cola esta llena, se entrega aqui: un
+// mensaje acaba en el almacen offline local y de ahi migra. Una publicacion
+// de sala no tiene dueno (y los miembros locales ya la recibieron); las
+// claves fijadas se reparten de nuevo con el anillo nuevo
+void
+Cluster::Dispatch(Envelope& envelope, const Topology& topology) {
+  if (envelope.kind == Kind::Room || envelope.kind == Kind::Identity) {
+    return;
+  }
+  const std::string& owner = topology.ring.Owner(envelope.destination);
+  auto it = topology.links.find(owner);
+  // TryPush no toca el sobre si la cola esta llena
+  if (owner != m_self && it != topology.links.end() &&
+      it->second->queue.TryPush(std::move(envelope))) {
+    return;
+  }
+  Receive(envelope);
+}
+
+void
+Cluster::Receive(Envelope& envelope) {
+  if (m_rejected.empty() &&
+      m_receiver(envelope.kind, std::move(envelope.destination), std::move(envelope.source),
+                 std::move(envelope.payload))) {
+    Bump(m_received);
+    if (envelope.delivered) {
+      envelope.delivered();
+    }
+    return;
+  }
+  Bump(m_deferred);
+  m_rejected.push_back(std::move(envelope));
+}
+
+// En orden: el primero que vuelve a no caber para la ronda
+void
+Cluster::RetryRejected() {
+  size_t done = 0;
+  while (done < m_rejected.size()) {
+    Envelope& envelope = m_rejected[done];
+    if (!m_receiver(envelope.kind, std::move(envelope.destination), std::move(envelope.source),
+                    std::move(envelope.payload))) {
+      break;
+    }
+    if (envelope.delivered) {
+      envelope.delivered();
+    }
+    ++done;
+  }
+  Bump(m_received, done);
+  m_rejected.erase(m_rejected.begin(), m_rejected.begin() + done);
+}
+
+void
+Cluster::Accept() {
+  while (true) {
+    SOCKET socket = accept(m_listener, nullptr, nullptr);
+    if (socket == INVALID_SOCKET) {
+      return;
+    }
+    u_long nonBlocking = 1;
+    int noDelay = 1;
+    if (m_incoming.size() >= kMaxIncoming ||
+        ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+      closesocket(socket);
+      continue;
+    }
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay),
+               sizeof(noDelay));
+
+    std::unique_ptr<Incoming> incoming(new Incoming());
+    incoming->socket = socket;
+    incoming->deadline = SteadyClock::now() + kHandshakeTimeout;
+    SecureRandom::Fill(incoming->challenge, sizeof(incoming->challenge));
+    QueueFrame(incoming->out, kLinkChallenge, incoming->challenge, sizeof(incoming->challenge));
+    size_t sent = 0;
+    incoming->out.Flush(socket, sent);
+    Bump(m_linkBytes, sent);
+    m_incoming.push_back(std::move(incoming));
+  }
+}
+
+bool
+Cluster::ReadIncoming(Incoming& incoming) {
+  return ReadFrames(incoming.socket, incoming.in, m_recvBuffer,
+                    [this, &incoming](unsigned char type, const unsigned char* body, size_t len) {
+                      return OnIncomingFrame(incoming, type, body, len);
+                    });
+}
+
+bool
+Cluster::OnIncomingFrame(Incoming& incoming, unsigned char type, const unsigned char* body,
+                         size_t len) {
+  if (type == kLinkHello) {
+    return incoming.node.empty() && OnHello(incoming, body, len);
+  }
+  if (type == kLinkBatch) {
+    return !incoming.node.empty() && OnBatch(incoming, body, len);
+  }
+  return false;
+}
+
+bool
+Cluster::OnHello(Incoming& incoming, const unsigned char* body, size_t len) {
+  if (len < 1 || body[0] == 0 || len != 1 + size_t(body[0]) + 8 + 32 + 32) {
+    return false;
+  }
+  std::string node(reinterpret_cast<const char*>(body + 1), body[0]);
+  const unsigned char* cursor = body + 1 + body[0];
+  uint64_t incarnation = ReadU64(cursor);
+  const unsigned char* salt = cursor + 8;
+  const unsigned char* mac = salt + 32;
+
+  unsigned char keys[64];
+  unsigned char expected[32];
+  DeriveLinkKeys(salt, incoming.challenge, keys);
+  CryptoHelper::HMACSHA256(keys + 32, 32, body, len - 32, expected);
+  if (CRYPTO_memcmp(expected, mac, sizeof(expected)) != 0) {
+    OPENSSL_cleanse(keys, sizeof(keys));
+    std::cerr << "Cluster link from " << node << " failed authentication" << std::endl;
+    return false;
+  }
+  incoming.session.reset(new CryptoHelper());
+  incoming.session->SetSessionKey(keys, false);
+  OPENSSL_cleanse(keys, sizeof(keys));
+
+  // Una conexion por emisor: si reconecto, la anterior esta muerta
+  for (auto& other : m_incoming) {
+    if (other.get() != &incoming && other->node == node) {
+      other->closed = true;
+    }
+  }
+  incoming.node = node;
+  Peer& peer = m_peers[node];
+  if (peer.incarnation != incarnation) {
+    // Proceso nuevo: sus secuencias vuelven a empezar
+    peer.incarnation = incarnation;
+    peer.acks = AckTracker();
+  }
+  SendAck(incoming);
+  return true;
+}
+
+bool
+Cluster::OnBatch(Incoming& incoming, const unsigned char* body, size_t len) {
+  std::string plaintext;
+  uint64_t seq = 0;
+  m_batch.clear();
+  if (!incoming.session->AEADDecrypt(body, len, plaintext) ||
+      !ParseBatch(reinterpret_cast<const unsigned char*>(plaintext.data()), plaintext.size(),
+                  seq, m_batch)) {
+    m_batch.clear();
+    return false;
+  }
+  SteadyClock::time_point now = SteadyClock::now();
+  Peer& peer = m_peers[incoming.node];
+  if (!peer.acks.Receive(seq, now)) {
+    Bump(m_duplicates);
+  }
+  else {
+    for (Envelope& envelope : m_batch) {
+      Receive(envelope);
+    }
+  }
+  m_batch.clear();
+  if (peer.acks.AckDue(now)) {
+    SendAck(incoming);
+  }
+  return true;
+}
+
+void
+Cluster::SendAck(Incoming& incoming) {
+  std::string ack;
+  m_peers[incoming.node].acks.Encode(ack);
+  std::vector<unsigned char> sealed = incoming.session->AEADEncrypt(ack);
+  QueueFrame(incoming.out, kLinkAck, sealed.data(), sealed.size());
+}
+
+// Sal del emisor + reto del receptor: 32 bytes para la sesion AEAD y 32 para el HMAC del Hello
+void
+Cluster::DeriveLinkKeys(const unsigned char salt[32], const unsigned char challenge[32],
+                        unsigned char out[64]) const {
+  unsigned char nonces[32 + kChallengeSize];
+  std::memcpy(nonces, salt, 32);
+  std::memcpy(nonces + 32, challenge, kChallengeSize);
+  CryptoHelper::HKDFSHA256(m_linkSecret, sizeof(m_linkSecret), nonces, sizeof(nonces),
+                           "E2EE-ClusterSession", out, 64);
+}
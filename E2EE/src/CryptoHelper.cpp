@@ -0,0 +1,632 @@
+#include "CryptoHelper.h"
+#include "SecureRandom.h"
+#include "PeerKeyCache.h"
+#include "SecureArena.h"
+#include "AlgorithmCache.h"
+#include <new>
+#include "openssl/pem.h"
+#include "openssl/rand.h"
+#include "openssl/core_names.h"
+#include "openssl/kdf.h"
+#include "openssl/err.h"
+#include "openssl/hpke.h"
+#include "openssl/x509.h"
+
+namespace {
+  // X25519 + HKDF-SHA256 + AES-256-GCM
+  const OSSL_HPKE_SUITE kHPKESuite = {
+    OSSL_HPKE_KEM_ID_X25519, OSSL_HPKE_KDF_ID_HKDF_SHA256, OSSL_HPKE_AEAD_ID_AES_GCM_256
+  };
+  const char kHPKEInfo[] = "E2EE-HPKE-v1";
+  // Prefijo de nonce de la sesion: el mismo en los dos extremos, asi que ni
+  // viaja ni se exporta (cada direccion ya tiene su propia clave)
+  const uint32_t kSessionNoncePrefix = 0;
+}
+
+CryptoHelper::CryptoHelper()
+  : rsaKeyPair(nullptr), peerPublicKey(nullptr), hpkeKeyPair(nullptr) {
+  // Las claves salen de la arena segura (bloqueada en RAM, a cero al liberar)
+  keyBlock = static_cast<unsigned char*>(SecureArena::Shared(3 * kKeySize)->Allocate());
+  if (!keyBlock) {
+    throw std::bad_alloc();
+  }
+  aesKey = keyBlock;
+  sendKey = keyBlock + kKeySize;
+  recvKey = keyBlock + 2 * kKeySize;
+}
+
+CryptoHelper::~CryptoHelper() {
+  EVP_PKEY_free(rsaKeyPair);
+  EVP_PKEY_free(peerPublicKey);
+  EVP_PKEY_free(hpkeKeyPair);
+  SecureArena::Shared(3 * kKeySize)->Free(keyBlock);
+}
+
+void
+CryptoHelper::GenerateRSAKeys() {
+  EVP_PKEY_free(rsaKeyPair);
+  publicKeyPEM.clear();
+  publicKeyDER.clear();
+  rsaKeyPair = EVP_RSA_gen(2048);
+  if (!rsaKeyPair) {
+    std::cerr << "Error generating RSA keys" << std::endl;
+    return;
+  }
+
+  // Se serializa una sola vez; GetPublicKeyString/DER devuelven la copia
+  int derLen = i2d_PUBKEY(rsaKeyPair, nullptr);
+  if (derLen > 0) {
+    publicKeyDER.resize(derLen);
+    unsigned char* p = publicKeyDER.data();
+    i2d_PUBKEY(rsaKeyPair, &p);
+  }
+
+  BIO* bio = BIO_new(BIO_s_mem());
+  PEM_write_bio_PUBKEY(bio, rsaKeyPair);
+  char* data = nullptr;
+  long len = BIO_get_mem_data(bio, &data);
+  publicKeyPEM.assign(data, len);
+  BIO_free(bio);
+}
+
+std::string
+CryptoHelper::GetPublicKeyString() const {
+  return publicKeyPEM;
+}
+
+const std::vector<unsigned char>&
+CryptoHelper::GetPublicKeyDER() const {
+  return publicKeyDER;
+}
+
+void
+CryptoHelper::LoadPeerPublicKey(const std::string& pemKey) {
+  // Solo se quita el base64; el DER resultante pasa por el cache
+  BIO* bio = BIO_new_mem_buf(pemKey.data(), static_cast<int>(pemKey.size()));
+  unsigned char* der = nullptr;
+  long derLen = 0;
+  int ok = PEM_bytes_read_bio(&der, &derLen, nullptr, PEM_STRING_PUBLIC, bio,
+                              nullptr, nullptr);
+  BIO_free(bio);
+
+  if (ok != 1 || !LoadPeerPublicKeyDER(std::vector<unsigned char>(der, der + derLen))) {
+    std::cerr << "Error loading peer public key" << std::endl;
+  }
+  OPENSSL_free(der);
+}
+
+bool
+CryptoHelper::LoadPeerPublicKeyDER(const std::vector<unsigned char>& derKey) {
+  EVP_PKEY* key = PeerKeyCache::Global().Acquire(derKey.data(), derKey.size());
+  if (!key) {
+    return false;
+  }
+  EVP_PKEY_free(peerPublicKey);
+  peerPublicKey = key;
+  return true;
+}
+
+void
+CryptoHelper::GenerateAESKey() {
+  SecureRandom::Fill(aesKey, kKeySize);
+  DeriveSessionKeys(true);
+}
+
+std::vector<unsigned char>
+CryptoHelper::EncryptAESKeyWithPeer() {
+  std::vector<unsigned char> encrypted;
+  if (!peerPublicKey) {
+    std::cerr << "Peer public key not loaded" << std::endl;
+    return encrypted;
+  }
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(peerPublicKey, nullptr);
+  size_t outLen = 0;
+  if (EVP_PKEY_encrypt_init(ctx) <= 0 ||
+      EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_OAEP_PADDING) <= 0 ||
+      EVP_PKEY_encrypt(ctx, nullptr, &outLen, aesKey, kKeySize) <= 0) {
+    std::cerr << "Error encrypting AES key" << std::endl;
+    EVP_PKEY_CTX_free(ctx);
+    return encrypted;
+  }
+
+  encrypted.resize(outLen);
+  if (EVP_PKEY_encrypt(ctx, encrypted.data(), &outLen, aesKey, kKeySize) <= 0) {
+    std::cerr << "Error encrypting AES key" << std::endl;
+    outLen = 0;
+  }
+  encrypted.resize(outLen);
+  EVP_PKEY_CTX_free(ctx);
+  return encrypted;
+}
+
+void
+CryptoHelper::DecryptAESKey(const std::vector<unsigned char>& encryptedKey) {
+  if (UnwrapAESKey(encryptedKey, aesKey)) {
+    DeriveSessionKeys(false);
+  }
+}
+
+bool
+CryptoHelper::UnwrapAESKey(const std::vector<unsigned char>& encryptedKey,
+                           unsigned char out[32]) const {
+  if (!rsaKeyPair) {
+    std::cerr << "RSA keys not generated" << std::endl;
+    return false;
+  }
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(rsaKeyPair, nullptr);
+  std::vector<unsigned char> plain(EVP_PKEY_get_size(rsaKeyPair));
+  size_t outLen = plain.size();
+  bool ok = EVP_PKEY_decrypt_init(ctx) > 0 &&
+            EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_OAEP_PADDING) > 0 &&
+            EVP_PKEY_decrypt(ctx, plain.data(), &outLen,
+                             encryptedKey.data(), encryptedKey.size()) > 0 &&
+            outLen == kKeySize;
+  if (ok) {
+    std::memcpy(out, plain.data(), kKeySize);
+  }
+  else {
+    std::cerr << "Error decrypting AES key" << std::endl;
+  }
+  OPENSSL_cleanse(plain.data(), plain.size());
+  EVP_PKEY_CTX_free(ctx);
+  return ok;
+}
+
+void
+CryptoHelper::SetSessionKey(const unsigned char key[32], bool initiator) {
+  std::memcpy(aesKey, key, kKeySize);
+  DeriveSessionKeys(initiator);
+}
+
+std::vector<unsigned char>
+CryptoHelper::AESEncrypt(const std::string& plaintext, std::vector<unsigned char>& outIV) {
+  outIV.resize(AES_BLOCK_SIZE);
+  SecureRandom::Fill(outIV.data(), AES_BLOCK_SIZE);
+
+  std::vector<unsigned char> ciphertext(plaintext.size() + AES_BLOCK_SIZE);
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  int len = 0;
+  int total = 0;
+
+  if (EVP_EncryptInit_ex(ctx, AlgorithmCache::AES256CBC(), nullptr, aesKey, outIV.data()) != 1 ||
+      EVP_EncryptUpdate(ctx, ciphertext.data(), &len,
+                        reinterpret_cast<const unsigned char*>(plaintext.data()),
+                        static_cast<int>(plaintext.size())) != 1) {
+    std::cerr << "Error encrypting data" << std::endl;
+    EVP_CIPHER_CTX_free(ctx);
+    return {};
+  }
+  total = len;
+
+  if (EVP_EncryptFinal_ex(ctx, ciphertext.data() + total, &len) != 1) {
+    std::cerr << "Error encrypting data" << std::endl;
+    EVP_CIPHER_CTX_free(ctx);
+    return {};
+  }
+  total += len;
+
+  EVP_CIPHER_CTX_free(ctx);
+  ciphertext.resize(total);
+  return ciphertext;
+}
+
+std::string
+CryptoHelper::AESDecrypt(const std::vector<unsigned char>& ciphertext,
+                         const std::vector<unsigned char>& iv) {
+  if (iv.size() != AES_BLOCK_SIZE) {
+    return "";
+  }
+
+  std::string plaintext(ciphertext.size() + AES_BLOCK_SIZE, '\0');
+  unsigned char* out = reinterpret_cast<unsigned char*>(&plaintext[0]);
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  int len = 0;
+  int total = 0;
+
+  if (EVP_DecryptInit_ex(ctx, AlgorithmCache::AES256CBC(), nullptr, aesKey, iv.data()) != 1 ||
+      EVP_DecryptUpdate(ctx, out, &len, ciphertext.data(),
+                        static_cast<int>(ciphertext.size())) != 1) {
+    std::cerr << "Error decrypting data" << std::endl;
+    EVP_CIPHER_CTX_free(ctx);
+    return "";
+  }
+  total = len;
+
+  if (EVP_DecryptFinal_ex(ctx, out + total, &len) != 1) {
+    std::cerr << "Error decrypting data" << std::endl;
+    EVP_CIPHER_CTX_free(ctx);
+    return "";
+  }
+  total += len;
+
+  EVP_CIPHER_CTX_free(ctx);
+  plaintext.resize(total);
+  return plaintext;
+}
+
+void
+CryptoHelper::DeriveSessionKeys(bool initiator) {
+  // Quien genero la clave AES envia con la clave "initiator"; el peer al reves
+  unsigned char keys[64];
+  HKDFSHA256(aesKey, kKeySize, nullptr, 0, "E2EE-SessionKeys", keys, sizeof(keys));
+  std::memcpy(sendKey, initiator ? keys : keys + 32, kKeySize);
+  std::memcpy(recvKey, initiator ? keys + 32 : keys, kKeySize);
+  OPENSSL_cleanse(keys, sizeof(keys));
+  sendNonces.Reset(kSessionNoncePrefix);
+  recvWindow.Reset();
+}
+
+std::vector<unsigned char>
+CryptoHelper::AEADEncrypt(const std::string& plaintext) {
+  return AEADEncrypt(reinterpret_cast<const unsigned char*>(plaintext.data()), plaintext.size());
+}
+
+std::vector<unsigned char>
+CryptoHelper::AEADEncrypt(const unsigned char* plaintext, size_t len) {
+  unsigned char nonce[NonceSequence::kNonceSize];
+  uint64_t sequence = 0;
+  if (!sendNonces.Next(nonce, sequence)) {
+    std::cerr << "Nonce space exhausted, renegotiate the session key" << std::endl;
+    return {};
+  }
+  return Seal(nonce, plaintext, len);
+}
+
+bool
+CryptoHelper::ReserveSequences(size_t count, uint64_t& outFirst) {
+  return !compressor && sendNonces.Reserve(count, outFirst);
+}
+
+std::vector<unsigned char>
+CryptoHelper::AEADEncryptAt(uint64_t sequence, const unsigned char* plaintext, size_t len) const {
+  unsigned char nonce[NonceSequence::kNonceSize];
+  NonceSequence::Build(sendNonces.Prefix(), sequence, nonce);
+  return Seal(nonce, plaintext, len);
+}
+
+std::vector<unsigned char>
+CryptoHelper::Seal(const unsigned char* nonce, const unsigned char* plaintext, size_t len) const {
+  const unsigned char* input = plaintext;
+  size_t inputLen = len;
+  std::vector<unsigned char> compressed;
+  if (compressor) {
+    compressed = compressor->Compress(input, inputLen);
+    input = compressed.data();
+    inputLen = compressed.size();
+  }
+
+  std::vector<unsigned char> sealed;
+  bool ok = AESGCMEncrypt(sendKey, nonce, NonceSequence::kNonceSize, nullptr, 0, input, inputLen,
+                          sealed);
+  OPENSSL_cleanse(compressed.data(), compressed.size());
+  if (!ok) {
+    std::cerr << "Error encrypting data" << std::endl;
+    return {};
+  }
+
+  // Solo viaja la parte del contador; el prefijo es fijo por sesion
+  std::vector<unsigned char> message(nonce + 4, nonce + NonceSequence::kNonceSize);
+  message.insert(message.end(), sealed.begin(), sealed.end());
+  return message;
+}
+
+bool
+CryptoHelper::AEADDecrypt(const std::vector<unsigned char>& message, std::string& outPlaintext) {
+  return AEADDecrypt(message.data(), message.size(), outPlaintext);
+}
+
+bool
+CryptoHelper::AEADDecrypt(const unsigned char* message, size_t len, std::string& outPlaintext) {
+  if (len < 8 + 16) {
+    return false;
+  }
+
+  uint64_t sequence = 0;
+  for (int i = 0; i < 8; ++i) {
+    sequence = (sequence << 8) | message[i];
+  }
+  // Replays y secuencias antiguas se descartan sin gastar AES
+  if (!recvWindow.Check(sequence)) {
+    return false;
+  }
+
+  unsigned char nonce[NonceSequence::kNonceSize];
+  NonceSequence::Build(kSessionNoncePrefix, sequence, nonce);
+
+  std::vector<unsigned char> plaintext;
+  if (!AESGCMDecrypt(recvKey, nonce, sizeof(nonce), nullptr, 0,
+                     message + 8, len - 8, plaintext)) {
+    return false;
+  }
+  // Solo se marca tras autenticar, asi un mensaje falso no avanza la ventana
+  recvWindow.Update(sequence);
+  if (compressor) {
+    std::vector<unsigned char> decompressed;
+    bool ok = compressor->Decompress(plaintext.data(), plaintext.size(), decompressed);
+    OPENSSL_cleanse(plaintext.data(), plaintext.size());
+    if (!ok) {
+      return false;
+    }
+    plaintext.swap(decompressed);
+  }
+
+  outPlaintext.assign(plaintext.begin(), plaintext.end());
+  OPENSSL_cleanse(plaintext.data(), plaintext.size());
+  return true;
+}
+
+// [clave envio][clave recepcion][contador u64][ventana]
+bool
+CryptoHelper::ExportSession(std::string& out) const {
+  if (compressor) {
+    return false;
+  }
+  out.reserve(out.size() + 2 * kKeySize + 8 + ReplayWindow<1024>::StateSize());
+  out.append(reinterpret_cast<const char*>(sendKey), kKeySize);
+  out.append(reinterpret_cast<const char*>(recvKey), kKeySize);
+  uint64_t counter = sendNonces.Sent();
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    out.push_back(static_cast<char>(counter >> shift));
+  }
+  recvWindow.Save(out);
+  return true;
+}
+
+bool
+CryptoHelper::ImportSession(const unsigned char* data, size_t len) {
+  if (len != 2 * kKeySize + 8 + ReplayWindow<1024>::StateSize()) {
+    std::cerr << "Invalid session state" << std::endl;
+    return false;
+  }
+  std::memcpy(sendKey, data, kKeySize);
+  std::memcpy(recvKey, data + kKeySize, kKeySize);
+  data += 2 * kKeySize;
+  uint64_t counter = 0;
+  for (int i = 0; i < 8; ++i) {
+    counter = (counter << 8) | data[i];
+  }
+  sendNonces.Restore(kSessionNoncePrefix, counter);
+  recvWindow.Load(data + 8);
+  return true;
+}
+
+void
+CryptoHelper::SetCompressor(std::shared_ptr<MessageCompressor> messageCompressor) {
+  compressor = std::move(messageCompressor);
+}
+
+bool
+CryptoHelper::GenerateHPKEKeys() {
+  EVP_PKEY_free(hpkeKeyPair);
+  hpkeKeyPair = nullptr;
+
+  size_t pubLen = OSSL_HPKE_get_public_encap_size(kHPKESuite);
+  hpkePublicKey.resize(pubLen);
+  if (OSSL_HPKE_keygen(kHPKESuite, hpkePublicKey.data(), &pubLen, &hpkeKeyPair,
+                       nullptr, 0, nullptr, nullptr) != 1) {
+    std::cerr << "Error generating HPKE keys" << std::endl;
+    hpkePublicKey.clear();
+    return false;
+  }
+  hpkePublicKey.resize(pubLen);
+  return true;
+}
+
+std::vector<unsigned char>
+CryptoHelper::GetHPKEPublicKey() const {
+  return hpkePublicKey;
+}
+
+bool
+CryptoHelper::HPKESealBatch(const std::vector<unsigned char>& recipientPublicKey,
+                            const std::vector<std::string>& plaintexts,
+                            std::vector<unsigned char>& outEnc,
+                            std::vector<std::vector<unsigned char>>& outCiphertexts) {
+  OSSL_HPKE_CTX* ctx = OSSL_HPKE_CTX_new(OSSL_HPKE_MODE_BASE, kHPKESuite,
+                                         OSSL_HPKE_ROLE_SENDER, nullptr, nullptr);
+  size_t encLen = OSSL_HPKE_get_public_encap_size(kHPKESuite);
+  outEnc.resize(encLen);
+  outCiphertexts.clear();
+  outCiphertexts.reserve(plaintexts.size());
+
+  // Una sola encapsulacion (la operacion de clave publica) para todo el lote
+  bool ok = ctx &&
+            OSSL_HPKE_encap(ctx, outEnc.data(), &encLen,
+                            recipientPublicKey.data(), recipientPublicKey.size(),
+                            reinterpret_cast<const unsigned char*>(kHPKEInfo),
+                            sizeof(kHPKEInfo) - 1) == 1;
+  for (size_t i = 0; ok && i < plaintexts.size(); ++i) {
+    const std::string& plaintext = plaintexts[i];
+    size_t ctLen = OSSL_HPKE_get_ciphertext_size(kHPKESuite, plaintext.size());
+    std::vector<unsigned char> ciphertext(ctLen);
+    ok = OSSL_HPKE_seal(ctx, ciphertext.data(), &ctLen, nullptr, 0,
+                        reinterpret_cast<const unsigned char*>(plaintext.data()),
+                        plaintext.size()) == 1;
+    ciphertext.resize(ctLen);
+    outCiphertexts.push_back(std::move(ciphertext));
+  }
+  OSSL_HPKE_CTX_free(ctx);
+
+  if (!ok) {
+    std::cerr << "Error sealing HPKE message" << std::endl;
+    outEnc.clear();
+    outCiphertexts.clear();
+    return false;
+  }
+  outEnc.resize(encLen);
+  return true;
+}
+
+bool
+CryptoHelper::HPKEOpenBatch(const std::vector<unsigned char>& enc,
+                            const std::vector<std::vector<unsigned char>>& ciphertexts,
+                            std::vector<std::string>& outPlaintexts) {
+  outPlaintexts.clear();
+  if (!hpkeKeyPair) {
+    return false;
+  }
+
+  OSSL_HPKE_CTX* ctx = OSSL_HPKE_CTX_new(OSSL_HPKE_MODE_BASE, kHPKESuite,
+                                         OSSL_HPKE_ROLE_RECEIVER, nullptr, nullptr);
+  bool ok = ctx &&
+            OSSL_HPKE_decap(ctx, enc.data(), enc.size(), hpkeKeyPair,
+                            reinterpret_cast<const unsigned char*>(kHPKEInfo),
+                            sizeof(kHPKEInfo) - 1) == 1;
+  outPlaintexts.reserve(ciphertexts.size());
+  for (size_t i = 0; ok && i < ciphertexts.size(); ++i) {
+    const std::vector<unsigned char>& ciphertext = ciphertexts[i];
+    std::string plaintext(ciphertext.size(), '\0');
+    size_t ptLen = plaintext.size();
+    ok = OSSL_HPKE_open(ctx, reinterpret_cast<unsigned char*>(&plaintext[0]), &ptLen,
+                        nullptr, 0, ciphertext.data(), ciphertext.size()) == 1;
+    plaintext.resize(ptLen);
+    outPlaintexts.push_back(std::move(plaintext));
+  }
+  OSSL_HPKE_CTX_free(ctx);
+
+  if (!ok) {
+    outPlaintexts.clear();
+  }
+  return ok;
+}
+
+std::vector<unsigned char>
+CryptoHelper::HPKESeal(const std::vector<unsigned char>& recipientPublicKey,
+                       const std::string& plaintext) {
+  std::vector<unsigned char> enc;
+  std::vector<std::vector<unsigned char>> ciphertexts;
+  if (!HPKESealBatch(recipientPublicKey, { plaintext }, enc, ciphertexts)) {
+    return {};
+  }
+  enc.insert(enc.end(), ciphertexts[0].begin(), ciphertexts[0].end());
+  return enc;
+}
+
+bool
+CryptoHelper::HPKEOpen(const std::vector<unsigned char>& sealed, std::string& outPlaintext) {
+  size_t encLen = OSSL_HPKE_get_public_encap_size(kHPKESuite);
+  if (sealed.size() < encLen) {
+    return false;
+  }
+
+  std::vector<unsigned char> enc(sealed.begin(), sealed.begin() + encLen);
+  std::vector<std::vector<unsigned char>> ciphertexts(1);
+  ciphertexts[0].assign(sealed.begin() + encLen, sealed.end());
+  std::vector<std::string> plaintexts;
+  if (!HPKEOpenBatch(enc, ciphertexts, plaintexts)) {
+    return false;
+  }
+  outPlaintext = std::move(plaintexts[0]);
+  return true;
+}
+
+bool
+CryptoHelper::AESGCMEncrypt(const unsigned char* key,
+                            const unsigned char* iv, size_t ivLen,
+                            const unsigned char* aad, size_t aadLen,
+                            const unsigned char* plaintext, size_t len,
+                            std::vector<unsigned char>& out) {
+  out.resize(len + 16);
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  int outLen = 0;
+  bool ok =
+    EVP_EncryptInit_ex(ctx, AlgorithmCache::AES256GCM(), nullptr, nullptr, nullptr) == 1 &&
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(ivLen), nullptr) == 1 &&
+    EVP_EncryptInit_ex(ctx, nullptr, nullptr, key, iv) == 1 &&
+    (aadLen == 0 ||
+     EVP_EncryptUpdate(ctx, nullptr, &outLen, aad, static_cast<int>(aadLen)) == 1) &&
+    EVP_EncryptUpdate(ctx, out.data(), &outLen, plaintext, static_cast<int>(len)) == 1 &&
+    EVP_EncryptFinal_ex(ctx, out.data() + outLen, &outLen) == 1 &&
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, 16, out.data() + len) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+
+  if (!ok) {
+    out.clear();
+  }
+  return ok;
+}
+
+bool
+CryptoHelper::AESGCMDecrypt(const unsigned char* key,
+                            const unsigned char* iv, size_t ivLen,
+                            const unsigned char* aad, size_t aadLen,
+                            const unsigned char* input, size_t len,
+                            std::vector<unsigned char>& out) {
+  if (len < 16) {
+    return false;
+  }
+
+  size_t ctLen = len - 16;
+  out.resize(ctLen);
+  EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+  int outLen = 0;
+  bool ok =
+    EVP_DecryptInit_ex(ctx, AlgorithmCache::AES256GCM(), nullptr, nullptr, nullptr) == 1 &&
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, static_cast<int>(ivLen), nullptr) == 1 &&
+    EVP_DecryptInit_ex(ctx, nullptr, nullptr, key, iv) == 1 &&
+    (aadLen == 0 ||
+     EVP_DecryptUpdate(ctx, nullptr, &outLen, aad, static_cast<int>(aadLen)) == 1) &&
+    EVP_DecryptUpdate(ctx, out.data(), &outLen, input, static_cast<int>(ctLen)) == 1 &&
+    EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, 16,
+                        const_cast<unsigned char*>(input + ctLen)) == 1 &&
+    EVP_DecryptFinal_ex(ctx, out.data() + outLen, &outLen) == 1;
+  EVP_CIPHER_CTX_free(ctx);
+
+  if (!ok) {
+    OPENSSL_cleanse(out.data(), out.size());
+    out.clear();
+  }
+  return ok;
+}
+
+void
+CryptoHelper::HMACSHA256(const unsigned char* key, size_t keyLen,
+                         const unsigned char* data, size_t len,
+                         unsigned char out[32]) {
+  // Contexto por hilo con el digest ya fijado: solo se recarga la clave
+  EVP_MAC_CTX* ctx = AlgorithmCache::ThreadHMAC();
+  size_t outLen = 32;
+  if (!ctx || EVP_MAC_init(ctx, key, keyLen, nullptr) != 1 ||
+      EVP_MAC_update(ctx, data, len) != 1 ||
+      EVP_MAC_final(ctx, out, &outLen, 32) != 1) {
+    std::cerr << "Error computing HMAC-SHA256" << std::endl;
+  }
+}
+
+bool
+CryptoHelper::HKDFSHA256(const unsigned char* ikm, size_t ikmLen,
+                         const unsigned char* salt, size_t saltLen,
+                         const std::string& info,
+                         unsigned char* out, size_t outLen) {
+  // Contexto por hilo con el digest ya fijado: solo se pasan clave, sal e info.
+  // OpenSSL 3.0 falla con una info vacia sobre un contexto que ya tuvo una;
+  // ese caso parte de un contexto limpio y no pasa la info
+  EVP_KDF_CTX* ctx = info.empty() ? AlgorithmCache::ResetThreadHKDF()
+                                  : AlgorithmCache::ThreadHKDF();
+  if (!ctx) {
+    return false;
+  }
+
+  // Una sal vacia no reemplaza la de la llamada anterior en el contexto;
+  // HashLen ceros es su equivalente en RFC 5869
+  static const unsigned char kZeroSalt[32] = {};
+  if (saltLen == 0) {
+    salt = kZeroSalt;
+    saltLen = sizeof(kZeroSalt);
+  }
+  OSSL_PARAM params[] = {
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_KEY,
+                                      const_cast<unsigned char*>(ikm), ikmLen),
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_SALT,
+                                      const_cast<unsigned char*>(salt), saltLen),
+    OSSL_PARAM_construct_octet_string(OSSL_KDF_PARAM_INFO,
+                                      const_cast<char*>(info.data()), info.size()),
+    OSSL_PARAM_construct_end()
+  };
+  if (info.empty()) {
+    params[2] = OSSL_PARAM_construct_end();
+  }
+  return EVP_KDF_derive(ctx, out, outLen, params) > 0;
+}
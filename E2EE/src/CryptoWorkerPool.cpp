@@ -0,0 +1,164 @@
+#include "CryptoWorkerPool.h"
+#include "AlgorithmCache.h"
+#include "SecureRandom.h"
+#include <algorithm>
+
+CompletionQueue::CompletionQueue(size_t capacity)
+  : m_queue(capacity), m_notified(false) {
+}
+
+void
+CompletionQueue::SetNotifier(std::function<void()> notifier) {
+  m_notifier = std::move(notifier);
+}
+
+void
+CompletionQueue::Post(std::function<void()>&& completion) {
+  // La cola del loop es mayor que los trabajos en vuelo; si se llenara,
+  // se espera a que el loop drene en lugar de perder el resultado
+  while (!m_queue.TryPush(std::move(completion))) {
+    std::this_thread::yield();
+  }
+
+  // Solo se avisa una vez por cada Drain()
+  if (m_notifier && !m_notified.exchange(true, std::memory_order_acq_rel)) {
+    m_notifier();
+  }
+}
+
+size_t
+CompletionQueue::Drain(size_t max) {
+  m_notified.store(false, std::memory_order_release);
+
+  // Un solo consumidor: se sacan por lotes, sin un CAS por continuacion
+  const size_t kBatch = 32;
+  std::function<void()> batch[kBatch];
+  size_t count = 0;
+  while (count < max) {
+    size_t popped = m_queue.PopBatch(batch, std::min(kBatch, max - count));
+    if (popped == 0) {
+      break;
+    }
+    for (size_t i = 0; i < popped; ++i) {
+      batch[i]();
+      batch[i] = nullptr;
+    }
+    count += popped;
+  }
+  return count;
+}
+
+CryptoWorkerPool::CryptoWorkerPool(size_t threads, size_t handshakeDepth, size_t bulkDepth)
+  : m_handshakes(handshakeDepth),
+    m_bulk(bulkDepth),
+    m_sleeping(0),
+    m_stop(false),
+    m_submitted(0),
+    m_rejected(0),
+    m_completed(0) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    m_workers.emplace_back(&CryptoWorkerPool::WorkerLoop, this);
+  }
+}
+
+CryptoWorkerPool::~CryptoWorkerPool() {
+  {
+    std::lock_guard<std::mutex> guard(m_sleepLock);
+    m_stop = true;
+  }
+  m_wakeup.notify_all();
+  for (auto& worker : m_workers) {
+    worker.join();
+  }
+}
+
+bool
+CryptoWorkerPool::Submit(CryptoJobKind kind,
+                         std::function<void()> work,
+                         std::function<void()> completion,
+                         CompletionQueue& owner) {
+  Job job;
+  job.work = std::move(work);
+  job.completion = std::move(completion);
+  job.owner = &owner;
+
+  MPMCQueue<Job>& queue = kind == CryptoJobKind::Handshake ? m_handshakes : m_bulk;
+  if (!queue.TryPush(std::move(job))) {
+    m_rejected.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  m_submitted.fetch_add(1, std::memory_order_relaxed);
+
+  // Emparejado con la barrera del worker antes de dormir
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> guard(m_sleepLock);
+    m_wakeup.notify_one();
+  }
+  return true;
+}
+
+bool
+CryptoWorkerPool::TakeJob(Job& job) {
+  // Los trabajos cortos primero: un handshake no retrasa mensajes ya cifrados
+  return m_bulk.TryPop(job) || m_handshakes.TryPop(job);
+}
+
+void
+CryptoWorkerPool::WorkerLoop() {
+  const int kSpins = 64;
+  Job job;
+
+  // DRBG y contextos del hilo listos antes del primer trabajo
+  SecureRandom::Prime();
+  AlgorithmCache::ThreadHMAC();
+  AlgorithmCache::ThreadHKDF();
+
+  while (true) {
+    bool found = false;
+    for (int spin = 0; spin < kSpins && !found; ++spin) {
+      found = TakeJob(job);
+      if (!found) {
+        std::this_thread::yield();
+      }
+    }
+
+    if (!found) {
+      std::unique_lock<std::mutex> lock(m_sleepLock);
+      m_sleeping.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      // Se comprueba de nuevo con el contador ya subido: Submit vera al durmiente
+      while (!m_stop && !(found = TakeJob(job))) {
+        m_wakeup.wait(lock);
+      }
+      m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+      if (!found) {
+        return;  // m_stop
+      }
+    }
+
+    job.work();
+    m_completed.fetch_add(1, std::memory_order_relaxed);
+    if (job.completion) {
+      job.owner->Post(std::move(job.completion));
+    }
+    job = Job();
+  }
+}
+
+CryptoWorkerPool::Stats
+CryptoWorkerPool::GetStats() const {
+  Stats stats;
+  stats.submitted = m_submitted.load(std::memory_order_relaxed);
+  stats.rejected = m_rejected.load(std::memory_order_relaxed);
+  stats.completed = m_completed.load(std::memory_order_relaxed);
+  return stats;
+}
+
+size_t
+CryptoWorkerPool::Pending() const {
+  return m_handshakes.SizeApprox() + m_bulk.SizeApprox();
+}
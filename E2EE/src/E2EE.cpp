@@ -1,8 +1,142 @@
 #include "openssl/crypto.h"
+#include "AlgorithmCache.h"
+#include "Benchmark.h"
+#include "Server.h"
+#include <atomic>
+#include <cstdlib>
 #include <iostream>
+#include <thread>
+
+namespace {
+  /**
+   * E2EE.exe --serve <puerto> [--cores n] [--offline dir]
+   *          [--node nombre --cluster spec --secret s]
+   *          [--restart-endpoint ruta] [--takeover ruta]
+   *
+   * Sirve hasta fin de stdin o "quit". Con cluster, "nodes <spec>" cambia
+   * los miembros y "stats" imprime los contadores: varios procesos por
+   * loopback forman un cluster de prueba.
+   *
+   * Reinicio en caliente: --restart-endpoint espera ahi a un sucesor; el
+   * sucesor se arranca con --takeover y esa misma ruta, recibe el socket de
+   * escucha y las conexiones, y el proceso viejo termina.
+   */
+  int
+  Serve(int argc, char* argv[]) {
+    int port = argc > 2 ? std::atoi(argv[2]) : 0;
+    size_t cores = 0;
+    std::string offline;
+    std::string node;
+    std::string spec;
+    std::string secret;
+    std::string restartEndpoint;
+    std::string takeover;
+    for (int i = 3; i + 1 < argc; i += 2) {
+      std::string option = argv[i];
+      if (option == "--cores") {
+        cores = static_cast<size_t>(std::atoi(argv[i + 1]));
+      }
+      else if (option == "--offline") {
+        offline = argv[i + 1];
+      }
+      else if (option == "--node") {
+        node = argv[i + 1];
+      }
+      else if (option == "--cluster") {
+        spec = argv[i + 1];
+      }
+      else if (option == "--secret") {
+        secret = argv[i + 1];
+      }
+      else if (option == "--restart-endpoint") {
+        restartEndpoint = argv[i + 1];
+      }
+      else if (option == "--takeover") {
+        takeover = argv[i + 1];
+      }
+      else {
+        std::cerr << "Unknown option: " << option << std::endl;
+        return 1;
+      }
+    }
+    std::vector<ClusterNode> nodes;
+    if (port <= 0 || (!spec.empty() && !Cluster::Parse(spec, nodes))) {
+      std::cerr << "Usage: --serve <port> [--cores n] [--offline dir] "
+                   "[--node name --cluster name=host:port:linkPort,... --secret s] "
+                   "[--restart-endpoint path] [--takeover path]\n"
+                   "  --restart-endpoint  wait there for a successor and hand it the service\n"
+                   "  --takeover          take the listener and connections from the server "
+                   "waiting on path (port is ignored)" << std::endl;
+      return 1;
+    }
+
+    Server server(port, cores, offline, RateLimiter::Limits(), takeover);
+    if (!server.IsRunning() || (!spec.empty() && !server.EnableCluster(node, nodes, secret)) ||
+        (!restartEndpoint.empty() && !server.EnableHotRestart(restartEndpoint))) {
+      return 1;
+    }
+    std::cout << (takeover.empty() ? "Serving on port " + std::to_string(port)
+                                   : "Serving after takeover from " + takeover)
+              << (spec.empty() ? "" : " as node " + node) << std::endl;
+
+    // Los comandos van en su hilo: tras un traspaso el proceso termina sin
+    // esperar a la siguiente linea
+    std::atomic<bool> finished(false);
+    std::thread commands([&server, &finished]() {
+      std::string line;
+      while (std::getline(std::cin, line) && line != "quit") {
+        if (line.compare(0, 6, "nodes ") == 0) {
+          std::vector<ClusterNode> members;
+          if (!Cluster::Parse(line.substr(6), members) || !server.SetClusterNodes(members)) {
+            std::cerr << "Cluster membership not changed" << std::endl;
+          }
+        }
+        else if (line == "stats") {
+          Server::Stats stats = server.GetStats();
+          std::cout << "connections " << stats.connections << " routed " << stats.routed
+                    << " stored " << stats.stored << " forwarded " << stats.forwarded
+                    << " fromCluster " << stats.fromCluster << " linkBatches "
+                    << stats.linkBatches << " redirected " << stats.redirected
+                    << " migrated " << stats.migrated << std::endl;
+        }
+      }
+      finished.store(true, std::memory_order_release);
+    });
+    while (!finished.load(std::memory_order_acquire) && !server.HandedOff()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    if (server.HandedOff()) {
+      std::cout << "Service handed off, exiting" << std::endl;
+      commands.detach();   // Bloqueado en stdin; el proceso termina igual
+    }
+    else {
+      commands.join();
+    }
+    server.Stop();
+    return 0;
+  }
+}
 
 int
-main() {
+main(int argc, char* argv[]) {
   std::cout << "OpenSSL version: " << OpenSSL_version(OPENSSL_VERSION) << std::endl;
+
+  // Proveedores, algoritmos y DRBG se resuelven aqui y no en el primer mensaje
+  AlgorithmCache::StartupReport startup;
+  if (!AlgorithmCache::Initialize(&startup)) {
+    std::cerr << "Error initializing crypto algorithms" << std::endl;
+    return 1;
+  }
+  std::cout << "Crypto startup: " << startup.totalMs << " ms (providers "
+            << startup.providersMs << ", fetch " << startup.fetchMs
+            << ", drbg " << startup.drbgMs << ")"
+            << (startup.mlkemAvailable ? "" : " [ML-KEM unavailable]") << std::endl;
+
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    return Benchmark::Run(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--serve") {
+    return Serve(argc, argv);
+  }
   return 0;
-}
\ No newline at end of file
+}
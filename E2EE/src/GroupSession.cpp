@@ -0,0 +1,305 @@
+#include "GroupSession.h"
+#include "SecureRandom.h"
+#include "SecureArena.h"
+
+namespace {
+  const unsigned char kVersion = 1;
+  const size_t kSignatureSize = 64;
+  const size_t kEd25519KeySize = 32;
+  const uint32_t kMaxSkippedKeys = 2000;  // Limite de mensajes fuera de orden por emisor
+
+  void
+  PutU32(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back(static_cast<unsigned char>(value >> 24));
+    out.push_back(static_cast<unsigned char>(value >> 16));
+    out.push_back(static_cast<unsigned char>(value >> 8));
+    out.push_back(static_cast<unsigned char>(value));
+  }
+
+  uint32_t
+  GetU32(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) |
+           (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+  }
+
+  // Deriva clave AES-256 e IV de 12 bytes a partir de la semilla del mensaje
+  bool
+  DeriveMessageKeys(const unsigned char seed[32], unsigned char out[44]) {
+    return CryptoHelper::HKDFSHA256(seed, 32, nullptr, 0, "E2EE-GroupMessage", out, 44);
+  }
+}
+
+GroupSession::GroupSession(const std::string& groupId, const std::string& selfId)
+  : m_groupId(groupId), m_selfId(selfId) {
+}
+
+GroupSession::~GroupSession() {
+  ClearState(m_self);
+  for (auto& member : m_members) {
+    ClearState(member.second);
+  }
+}
+
+bool
+GroupSession::InitState(SenderState& state) {
+  ClearState(state);
+  state.chainKey = static_cast<unsigned char*>(SecureArena::Shared(32)->Allocate());
+  return state.chainKey != nullptr;
+}
+
+void
+GroupSession::ClearState(SenderState& state) {
+  SecureArena::Shared(32)->Free(state.chainKey);
+  state.chainKey = nullptr;
+  for (auto& skipped : state.skippedKeys) {
+    OPENSSL_cleanse(skipped.second.data(), skipped.second.size());
+  }
+  state.skippedKeys.clear();
+  EVP_PKEY_free(state.signingKey);
+  state.signingKey = nullptr;
+  state.iteration = 0;
+}
+
+void
+GroupSession::StepChain(SenderState& state, Key32& outMessageSeed) {
+  static const unsigned char kMessageConst = 0x01;
+  static const unsigned char kChainConst = 0x02;
+
+  Key32 next;
+  CryptoHelper::HMACSHA256(state.chainKey, 32, &kMessageConst, 1, outMessageSeed.data());
+  CryptoHelper::HMACSHA256(state.chainKey, 32, &kChainConst, 1, next.data());
+  std::memcpy(state.chainKey, next.data(), next.size());
+  OPENSSL_cleanse(next.data(), next.size());
+  ++state.iteration;
+}
+
+void
+GroupSession::CreateSenderKey() {
+  if (!InitState(m_self)) {
+    std::cerr << "Error allocating group chain key" << std::endl;
+    return;
+  }
+  SecureRandom::Fill(m_self.chainKey, 32);
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_ED25519, nullptr);
+  if (EVP_PKEY_keygen_init(ctx) <= 0 || EVP_PKEY_keygen(ctx, &m_self.signingKey) <= 0) {
+    std::cerr << "Error generating group signing key" << std::endl;
+  }
+  EVP_PKEY_CTX_free(ctx);
+}
+
+std::vector<unsigned char>
+GroupSession::GetSenderKeyDistribution() const {
+  std::vector<unsigned char> out;
+  if (!m_self.signingKey) {
+    return out;
+  }
+
+  // [version][iteration u32][chain key 32][clave publica Ed25519 32]
+  out.push_back(kVersion);
+  PutU32(out, m_self.iteration);
+  out.insert(out.end(), m_self.chainKey, m_self.chainKey + 32);
+
+  size_t pubLen = kEd25519KeySize;
+  out.resize(out.size() + kEd25519KeySize);
+  EVP_PKEY_get_raw_public_key(m_self.signingKey, out.data() + out.size() - kEd25519KeySize,
+                              &pubLen);
+  return out;
+}
+
+bool
+GroupSession::ProcessSenderKeyDistribution(const std::string& senderId,
+                                           const std::vector<unsigned char>& distribution) {
+  if (distribution.size() != 1 + 4 + 32 + kEd25519KeySize || distribution[0] != kVersion) {
+    return false;
+  }
+
+  EVP_PKEY* pub = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr,
+                                              distribution.data() + 37, kEd25519KeySize);
+  if (!pub) {
+    return false;
+  }
+
+  SenderState& state = m_members[senderId];
+  if (!InitState(state)) {
+    EVP_PKEY_free(pub);
+    m_members.erase(senderId);
+    return false;
+  }
+  state.iteration = GetU32(distribution.data() + 1);
+  std::memcpy(state.chainKey, distribution.data() + 5, 32);
+  state.signingKey = pub;
+  return true;
+}
+
+void
+GroupSession::RemoveMember(const std::string& memberId) {
+  auto it = m_members.find(memberId);
+  if (it != m_members.end()) {
+    ClearState(it->second);
+    m_members.erase(it);
+  }
+}
+
+std::vector<unsigned char>
+GroupSession::BuildHeader(const std::string& senderId, uint32_t iteration) const {
+  // [version][len id][sender id][iteration u32]
+  std::vector<unsigned char> header;
+  header.reserve(2 + senderId.size() + 4);
+  header.push_back(kVersion);
+  header.push_back(static_cast<unsigned char>(senderId.size()));
+  header.insert(header.end(), senderId.begin(), senderId.end());
+  PutU32(header, iteration);
+  return header;
+}
+
+std::vector<unsigned char>
+GroupSession::BuildGroupPrefix() const {
+  // Con la longitud delante, (grupo, cabecera) no se pueden partir de otra forma
+  std::vector<unsigned char> prefix;
+  prefix.reserve(4 + m_groupId.size());
+  PutU32(prefix, static_cast<uint32_t>(m_groupId.size()));
+  prefix.insert(prefix.end(), m_groupId.begin(), m_groupId.end());
+  return prefix;
+}
+
+std::vector<unsigned char>
+GroupSession::Encrypt(const std::string& plaintext) {
+  if (m_selfId.empty() || m_selfId.size() > 255) {
+    std::cerr << "Invalid group member id" << std::endl;
+    return {};
+  }
+  if (!m_self.signingKey) {
+    std::cerr << "Sender key not created" << std::endl;
+    return {};
+  }
+
+  std::vector<unsigned char> message = BuildHeader(m_selfId, m_self.iteration);
+
+  Key32 seed;
+  unsigned char keys[44];
+  StepChain(m_self, seed);
+  bool derived = DeriveMessageKeys(seed.data(), keys);
+  OPENSSL_cleanse(seed.data(), seed.size());
+  if (!derived) {
+    std::cerr << "Error deriving group message keys" << std::endl;
+    return {};
+  }
+
+  // AAD: grupo + cabecera, para que un mensaje no pueda moverse entre grupos
+  std::vector<unsigned char> aad = BuildGroupPrefix();
+  aad.insert(aad.end(), message.begin(), message.end());
+
+  std::vector<unsigned char> ciphertext;
+  bool ok = CryptoHelper::AESGCMEncrypt(keys, keys + 32, 12, aad.data(), aad.size(),
+                                        reinterpret_cast<const unsigned char*>(plaintext.data()),
+                                        plaintext.size(), ciphertext);
+  OPENSSL_cleanse(keys, sizeof(keys));
+  if (!ok) {
+    return {};
+  }
+  message.insert(message.end(), ciphertext.begin(), ciphertext.end());
+
+  // Una sola firma por mensaje, independiente del numero de miembros
+  aad.insert(aad.end(), ciphertext.begin(), ciphertext.end());
+  size_t sigLen = kSignatureSize;
+  message.resize(message.size() + kSignatureSize);
+  EVP_MD_CTX* md = EVP_MD_CTX_new();
+  ok = EVP_DigestSignInit(md, nullptr, nullptr, nullptr, m_self.signingKey) == 1 &&
+       EVP_DigestSign(md, message.data() + message.size() - kSignatureSize, &sigLen,
+                      aad.data(), aad.size()) == 1;
+  EVP_MD_CTX_free(md);
+  if (!ok) {
+    std::cerr << "Error signing group message" << std::endl;
+    return {};
+  }
+  return message;
+}
+
+bool
+GroupSession::Decrypt(const std::vector<unsigned char>& message,
+                      std::string& outSenderId,
+                      std::string& outPlaintext) {
+  if (message.size() < 2 || message[0] != kVersion) {
+    return false;
+  }
+  size_t idLen = message[1];
+  size_t headerLen = 2 + idLen + 4;
+  if (message.size() < headerLen + 16 + kSignatureSize) {
+    return false;
+  }
+
+  std::string senderId(reinterpret_cast<const char*>(message.data() + 2), idLen);
+  auto it = m_members.find(senderId);
+  if (it == m_members.end()) {
+    return false;
+  }
+  SenderState& state = it->second;
+  uint32_t iteration = GetU32(message.data() + 2 + idLen);
+
+  const unsigned char* ciphertext = message.data() + headerLen;
+  size_t ctLen = message.size() - headerLen - kSignatureSize;
+
+  std::vector<unsigned char> signedData = BuildGroupPrefix();
+  size_t prefixLen = signedData.size();
+  signedData.insert(signedData.end(), message.begin(), message.end() - kSignatureSize);
+
+  // La firma se comprueba antes de tocar la cadena
+  EVP_MD_CTX* md = EVP_MD_CTX_new();
+  bool ok = EVP_DigestVerifyInit(md, nullptr, nullptr, nullptr, state.signingKey) == 1 &&
+            EVP_DigestVerify(md, message.data() + message.size() - kSignatureSize,
+                             kSignatureSize, signedData.data(), signedData.size()) == 1;
+  EVP_MD_CTX_free(md);
+  if (!ok) {
+    return false;
+  }
+
+  Key32 seed;
+  if (iteration < state.iteration) {
+    auto skipped = state.skippedKeys.find(iteration);
+    if (skipped == state.skippedKeys.end()) {
+      return false;  // Duplicado o demasiado antiguo
+    }
+    seed = skipped->second;
+    OPENSSL_cleanse(skipped->second.data(), skipped->second.size());
+    state.skippedKeys.erase(skipped);
+  }
+  else {
+    if (iteration - state.iteration > kMaxSkippedKeys) {
+      return false;
+    }
+    while (state.iteration < iteration) {
+      Key32 skippedSeed;
+      uint32_t index = state.iteration;
+      StepChain(state, skippedSeed);
+      state.skippedKeys[index] = skippedSeed;
+      OPENSSL_cleanse(skippedSeed.data(), skippedSeed.size());
+    }
+    StepChain(state, seed);
+
+    while (state.skippedKeys.size() > kMaxSkippedKeys) {
+      OPENSSL_cleanse(state.skippedKeys.begin()->second.data(), 32);
+      state.skippedKeys.erase(state.skippedKeys.begin());
+    }
+  }
+
+  unsigned char keys[44];
+  bool derived = DeriveMessageKeys(seed.data(), keys);
+  OPENSSL_cleanse(seed.data(), seed.size());
+  if (!derived) {
+    return false;
+  }
+  std::vector<unsigned char> plaintext;
+  ok = CryptoHelper::AESGCMDecrypt(keys, keys + 32, 12,
+                                   signedData.data(), prefixLen + headerLen,
+                                   ciphertext, ctLen, plaintext);
+  OPENSSL_cleanse(keys, sizeof(keys));
+  if (!ok) {
+    return false;
+  }
+
+  outSenderId = senderId;
+  outPlaintext.assign(plaintext.begin(), plaintext.end());
+  OPENSSL_cleanse(plaintext.data(), plaintext.size());
+  return true;
+}
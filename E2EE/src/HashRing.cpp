@@ -0,0 +1,72 @@
+#include "HashRing.h"
+#include "SipHash.h"
+#include <algorithm>
+
+namespace {
+  const std::string kNoNode;
+}
+
+HashRing::HashRing(const uint64_t key[2]) {
+  m_key[0] = key[0];
+  m_key[1] = key[1];
+}
+
+uint64_t
+HashRing::Hash(const std::string& value) const {
+  return SipHash::Hash24(m_key, reinterpret_cast<const unsigned char*>(value.data()), value.size());
+}
+
+void
+HashRing::Add(const std::string& node, uint32_t vnodes) {
+  if (std::find(m_nodes.begin(), m_nodes.end(), node) != m_nodes.end()) {
+    return;
+  }
+  uint32_t index = static_cast<uint32_t>(m_nodes.size());
+  m_nodes.push_back(node);
+  m_vnodes.push_back(vnodes);
+  for (uint32_t i = 0; i < vnodes; ++i) {
+    m_points.push_back(Point{ Hash(node + "#" + std::to_string(i)), index });
+  }
+  // Empates (casi imposibles) por nombre: el orden no depende del de Add
+  std::sort(m_points.begin(), m_points.end(), [this](const Point& a, const Point& b) {
+    return a.hash != b.hash ? a.hash < b.hash : m_nodes[a.node] < m_nodes[b.node];
+  });
+}
+
+bool
+HashRing::Remove(const std::string& node) {
+  auto it = std::find(m_nodes.begin(), m_nodes.end(), node);
+  if (it == m_nodes.end()) {
+    return false;
+  }
+  // Se reconstruye: los indices de los nodos de detras cambian
+  std::vector<std::string> nodes;
+  std::vector<uint32_t> vnodes;
+  for (size_t i = 0; i < m_nodes.size(); ++i) {
+    if (m_nodes[i] != node) {
+      nodes.push_back(m_nodes[i]);
+      vnodes.push_back(m_vnodes[i]);
+    }
+  }
+  m_nodes.clear();
+  m_vnodes.clear();
+  m_points.clear();
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    Add(nodes[i], vnodes[i]);
+  }
+  return true;
+}
+
+const std::string&
+HashRing::Owner(const std::string& key) const {
+  if (m_points.empty()) {
+    return kNoNode;
+  }
+  uint64_t hash = Hash(key);
+  auto it = std::upper_bound(m_points.begin(), m_points.end(), hash,
+                             [](uint64_t value, const Point& point) { return value < point.hash; });
+  if (it == m_points.end()) {
+    it = m_points.begin();  // Vuelta completa
+  }
+  return m_nodes[it->node];
+}
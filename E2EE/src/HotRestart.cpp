@@ -0,0 +1,491 @@
+#include "HotRestart.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace {
+  const uint32_t kMagic = 0x45324852;   // "E2HR"
+  const uint32_t kVersion = 1;
+  const uint32_t kMaxPayload = 256 * 1024 * 1024;
+
+  void
+  PutU32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      out[i] = static_cast<unsigned char>(value >> (24 - 8 * i));
+    }
+  }
+
+  uint32_t
+  GetU32(const unsigned char* in) {
+    return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | in[3];
+  }
+}
+
+HotRestart::~HotRestart() {
+  Close();
+}
+
+void
+HotRestart::SetTimeout(int timeoutMs) {
+  m_timeoutMs = timeoutMs;
+}
+
+#ifdef _WIN32
+
+namespace {
+  std::string
+  PipeName(const std::string& endpoint) {
+    return "\\\\.\\pipe\\" + endpoint;
+  }
+
+  // El pipe se abre con FILE_FLAG_OVERLAPPED en ambos extremos para poder
+  // esperar con plazo; vencido, la operacion se cancela
+  bool
+  Transfer(HANDLE pipe, bool write, void* data, DWORD len, int timeoutMs, DWORD& done) {
+    OVERLAPPED overlapped{};
+    overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    if (!overlapped.hEvent) {
+      return false;
+    }
+    BOOL ok = write ? WriteFile(pipe, data, len, nullptr, &overlapped)
+                    : ReadFile(pipe, data, len, nullptr, &overlapped);
+    if (!ok && GetLastError() != ERROR_IO_PENDING) {
+      CloseHandle(overlapped.hEvent);
+      return false;
+    }
+    DWORD wait = timeoutMs <= 0 ? INFINITE : static_cast<DWORD>(timeoutMs);
+    if (WaitForSingleObject(overlapped.hEvent, wait) != WAIT_OBJECT_0) {
+      CancelIo(pipe);
+      GetOverlappedResult(pipe, &overlapped, &done, TRUE);
+      CloseHandle(overlapped.hEvent);
+      return false;
+    }
+    ok = GetOverlappedResult(pipe, &overlapped, &done, FALSE);
+    CloseHandle(overlapped.hEvent);
+    return ok && done > 0;
+  }
+}
+
+bool
+HotRestart::Listen(const std::string& endpoint) {
+  Close();
+  m_pipe = CreateNamedPipeA(PipeName(endpoint).c_str(),
+                            PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                            PIPE_TYPE_BYTE | PIPE_READMODE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS,
+                            1, 64 * 1024, 64 * 1024, 0, nullptr);
+  if (m_pipe == INVALID_HANDLE_VALUE) {
+    m_pipe = nullptr;
+    std::cerr << "Error creating restart pipe: " << GetLastError() << std::endl;
+    return false;
+  }
+  m_endpoint = endpoint;
+  m_server = true;
+  return true;
+}
+
+bool
+HotRestart::Accept(int timeoutMs) {
+  if (!m_pipe || !m_server) {
+    return false;
+  }
+  if (m_peerProcess != 0) {   // Sucesor anterior que fallo: libera la instancia
+    DisconnectNamedPipe(m_pipe);
+    m_peerProcess = 0;
+  }
+  OVERLAPPED overlapped{};
+  overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+  if (!overlapped.hEvent) {
+    return false;
+  }
+  bool connected = false;
+  if (ConnectNamedPipe(m_pipe, &overlapped)) {
+    connected = true;
+  }
+  else if (GetLastError() == ERROR_PIPE_CONNECTED) {
+    connected = true;
+  }
+  else if (GetLastError() == ERROR_IO_PENDING) {
+    DWORD unused = 0;
+    if (WaitForSingleObject(overlapped.hEvent, static_cast<DWORD>(timeoutMs)) == WAIT_OBJECT_0) {
+      connected = GetOverlappedResult(m_pipe, &overlapped, &unused, FALSE) != 0;
+    }
+    else {
+      CancelIo(m_pipe);
+      GetOverlappedResult(m_pipe, &overlapped, &unused, TRUE);
+    }
+  }
+  CloseHandle(overlapped.hEvent);
+  if (!connected) {
+    return false;
+  }
+
+  unsigned char hello[12];
+  if (!ReadAll(hello, sizeof(hello)) || GetU32(hello) != kMagic || GetU32(hello + 4) != kVersion) {
+    DisconnectNamedPipe(m_pipe);
+    return false;
+  }
+  m_peerProcess = GetU32(hello + 8);
+  return true;
+}
+
+bool
+HotRestart::Connect(const std::string& endpoint) {
+  Close();
+  m_pipe = CreateFileA(PipeName(endpoint).c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr,
+                       OPEN_EXISTING, FILE_FLAG_OVERLAPPED, nullptr);
+  if (m_pipe == INVALID_HANDLE_VALUE) {
+    m_pipe = nullptr;
+    std::cerr << "Error connecting to restart pipe: " << GetLastError() << std::endl;
+    return false;
+  }
+  m_endpoint = endpoint;
+  m_server = false;
+
+  unsigned char hello[12];
+  PutU32(hello, kMagic);
+  PutU32(hello + 4, kVersion);
+  PutU32(hello + 8, static_cast<uint32_t>(GetCurrentProcessId()));
+  return WriteAll(hello, sizeof(hello));
+}
+
+bool
+HotRestart::Send(const std::string& payload, const std::vector<SOCKET>& sockets) {
+  if (sockets.size() > kMaxSockets || payload.size() > kMaxPayload) {
+    return false;
+  }
+  unsigned char header[8];
+  PutU32(header, static_cast<uint32_t>(payload.size()));
+  PutU32(header + 4, static_cast<uint32_t>(sockets.size()));
+  if (!WriteAll(header, sizeof(header))) {
+    return false;
+  }
+  for (SOCKET socket : sockets) {
+    WSAPROTOCOL_INFOW info{};
+    if (WSADuplicateSocketW(socket, m_peerProcess, &info) == SOCKET_ERROR) {
+      std::cerr << "Error duplicating socket: " << WSAGetLastError() << std::endl;
+      return false;
+    }
+    if (!WriteAll(&info, sizeof(info))) {
+      return false;
+    }
+  }
+  return payload.empty() || WriteAll(payload.data(), payload.size());
+}
+
+bool
+HotRestart::Receive(std::string& payload, std::vector<SOCKET>& sockets) {
+  unsigned char header[8];
+  if (!ReadAll(header, sizeof(header))) {
+    return false;
+  }
+  uint32_t length = GetU32(header);
+  uint32_t count = GetU32(header + 4);
+  if (count > kMaxSockets || length > kMaxPayload) {
+    return false;
+  }
+  sockets.clear();
+  for (uint32_t i = 0; i < count; ++i) {
+    WSAPROTOCOL_INFOW info{};
+    if (!ReadAll(&info, sizeof(info))) {
+      return false;
+    }
+    SOCKET socket = WSASocketW(FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO, FROM_PROTOCOL_INFO,
+                               &info, 0, WSA_FLAG_OVERLAPPED);
+    if (socket == INVALID_SOCKET) {
+      std::cerr << "Error importing socket: " << WSAGetLastError() << std::endl;
+    }
+    sockets.push_back(socket);   // Invalido en su sitio: el orden casa con el payload
+  }
+  payload.resize(length);
+  return length == 0 || ReadAll(&payload[0], length);
+}
+
+void
+HotRestart::Close() {
+  if (m_pipe) {
+    if (m_server) {
+      DisconnectNamedPipe(m_pipe);
+    }
+    CloseHandle(m_pipe);
+    m_pipe = nullptr;
+  }
+}
+
+bool
+HotRestart::WriteAll(const void* data, size_t len) {
+  const char* cursor = static_cast<const char*>(data);
+  while (len > 0) {
+    DWORD done = 0;
+    DWORD chunk = static_cast<DWORD>(std::min<size_t>(len, 1024 * 1024));
+    if (!Transfer(static_cast<HANDLE>(m_pipe), true, const_cast<char*>(cursor), chunk,
+                  m_timeoutMs, done)) {
+      return false;
+    }
+    cursor += done;
+    len -= done;
+  }
+  return true;
+}
+
+bool
+HotRestart::ReadAll(void* data, size_t len) {
+  char* cursor = static_cast<char*>(data);
+  while (len > 0) {
+    DWORD done = 0;
+    DWORD chunk = static_cast<DWORD>(std::min<size_t>(len, 1024 * 1024));
+    if (!Transfer(static_cast<HANDLE>(m_pipe), false, cursor, chunk, m_timeoutMs, done)) {
+      return false;
+    }
+    cursor += done;
+    len -= done;
+  }
+  return true;
+}
+
+#else
+
+namespace {
+  bool
+  FillAddress(const std::string& endpoint, sockaddr_un& address) {
+    if (endpoint.empty() || endpoint.size() >= sizeof(address.sun_path)) {
+      std::cerr << "Invalid restart endpoint: " << endpoint << std::endl;
+      return false;
+    }
+    address = sockaddr_un();
+    address.sun_family = AF_UNIX;
+    std::memcpy(address.sun_path, endpoint.data(), endpoint.size());
+    return true;
+  }
+
+#ifdef MSG_NOSIGNAL
+  const int kSendFlags = MSG_NOSIGNAL;   // Un sucesor que muere no mata al viejo
+#else
+  const int kSendFlags = 0;
+#endif
+
+  // Vencido el plazo, recv/send/recvmsg/sendmsg vuelven con EAGAIN
+  void
+  ApplyTimeout(int descriptor, int timeoutMs) {
+    timeval timeout{};
+    if (timeoutMs > 0) {
+      timeout.tv_sec = timeoutMs / 1000;
+      timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    }
+    ::setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    ::setsockopt(descriptor, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+  }
+}
+
+bool
+HotRestart::Listen(const std::string& endpoint) {
+  Close();
+  sockaddr_un address;
+  if (!FillAddress(endpoint, address)) {
+    return false;
+  }
+  m_listen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ::unlink(endpoint.c_str());   // De un proceso anterior que no limpio
+  if (m_listen < 0 ||
+      ::bind(m_listen, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+      ::listen(m_listen, 1) < 0) {
+    std::cerr << "Error creating restart socket: " << errno << std::endl;
+    Close();
+    return false;
+  }
+  m_endpoint = endpoint;
+  return true;
+}
+
+bool
+HotRestart::Accept(int timeoutMs) {
+  if (m_listen < 0) {
+    return false;
+  }
+  if (m_peer >= 0) {   // Sucesor anterior que fallo
+    ::close(m_peer);
+    m_peer = -1;
+  }
+  pollfd wait{};
+  wait.fd = m_listen;
+  wait.events = POLLIN;
+  if (::poll(&wait, 1, timeoutMs) <= 0) {
+    return false;
+  }
+  m_peer = ::accept(m_listen, nullptr, nullptr);
+  if (m_peer < 0) {
+    return false;
+  }
+  ApplyTimeout(m_peer, m_timeoutMs);
+
+  unsigned char hello[12];
+  if (!ReadAll(hello, sizeof(hello)) || GetU32(hello) != kMagic || GetU32(hello + 4) != kVersion) {
+    ::close(m_peer);
+    m_peer = -1;
+    return false;
+  }
+  m_peerProcess = GetU32(hello + 8);
+  return true;
+}
+
+bool
+HotRestart::Connect(const std::string& endpoint) {
+  Close();
+  sockaddr_un address;
+  if (!FillAddress(endpoint, address)) {
+    return false;
+  }
+  m_peer = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (m_peer < 0 || ::connect(m_peer, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0) {
+    std::cerr << "Error connecting to restart socket: " << errno << std::endl;
+    Close();
+    return false;
+  }
+  ApplyTimeout(m_peer, m_timeoutMs);
+
+  unsigned char hello[12];
+  PutU32(hello, kMagic);
+  PutU32(hello + 4, kVersion);
+  PutU32(hello + 8, static_cast<uint32_t>(::getpid()));
+  return WriteAll(hello, sizeof(hello));
+}
+
+// La cabecera viaja con los descriptores adjuntos (SCM_RIGHTS); el payload detras
+bool
+HotRestart::Send(const std::string& payload, const std::vector<SOCKET>& sockets) {
+  if (m_peer < 0 || sockets.size() > kMaxSockets || payload.size() > kMaxPayload) {
+    return false;
+  }
+  unsigned char header[8];
+  PutU32(header, static_cast<uint32_t>(payload.size()));
+  PutU32(header + 4, static_cast<uint32_t>(sockets.size()));
+
+  iovec vector{ header, sizeof(header) };
+  msghdr message{};
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxSockets)];
+  if (!sockets.empty()) {
+    message.msg_control = control;
+    message.msg_controllen = CMSG_SPACE(sizeof(int) * sockets.size());
+    cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+    std::memcpy(CMSG_DATA(rights), sockets.data(), sizeof(int) * sockets.size());
+  }
+  ssize_t sent = ::sendmsg(m_peer, &message, kSendFlags);
+  if (sent <= 0) {
+    return false;
+  }
+  if (static_cast<size_t>(sent) < sizeof(header) &&
+      !WriteAll(header + sent, sizeof(header) - static_cast<size_t>(sent))) {
+    return false;
+  }
+  return payload.empty() || WriteAll(payload.data(), payload.size());
+}
+
+bool
+HotRestart::Receive(std::string& payload, std::vector<SOCKET>& sockets) {
+  if (m_peer < 0) {
+    return false;
+  }
+  unsigned char header[8];
+  iovec vector{ header, sizeof(header) };
+  msghdr message{};
+  message.msg_iov = &vector;
+  message.msg_iovlen = 1;
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxSockets)];
+  message.msg_control = control;
+  message.msg_controllen = sizeof(control);
+  ssize_t received = ::recvmsg(m_peer, &message, 0);
+  if (received <= 0) {
+    return false;
+  }
+
+  sockets.clear();
+  for (cmsghdr* rights = CMSG_FIRSTHDR(&message); rights; rights = CMSG_NXTHDR(&message, rights)) {
+    if (rights->cmsg_level != SOL_SOCKET || rights->cmsg_type != SCM_RIGHTS) {
+      continue;
+    }
+    size_t count = (rights->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    const unsigned char* data = CMSG_DATA(rights);
+    for (size_t i = 0; i < count; ++i) {
+      int descriptor = -1;
+      std::memcpy(&descriptor, data + i * sizeof(int), sizeof(int));
+      sockets.push_back(descriptor);
+    }
+  }
+  if (static_cast<size_t>(received) < sizeof(header) &&
+      !ReadAll(header + received, sizeof(header) - static_cast<size_t>(received))) {
+    return false;
+  }
+  uint32_t length = GetU32(header);
+  if (GetU32(header + 4) != sockets.size() || (message.msg_flags & MSG_CTRUNC) ||
+      length > kMaxPayload) {
+    for (SOCKET socket : sockets) {
+      ::close(socket);
+    }
+    sockets.clear();
+    return false;
+  }
+  payload.resize(length);
+  return length == 0 || ReadAll(&payload[0], length);
+}
+
+void
+HotRestart::Close() {
+  if (m_peer >= 0) {
+    ::close(m_peer);
+    m_peer = -1;
+  }
+  if (m_listen >= 0) {
+    ::close(m_listen);
+    m_listen = -1;
+    ::unlink(m_endpoint.c_str());
+  }
+}
+
+bool
+HotRestart::WriteAll(const void* data, size_t len) {
+  const char* cursor = static_cast<const char*>(data);
+  while (len > 0) {
+    ssize_t sent = ::send(m_peer, cursor, len, kSendFlags);
+    if (sent < 0 && errno == EINTR) {
+      continue;
+    }
+    if (sent <= 0) {
+      return false;
+    }
+    cursor += sent;
+    len -= static_cast<size_t>(sent);
+  }
+  return true;
+}
+
+bool
+HotRestart::ReadAll(void* data, size_t len) {
+  char* cursor = static_cast<char*>(data);
+  while (len > 0) {
+    ssize_t received = ::recv(m_peer, cursor, len, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return false;
+    }
+    cursor += received;
+    len -= static_cast<size_t>(received);
+  }
+  return true;
+}
+
+#endif
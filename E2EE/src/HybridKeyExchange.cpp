@@ -0,0 +1,208 @@
+#include "HybridKeyExchange.h"
+#include "CryptoHelper.h"
+#include "AlgorithmCache.h"
+
+namespace {
+  const char* kMLKEMName = "ML-KEM-768";
+}
+
+HybridKeyExchange::HybridKeyExchange() : m_x25519(nullptr), m_mlkem(nullptr) {
+}
+
+HybridKeyExchange::~HybridKeyExchange() {
+  EVP_PKEY_free(m_x25519);
+  EVP_PKEY_free(m_mlkem);
+}
+
+bool
+HybridKeyExchange::IsAvailable() {
+  return AlgorithmCache::HasMLKEM();
+}
+
+std::vector<unsigned char>
+HybridKeyExchange::SupportedModes() {
+  std::vector<unsigned char> modes;
+  if (IsAvailable()) {
+    modes.push_back(static_cast<unsigned char>(HandshakeMode::HybridPQ));
+  }
+  modes.push_back(static_cast<unsigned char>(HandshakeMode::RSA));
+  return modes;
+}
+
+HandshakeMode
+HybridKeyExchange::Negotiate(const std::vector<unsigned char>& peerModes) {
+  for (unsigned char mode : SupportedModes()) {
+    for (unsigned char peer : peerModes) {
+      if (mode == peer) {
+        return static_cast<HandshakeMode>(mode);
+      }
+    }
+  }
+  return HandshakeMode::RSA;
+}
+
+bool
+HybridKeyExchange::DeriveSessionKey(HandshakeMode mode, const unsigned char transportKey[32],
+                                    const unsigned char* hybridSecret,
+                                    const std::vector<unsigned char>& offeredModes,
+                                    unsigned char outKey[32]) {
+  unsigned char ikm[64];
+  size_t ikmLen = 32;
+  std::memcpy(ikm, transportKey, 32);
+  const char* info = "E2EE-Handshake-RSA";
+  if (mode == HandshakeMode::HybridPQ) {
+    if (!hybridSecret) {
+      return false;
+    }
+    std::memcpy(ikm + 32, hybridSecret, 32);
+    ikmLen = 64;
+    info = "E2EE-Handshake-HybridPQ";
+  }
+  bool ok = CryptoHelper::HKDFSHA256(ikm, ikmLen, offeredModes.data(), offeredModes.size(),
+                                     info, outKey, 32);
+  OPENSSL_cleanse(ikm, sizeof(ikm));
+  return ok;
+}
+
+bool
+HybridKeyExchange::GenerateKeyPair() {
+  EVP_PKEY_free(m_x25519);
+  EVP_PKEY_free(m_mlkem);
+  m_x25519 = EVP_PKEY_Q_keygen(nullptr, nullptr, "X25519");
+  m_mlkem = EVP_PKEY_Q_keygen(nullptr, nullptr, kMLKEMName);
+  m_share.clear();
+  if (!m_x25519 || !m_mlkem) {
+    std::cerr << "Error generating hybrid key pair" << std::endl;
+    return false;
+  }
+
+  m_share.resize(kShareSize);
+  size_t xLen = kX25519Size;
+  size_t kLen = kMLKEMPublicSize;
+  if (EVP_PKEY_get_raw_public_key(m_x25519, m_share.data(), &xLen) != 1 ||
+      EVP_PKEY_get_raw_public_key(m_mlkem, m_share.data() + kX25519Size, &kLen) != 1 ||
+      xLen != kX25519Size || kLen != kMLKEMPublicSize) {
+    m_share.clear();
+    return false;
+  }
+  return true;
+}
+
+std::vector<unsigned char>
+HybridKeyExchange::GetPublicShare() const {
+  return m_share;
+}
+
+bool
+HybridKeyExchange::X25519Derive(EVP_PKEY* self, const unsigned char* peerPublic,
+                                unsigned char out[32]) {
+  EVP_PKEY* peer = EVP_PKEY_new_raw_public_key(EVP_PKEY_X25519, nullptr, peerPublic, kX25519Size);
+  if (!peer) {
+    return false;
+  }
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(self, nullptr);
+  size_t outLen = 32;
+  bool ok = EVP_PKEY_derive_init(ctx) == 1 &&
+            EVP_PKEY_derive_set_peer(ctx, peer) == 1 &&
+            EVP_PKEY_derive(ctx, out, &outLen) == 1 &&
+            outLen == 32;
+  EVP_PKEY_CTX_free(ctx);
+  EVP_PKEY_free(peer);
+  return ok;
+}
+
+bool
+HybridKeyExchange::Combine(const unsigned char mlkemSecret[32],
+                           const unsigned char x25519Secret[32],
+                           const std::vector<unsigned char>& share,
+                           const std::vector<unsigned char>& response,
+                           unsigned char outSecret[32]) {
+  // Salt = SHA-256(share || response): liga el secreto a ambos mensajes
+  unsigned char transcript[32];
+  EVP_MD_CTX* md = EVP_MD_CTX_new();
+  bool ok = EVP_DigestInit_ex(md, AlgorithmCache::SHA256(), nullptr) == 1 &&
+            EVP_DigestUpdate(md, share.data(), share.size()) == 1 &&
+            EVP_DigestUpdate(md, response.data(), response.size()) == 1 &&
+            EVP_DigestFinal_ex(md, transcript, nullptr) == 1;
+  EVP_MD_CTX_free(md);
+  if (!ok) {
+    return false;
+  }
+
+  unsigned char ikm[64];
+  std::memcpy(ikm, mlkemSecret, 32);
+  std::memcpy(ikm + 32, x25519Secret, 32);
+  ok = CryptoHelper::HKDFSHA256(ikm, sizeof(ikm), transcript, sizeof(transcript),
+                                "E2EE-HybridPQ-MLKEM768-X25519", outSecret, 32);
+  OPENSSL_cleanse(ikm, sizeof(ikm));
+  return ok;
+}
+
+bool
+HybridKeyExchange::Encapsulate(const std::vector<unsigned char>& peerShare,
+                               std::vector<unsigned char>& outResponse,
+                               unsigned char outSecret[32]) {
+  if (peerShare.size() != kShareSize) {
+    return false;
+  }
+
+  EVP_PKEY* peerKEM = EVP_PKEY_new_raw_public_key_ex(nullptr, kMLKEMName, nullptr,
+                                                     peerShare.data() + kX25519Size,
+                                                     kMLKEMPublicSize);
+  EVP_PKEY_free(m_x25519);
+  m_x25519 = EVP_PKEY_Q_keygen(nullptr, nullptr, "X25519");
+  if (!peerKEM || !m_x25519) {
+    EVP_PKEY_free(peerKEM);
+    return false;
+  }
+
+  unsigned char mlkemSecret[32];
+  unsigned char x25519Secret[32];
+  size_t ctLen = kMLKEMCiphertextSize;
+  size_t ssLen = sizeof(mlkemSecret);
+  size_t xLen = kX25519Size;
+  outResponse.assign(kResponseSize, 0);
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(peerKEM, nullptr);
+  bool ok = EVP_PKEY_encapsulate_init(ctx, nullptr) == 1 &&
+            EVP_PKEY_encapsulate(ctx, outResponse.data() + kX25519Size, &ctLen,
+                                 mlkemSecret, &ssLen) == 1 &&
+            ctLen == kMLKEMCiphertextSize && ssLen == 32 &&
+            EVP_PKEY_get_raw_public_key(m_x25519, outResponse.data(), &xLen) == 1 &&
+            X25519Derive(m_x25519, peerShare.data(), x25519Secret) &&
+            Combine(mlkemSecret, x25519Secret, peerShare, outResponse, outSecret);
+  EVP_PKEY_CTX_free(ctx);
+  EVP_PKEY_free(peerKEM);
+  OPENSSL_cleanse(mlkemSecret, sizeof(mlkemSecret));
+  OPENSSL_cleanse(x25519Secret, sizeof(x25519Secret));
+
+  if (!ok) {
+    outResponse.clear();
+  }
+  return ok;
+}
+
+bool
+HybridKeyExchange::Decapsulate(const std::vector<unsigned char>& response,
+                               unsigned char outSecret[32]) {
+  if (!m_mlkem || !m_x25519 || response.size() != kResponseSize) {
+    return false;
+  }
+
+  unsigned char mlkemSecret[32];
+  unsigned char x25519Secret[32];
+  size_t ssLen = sizeof(mlkemSecret);
+
+  EVP_PKEY_CTX* ctx = EVP_PKEY_CTX_new(m_mlkem, nullptr);
+  bool ok = EVP_PKEY_decapsulate_init(ctx, nullptr) == 1 &&
+            EVP_PKEY_decapsulate(ctx, mlkemSecret, &ssLen,
+                                 response.data() + kX25519Size, kMLKEMCiphertextSize) == 1 &&
+            ssLen == 32 &&
+            X25519Derive(m_x25519, response.data(), x25519Secret) &&
+            Combine(mlkemSecret, x25519Secret, m_share, response, outSecret);
+  EVP_PKEY_CTX_free(ctx);
+  OPENSSL_cleanse(mlkemSecret, sizeof(mlkemSecret));
+  OPENSSL_cleanse(x25519Secret, sizeof(x25519Secret));
+  return ok;
+}
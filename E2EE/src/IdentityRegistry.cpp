@@ -0,0 +1,218 @@
+#include "IdentityRegistry.h"
+#include "openssl/evp.h"
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+  // fflush solo llega al sistema; esto llega al disco
+  bool
+  SyncFile(std::FILE* file) {
+    if (std::fflush(file) != 0) {
+      return false;
+    }
+#ifdef _WIN32
+    return _commit(_fileno(file)) == 0;
+#else
+    return fsync(fileno(file)) == 0;
+#endif
+  }
+
+  void
+  AppendRecord(std::string& out, const std::string& user, const IdentityRegistry::Key& key) {
+    out.push_back(static_cast<char>(user.size()));
+    out += user;
+    out.append(reinterpret_cast<const char*>(key.data()), key.size());
+  }
+
+  // Recorre registros completos; devuelve los bytes consumidos
+  template <typename Visit>
+  size_t
+  ParseRecords(const std::string& data, Visit visit) {
+    size_t offset = 0;
+    while (offset < data.size()) {
+      size_t userLen = static_cast<unsigned char>(data[offset]);
+      if (userLen == 0 || data.size() - offset < 1 + userLen + 32) {
+        break;
+      }
+      std::string user = data.substr(offset + 1, userLen);
+      IdentityRegistry::Key key;
+      std::memcpy(key.data(), data.data() + offset + 1 + userLen, key.size());
+      visit(user, key);
+      offset += 1 + userLen + key.size();
+    }
+    return offset;
+  }
+}
+
+IdentityRegistry::~IdentityRegistry() {
+  if (m_file) {
+    std::fclose(m_file);
+  }
+}
+
+bool
+IdentityRegistry::Open(const std::string& path) {
+  std::string data;
+  {
+    std::ifstream in(path, std::ios::binary);
+    data.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+  }
+
+  std::unique_lock<std::shared_mutex> guard(m_lock);
+  size_t valid = ParseRecords(data, [this](const std::string& user, const Key& key) {
+    m_keys.emplace(user, key);
+  });
+  if (valid < data.size()) {
+    std::error_code ec;
+    std::filesystem::resize_file(path, valid, ec);
+    if (ec) {
+      std::cerr << "Error truncating identity file: " << ec.message() << std::endl;
+      return false;
+    }
+  }
+  if (m_file) {
+    std::fclose(m_file);
+  }
+  m_file = std::fopen(path.c_str(), "ab");
+  if (!m_file) {
+    std::cerr << "Error opening identity file: " << path << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool
+IdentityRegistry::Bind(const std::string& user, const Key& key) {
+  if (user.empty() || user.size() > 255) {
+    return false;
+  }
+  {
+    std::shared_lock<std::shared_mutex> guard(m_lock);
+    auto it = m_keys.find(user);
+    if (it != m_keys.end()) {
+      return it->second == key;
+    }
+  }
+
+  std::unique_lock<std::shared_mutex> guard(m_lock);
+  auto it = m_keys.find(user);
+  if (it != m_keys.end()) {
+    return it->second == key;
+  }
+  // En disco antes de aceptarla: tras una caida nadie puede fijar otra
+  if (m_file) {
+    std::string record;
+    AppendRecord(record, user, key);
+    if (std::fwrite(record.data(), 1, record.size(), m_file) != record.size() ||
+        !SyncFile(m_file)) {
+      std::cerr << "Error writing identity file" << std::endl;
+      return false;
+    }
+  }
+  m_keys.emplace(user, key);
+  return true;
+}
+
+bool
+IdentityRegistry::Find(const std::string& user, Key& out) const {
+  std::shared_lock<std::shared_mutex> guard(m_lock);
+  auto it = m_keys.find(user);
+  if (it == m_keys.end()) {
+    return false;
+  }
+  out = it->second;
+  return true;
+}
+
+size_t
+IdentityRegistry::Size() const {
+  std::shared_lock<std::shared_mutex> guard(m_lock);
+  return m_keys.size();
+}
+
+void
+IdentityRegistry::Users(std::vector<std::string>& out) const {
+  std::shared_lock<std::shared_mutex> guard(m_lock);
+  out.reserve(out.size() + m_keys.size());
+  for (const auto& entry : m_keys) {
+    out.push_back(entry.first);
+  }
+}
+
+// El mismo formato que el fichero
+void
+IdentityRegistry::Export(std::string& out) const {
+  std::shared_lock<std::shared_mutex> guard(m_lock);
+  for (const auto& entry : m_keys) {
+    AppendRecord(out, entry.first, entry.second);
+  }
+}
+
+void
+IdentityRegistry::Export(const std::vector<std::string>& users, std::string& out) const {
+  std::shared_lock<std::shared_mutex> guard(m_lock);
+  for (const std::string& user : users) {
+    auto it = m_keys.find(user);
+    if (it != m_keys.end()) {
+      AppendRecord(out, it->first, it->second);
+    }
+  }
+}
+
+bool
+IdentityRegistry::Import(const std::string& state) {
+  std::unique_lock<std::shared_mutex> guard(m_lock);
+  return ParseRecords(state, [this](const std::string& user, const Key& key) {
+    m_keys.emplace(user, key);
+  }) == state.size();
+}
+
+bool
+IdentityRegistry::Merge(const std::string& state) {
+  std::vector<std::pair<std::string, Key>> added;
+  std::string records;
+  std::unique_lock<std::shared_mutex> guard(m_lock);
+  size_t valid = ParseRecords(state, [&](const std::string& user, const Key& key) {
+    if (!m_keys.count(user)) {
+      added.emplace_back(user, key);
+      AppendRecord(records, user, key);
+    }
+  });
+  if (valid != state.size()) {
+    return false;
+  }
+  if (m_file && !records.empty() &&
+      (std::fwrite(records.data(), 1, records.size(), m_file) != records.size() ||
+       !SyncFile(m_file))) {
+    std::cerr << "Error writing identity file" << std::endl;
+    return false;
+  }
+  // Una clave repetida en state: vale la primera, como al cargar el fichero
+  for (auto& entry : added) {
+    m_keys.emplace(std::move(entry.first), entry.second);
+  }
+  return true;
+}
+
+bool
+IdentityRegistry::Verify(const Key& key, const unsigned char* data, size_t len,
+                         const unsigned char signature[kSignatureSize]) {
+  EVP_PKEY* pub = EVP_PKEY_new_raw_public_key(EVP_PKEY_ED25519, nullptr, key.data(), key.size());
+  if (!pub) {
+    return false;
+  }
+  EVP_MD_CTX* md = EVP_MD_CTX_new();
+  bool ok = EVP_DigestVerifyInit(md, nullptr, nullptr, nullptr, pub) == 1 &&
+            EVP_DigestVerify(md, signature, kSignatureSize, data, len) == 1;
+  EVP_MD_CTX_free(md);
+  EVP_PKEY_free(pub);
+  return ok;
+}
@@ -0,0 +1,220 @@
+#include "MappedFile.h"
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile() {
+  Close();
+}
+
+bool
+MappedFile::Open(const std::string& path) {
+  return Map(path, 0, false);
+}
+
+bool
+MappedFile::Create(const std::string& path, uint64_t size) {
+  return Map(path, size, true);
+}
+
+#ifdef _WIN32
+
+bool
+MappedFile::Map(const std::string& path, uint64_t size, bool writable) {
+  Close();
+  HANDLE file = CreateFileA(path.c_str(),
+                            writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                            FILE_SHARE_READ, nullptr,
+                            writable ? CREATE_ALWAYS : OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    std::cerr << "Error opening " << path << std::endl;
+    return false;
+  }
+  m_file = file;
+
+  if (!writable) {
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize)) {
+      Close();
+      return false;
+    }
+    size = static_cast<uint64_t>(fileSize.QuadPart);
+  }
+  m_size = size;
+  m_writable = writable;
+  m_open = true;
+
+  // Un fichero vacio no se puede proyectar; queda abierto con Data() nulo
+  if (size == 0) {
+    return true;
+  }
+
+  HANDLE mapping = CreateFileMappingA(file, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY,
+                                      static_cast<DWORD>(size >> 32),
+                                      static_cast<DWORD>(size & 0xFFFFFFFF), nullptr);
+  if (!mapping) {
+    std::cerr << "Error mapping " << path << std::endl;
+    Close();
+    return false;
+  }
+  m_mapping = mapping;
+
+  m_data = static_cast<unsigned char*>(
+    MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+  if (!m_data) {
+    std::cerr << "Error mapping " << path << std::endl;
+    Close();
+    return false;
+  }
+  return true;
+}
+
+bool
+MappedFile::Flush() {
+  if (!m_writable) {
+    return false;
+  }
+  if (m_data && !FlushViewOfFile(m_data, 0)) {
+    return false;
+  }
+  return FlushFileBuffers(static_cast<HANDLE>(m_file)) != 0;
+}
+
+bool
+MappedFile::Flush(uint64_t offset, uint64_t len) {
+  if (!m_writable || offset > m_size) {
+    return false;
+  }
+  len = std::min(len, m_size - offset);
+  if (m_data && len > 0 && !FlushViewOfFile(m_data + offset, static_cast<SIZE_T>(len))) {
+    return false;
+  }
+  return FlushFileBuffers(static_cast<HANDLE>(m_file)) != 0;
+}
+
+void
+MappedFile::Close() {
+  if (m_data) {
+    UnmapViewOfFile(m_data);
+  }
+  if (m_mapping) {
+    CloseHandle(static_cast<HANDLE>(m_mapping));
+  }
+  if (m_file) {
+    CloseHandle(static_cast<HANDLE>(m_file));
+  }
+  m_data = nullptr;
+  m_mapping = nullptr;
+  m_file = nullptr;
+  m_size = 0;
+  m_open = false;
+  m_writable = false;
+}
+
+#else
+
+bool
+MappedFile::Map(const std::string& path, uint64_t size, bool writable) {
+  Close();
+  int fd = writable ? open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0600)
+                    : open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cerr << "Error opening " << path << std::endl;
+    return false;
+  }
+  m_fd = fd;
+
+  if (writable) {
+    // Reservado de verdad: en un fichero disperso un disco lleno seria SIGBUS
+    // al escribir en la proyeccion, no un error de Create
+    if (size > 0 && posix_fallocate(fd, 0, static_cast<off_t>(size)) != 0 &&
+        ftruncate(fd, static_cast<off_t>(size)) != 0) {
+      Close();
+      return false;
+    }
+    if (size == 0 && ftruncate(fd, 0) != 0) {
+      Close();
+      return false;
+    }
+  }
+  else {
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      Close();
+      return false;
+    }
+    size = static_cast<uint64_t>(st.st_size);
+  }
+  m_size = size;
+  m_writable = writable;
+  m_open = true;
+
+  if (size == 0) {
+    return true;
+  }
+
+  void* p = mmap(nullptr, static_cast<size_t>(size),
+                 writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    std::cerr << "Error mapping " << path << std::endl;
+    Close();
+    return false;
+  }
+  m_data = static_cast<unsigned char*>(p);
+  return true;
+}
+
+bool
+MappedFile::Flush() {
+  if (!m_writable) {
+    return false;
+  }
+  if (m_data && msync(m_data, static_cast<size_t>(m_size), MS_SYNC) != 0) {
+    return false;
+  }
+  return fsync(m_fd) == 0;
+}
+
+bool
+MappedFile::Flush(uint64_t offset, uint64_t len) {
+  if (!m_writable || offset > m_size) {
+    return false;
+  }
+  len = std::min(len, m_size - offset);
+  if (!m_data || len == 0) {
+    return true;
+  }
+  // msync exige una direccion alineada a pagina; con MS_SYNC escribe el rango
+  // y los metadatos que hagan falta para leerlo (el tamano no cambia)
+  uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+  uint64_t start = offset - offset % page;
+  return msync(m_data + start, static_cast<size_t>(offset + len - start), MS_SYNC) == 0;
+}
+
+void
+MappedFile::Close() {
+  if (m_data) {
+    munmap(m_data, static_cast<size_t>(m_size));
+  }
+  if (m_fd >= 0) {
+    close(m_fd);
+  }
+  m_data = nullptr;
+  m_fd = -1;
+  m_size = 0;
+  m_open = false;
+  m_writable = false;
+}
+
+#endif
@@ -0,0 +1,404 @@
+#include "MessageCompressor.h"
+#include "openssl/crypto.h"
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace {
+  // Cabecera de cada mensaje
+  const unsigned char kRaw = 0;
+  const unsigned char kLZ4 = 1;
+  const unsigned char kLZ4Dictionary = 2;
+
+  // Parametros del formato de bloque LZ4
+  const int kHashLog = 12;
+  const uint32_t kEmpty = UINT32_MAX;
+  const size_t kMinMatch = 4;
+  const size_t kLastLiterals = 5;
+  const size_t kMatchFindLimit = 12;
+  const size_t kMaxOffset = 65535;
+
+  // Entrenamiento
+  const size_t kDmerSize = 8;
+  const size_t kSegmentSize = 32;
+
+  uint32_t
+  Read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+
+  uint32_t
+  Hash(uint32_t sequence) {
+    return (sequence * 2654435761u) >> (32 - kHashLog);
+  }
+
+  void
+  PutU32(std::vector<unsigned char>& out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+    }
+  }
+
+  uint32_t
+  GetU32(const unsigned char* p) {
+    return uint32_t(p[0]) | (uint32_t(p[1]) << 8) | (uint32_t(p[2]) << 16) | (uint32_t(p[3]) << 24);
+  }
+
+  void
+  PutLength(std::vector<unsigned char>& out, size_t length) {
+    while (length >= 255) {
+      out.push_back(255);
+      length -= 255;
+    }
+    out.push_back(static_cast<unsigned char>(length));
+  }
+
+  /**
+   * Comprime work[start, end) como un bloque LZ4. Las posiciones [0, start)
+   * son el diccionario y pueden usarse como referencias.
+   */
+  void
+  CompressBlock(const unsigned char* work, size_t start, size_t end,
+                std::vector<uint32_t>& table, std::vector<unsigned char>& out) {
+    size_t anchor = start;
+    size_t ip = start;
+
+    if (end - start >= kMatchFindLimit + 1) {
+      const size_t matchFindLimit = end - kMatchFindLimit;
+      const size_t matchLimit = end - kLastLiterals;
+
+      while (ip < matchFindLimit) {
+        uint32_t sequence = Read32(work + ip);
+        uint32_t& slot = table[Hash(sequence)];
+        size_t ref = slot;
+        slot = static_cast<uint32_t>(ip);
+
+        if (ref == kEmpty || ip - ref > kMaxOffset || Read32(work + ref) != sequence) {
+          ++ip;
+          continue;
+        }
+
+        // Extiende hacia atras dentro de los literales pendientes
+        while (ip > anchor && ref > 0 && work[ip - 1] == work[ref - 1]) {
+          --ip;
+          --ref;
+        }
+
+        size_t matchLen = kMinMatch;
+        while (ip + matchLen < matchLimit && work[ip + matchLen] == work[ref + matchLen]) {
+          ++matchLen;
+        }
+
+        size_t literals = ip - anchor;
+        size_t extra = matchLen - kMinMatch;
+        out.push_back(static_cast<unsigned char>((std::min<size_t>(literals, 15) << 4) |
+                                                 std::min<size_t>(extra, 15)));
+        if (literals >= 15) {
+          PutLength(out, literals - 15);
+        }
+        out.insert(out.end(), work + anchor, work + ip);
+        size_t offset = ip - ref;
+        out.push_back(static_cast<unsigned char>(offset));
+        out.push_back(static_cast<unsigned char>(offset >> 8));
+        if (extra >= 15) {
+          PutLength(out, extra - 15);
+        }
+
+        ip += matchLen;
+        anchor = ip;
+        if (ip >= 2 && ip < matchFindLimit) {
+          table[Hash(Read32(work + ip - 2))] = static_cast<uint32_t>(ip - 2);
+        }
+      }
+    }
+
+    // Ultimos literales
+    size_t literals = end - anchor;
+    out.push_back(static_cast<unsigned char>(std::min<size_t>(literals, 15) << 4));
+    if (literals >= 15) {
+      PutLength(out, literals - 15);
+    }
+    out.insert(out.end(), work + anchor, work + end);
+  }
+
+  bool
+  ReadLength(const unsigned char*& ip, const unsigned char* end, size_t& length) {
+    unsigned char byte;
+    do {
+      if (ip >= end) {
+        return false;
+      }
+      byte = *ip++;
+      length += byte;
+    } while (byte == 255);
+    return true;
+  }
+
+  /**
+   * Descomprime un bloque LZ4 al final de work (que ya contiene el
+   * diccionario). Falla si la salida no mide exactamente expected bytes.
+   */
+  bool
+  DecompressBlock(const unsigned char* ip, const unsigned char* end,
+                  std::vector<unsigned char>& work, size_t expected) {
+    const size_t start = work.size();
+    const size_t limit = start + expected;
+    work.reserve(limit);
+
+    while (ip < end) {
+      unsigned char token = *ip++;
+      size_t literals = token >> 4;
+      if (literals == 15 && !ReadLength(ip, end, literals)) {
+        return false;
+      }
+      if (literals > static_cast<size_t>(end - ip) || work.size() + literals > limit) {
+        return false;
+      }
+      work.insert(work.end(), ip, ip + literals);
+      ip += literals;
+      if (ip == end) {
+        break;  // La ultima secuencia solo lleva literales
+      }
+
+      if (end - ip < 2) {
+        return false;
+      }
+      size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+      ip += 2;
+      size_t matchLen = token & 15;
+      if (matchLen == 15 && !ReadLength(ip, end, matchLen)) {
+        return false;
+      }
+      matchLen += kMinMatch;
+
+      if (offset == 0 || offset > work.size() || work.size() + matchLen > limit) {
+        return false;
+      }
+      // Copia byte a byte: la referencia puede solaparse con la salida
+      size_t from = work.size() - offset;
+      for (size_t i = 0; i < matchLen; ++i) {
+        work.push_back(work[from + i]);
+      }
+    }
+    return work.size() == limit;
+  }
+
+  uint64_t
+  Dmer(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+    return value;
+  }
+}
+
+std::shared_ptr<CompressionDictionary>
+CompressionDictionary::Load(uint32_t id, const std::string& type,
+                            const std::vector<unsigned char>& content) {
+  auto dictionary = std::make_shared<CompressionDictionary>();
+  dictionary->id = id;
+  dictionary->type = type;
+  dictionary->content.assign(content.end() - std::min(content.size(), kMaxSize), content.end());
+
+  // Las posiciones del diccionario se indexan una sola vez
+  dictionary->hashTable.assign(size_t(1) << kHashLog, kEmpty);
+  const std::vector<unsigned char>& bytes = dictionary->content;
+  for (size_t i = 0; i + kMinMatch <= bytes.size(); ++i) {
+    dictionary->hashTable[Hash(Read32(bytes.data() + i))] = static_cast<uint32_t>(i);
+  }
+  return dictionary;
+}
+
+std::shared_ptr<CompressionDictionary>
+CompressionDictionary::Train(uint32_t id, const std::string& type,
+                             const std::vector<std::string>& samples,
+                             size_t maxSize) {
+  maxSize = std::min(maxSize, kMaxSize);
+
+  // Frecuencia de cada d-mer contando una vez por muestra
+  std::unordered_map<uint64_t, uint32_t> frequency;
+  for (const std::string& sample : samples) {
+    std::unordered_set<uint64_t> seen;
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(sample.data());
+    for (size_t i = 0; i + kDmerSize <= sample.size(); ++i) {
+      if (seen.insert(Dmer(p + i)).second) {
+        ++frequency[Dmer(p + i)];
+      }
+    }
+  }
+
+  struct Segment {
+    const unsigned char* data;
+    size_t len;
+  };
+  std::vector<Segment> segments;
+  for (const std::string& sample : samples) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(sample.data());
+    for (size_t i = 0; i < sample.size(); i += kSegmentSize) {
+      segments.push_back({ p + i, std::min(kSegmentSize, sample.size() - i) });
+    }
+  }
+
+  auto score = [&](const Segment& segment) {
+    uint64_t total = 0;
+    for (size_t i = 0; i + kDmerSize <= segment.len; ++i) {
+      auto it = frequency.find(Dmer(segment.data + i));
+      if (it != frequency.end() && it->second > 1) {
+        total += it->second;
+      }
+    }
+    return total;
+  };
+
+  // Greedy perezoso: se recalcula la puntuacion al sacar cada candidato
+  std::priority_queue<std::pair<uint64_t, size_t>> candidates;
+  for (size_t i = 0; i < segments.size(); ++i) {
+    candidates.push({ score(segments[i]), i });
+  }
+
+  std::vector<size_t> chosen;
+  size_t total = 0;
+  while (!candidates.empty() && total < maxSize) {
+    auto top = candidates.top();
+    candidates.pop();
+    uint64_t current = score(segments[top.second]);
+    if (current == 0) {
+      continue;  // Todo lo que aportaba ya esta cubierto
+    }
+    if (!candidates.empty() && current < candidates.top().first) {
+      candidates.push({ current, top.second });
+      continue;
+    }
+
+    const Segment& segment = segments[top.second];
+    chosen.push_back(top.second);
+    total += segment.len;
+    for (size_t i = 0; i + kDmerSize <= segment.len; ++i) {
+      frequency.erase(Dmer(segment.data + i));  // Ya cubierto
+    }
+  }
+
+  // Lo mas valioso al final: offsets mas cortos desde el mensaje
+  std::vector<unsigned char> content;
+  for (auto it = chosen.rbegin(); it != chosen.rend(); ++it) {
+    const Segment& segment = segments[*it];
+    content.insert(content.end(), segment.data, segment.data + segment.len);
+  }
+  return Load(id, type, content);
+}
+
+MessageCompressor::MessageCompressor(size_t threshold)
+  : m_threshold(threshold), m_rawBytes(0), m_compressedBytes(0) {
+}
+
+void
+MessageCompressor::SetDictionary(std::shared_ptr<const CompressionDictionary> dictionary) {
+  m_dictionary = std::move(dictionary);
+}
+
+uint32_t
+MessageCompressor::Negotiate(const std::vector<uint32_t>& offered,
+                             const std::vector<uint32_t>& supported) {
+  for (uint32_t id : offered) {
+    if (id != 0 && std::find(supported.begin(), supported.end(), id) != supported.end()) {
+      return id;
+    }
+  }
+  return 0;
+}
+
+std::vector<unsigned char>
+MessageCompressor::Compress(const unsigned char* data, size_t len) {
+  std::vector<unsigned char> out;
+  m_rawBytes.fetch_add(len, std::memory_order_relaxed);
+
+  if (len >= m_threshold && len <= kMaxMessageSize) {
+    const CompressionDictionary* dictionary = m_dictionary.get();
+    size_t dictLen = dictionary ? dictionary->content.size() : 0;
+
+    // Buffer de trabajo por hilo: diccionario || mensaje
+    thread_local std::vector<unsigned char> work;
+    thread_local std::vector<uint32_t> table;
+    work.resize(dictLen + len);
+    if (dictLen) {
+      std::memcpy(work.data(), dictionary->content.data(), dictLen);
+      table = dictionary->hashTable;
+    }
+    else {
+      table.assign(size_t(1) << kHashLog, kEmpty);
+    }
+    std::memcpy(work.data() + dictLen, data, len);
+
+    out.reserve(len);
+    out.push_back(dictLen ? kLZ4Dictionary : kLZ4);
+    if (dictLen) {
+      PutU32(out, dictionary->id);
+    }
+    PutU32(out, static_cast<uint32_t>(len));
+    CompressBlock(work.data(), dictLen, dictLen + len, table, out);
+    OPENSSL_cleanse(work.data() + dictLen, len);
+
+    if (out.size() < len + 1) {
+      m_compressedBytes.fetch_add(out.size(), std::memory_order_relaxed);
+      return out;
+    }
+    out.clear();
+  }
+
+  out.reserve(len + 1);
+  out.push_back(kRaw);
+  out.insert(out.end(), data, data + len);
+  m_compressedBytes.fetch_add(out.size(), std::memory_order_relaxed);
+  return out;
+}
+
+bool
+MessageCompressor::Decompress(const unsigned char* data, size_t len,
+                              std::vector<unsigned char>& out) const {
+  out.clear();
+  if (len < 1) {
+    return false;
+  }
+
+  const unsigned char* end = data + len;
+  unsigned char mode = *data++;
+  if (mode == kRaw) {
+    out.assign(data, end);
+    return true;
+  }
+
+  const CompressionDictionary* dictionary = nullptr;
+  if (mode == kLZ4Dictionary) {
+    if (end - data < 4 || !m_dictionary || GetU32(data) != m_dictionary->id) {
+      return false;
+    }
+    dictionary = m_dictionary.get();
+    data += 4;
+  }
+  else if (mode != kLZ4) {
+    return false;
+  }
+
+  if (end - data < 4) {
+    return false;
+  }
+  size_t expected = GetU32(data);
+  data += 4;
+  if (expected > kMaxMessageSize) {
+    return false;
+  }
+
+  if (!dictionary) {
+    return DecompressBlock(data, end, out, expected);
+  }
+
+  std::vector<unsigned char> work(dictionary->content);
+  if (!DecompressBlock(data, end, work, expected)) {
+    return false;
+  }
+  out.assign(work.begin() + dictionary->content.size(), work.end());
+  OPENSSL_cleanse(work.data(), work.size());
+  return true;
+}
@@ -0,0 +1,467 @@
+#include "MultiHash.h"
+#include "openssl/crypto.h"
+#include <algorithm>
+#include <array>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define E2EE_MULTIHASH_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define E2EE_TARGET(x)
+#else
+#define E2EE_TARGET(x) __attribute__((target(x)))
+#endif
+#endif
+
+namespace {
+  const uint32_t kK[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+  };
+
+  const uint32_t kInitialState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+  };
+
+  const size_t kMaxLanes = 16;
+
+  uint32_t
+  LoadBE(const unsigned char* p) {
+    return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | uint32_t(p[3]);
+  }
+
+  uint32_t
+  Ror(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+  }
+
+  // Estado traspuesto: state[palabra * lanes + carril]
+  using CompressFn = void (*)(uint32_t* state, const unsigned char* const* blocks);
+
+  // Camino portable de 4 carriles. Los bucles por carril son triviales de
+  // auto-vectorizar con SSE2/NEON
+  void
+  CompressPortable(uint32_t* state, const unsigned char* const* blocks) {
+    const size_t L = 4;
+    uint32_t w[64][L];
+    for (int t = 0; t < 16; ++t) {
+      for (size_t l = 0; l < L; ++l) {
+        w[t][l] = LoadBE(blocks[l] + 4 * t);
+      }
+    }
+    for (int t = 16; t < 64; ++t) {
+      for (size_t l = 0; l < L; ++l) {
+        uint32_t s0 = Ror(w[t - 15][l], 7) ^ Ror(w[t - 15][l], 18) ^ (w[t - 15][l] >> 3);
+        uint32_t s1 = Ror(w[t - 2][l], 17) ^ Ror(w[t - 2][l], 19) ^ (w[t - 2][l] >> 10);
+        w[t][l] = w[t - 16][l] + s0 + w[t - 7][l] + s1;
+      }
+    }
+
+    uint32_t v[8][L];
+    std::memcpy(v, state, sizeof(v));
+    for (int t = 0; t < 64; ++t) {
+      for (size_t l = 0; l < L; ++l) {
+        uint32_t e = v[4][l];
+        uint32_t a = v[0][l];
+        uint32_t t1 = v[7][l] + (Ror(e, 6) ^ Ror(e, 11) ^ Ror(e, 25)) +
+                      ((e & v[5][l]) ^ (~e & v[6][l])) + kK[t] + w[t][l];
+        uint32_t t2 = (Ror(a, 2) ^ Ror(a, 13) ^ Ror(a, 22)) +
+                      ((a & v[1][l]) ^ (a & v[2][l]) ^ (v[1][l] & v[2][l]));
+        v[7][l] = v[6][l];
+        v[6][l] = v[5][l];
+        v[5][l] = e;
+        v[4][l] = v[3][l] + t1;
+        v[3][l] = v[2][l];
+        v[2][l] = v[1][l];
+        v[1][l] = a;
+        v[0][l] = t1 + t2;
+      }
+    }
+    for (size_t i = 0; i < 8; ++i) {
+      for (size_t l = 0; l < L; ++l) {
+        state[i * L + l] += v[i][l];
+      }
+    }
+  }
+
+#ifdef E2EE_MULTIHASH_X86
+  E2EE_TARGET("avx2") void
+  CompressAVX2(uint32_t* state, const unsigned char* const* blocks) {
+    const __m256i bswap = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                           3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+#define ROR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+    __m256i w[64];
+    for (int t = 0; t < 16; ++t) {
+      uint32_t words[8];
+      for (int l = 0; l < 8; ++l) {
+        std::memcpy(&words[l], blocks[l] + 4 * t, 4);
+      }
+      w[t] = _mm256_shuffle_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(words)), bswap);
+    }
+    for (int t = 16; t < 64; ++t) {
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROR(w[t - 15], 7), ROR(w[t - 15], 18)),
+                                    _mm256_srli_epi32(w[t - 15], 3));
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROR(w[t - 2], 17), ROR(w[t - 2], 19)),
+                                    _mm256_srli_epi32(w[t - 2], 10));
+      w[t] = _mm256_add_epi32(_mm256_add_epi32(w[t - 16], s0), _mm256_add_epi32(w[t - 7], s1));
+    }
+
+    __m256i v[8];
+    for (int i = 0; i < 8; ++i) {
+      v[i] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(state + 8 * i));
+    }
+    __m256i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+    for (int t = 0; t < 64; ++t) {
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROR(e, 6), ROR(e, 11)), ROR(e, 25));
+      __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+      __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1),
+                                    _mm256_add_epi32(_mm256_add_epi32(ch, w[t]),
+                                                     _mm256_set1_epi32(static_cast<int>(kK[t]))));
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROR(a, 2), ROR(a, 13)), ROR(a, 22));
+      __m256i maj = _mm256_xor_si256(_mm256_and_si256(a, b),
+                                     _mm256_and_si256(c, _mm256_xor_si256(a, b)));
+      __m256i t2 = _mm256_add_epi32(s0, maj);
+      h = g; g = f; f = e;
+      e = _mm256_add_epi32(d, t1);
+      d = c; c = b; b = a;
+      a = _mm256_add_epi32(t1, t2);
+    }
+#undef ROR
+    __m256i out[8] = { a, b, c, d, e, f, g, h };
+    for (int i = 0; i < 8; ++i) {
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(state + 8 * i), _mm256_add_epi32(v[i], out[i]));
+    }
+  }
+
+  E2EE_TARGET("avx512f") void
+  CompressAVX512(uint32_t* state, const unsigned char* const* blocks) {
+    __m512i w[64];
+    for (int t = 0; t < 16; ++t) {
+      uint32_t words[16];
+      for (int l = 0; l < 16; ++l) {
+        words[l] = LoadBE(blocks[l] + 4 * t);
+      }
+      w[t] = _mm512_loadu_si512(words);
+    }
+    for (int t = 16; t < 64; ++t) {
+      __m512i s0 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi32(w[t - 15], 7),
+                                                     _mm512_ror_epi32(w[t - 15], 18)),
+                                    _mm512_srli_epi32(w[t - 15], 3));
+      __m512i s1 = _mm512_xor_si512(_mm512_xor_si512(_mm512_ror_epi32(w[t - 2], 17),
+                                                     _mm512_ror_epi32(w[t - 2], 19)),
+                                    _mm512_srli_epi32(w[t - 2], 10));
+      w[t] = _mm512_add_epi32(_mm512_add_epi32(w[t - 16], s0), _mm512_add_epi32(w[t - 7], s1));
+    }
+
+    __m512i v[8];
+    for (int i = 0; i < 8; ++i) {
+      v[i] = _mm512_loadu_si512(state + 16 * i);
+    }
+    __m512i a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+    for (int t = 0; t < 64; ++t) {
+      __m512i s1 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11),
+                                             _mm512_ror_epi32(e, 25), 0x96);
+      __m512i ch = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+      __m512i t1 = _mm512_add_epi32(_mm512_add_epi32(h, s1),
+                                    _mm512_add_epi32(_mm512_add_epi32(ch, w[t]),
+                                                     _mm512_set1_epi32(static_cast<int>(kK[t]))));
+      __m512i s0 = _mm512_ternarylogic_epi32(_mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13),
+                                             _mm512_ror_epi32(a, 22), 0x96);
+      __m512i maj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+      __m512i t2 = _mm512_add_epi32(s0, maj);
+      h = g; g = f; f = e;
+      e = _mm512_add_epi32(d, t1);
+      d = c; c = b; b = a;
+      a = _mm512_add_epi32(t1, t2);
+    }
+    __m512i out[8] = { a, b, c, d, e, f, g, h };
+    for (int i = 0; i < 8; ++i) {
+      _mm512_storeu_si512(state + 16 * i, _mm512_add_epi32(v[i], out[i]));
+    }
+  }
+
+  bool
+  CpuHas(bool avx512) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7) {
+      return false;
+    }
+    __cpuid(info, 1);
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    if (!osxsave) {
+      return false;
+    }
+    unsigned long long xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    if (avx512) {
+      return (xcr0 & 0xE6) == 0xE6 && (info[1] & (1 << 16)) != 0;
+    }
+    return (xcr0 & 0x6) == 0x6 && (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return avx512 ? __builtin_cpu_supports("avx512f") : __builtin_cpu_supports("avx2");
+#endif
+  }
+#endif
+
+  struct Backend {
+    CompressFn compress;
+    size_t lanes;
+    const char* name;
+  };
+
+  const Backend&
+  SelectBackend() {
+    static const Backend backend = [] {
+#ifdef E2EE_MULTIHASH_X86
+      if (CpuHas(true)) {
+        return Backend{ &CompressAVX512, 16, "avx512" };
+      }
+      if (CpuHas(false)) {
+        return Backend{ &CompressAVX2, 8, "avx2" };
+      }
+#endif
+      return Backend{ &CompressPortable, 4, "portable" };
+    }();
+    return backend;
+  }
+
+  /**
+   * Un carril: estado propio mas sus bloques. Los bloques completos se leen
+   * del mensaje original; solo el final con el relleno se copia.
+   */
+  struct Lane {
+    uint32_t state[8];
+    const unsigned char* data = nullptr;
+    size_t fullBlocks = 0;
+    size_t blocks = 0;
+    unsigned char tail[128];
+
+    /**
+     * @param prefixBytes Bytes ya comprimidos en state (64 tras el ipad de HMAC).
+     * @param pad false para comprimir un bloque exacto sin relleno.
+     */
+    void
+    Setup(const uint32_t initial[8], const unsigned char* message, size_t len,
+          uint64_t prefixBytes, bool pad = true) {
+      std::memcpy(state, initial, sizeof(state));
+      data = message;
+      fullBlocks = len / 64;
+      size_t rest = len % 64;
+      if (!pad) {
+        blocks = fullBlocks;
+        return;
+      }
+      std::memset(tail, 0, sizeof(tail));
+      if (rest) {
+        std::memcpy(tail, message + fullBlocks * 64, rest);
+      }
+      tail[rest] = 0x80;
+      size_t tailBlocks = rest + 9 > 64 ? 2 : 1;
+      uint64_t bits = (prefixBytes + len) * 8;
+      for (int i = 0; i < 8; ++i) {
+        tail[tailBlocks * 64 - 1 - i] = static_cast<unsigned char>(bits >> (8 * i));
+      }
+      blocks = fullBlocks + tailBlocks;
+    }
+
+    const unsigned char*
+    Block(size_t index) const {
+      return index < fullBlocks ? data + 64 * index : tail + 64 * (index - fullBlocks);
+    }
+
+    void
+    Digest(unsigned char out[32]) const {
+      for (int i = 0; i < 8; ++i) {
+        out[4 * i] = static_cast<unsigned char>(state[i] >> 24);
+        out[4 * i + 1] = static_cast<unsigned char>(state[i] >> 16);
+        out[4 * i + 2] = static_cast<unsigned char>(state[i] >> 8);
+        out[4 * i + 3] = static_cast<unsigned char>(state[i]);
+      }
+    }
+  };
+
+  /**
+   * Comprime todos los carriles. Se ordenan por numero de bloques para que
+   * cada grupo SIMD termine casi a la vez; los carriles que acaban antes
+   * siguen con un bloque de relleno y su estado se restaura.
+   */
+  void
+  ProcessLanes(Lane* lanes, size_t count) {
+    const Backend& backend = SelectBackend();
+    const size_t L = backend.lanes;
+    static const unsigned char kZeroBlock[64] = {};
+
+    std::vector<Lane*> order(count);
+    for (size_t i = 0; i < count; ++i) {
+      order[i] = &lanes[i];
+    }
+    std::sort(order.begin(), order.end(),
+              [](const Lane* x, const Lane* y) { return x->blocks < y->blocks; });
+
+    uint32_t state[8 * kMaxLanes];
+    const unsigned char* blocks[kMaxLanes];
+    for (size_t group = 0; group < count; group += L) {
+      size_t active = std::min(L, count - group);
+      Lane** members = order.data() + group;
+      size_t maxBlocks = members[active - 1]->blocks;
+
+      for (size_t i = 0; i < 8; ++i) {
+        for (size_t l = 0; l < L; ++l) {
+          state[i * L + l] = l < active ? members[l]->state[i] : 0;
+        }
+      }
+      for (size_t b = 0; b < maxBlocks; ++b) {
+        for (size_t l = 0; l < L; ++l) {
+          blocks[l] = l < active && b < members[l]->blocks ? members[l]->Block(b) : kZeroBlock;
+        }
+        // Guardar el estado de los carriles que ya terminaron
+        for (size_t l = 0; l < active; ++l) {
+          if (b == members[l]->blocks) {
+            for (size_t i = 0; i < 8; ++i) {
+              members[l]->state[i] = state[i * L + l];
+            }
+          }
+        }
+        backend.compress(state, blocks);
+      }
+      for (size_t l = 0; l < active; ++l) {
+        if (members[l]->blocks == maxBlocks) {
+          for (size_t i = 0; i < 8; ++i) {
+            members[l]->state[i] = state[i * L + l];
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Estados tras comprimir (key ^ ipad) y (key ^ opad) para cada clave.
+   */
+  void
+  HMACPadStates(const MultiHash::Input* keys, size_t count, bool sameKey,
+                std::vector<Lane>& inner, std::vector<Lane>& outer) {
+    size_t distinct = sameKey ? 1 : count;
+    std::vector<std::array<unsigned char, 64>> blockKeys(distinct);
+    std::vector<unsigned char> longKeys;
+    for (size_t i = 0; i < distinct; ++i) {
+      std::array<unsigned char, 64>& k = blockKeys[i];
+      k.fill(0);
+      if (keys[i].len > 64) {
+        unsigned char digest[1][32];
+        MultiHash::SHA256(&keys[i], 1, digest);
+        std::memcpy(k.data(), digest[0], 32);
+        OPENSSL_cleanse(digest, sizeof(digest));
+      }
+      else if (keys[i].len) {
+        std::memcpy(k.data(), keys[i].data, keys[i].len);
+      }
+    }
+
+    std::vector<std::array<unsigned char, 64>> pads(2 * distinct);
+    std::vector<Lane> padLanes(2 * distinct);
+    for (size_t i = 0; i < distinct; ++i) {
+      for (size_t j = 0; j < 64; ++j) {
+        pads[2 * i][j] = blockKeys[i][j] ^ 0x36;
+        pads[2 * i + 1][j] = blockKeys[i][j] ^ 0x5c;
+      }
+      padLanes[2 * i].Setup(kInitialState, pads[2 * i].data(), 64, 0, false);
+      padLanes[2 * i + 1].Setup(kInitialState, pads[2 * i + 1].data(), 64, 0, false);
+    }
+    ProcessLanes(padLanes.data(), padLanes.size());
+
+    inner.resize(count);
+    outer.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      size_t k = sameKey ? 0 : i;
+      std::memcpy(inner[i].state, padLanes[2 * k].state, sizeof(inner[i].state));
+      std::memcpy(outer[i].state, padLanes[2 * k + 1].state, sizeof(outer[i].state));
+    }
+
+    for (auto& k : blockKeys) {
+      OPENSSL_cleanse(k.data(), k.size());
+    }
+    for (auto& p : pads) {
+      OPENSSL_cleanse(p.data(), p.size());
+    }
+  }
+
+  void
+  RunHMAC(const MultiHash::Input* keys, bool sameKey, const MultiHash::Input* inputs,
+          size_t count, unsigned char (*out)[32]) {
+    if (count == 0) {
+      return;
+    }
+    std::vector<Lane> inner;
+    std::vector<Lane> outer;
+    HMACPadStates(keys, count, sameKey, inner, outer);
+
+    for (size_t i = 0; i < count; ++i) {
+      uint32_t initial[8];
+      std::memcpy(initial, inner[i].state, sizeof(initial));
+      inner[i].Setup(initial, inputs[i].data, inputs[i].len, 64);
+    }
+    ProcessLanes(inner.data(), count);
+
+    std::vector<std::array<unsigned char, 32>> innerDigests(count);
+    for (size_t i = 0; i < count; ++i) {
+      inner[i].Digest(innerDigests[i].data());
+      uint32_t initial[8];
+      std::memcpy(initial, outer[i].state, sizeof(initial));
+      outer[i].Setup(initial, innerDigests[i].data(), 32, 64);
+    }
+    ProcessLanes(outer.data(), count);
+
+    for (size_t i = 0; i < count; ++i) {
+      outer[i].Digest(out[i]);
+      OPENSSL_cleanse(innerDigests[i].data(), 32);
+      OPENSSL_cleanse(inner[i].state, sizeof(inner[i].state));
+      OPENSSL_cleanse(outer[i].state, sizeof(outer[i].state));
+    }
+  }
+}
+
+void
+MultiHash::SHA256(const Input* inputs, size_t count, unsigned char (*out)[32]) {
+  std::vector<Lane> lanes(count);
+  for (size_t i = 0; i < count; ++i) {
+    lanes[i].Setup(kInitialState, inputs[i].data, inputs[i].len, 0);
+  }
+  ProcessLanes(lanes.data(), count);
+  for (size_t i = 0; i < count; ++i) {
+    lanes[i].Digest(out[i]);
+  }
+}
+
+void
+MultiHash::HMACSHA256(const unsigned char* key, size_t keyLen,
+                      const Input* inputs, size_t count, unsigned char (*out)[32]) {
+  Input shared = { key, keyLen };
+  RunHMAC(&shared, true, inputs, count, out);
+}
+
+void
+MultiHash::HMACSHA256(const Input* keys, const Input* inputs, size_t count,
+                      unsigned char (*out)[32]) {
+  RunHMAC(keys, false, inputs, count, out);
+}
+
+size_t
+MultiHash::Lanes() {
+  return SelectBackend().lanes;
+}
+
+const char*
+MultiHash::Backend() {
+  return SelectBackend().name;
+}
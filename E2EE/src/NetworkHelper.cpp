@@ -67,6 +67,41 @@ NetworkHelper::AcceptClient() {
   return clientSocket;
 }
 
+void
+NetworkHelper::StopServer() {
+  if (m_serverSocket != INVALID_SOCKET) {
+    // En pilas BSD cerrar no despierta a un accept() bloqueado; shutdown si
+    shutdown(m_serverSocket, SD_BOTH);
+    closesocket(m_serverSocket);
+    m_serverSocket = INVALID_SOCKET;
+  }
+}
+
+bool
+NetworkHelper::WaitForClient(int timeoutMs) {
+  if (m_serverSocket == INVALID_SOCKET) {
+    return false;
+  }
+  WSAPOLLFD listener{};
+  listener.fd = m_serverSocket;
+  listener.events = POLLRDNORM;
+  return WSAPoll(&listener, 1, timeoutMs) > 0;
+}
+
+void
+NetworkHelper::AdoptServer(SOCKET socket) {
+  ReleaseServer();
+  m_serverSocket = socket;
+}
+
+void
+NetworkHelper::ReleaseServer() {
+  if (m_serverSocket != INVALID_SOCKET) {
+    closesocket(m_serverSocket);
+    m_serverSocket = INVALID_SOCKET;
+  }
+}
+
 bool
 NetworkHelper::ConnectToServer(const std::string& ip, int port) {
   // Crea el socket TCP
@@ -0,0 +1,517 @@
+#include "OfflineStore.h"
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+
+namespace fs = std::filesystem;
+
+namespace {
+  // Cabecera de segmento: magic, version, id
+  const unsigned char kMagic[4] = { 'E', '2', 'O', 'S' };
+  const uint32_t kVersion = 1;
+  const size_t kSegmentHeader = 16;
+  // Registro: [u32 tamano][u32 crc][tipo][len usuario][usuario][cuerpo]
+  const size_t kRecordHeader = 8;
+  const unsigned char kMessage = 1;
+  const unsigned char kAck = 2;
+  const size_t kMaxPendingPerUser = 100000;
+  const char kSegmentSuffix[] = ".seg";
+
+  void
+  StoreU32(unsigned char* out, uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+      out[i] = static_cast<unsigned char>(value >> (24 - 8 * i));
+    }
+  }
+
+  void
+  StoreU64(unsigned char* out, uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+      out[i] = static_cast<unsigned char>(value >> (56 - 8 * i));
+    }
+  }
+
+  uint32_t
+  LoadU32(const unsigned char* in) {
+    return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) |
+           uint32_t(in[3]);
+  }
+
+  uint64_t
+  LoadU64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | in[i];
+    }
+    return value;
+  }
+
+  // CRC-32C por tabla: detecta la cola a medio escribir de un segmento
+  uint32_t
+  Crc32c(uint32_t crc, const unsigned char* data, size_t len) {
+    static const auto table = []() {
+      std::array<uint32_t, 256> entries{};
+      for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t value = i;
+        for (int bit = 0; bit < 8; ++bit) {
+          value = (value >> 1) ^ (0x82F63B78u & (0u - (value & 1)));
+        }
+        entries[i] = value;
+      }
+      return entries;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < len; ++i) {
+      crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+  }
+}
+
+OfflineStore::OfflineStore(const std::string& directory, uint64_t segmentSize, uint64_t maxBytes)
+  : m_directory(directory),
+    m_segmentSize(std::min<uint64_t>(segmentSize, UINT32_MAX)),
+    m_maxBytes(maxBytes) {
+  std::error_code ec;
+  fs::create_directories(m_directory, ec);
+  Recover();
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  if (!Roll()) {
+    std::cerr << "Error opening offline store in " << m_directory << std::endl;
+    return;
+  }
+  DropSegments();
+  m_open = true;
+  m_running = true;
+  m_committer = std::thread(&OfflineStore::CommitLoop, this);
+}
+
+OfflineStore::~OfflineStore() {
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    m_running = false;
+  }
+  m_commitWake.notify_all();
+  if (m_committer.joinable()) {
+    m_committer.join();
+  }
+}
+
+std::string
+OfflineStore::PathFor(uint32_t id) const {
+  char name[32];
+  std::snprintf(name, sizeof(name), "%08u%s", id, kSegmentSuffix);
+  return (fs::path(m_directory) / name).string();
+}
+
+void
+OfflineStore::Recover() {
+  std::vector<uint32_t> ids;
+  std::error_code ec;
+  for (const auto& file : fs::directory_iterator(m_directory, ec)) {
+    const fs::path& path = file.path();
+    if (path.extension() == kSegmentSuffix) {
+      ids.push_back(static_cast<uint32_t>(std::strtoul(path.stem().string().c_str(), nullptr, 10)));
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (uint32_t id : ids) {
+    auto file = std::make_shared<MappedFile>();
+    if (!file->Open(PathFor(id)) || file->Size() < kSegmentHeader ||
+        std::memcmp(file->Data(), kMagic, sizeof(kMagic)) != 0 ||
+        LoadU32(file->Data() + 4) != kVersion) {
+      std::cerr << "Skipping invalid offline segment " << PathFor(id) << std::endl;
+      continue;
+    }
+    m_active = std::max(m_active, id);
+    Segment& segment = m_segments[id];
+    segment.file = file;
+    m_stats.diskBytes += file->Size();
+
+    // Se lee hasta el primer hueco sin escribir o registro roto
+    const unsigned char* data = file->Data();
+    uint64_t size = file->Size();
+    uint64_t offset = kSegmentHeader;
+    while (offset + kRecordHeader <= size) {
+      uint32_t length = LoadU32(data + offset);
+      if (length < 2 || offset + kRecordHeader + length > size ||
+          Crc32c(0, data + offset + kRecordHeader, length) != LoadU32(data + offset + 4)) {
+        break;
+      }
+      const unsigned char* record = data + offset + kRecordHeader;
+      unsigned char kind = record[0];
+      size_t userLen = record[1];
+      if (2 + userLen + 8 > length) {
+        break;
+      }
+      std::string user(reinterpret_cast<const char*>(record + 2), userLen);
+      const unsigned char* body = record + 2 + userLen;
+      uint64_t seq = LoadU64(body);
+      Queue& queue = m_queues[user];
+
+      if (kind == kMessage) {
+        Entry entry;
+        entry.segment = id;
+        entry.offset = static_cast<uint32_t>(body - data);
+        entry.length = static_cast<uint32_t>(length - 2 - userLen);
+        entry.seq = seq;
+        if (seq > queue.acked) {
+          queue.entries.push_back(entry);
+          ++segment.live;
+          ++m_stats.pending;
+        }
+        queue.nextSeq = std::max(queue.nextSeq, seq + 1);
+        queue.lastSegment = id;
+      }
+      else if (kind == kAck) {
+        while (!queue.entries.empty() && queue.entries.front().seq <= seq) {
+          Release(queue.entries.front());
+          queue.entries.pop_front();
+        }
+        queue.acked = std::max(queue.acked, seq);
+        queue.nextSeq = std::max(queue.nextSeq, seq + 1);
+      }
+      offset += kRecordHeader + length;
+    }
+    segment.used = offset;
+    segment.flushed = offset;
+  }
+}
+
+bool
+OfflineStore::Roll() {
+  if (m_stats.diskBytes + m_segmentSize > m_maxBytes) {
+    return false;
+  }
+  uint32_t id = m_active + 1;
+  auto file = std::make_shared<MappedFile>();
+  if (!file->Create(PathFor(id), m_segmentSize)) {
+    return false;
+  }
+  unsigned char* header = file->MutableData();
+  std::memcpy(header, kMagic, sizeof(kMagic));
+  StoreU32(header + 4, kVersion);
+  StoreU64(header + 8, id);
+
+  Segment& segment = m_segments[id];
+  segment.file = file;
+  segment.used = kSegmentHeader;
+  m_active = id;
+  m_stats.diskBytes += m_segmentSize;
+  ++m_written;
+
+  // Los que ya no tienen registros en disco pasan a m_idle: sin cola, solo
+  // su ultimo seq, que es todo lo que Append necesita para no repetir uno
+  uint32_t oldest = m_segments.begin()->first;
+  for (auto it = m_queues.begin(); it != m_queues.end();) {
+    Queue& queue = it->second;
+    if (queue.entries.empty() && queue.lastSegment < oldest) {
+      if (queue.acked > 0) {
+        m_idle[it->first] = queue.acked;
+      }
+      it = m_queues.erase(it);
+      continue;
+    }
+    ++it;
+  }
+
+  // Punto de control: el ultimo ack de cada destinatario, tenga o no cola
+  bool written = true;
+  for (const auto& entry : m_queues) {
+    if (entry.second.acked > 0) {
+      written = written && WriteCheckpoint(entry.first, entry.second.acked);
+    }
+  }
+  for (const auto& entry : m_idle) {
+    written = written && WriteCheckpoint(entry.first, entry.second);
+  }
+  if (!written) {
+    std::cerr << "Offline segment too small for its checkpoint" << std::endl;
+  }
+  return true;
+}
+
+bool
+OfflineStore::WriteCheckpoint(const std::string& user, uint64_t acked) {
+  unsigned char seq[8];
+  StoreU64(seq, acked);
+  return WriteRecord(kAck, user, seq, sizeof(seq), nullptr, 0, nullptr);
+}
+
+bool
+OfflineStore::WriteRecord(unsigned char kind, const std::string& user, const unsigned char* head,
+                          size_t headLen, const unsigned char* body, size_t bodyLen,
+                          Entry* outEntry) {
+  Segment& segment = m_segments[m_active];
+  size_t length = 2 + user.size() + headLen + bodyLen;
+  if (segment.used + kRecordHeader + length > m_segmentSize) {
+    return false;
+  }
+
+  unsigned char* out = segment.file->MutableData() + segment.used;
+  unsigned char* record = out + kRecordHeader;
+  record[0] = kind;
+  record[1] = static_cast<unsigned char>(user.size());
+  std::memcpy(record + 2, user.data(), user.size());
+  std::memcpy(record + 2 + user.size(), head, headLen);
+  if (bodyLen > 0) {
+    std::memcpy(record + 2 + user.size() + headLen, body, bodyLen);
+  }
+  StoreU32(out, static_cast<uint32_t>(length));
+  StoreU32(out + 4, Crc32c(0, record, length));
+
+  if (outEntry) {
+    outEntry->segment = m_active;
+    outEntry->offset = static_cast<uint32_t>(segment.used + kRecordHeader + 2 + user.size());
+    outEntry->length = static_cast<uint32_t>(headLen + bodyLen);
+  }
+  segment.used += kRecordHeader + length;
+  ++m_written;
+  return true;
+}
+
+bool
+OfflineStore::Append(const std::string& user, const std::string& source,
+                     const unsigned char* payload, size_t len, Durable done) {
+  if (!m_open || user.empty() || user.size() > 255 || source.size() > 255) {
+    return false;
+  }
+  size_t length = 2 + user.size() + 8 + 1 + source.size() + len;
+  if (kSegmentHeader + kRecordHeader + length > m_segmentSize) {
+    return false;
+  }
+
+  // Cabecera del cuerpo: [seq][len origen][origen], el payload va detras sin copiarlo antes
+  unsigned char head[8 + 1 + 255];
+  size_t headLen = 8 + 1 + source.size();
+  head[8] = static_cast<unsigned char>(source.size());
+  std::memcpy(head + 9, source.data(), source.size());
+
+  std::unique_lock<std::mutex> guard(m_lock);
+  if (m_segments[m_active].used + kRecordHeader + length > m_segmentSize && !Roll()) {
+    return false;
+  }
+  Queue& queue = m_queues[user];
+  auto idle = m_idle.find(user);
+  if (idle != m_idle.end()) {
+    queue.acked = idle->second;
+    queue.nextSeq = idle->second + 1;
+    m_idle.erase(idle);
+  }
+  if (queue.entries.size() >= kMaxPendingPerUser) {
+    return false;
+  }
+
+  Entry entry;
+  entry.seq = queue.nextSeq;
+  StoreU64(head, entry.seq);
+  if (!WriteRecord(kMessage, user, head, headLen, payload, len, &entry)) {
+    return false;
+  }
+  ++queue.nextSeq;
+  queue.entries.push_back(entry);
+  queue.lastSegment = m_active;
+  ++m_segments[m_active].live;
+  ++m_stats.appended;
+  ++m_stats.pending;
+  if (done) {
+    m_waiters.push_back(Waiter{ m_written, std::move(done) });
+  }
+  guard.unlock();
+  m_commitWake.notify_one();
+  return true;
+}
+
+bool
+OfflineStore::Flush() {
+  std::unique_lock<std::mutex> guard(m_lock);
+  uint64_t target = m_written;
+  m_commitWake.notify_one();
+  m_durableWake.wait(guard, [&]() { return m_durable >= target || !m_running; });
+  return m_durable >= target;
+}
+
+size_t
+OfflineStore::Read(const std::string& user, uint64_t after, size_t maxRecords, size_t maxBytes,
+                   std::vector<Record>& out) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto it = m_queues.find(user);
+  if (it == m_queues.end()) {
+    return 0;
+  }
+  const std::deque<Entry>& entries = it->second.entries;
+  auto first = std::upper_bound(entries.begin(), entries.end(), after,
+                                [](uint64_t seq, const Entry& entry) { return seq < entry.seq; });
+  size_t count = 0;
+  size_t bytes = 0;
+  for (auto entry = first; entry != entries.end() && count < maxRecords; ++entry) {
+    if (count > 0 && bytes + entry->length > maxBytes) {
+      break;
+    }
+    const Segment& segment = m_segments[entry->segment];
+    Record record;
+    record.seq = entry->seq;
+    record.data = segment.file->Data() + entry->offset;
+    record.len = entry->length;
+    record.segment = segment.file;
+    out.push_back(std::move(record));
+    bytes += entry->length;
+    ++count;
+  }
+  return count;
+}
+
+size_t
+OfflineStore::Ack(const std::string& user, uint64_t seq) {
+  if (!m_open) {
+    return 0;
+  }
+  std::unique_lock<std::mutex> guard(m_lock);
+  auto it = m_queues.find(user);
+  if (it == m_queues.end()) {
+    return 0;
+  }
+  Queue& queue = it->second;
+  // Un ack de un seq que aun no existe no puede confirmar mensajes futuros
+  seq = std::min(seq, queue.nextSeq - 1);
+  if (seq <= queue.acked) {
+    return 0;
+  }
+
+  size_t removed = 0;
+  while (!queue.entries.empty() && queue.entries.front().seq <= seq) {
+    Release(queue.entries.front());
+    queue.entries.pop_front();
+    ++removed;
+  }
+  queue.acked = seq;
+  m_stats.acked += removed;
+
+  // Si el ack no llega al disco se reenvia algun mensaje, nunca se pierde uno
+  unsigned char body[8];
+  StoreU64(body, seq);
+  const size_t length = kRecordHeader + 2 + user.size() + sizeof(body);
+  bool written = (m_segments[m_active].used + length <= m_segmentSize || Roll()) &&
+                 WriteRecord(kAck, user, body, sizeof(body), nullptr, 0, nullptr);
+  if (!written) {
+    std::cerr << "Error logging offline ack for " << user << std::endl;
+  }
+  DropSegments();
+  guard.unlock();
+  m_commitWake.notify_one();
+  return removed;
+}
+
+void
+OfflineStore::Release(const Entry& entry) {
+  auto segment = m_segments.find(entry.segment);
+  if (segment != m_segments.end() && segment->second.live > 0) {
+    --segment->second.live;
+  }
+  --m_stats.pending;
+}
+
+void
+OfflineStore::DropSegments() {
+  // En Windows un segmento que un lector aun tiene proyectado no se puede borrar
+  auto undeleted = std::remove_if(m_undeleted.begin(), m_undeleted.end(),
+                                  [](const std::string& path) { return std::remove(path.c_str()) == 0; });
+  m_undeleted.erase(undeleted, m_undeleted.end());
+
+  for (auto it = m_segments.begin(); it != m_segments.end();) {
+    if (it->first == m_active || it->second.live > 0) {
+      ++it;
+      continue;
+    }
+    uint64_t size = it->second.file->Size();
+    it->second.file.reset();
+    std::string path = PathFor(it->first);
+    if (std::remove(path.c_str()) != 0) {
+      m_undeleted.push_back(path);
+    }
+    m_stats.diskBytes -= size;
+    ++m_stats.deletedSegments;
+    it = m_segments.erase(it);
+  }
+}
+
+void
+OfflineStore::CommitLoop() {
+  std::unique_lock<std::mutex> guard(m_lock);
+  for (;;) {
+    m_commitWake.wait(guard, [this]() { return !m_running || m_written > m_durable; });
+    if (m_written == m_durable) {
+      break;  // Parado y sin nada pendiente
+    }
+
+    // Todo lo escrito hasta aqui sale en un solo volcado por segmento
+    uint64_t ticket = m_written;
+    std::vector<std::pair<std::shared_ptr<MappedFile>, std::pair<uint64_t, uint64_t>>> ranges;
+    for (auto& entry : m_segments) {
+      Segment& segment = entry.second;
+      if (segment.flushed < segment.used) {
+        ranges.emplace_back(segment.file,
+                            std::make_pair(segment.flushed, segment.used - segment.flushed));
+        segment.flushed = segment.used;
+      }
+    }
+    guard.unlock();
+
+    bool ok = true;
+    for (auto& range : ranges) {
+      ok = range.first->Flush(range.second.first, range.second.second) && ok;
+    }
+    if (!ok) {
+      std::cerr << "Error flushing offline store" << std::endl;
+    }
+
+    guard.lock();
+    m_stats.committed += ticket - m_durable;
+    ++m_stats.commits;
+    m_durable = ticket;
+    std::vector<Durable> ready;
+    while (!m_waiters.empty() && m_waiters.front().ticket <= ticket) {
+      ready.push_back(std::move(m_waiters.front().done));
+      m_waiters.pop_front();
+    }
+    m_durableWake.notify_all();
+
+    guard.unlock();
+    for (Durable& done : ready) {
+      done(ok);
+    }
+    guard.lock();
+  }
+}
+
+size_t
+OfflineStore::Pending(const std::string& user) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  auto it = m_queues.find(user);
+  return it == m_queues.end() ? 0 : it->second.entries.size();
+}
+
+void
+OfflineStore::Users(std::vector<std::string>& out) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (const auto& entry : m_queues) {
+    if (!entry.second.entries.empty()) {
+      out.push_back(entry.first);
+    }
+  }
+}
+
+OfflineStore::Stats
+OfflineStore::GetStats() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  Stats stats = m_stats;
+  stats.users = m_queues.size() + m_idle.size();
+  stats.idle = m_idle.size();
+  stats.segments = m_segments.size();
+  return stats;
+}
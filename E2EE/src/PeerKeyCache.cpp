@@ -0,0 +1,94 @@
+#include "PeerKeyCache.h"
+#include "AlgorithmCache.h"
+#include "openssl/x509.h"
+#include <algorithm>
+
+PeerKeyCache::PeerKeyCache(size_t capacity)
+  : m_capacityPerShard(std::max<size_t>(1, capacity / kShards)), m_hits(0), m_misses(0) {
+}
+
+PeerKeyCache::~PeerKeyCache() {
+  Clear();
+}
+
+PeerKeyCache&
+PeerKeyCache::Global() {
+  static PeerKeyCache cache;
+  return cache;
+}
+
+PeerKeyCache::Fingerprint
+PeerKeyCache::ComputeFingerprint(const unsigned char* der, size_t len) {
+  Fingerprint fingerprint;
+  EVP_Digest(der, len, fingerprint.data(), nullptr, AlgorithmCache::SHA256(), nullptr);
+  return fingerprint;
+}
+
+EVP_PKEY*
+PeerKeyCache::Find(const Fingerprint& fingerprint) {
+  Shard& shard = ShardFor(fingerprint);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  auto it = shard.index.find(fingerprint);
+  if (it == shard.index.end()) {
+    return nullptr;
+  }
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  EVP_PKEY* key = it->second->second;
+  EVP_PKEY_up_ref(key);
+  return key;
+}
+
+EVP_PKEY*
+PeerKeyCache::Acquire(const unsigned char* der, size_t len) {
+  Fingerprint fingerprint = ComputeFingerprint(der, len);
+  EVP_PKEY* key = Find(fingerprint);
+  if (key) {
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return key;
+  }
+  m_misses.fetch_add(1, std::memory_order_relaxed);
+
+  // El parseo se hace fuera del lock del shard
+  const unsigned char* p = der;
+  key = d2i_PUBKEY(nullptr, &p, static_cast<long>(len));
+  if (!key || p != der + len) {
+    EVP_PKEY_free(key);
+    return nullptr;
+  }
+
+  Shard& shard = ShardFor(fingerprint);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  auto it = shard.index.find(fingerprint);
+  if (it != shard.index.end()) {
+    // Otro hilo la inserto mientras parseabamos
+    EVP_PKEY_free(key);
+    key = it->second->second;
+    EVP_PKEY_up_ref(key);
+    return key;
+  }
+
+  shard.lru.emplace_front(fingerprint, key);
+  shard.index[fingerprint] = shard.lru.begin();
+  EVP_PKEY_up_ref(key);  // Una referencia para el cache y otra para el llamador
+
+  while (shard.lru.size() > m_capacityPerShard) {
+    EVP_PKEY_free(shard.lru.back().second);
+    shard.index.erase(shard.lru.back().first);
+    shard.lru.pop_back();
+  }
+  return key;
+}
+
+void
+PeerKeyCache::Clear() {
+  for (Shard& shard : m_shards) {
+    std::lock_guard<std::mutex> guard(shard.lock);
+    for (auto& entry : shard.lru) {
+      EVP_PKEY_free(entry.second);
+    }
+    shard.lru.clear();
+    shard.index.clear();
+  }
+}
@@ -0,0 +1,71 @@
+#include "QueueWaiter.h"
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#pragma comment(lib, "Synchronization.lib")
+#elif defined(__linux__)
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define E2EE_HAS_PAUSE 1
+#endif
+
+void
+QueueWaiter::CpuRelax() {
+#ifdef E2EE_HAS_PAUSE
+  _mm_pause();
+#else
+  std::this_thread::yield();
+#endif
+}
+
+#ifdef _WIN32
+
+void
+QueueWaiter::WaitOnEpoch(uint32_t expected) {
+  // El atomic de 32 bits sin locks tiene la misma representacion que el entero
+  WaitOnAddress(reinterpret_cast<volatile VOID*>(&m_epoch), &expected, sizeof(expected), INFINITE);
+}
+
+void
+QueueWaiter::WakeEpoch() {
+  WakeByAddressAll(reinterpret_cast<PVOID>(&m_epoch));
+}
+
+#elif defined(__linux__)
+
+void
+QueueWaiter::WaitOnEpoch(uint32_t expected) {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_epoch), FUTEX_WAIT_PRIVATE, expected,
+          nullptr, nullptr, 0);
+}
+
+void
+QueueWaiter::WakeEpoch() {
+  syscall(SYS_futex, reinterpret_cast<uint32_t*>(&m_epoch), FUTEX_WAKE_PRIVATE, INT32_MAX,
+          nullptr, nullptr, 0);
+}
+
+#else
+
+// Sin primitiva de espera por direccion: se duerme poco y se vuelve a mirar
+void
+QueueWaiter::WaitOnEpoch(uint32_t expected) {
+  if (m_epoch.load(std::memory_order_acquire) == expected) {
+    std::this_thread::sleep_for(std::chrono::microseconds(50));
+  }
+}
+
+void
+QueueWaiter::WakeEpoch() {
+}
+
+#endif
@@ -0,0 +1,50 @@
+#include "RateLimiter.h"
+
+void
+TokenBucket::Configure(const RateLimit& limit) {
+  if (limit.rate <= 0) {
+    m_interval = 0;
+    m_tolerance = 0;
+    return;
+  }
+  m_interval = std::max<Tick>(1, static_cast<Tick>(1e9 / limit.rate));
+  m_tolerance = static_cast<Tick>(std::max(1.0, limit.burst) * m_interval);
+}
+
+RateLimiter::RateLimiter()
+  : m_limits() {
+}
+
+RateLimiter::RateLimiter(const Limits& limits)
+  : m_limits(limits) {
+}
+
+std::shared_ptr<TokenBucket>
+RateLimiter::Address(const std::string& address) {
+  if (m_limits.address.rate <= 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::shared_ptr<TokenBucket>& bucket = m_addresses[address];
+  if (!bucket) {
+    bucket = std::make_shared<TokenBucket>();
+    bucket->Configure(m_limits.address);
+  }
+  return bucket;
+}
+
+size_t
+RateLimiter::Sweep() {
+  TokenBucket::Tick now = TokenBucket::Now();
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (auto it = m_addresses.begin(); it != m_addresses.end();) {
+    // use_count() == 1: solo la tabla lo referencia, y nadie puede copiarlo sin el lock
+    if (it->second.use_count() == 1 && it->second->Full(now)) {
+      it = m_addresses.erase(it);
+    }
+    else {
+      ++it;
+    }
+  }
+  return m_addresses.size();
+}
@@ -0,0 +1,249 @@
+#include "ReliableChannel.h"
+#include <algorithm>
+
+namespace {
+  void
+  AppendU64(std::string& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  uint64_t
+  ReadU64(const unsigned char* in) {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value = (value << 8) | in[i];
+    }
+    return value;
+  }
+
+  void
+  AppendU32(std::string& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  uint32_t
+  ReadU32(const unsigned char* in) {
+    return (uint32_t(in[0]) << 24) | (uint32_t(in[1]) << 16) | (uint32_t(in[2]) << 8) | in[3];
+  }
+}
+
+bool
+AckTracker::Receive(uint64_t seq, Clock::time_point now) {
+  // Un duplicado tambien pide ack: el emisor reenvia porque no vio el anterior
+  if (m_unacked++ == 0) {
+    m_firstUnacked = now;
+  }
+  if (seq == 0 || seq <= m_cumulative) {
+    return false;
+  }
+
+  // Primer rango que termina en seq - 1 o despues: seq cae dentro, lo
+  // extiende o va justo antes
+  auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), seq,
+                             [](const AckBlock& range, uint64_t value) { return range.last + 1 < value; });
+  if (it != m_ranges.end() && it->first <= seq && seq <= it->last) {
+    return false;
+  }
+  if (it != m_ranges.end() && it->last + 1 == seq) {
+    it->last = seq;
+    auto next = it + 1;
+    if (next != m_ranges.end() && next->first == seq + 1) {
+      it->last = next->last;
+      m_ranges.erase(next);
+    }
+  }
+  else if (it != m_ranges.end() && it->first == seq + 1) {
+    it->first = seq;
+  }
+  else {
+    if (m_ranges.size() >= kMaxRanges) {
+      return false;  // Demasiados huecos: el emisor lo reenviara
+    }
+    it = m_ranges.insert(it, AckBlock{ seq, seq });
+  }
+
+  // El primer rango pegado al acumulado se absorbe
+  if (!m_ranges.empty() && m_ranges.front().first == m_cumulative + 1) {
+    m_cumulative = m_ranges.front().last;
+    m_ranges.erase(m_ranges.begin());
+  }
+  return true;
+}
+
+bool
+AckTracker::Accepts(uint64_t seq) const {
+  if (seq == 0 || seq <= m_cumulative) {
+    return false;
+  }
+  auto it = std::lower_bound(m_ranges.begin(), m_ranges.end(), seq,
+                             [](const AckBlock& range, uint64_t value) { return range.last + 1 < value; });
+  if (it != m_ranges.end() && it->first <= seq && seq <= it->last) {
+    return false;
+  }
+  // Pegado a un rango no ocupa otro
+  return (it != m_ranges.end() && (it->last + 1 == seq || it->first == seq + 1)) ||
+         m_ranges.size() < kMaxRanges;
+}
+
+void
+AckTracker::Encode(std::string& out) {
+  size_t blocks = std::min(m_ranges.size(), kMaxBlocks);
+  AppendU64(out, m_cumulative);
+  out.push_back(static_cast<char>(blocks));
+  for (size_t i = 0; i < blocks; ++i) {
+    AppendU64(out, m_ranges[i].first);
+    AppendU64(out, m_ranges[i].last);
+  }
+  m_unacked = 0;
+}
+
+bool
+AckTracker::Decode(const unsigned char* data, size_t len, uint64_t& cumulative,
+                   std::vector<AckBlock>& blocks) {
+  if (len < 9) {
+    return false;
+  }
+  cumulative = ReadU64(data);
+  size_t count = data[8];
+  if (count > kMaxBlocks || len != 9 + count * 16) {
+    return false;
+  }
+  blocks.clear();
+  for (size_t i = 0; i < count; ++i) {
+    AckBlock block{ ReadU64(data + 9 + i * 16), ReadU64(data + 17 + i * 16) };
+    if (block.first > block.last) {
+      return false;
+    }
+    blocks.push_back(block);
+  }
+  return true;
+}
+
+// [acumulado u64][n u8][n x (first u64, last u64)]: como Encode, pero con
+// todos los rangos recordados
+void
+AckTracker::Save(std::string& out) const {
+  AppendU64(out, m_cumulative);
+  out.push_back(static_cast<char>(m_ranges.size()));
+  for (const AckBlock& range : m_ranges) {
+    AppendU64(out, range.first);
+    AppendU64(out, range.last);
+  }
+}
+
+bool
+AckTracker::Load(const unsigned char*& data, const unsigned char* end) {
+  if (end - data < 9) {
+    return false;
+  }
+  uint64_t cumulative = ReadU64(data);
+  size_t count = data[8];
+  if (count > kMaxRanges || static_cast<size_t>(end - data) < 9 + count * 16) {
+    return false;
+  }
+  m_ranges.clear();
+  for (size_t i = 0; i < count; ++i) {
+    m_ranges.push_back(AckBlock{ ReadU64(data + 9 + i * 16), ReadU64(data + 17 + i * 16) });
+  }
+  m_cumulative = cumulative;
+  m_unacked = 0;
+  data += 9 + count * 16;
+  return true;
+}
+
+void
+RetransmitBuffer::Push(Payload payload) {
+  m_bytes += payload->size();
+  ++m_count;
+  m_entries.push_back(Entry{ std::move(payload) });
+}
+
+void
+RetransmitBuffer::Release(Entry& entry) {
+  if (entry.payload) {
+    m_bytes -= entry.payload->size();
+    --m_count;
+    entry.payload.reset();
+  }
+}
+
+size_t
+RetransmitBuffer::OnAck(uint64_t cumulative, const std::vector<AckBlock>& blocks) {
+  size_t before = m_count;
+  // Un ack de secuencias que nunca se enviaron no confirma nada mas alla
+  uint64_t end = Next();
+  for (const AckBlock& block : blocks) {
+    uint64_t first = std::max(block.first, m_base);
+    uint64_t last = std::min(block.last, end - 1);
+    for (uint64_t seq = first; seq <= last; ++seq) {
+      Release(m_entries[static_cast<size_t>(seq - m_base)]);
+    }
+  }
+  cumulative = std::min(cumulative, end - 1);
+  while (!m_entries.empty() && (m_base <= cumulative || !m_entries.front().payload)) {
+    Release(m_entries.front());
+    m_entries.pop_front();
+    ++m_base;
+  }
+  return before - m_count;
+}
+
+void
+RetransmitBuffer::Unacked(std::vector<Pending>& out) const {
+  uint64_t seq = m_base;
+  for (const Entry& entry : m_entries) {
+    if (entry.payload) {
+      out.push_back(Pending{ seq, entry.payload });
+    }
+    ++seq;
+  }
+}
+
+// [base u64][n u32][n x (len u32, bytes)]; len = UINT32_MAX si ya se
+// confirmo por SACK
+void
+RetransmitBuffer::Save(std::string& out) const {
+  AppendU64(out, m_base);
+  AppendU32(out, static_cast<uint32_t>(m_entries.size()));
+  for (const Entry& entry : m_entries) {
+    if (!entry.payload) {
+      AppendU32(out, UINT32_MAX);
+      continue;
+    }
+    AppendU32(out, static_cast<uint32_t>(entry.payload->size()));
+    out.append(reinterpret_cast<const char*>(entry.payload->data()), entry.payload->size());
+  }
+}
+
+bool
+RetransmitBuffer::Load(const unsigned char*& data, const unsigned char* end) {
+  if (!m_entries.empty() || end - data < 12) {
+    return false;
+  }
+  uint64_t base = ReadU64(data);
+  uint32_t count = ReadU32(data + 8);
+  const unsigned char* cursor = data + 12;
+  for (uint32_t i = 0; i < count; ++i) {
+    if (end - cursor < 4) {
+      return false;
+    }
+    uint32_t len = ReadU32(cursor);
+    cursor += 4;
+    if (len == UINT32_MAX) {
+      m_entries.push_back(Entry());
+      continue;
+    }
+    if (static_cast<size_t>(end - cursor) < len) {
+      return false;
+    }
+    Push(std::make_shared<const std::vector<unsigned char>>(cursor, cursor + len));
+    cursor += len;
+  }
+  m_base = base;
+  data = cursor;
+  return true;
+}
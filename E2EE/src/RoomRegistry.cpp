@@ -0,0 +1,196 @@
+#include "RoomRegistry.h"
+#include "FrameCodec.h"
+#include "SecureRandom.h"
+#include <algorithm>
+
+RoomRegistry::RoomRegistry()
+  : m_memberships(0), m_broadcasts(0), m_fanout(0), m_rekeys(0) {
+}
+
+std::shared_ptr<RoomRegistry::Room>
+RoomRegistry::Find(const std::string& room) const {
+  std::shared_lock<std::shared_mutex> guard(m_lock);
+  auto it = m_rooms.find(room);
+  return it == m_rooms.end() ? nullptr : it->second;
+}
+
+std::shared_ptr<RoomRegistry::Room>
+RoomRegistry::FindOrCreate(const std::string& room) {
+  std::shared_ptr<Room> found = Find(room);
+  if (found) {
+    return found;
+  }
+
+  std::unique_lock<std::shared_mutex> guard(m_lock);
+  std::shared_ptr<Room>& slot = m_rooms[room];
+  if (!slot) {
+    auto created = std::make_shared<Room>();
+    created->members = std::make_shared<const Members>();
+    if (!Rekey(*created)) {
+      m_rooms.erase(room);
+      return nullptr;
+    }
+    slot = created;
+  }
+  return slot;
+}
+
+bool
+RoomRegistry::Rekey(Room& room) {
+  if (!SecureRandom::Fill(room.key.key, sizeof(room.key.key))) {
+    return false;
+  }
+  ++room.key.epoch;
+  room.sealer.reset(new CryptoHelper());
+  room.sealer->SetSessionKey(room.key.key, false);
+  room.rotate = false;
+  return true;
+}
+
+bool
+RoomRegistry::Join(const std::string& room, uint64_t connection, RoomKey& outKey) {
+  if (room.empty() || room.size() > kMaxRoomName) {
+    return false;
+  }
+
+  // Una sala que se vacia a la vez se cierra: se reintenta con una nueva
+  for (;;) {
+    std::shared_ptr<Room> target = FindOrCreate(room);
+    if (!target) {
+      return false;
+    }
+    std::lock_guard<std::mutex> guard(target->lock);
+    if (target->closed) {
+      continue;
+    }
+
+    const Members& current = *target->members;
+    auto position = std::lower_bound(current.begin(), current.end(), connection);
+    if (position == current.end() || *position != connection) {
+      auto members = std::make_shared<Members>();
+      members->reserve(current.size() + 1);
+      members->insert(members->end(), current.begin(), position);
+      members->push_back(connection);
+      members->insert(members->end(), position, current.end());
+      target->members = std::move(members);
+      m_memberships.fetch_add(1, std::memory_order_relaxed);
+    }
+    outKey.epoch = target->key.epoch;
+    std::memcpy(outKey.key, target->key.key, sizeof(outKey.key));
+    return true;
+  }
+}
+
+bool
+RoomRegistry::Leave(const std::string& room, uint64_t connection) {
+  std::shared_ptr<Room> target = Find(room);
+  if (!target) {
+    return false;
+  }
+
+  bool empty = false;
+  {
+    std::lock_guard<std::mutex> guard(target->lock);
+    const Members& current = *target->members;
+    auto position = std::lower_bound(current.begin(), current.end(), connection);
+    if (target->closed || position == current.end() || *position != connection) {
+      return false;
+    }
+    auto members = std::make_shared<Members>();
+    members->reserve(current.size() - 1);
+    members->insert(members->end(), current.begin(), position);
+    members->insert(members->end(), position + 1, current.end());
+    target->members = std::move(members);
+    target->rotate = true;  // El que sale conoce la clave actual
+    m_memberships.fetch_sub(1, std::memory_order_relaxed);
+    empty = target->members->empty();
+    if (empty) {
+      target->closed = true;
+    }
+  }
+
+  if (empty) {
+    std::unique_lock<std::shared_mutex> guard(m_lock);
+    auto it = m_rooms.find(room);
+    if (it != m_rooms.end() && it->second == target) {
+      m_rooms.erase(it);
+    }
+  }
+  return true;
+}
+
+bool
+RoomRegistry::Publish(const std::string& room, uint64_t publisher, const std::string& source,
+                      const unsigned char* payload, size_t len, Broadcast& out) {
+  std::shared_ptr<Room> target = Find(room);
+  if (!target || source.size() > 255) {
+    return false;
+  }
+
+  std::string plaintext;
+  plaintext.reserve(1 + source.size() + len);
+  plaintext.push_back(static_cast<char>(source.size()));
+  plaintext += source;
+  plaintext.append(reinterpret_cast<const char*>(payload), len);
+
+  std::vector<unsigned char> sealed;
+  {
+    std::lock_guard<std::mutex> guard(target->lock);
+    const Members& members = *target->members;
+    if (target->closed ||
+        (publisher != kRemotePublisher &&
+         !std::binary_search(members.begin(), members.end(), publisher))) {
+      OPENSSL_cleanse(&plaintext[0], plaintext.size());
+      return false;
+    }
+    if (target->rotate) {
+      if (!Rekey(*target)) {
+        OPENSSL_cleanse(&plaintext[0], plaintext.size());
+        return false;
+      }
+      m_rekeys.fetch_add(1, std::memory_order_relaxed);
+    }
+    out.key.epoch = target->key.epoch;
+    std::memcpy(out.key.key, target->key.key, sizeof(out.key.key));
+    out.members = target->members;
+    sealed = target->sealer->AEADEncrypt(plaintext);
+  }
+  OPENSSL_cleanse(&plaintext[0], plaintext.size());
+  if (sealed.empty()) {
+    return false;
+  }
+
+  // [len sala][sala][epoch u32][AEAD con la clave de la sala]
+  std::vector<unsigned char> body;
+  body.reserve(1 + room.size() + 4 + sealed.size());
+  body.push_back(static_cast<unsigned char>(room.size()));
+  body.insert(body.end(), room.begin(), room.end());
+  body.push_back(static_cast<unsigned char>(out.key.epoch >> 24));
+  body.push_back(static_cast<unsigned char>(out.key.epoch >> 16));
+  body.push_back(static_cast<unsigned char>(out.key.epoch >> 8));
+  body.push_back(static_cast<unsigned char>(out.key.epoch));
+  body.insert(body.end(), sealed.begin(), sealed.end());
+
+  auto frame = std::make_shared<std::vector<unsigned char>>();
+  frame->reserve(FrameCodec::kHeaderSize + body.size());
+  FrameCodec::Append(FrameType::RoomDeliver, body.data(), body.size(), *frame);
+  out.frame = std::move(frame);
+
+  m_broadcasts.fetch_add(1, std::memory_order_relaxed);
+  m_fanout.fetch_add(out.members->size(), std::memory_order_relaxed);
+  return true;
+}
+
+RoomRegistry::Stats
+RoomRegistry::GetStats() const {
+  Stats stats;
+  {
+    std::shared_lock<std::shared_mutex> guard(m_lock);
+    stats.rooms = m_rooms.size();
+  }
+  stats.memberships = m_memberships.load(std::memory_order_relaxed);
+  stats.broadcasts = m_broadcasts.load(std::memory_order_relaxed);
+  stats.fanout = m_fanout.load(std::memory_order_relaxed);
+  stats.rekeys = m_rekeys.load(std::memory_order_relaxed);
+  return stats;
+}
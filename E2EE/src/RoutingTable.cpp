@@ -0,0 +1,222 @@
+#include "RoutingTable.h"
+#include "SecureRandom.h"
+#include "SipHash.h"
+#include <algorithm>
+
+namespace {
+  const uint64_t kEmpty = 0;
+  const uint64_t kTombstone = 1;
+  const size_t kInitialSlots = 64;
+}
+
+RoutingTable::Array::Array(size_t size)
+  : mask(size - 1), slots(new Slot[size]) {
+  for (size_t i = 0; i < size; ++i) {
+    slots[i].key.store(kEmpty, std::memory_order_relaxed);
+    slots[i].value.store(0, std::memory_order_relaxed);
+  }
+}
+
+RoutingTable::RoutingTable(size_t readers, size_t shards)
+  : m_readers(new Reader[std::max<size_t>(readers, 1)]),
+    m_readerCount(readers),
+    m_epoch(0) {
+  size_t count = 2;
+  m_shardShift = 63;
+  while (count < shards) {
+    count <<= 1;
+    --m_shardShift;
+  }
+  m_shardMask = count - 1;
+  m_shards.reset(new Shard[count]);
+  for (size_t i = 0; i < count; ++i) {
+    m_shards[i].array.store(new Array(kInitialSlots), std::memory_order_relaxed);
+    m_shards[i].load.capacity = kInitialSlots;
+  }
+
+  unsigned char seed[16];
+  SecureRandom::Fill(seed, sizeof(seed));
+  std::memcpy(m_sipKey, seed, sizeof(seed));
+}
+
+RoutingTable::~RoutingTable() {
+  for (size_t i = 0; i <= m_shardMask; ++i) {
+    delete m_shards[i].array.load(std::memory_order_relaxed);
+  }
+  for (const Retired& retired : m_retired) {
+    delete retired.array;
+  }
+}
+
+uint64_t
+RoutingTable::Fingerprint(const std::string& user) const {
+  uint64_t key = SipHash::Hash24(m_sipKey, reinterpret_cast<const unsigned char*>(user.data()),
+                                 user.size());
+  return key > kTombstone ? key : key + 2;  // 0 y 1 marcan huecos libres/borrados
+}
+
+RoutingTable::Shard&
+RoutingTable::ShardFor(uint64_t key) const {
+  // Bits altos para el shard, bajos para el hueco: independientes entre si
+  return m_shards[static_cast<size_t>(key >> m_shardShift) & m_shardMask];
+}
+
+bool
+RoutingTable::Lookup(const std::string& user, uint64_t& connection) const {
+  uint64_t key = Fingerprint(user);
+  const Array* array = ShardFor(key).array.load(std::memory_order_acquire);
+  size_t index = static_cast<size_t>(key) & array->mask;
+  for (size_t probe = 0; probe <= array->mask; ++probe) {
+    const Slot& slot = array->slots[(index + probe) & array->mask];
+    uint64_t found = slot.key.load(std::memory_order_acquire);
+    if (found == key) {
+      uint64_t value = slot.value.load(std::memory_order_acquire);
+      // Si el hueco se borro y reutilizo entre las dos lecturas, no vale
+      if (slot.key.load(std::memory_order_acquire) != key) {
+        return false;
+      }
+      connection = value;
+      return true;
+    }
+    if (found == kEmpty) {
+      return false;
+    }
+  }
+  return false;
+}
+
+void
+RoutingTable::Insert(const std::string& user, uint64_t connection) {
+  uint64_t key = Fingerprint(user);
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  // Ocupacion maxima 3/4 contando borrados; si la mayoria son borrados basta
+  // con reconstruir del mismo tamano
+  ShardLoad& load = shard.load;
+  if ((load.live + load.tombstones + 1) * 4 > load.capacity * 3) {
+    Rebuild(shard, (load.live + 1) * 2 > load.capacity ? load.capacity * 2 : load.capacity);
+  }
+
+  Array* array = shard.array.load(std::memory_order_relaxed);
+  size_t index = static_cast<size_t>(key) & array->mask;
+  Slot* reuse = nullptr;
+  for (size_t probe = 0; probe <= array->mask; ++probe) {
+    Slot& slot = array->slots[(index + probe) & array->mask];
+    uint64_t found = slot.key.load(std::memory_order_relaxed);
+    if (found == key) {
+      slot.value.store(connection, std::memory_order_release);
+      ++load.inserts;
+      return;
+    }
+    if ((found == kTombstone || found == kEmpty) && !reuse) {
+      reuse = &slot;
+    }
+    if (found == kEmpty) {
+      break;
+    }
+  }
+
+  if (reuse->key.load(std::memory_order_relaxed) == kTombstone) {
+    --load.tombstones;
+  }
+  // Valor antes que la huella: un lector que ve la huella ve ya su valor
+  reuse->value.store(connection, std::memory_order_relaxed);
+  reuse->key.store(key, std::memory_order_release);
+  ++load.live;
+  ++load.inserts;
+}
+
+bool
+RoutingTable::Remove(const std::string& user, uint64_t connection) {
+  uint64_t key = Fingerprint(user);
+  Shard& shard = ShardFor(key);
+  std::lock_guard<std::mutex> guard(shard.lock);
+
+  Array* array = shard.array.load(std::memory_order_relaxed);
+  size_t index = static_cast<size_t>(key) & array->mask;
+  for (size_t probe = 0; probe <= array->mask; ++probe) {
+    Slot& slot = array->slots[(index + probe) & array->mask];
+    uint64_t found = slot.key.load(std::memory_order_relaxed);
+    if (found == key) {
+      if (slot.value.load(std::memory_order_relaxed) != connection) {
+        return false;
+      }
+      slot.key.store(kTombstone, std::memory_order_release);
+      --shard.load.live;
+      ++shard.load.tombstones;
+      ++shard.load.removes;
+      return true;
+    }
+    if (found == kEmpty) {
+      break;
+    }
+  }
+  return false;
+}
+
+void
+RoutingTable::Rebuild(Shard& shard, size_t size) {
+  Array* old = shard.array.load(std::memory_order_relaxed);
+  Array* array = new Array(size);
+  for (size_t i = 0; i <= old->mask; ++i) {
+    uint64_t key = old->slots[i].key.load(std::memory_order_relaxed);
+    if (key == kEmpty || key == kTombstone) {
+      continue;
+    }
+    size_t index = static_cast<size_t>(key) & array->mask;
+    while (array->slots[index].key.load(std::memory_order_relaxed) != kEmpty) {
+      index = (index + 1) & array->mask;
+    }
+    array->slots[index].value.store(old->slots[i].value.load(std::memory_order_relaxed),
+                                    std::memory_order_relaxed);
+    array->slots[index].key.store(key, std::memory_order_relaxed);
+  }
+  shard.array.store(array, std::memory_order_release);
+  shard.load.capacity = size;
+  shard.load.tombstones = 0;
+  ++shard.load.resizes;
+  Retire(old);
+}
+
+void
+RoutingTable::Retire(Array* array) {
+  std::lock_guard<std::mutex> guard(m_retireLock);
+  uint64_t epoch = m_epoch.fetch_add(1, std::memory_order_acq_rel) + 1;
+  m_retired.push_back(Retired{ array, epoch });
+
+  // Libre cuando todos los lectores han pasado por Quiescent() despues de retirarlo
+  uint64_t safe = UINT64_MAX;
+  for (size_t i = 0; i < m_readerCount; ++i) {
+    safe = std::min(safe, m_readers[i].seen.load(std::memory_order_acquire));
+  }
+  auto freed = std::remove_if(m_retired.begin(), m_retired.end(), [safe](const Retired& retired) {
+    if (retired.epoch > safe) {
+      return false;
+    }
+    delete retired.array;
+    return true;
+  });
+  m_retired.erase(freed, m_retired.end());
+}
+
+size_t
+RoutingTable::Size() const {
+  size_t size = 0;
+  for (size_t i = 0; i <= m_shardMask; ++i) {
+    std::lock_guard<std::mutex> guard(m_shards[i].lock);
+    size += m_shards[i].load.live;
+  }
+  return size;
+}
+
+std::vector<RoutingTable::ShardLoad>
+RoutingTable::GetLoad() const {
+  std::vector<ShardLoad> loads;
+  loads.reserve(m_shardMask + 1);
+  for (size_t i = 0; i <= m_shardMask; ++i) {
+    std::lock_guard<std::mutex> guard(m_shards[i].lock);
+    loads.push_back(m_shards[i].load);
+  }
+  return loads;
+}
@@ -0,0 +1,185 @@
+#include "SecureArena.h"
+#include "openssl/crypto.h"
+
+#include <algorithm>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+  size_t
+  PageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+  }
+
+  unsigned char*
+  ReservePages(size_t bytes) {
+#ifdef _WIN32
+    return static_cast<unsigned char*>(
+      VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+#else
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? nullptr : static_cast<unsigned char*>(p);
+#endif
+  }
+
+  void
+  ReleasePages(unsigned char* base, size_t bytes) {
+#ifdef _WIN32
+    (void)bytes;
+    VirtualFree(base, 0, MEM_RELEASE);
+#else
+    munmap(base, bytes);
+#endif
+  }
+
+  void
+  MakeGuard(unsigned char* page, size_t pageSize) {
+#ifdef _WIN32
+    DWORD old;
+    VirtualProtect(page, pageSize, PAGE_NOACCESS, &old);
+#else
+    mprotect(page, pageSize, PROT_NONE);
+#endif
+  }
+
+  bool
+  LockPages(unsigned char* data, size_t bytes) {
+#ifdef _WIN32
+    if (VirtualLock(data, bytes)) {
+      return true;
+    }
+    // El working set minimo por defecto es pequeno: se amplia y se reintenta
+    SIZE_T minSet = 0;
+    SIZE_T maxSet = 0;
+    HANDLE process = GetCurrentProcess();
+    if (GetProcessWorkingSetSize(process, &minSet, &maxSet) &&
+        SetProcessWorkingSetSize(process, minSet + bytes, std::max(maxSet, minSet + bytes))) {
+      return VirtualLock(data, bytes) != 0;
+    }
+    return false;
+#else
+    madvise(data, bytes, MADV_DONTDUMP);
+    return mlock(data, bytes) == 0;
+#endif
+  }
+}
+
+SecureArena::SecureArena(size_t blockSize, size_t blocksPerSlab)
+  : m_blockSize(std::max<size_t>(16, (blockSize + 15) & ~size_t(15))),
+    m_blocksPerSlab(std::max<size_t>(1, blocksPerSlab)),
+    m_pageSize(PageSize()) {
+  m_stats.blockSize = m_blockSize;
+  m_stats.blocksPerSlab = m_blocksPerSlab;
+}
+
+SecureArena::~SecureArena() {
+  while (m_slabs) {
+    Slab* slab = m_slabs;
+    m_slabs = slab->next;
+
+    unsigned char* data = slab->base + m_pageSize;
+    OPENSSL_cleanse(data, slab->reserved - 2 * m_pageSize);
+    ReleasePages(slab->base, slab->reserved);
+    delete slab;
+  }
+}
+
+SecureArena*
+SecureArena::Shared(size_t blockSize) {
+  static SecureArena arena32(32);
+  static SecureArena arena64(64);
+  static SecureArena arena128(128, 512);
+  static SecureArena arena256(256, 256);
+
+  if (blockSize <= 32) return &arena32;
+  if (blockSize <= 64) return &arena64;
+  if (blockSize <= 128) return &arena128;
+  if (blockSize <= 256) return &arena256;
+  return nullptr;
+}
+
+bool
+SecureArena::AddSlab() {
+  // [guarda][bloques redondeados a paginas][guarda]
+  size_t dataBytes = m_blockSize * m_blocksPerSlab;
+  dataBytes = (dataBytes + m_pageSize - 1) / m_pageSize * m_pageSize;
+  size_t reserved = dataBytes + 2 * m_pageSize;
+
+  unsigned char* base = ReservePages(reserved);
+  if (!base) {
+    return false;
+  }
+  MakeGuard(base, m_pageSize);
+  MakeGuard(base + m_pageSize + dataBytes, m_pageSize);
+
+  unsigned char* data = base + m_pageSize;
+  if (LockPages(data, dataBytes)) {
+    m_stats.lockedBytes += dataBytes;
+  }
+  else {
+    ++m_stats.lockFailures;
+  }
+
+  // Encadena los bloques del slab nuevo en la lista libre
+  size_t blocks = dataBytes / m_blockSize;
+  for (size_t i = blocks; i-- > 0;) {
+    FreeBlock* block = reinterpret_cast<FreeBlock*>(data + i * m_blockSize);
+    block->next = m_freeList;
+    m_freeList = block;
+  }
+
+  m_slabs = new Slab{ m_slabs, base, reserved };
+  ++m_stats.slabs;
+  return true;
+}
+
+void*
+SecureArena::Allocate() {
+  std::lock_guard<std::mutex> guard(m_lock);
+  if (!m_freeList && !AddSlab()) {
+    return nullptr;
+  }
+
+  FreeBlock* block = m_freeList;
+  m_freeList = block->next;
+  block->next = nullptr;  // El resto del bloque ya esta a cero
+
+  ++m_stats.inUse;
+  ++m_stats.totalAllocations;
+  m_stats.peakInUse = std::max(m_stats.peakInUse, m_stats.inUse);
+  return block;
+}
+
+void
+SecureArena::Free(void* block) {
+  if (!block) {
+    return;
+  }
+  OPENSSL_cleanse(block, m_blockSize);
+
+  std::lock_guard<std::mutex> guard(m_lock);
+  FreeBlock* freed = static_cast<FreeBlock*>(block);
+  freed->next = m_freeList;
+  m_freeList = freed;
+  --m_stats.inUse;
+}
+
+SecureArena::Stats
+SecureArena::GetStats() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_stats;
+}
@@ -0,0 +1,61 @@
+#include "SecureRandom.h"
+#include "openssl/rand.h"
+#include "openssl/crypto.h"
+#include <algorithm>
+
+namespace {
+  struct ThreadPool {
+    unsigned char block[SecureRandom::kBlockSize];
+    size_t pos = SecureRandom::kBlockSize;  // Vacio hasta la primera recarga
+
+    ~ThreadPool() {
+      OPENSSL_cleanse(block, sizeof(block));
+    }
+
+    bool
+    Refill() {
+      if (RAND_priv_bytes(block, sizeof(block)) != 1) {
+        return false;
+      }
+      pos = 0;
+      return true;
+    }
+  };
+
+  thread_local ThreadPool t_pool;
+}
+
+bool
+SecureRandom::Fill(unsigned char* out, size_t len) {
+  // Peticiones grandes van directas: no merece la pena pasar por el buffer
+  if (len >= kBlockSize) {
+    return RAND_priv_bytes(out, static_cast<int>(len)) == 1;
+  }
+
+  ThreadPool& pool = t_pool;
+  while (len > 0) {
+    if (pool.pos == kBlockSize && !pool.Refill()) {
+      return false;
+    }
+    size_t n = std::min(len, kBlockSize - pool.pos);
+    std::memcpy(out, pool.block + pool.pos, n);
+    OPENSSL_cleanse(pool.block + pool.pos, n);
+    pool.pos += n;
+    out += n;
+    len -= n;
+  }
+  return true;
+}
+
+uint64_t
+SecureRandom::NextU64() {
+  uint64_t value = 0;
+  Fill(reinterpret_cast<unsigned char*>(&value), sizeof(value));
+  return value;
+}
+
+bool
+SecureRandom::Prime() {
+  ThreadPool& pool = t_pool;
+  return pool.pos < kBlockSize || pool.Refill();
+}
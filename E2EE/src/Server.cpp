@@ -0,0 +1,2756 @@
+#include "Server.h"
+#include "AdmissionControl.h"
+#include "AlgorithmCache.h"
+#include "BufferPool.h"
+#include "FrameCodec.h"
+#include "HybridKeyExchange.h"
+#include "LockFreeQueue.h"
+#include "SecureRandom.h"
+#include "WriteQueue.h"
+#include <algorithm>
+#include <array>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <unordered_map>
+
+namespace {
+  const size_t kInboxDepth = 16384;
+  const size_t kRecvChunk = 64 * 1024;
+  const size_t kMaxPendingOut = 8 * 1024 * 1024;  // Cliente lento: se cierra
+  const int kReadsPerWakeup = 4;                   // Reparto justo entre conexiones
+  const size_t kInboxBatch = 64;                   // Mensajes por PopBatch
+  const int kConnectionIdShift = 48;               // Nucleo dueno en los bits altos
+  const size_t kInlineCryptoLimit = 4 * 1024;      // Mas grande: al scheduler
+  const size_t kSealBatch = 16;                    // Sellos seguidos que se reparten entre workers
+  const size_t kSealBatchMax = 256;
+  const size_t kSealChunk = 8;                     // Sellos por subtarea
+  const size_t kRoomBatch = 1024;                  // Miembros por mensaje de difusion
+  const size_t kMaxRoomsPerConnection = 256;
+  const size_t kStoredWindow = 256;                // Stored sin confirmar por conexion
+  const size_t kStoredWindowBytes = 1024 * 1024;   // Por lectura del backlog
+  const size_t kMaxUnacked = 8192;                 // Deliver sin ack por sesion
+  const int kAckPollMs = 5;                        // Espera de WSAPoll con acks pendientes
+  const std::chrono::seconds kSweepInterval(1);    // Caducidad de sesiones (nucleo 0)
+  const unsigned char kAckStored = 0;              // Flujos de un Ack
+  const unsigned char kAckSession = 1;
+  const size_t kBulkFrame = 16 * 1024;             // Send/Publish mas grande: transferencia
+  const int kRestartPollMs = 200;                  // Espera de accept y de HotRestart::Accept
+  const std::chrono::seconds kQuietTimeout(2);     // Reinicio: espera a que no quede cripto
+  const int kHandoffTimeoutMs = 10000;             // Por mensaje del traspaso; vencido, se sigue aqui
+  const size_t kMigrateBudget = 4096;              // Mensajes offline (o claves) migrados por barrido
+
+  // Mensajes del reinicio en caliente: el primer byte del payload
+  const unsigned char kHandoffListener = 1;        // Socket de escucha + sesiones
+  const unsigned char kHandoffConnections = 2;     // n x [len u32][conexion] + n sockets
+  const unsigned char kHandoffDone = 3;
+  const unsigned char kHandoffReady = 4;           // Del sucesor: ya puede soltarlo todo
+  const unsigned char kHandoffIdentities = 5;      // Claves fijadas (IdentityRegistry::Export)
+  const char kIdentityFile[] = "identities";       // En el directorio offline
+  const char kBlobDirectory[] = "blobs";           // Tambien
+  const size_t kMaxBlobRead = 1024 * 1024;         // Por BlobRead: el resto, en mas peticiones
+  const std::chrono::seconds kBlobGCInterval(30);
+
+  using SteadyClock = std::chrono::steady_clock;
+
+  // Contador con un solo escritor: sin instruccion atomica de lectura-modificacion
+  void
+  Bump(std::atomic<uint64_t>& counter, uint64_t amount = 1) {
+    counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+  }
+
+  // Bytes crudos de la IP del otro extremo: la clave del bucket por IP
+  bool
+  PeerAddress(SOCKET socket, std::string& out) {
+    sockaddr_storage peer{};
+    socklen_t length = sizeof(peer);
+    if (getpeername(socket, reinterpret_cast<sockaddr*>(&peer), &length) == SOCKET_ERROR) {
+      return false;
+    }
+    if (peer.ss_family == AF_INET) {
+      const in_addr& address = reinterpret_cast<const sockaddr_in&>(peer).sin_addr;
+      out.assign(reinterpret_cast<const char*>(&address), sizeof(address));
+      return true;
+    }
+    if (peer.ss_family == AF_INET6) {
+      const in6_addr& address = reinterpret_cast<const sockaddr_in6&>(peer).sin6_addr;
+      out.assign(reinterpret_cast<const char*>(&address), sizeof(address));
+      return true;
+    }
+    return false;
+  }
+
+  void
+  AppendU32(std::string& out, uint32_t value) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  void
+  AppendU64(std::string& out, uint64_t value) {
+    for (int shift = 56; shift >= 0; shift -= 8) {
+      out.push_back(static_cast<char>(value >> shift));
+    }
+  }
+
+  // Lector de [len][bytes] de los mensajes del reinicio; falla sin salirse
+  struct Cursor {
+    const unsigned char* data;
+    const unsigned char* end;
+
+    bool
+    Read(uint64_t& value, int bytes) {
+      if (end - data < bytes) {
+        return false;
+      }
+      value = 0;
+      for (int i = 0; i < bytes; ++i) {
+        value = (value << 8) | *data++;
+      }
+      return true;
+    }
+
+    bool
+    Read(std::string& out, int lengthBytes) {
+      uint64_t len = 0;
+      if (!Read(len, lengthBytes) || static_cast<uint64_t>(end - data) < len) {
+        return false;
+      }
+      out.assign(reinterpret_cast<const char*>(data), static_cast<size_t>(len));
+      data += len;
+      return true;
+    }
+  };
+
+  bool
+  WouldBlock() {
+    int error = WSAGetLastError();
+    return error == WSAEWOULDBLOCK || error == WSAEINTR;
+  }
+
+  struct CoreMessage {
+    enum class Kind {
+      Adopt,       // Socket recien aceptado
+      Deliver,     // Mensaje para connection (de user); va al nucleo dueno
+      RoomDeliver, // Publicacion de la sala user para members[begin, end)
+      Stored,      // Hay backlog nuevo para connection (de user)
+      Signal,      // Senal efimera para connection (de user)
+      Forwarded    // De otro nodo del cluster para user; no vuelve a salir
+    };
+
+    Kind kind = Kind::Adopt;
+    SOCKET socket = INVALID_SOCKET;
+    uint64_t connection = 0;
+    std::string user;     // Destinatario esperado de connection / sala
+    std::string source;
+    std::string payload;
+    std::shared_ptr<const RoomRegistry::Broadcast> broadcast;
+    size_t begin = 0;
+    size_t end = 0;
+    Cluster::Kind remote = Cluster::Kind::Message;   // Forwarded: que trae payload
+    SteadyClock::time_point posted;   // Para el control de admision
+  };
+
+  bool
+  IsBlobRequest(unsigned char type) {
+    return type == FrameType::BlobPut || type == FrameType::BlobRef ||
+           type == FrameType::BlobRelease || type == FrameType::BlobRead;
+  }
+
+  // Un descifrado (Open) o cifrado (Seal) de la sesion de una conexion, o
+  // una trama ya cifrada (Shared) que debe salir en orden detras de ellos
+  struct CryptoStep {
+    enum class Kind {
+      Open,     // Trama de cliente: ciphertext -> seq + destination + payload
+      SealRaw,  // payload -> sealed
+      SealView, // [view, view + viewLen) -> sealed, sin copiarlo antes
+      Shared    // frame tal cual
+    };
+
+    Kind kind = Kind::Open;
+    unsigned char frameType = FrameType::Send;  // Tipo recibido (Open) o a enviar
+    bool ok = false;
+    std::vector<unsigned char> ciphertext;  // Open (solo si va al scheduler)
+    uint64_t seq = 0;                       // Resultado de Open (Send)
+    std::string destination;                // Resultado de Open: destino o sala
+    std::string payload;                    // Resultado de Open / entrada de SealRaw
+    std::shared_ptr<const void> viewOwner;  // SealView: mantiene view viva
+    const unsigned char* view = nullptr;
+    size_t viewLen = 0;
+    std::vector<unsigned char> sealed;      // Resultado de Seal
+    bool reserved = false;                  // Seal con una secuencia AEAD ya apartada
+    uint64_t sendSequence = 0;
+    WriteQueue::Shared frame;               // Shared
+    SteadyClock::time_point submitted;      // Entrada al scheduler
+
+    static void
+    Open(CryptoHelper& session, const unsigned char* body, size_t len, CryptoStep& step) {
+      std::string plaintext;
+      step.ok = session.AEADDecrypt(body, len, plaintext);
+      const unsigned char* data = reinterpret_cast<const unsigned char*>(plaintext.data());
+      size_t dataLen = plaintext.size();
+      if (step.ok && (step.frameType == FrameType::Ack || IsBlobRequest(step.frameType))) {
+        step.payload.swap(plaintext);  // Sin id delante: se interpreta en el nucleo
+        return;
+      }
+      // Send: [seq u64][len destino][destino][payload]
+      if (step.ok && step.frameType == FrameType::Send) {
+        step.ok = dataLen >= 8;
+        for (size_t i = 0; step.ok && i < 8; ++i) {
+          step.seq = (step.seq << 8) | data[i];
+        }
+        data += step.ok ? 8 : 0;
+        dataLen -= step.ok ? 8 : 0;
+      }
+      const unsigned char* payload = nullptr;
+      size_t payloadLen = 0;
+      step.ok = step.ok && FrameCodec::SplitId(data, dataLen, step.destination, payload, payloadLen);
+      if (step.ok) {
+        step.payload.assign(reinterpret_cast<const char*>(payload), payloadLen);
+      }
+      if (!plaintext.empty()) {
+        OPENSSL_cleanse(&plaintext[0], plaintext.size());
+      }
+    }
+
+    static CryptoStep
+    View(unsigned char type, std::shared_ptr<const void> owner, const unsigned char* data,
+         size_t len) {
+      CryptoStep step;
+      step.kind = Kind::SealView;
+      step.frameType = type;
+      step.viewOwner = std::move(owner);
+      step.view = data;
+      step.viewLen = len;
+      return step;
+    }
+
+    bool
+    IsSeal() const { return kind == Kind::SealRaw || kind == Kind::SealView; }
+
+    static void
+    Seal(CryptoHelper& session, CryptoStep& step) {
+      if (step.kind == Kind::SealView) {
+        step.sealed = step.reserved ?
+          session.AEADEncryptAt(step.sendSequence, step.view, step.viewLen) :
+          session.AEADEncrypt(step.view, step.viewLen);
+        step.viewOwner.reset();  // Suelta la proyeccion o el buffer cuanto antes
+        step.view = nullptr;
+      }
+      else {
+        const unsigned char* data = reinterpret_cast<const unsigned char*>(step.payload.data());
+        step.sealed = step.reserved ?
+          session.AEADEncryptAt(step.sendSequence, data, step.payload.size()) :
+          session.AEADEncrypt(data, step.payload.size());
+        OPENSSL_cleanse(&step.payload[0], step.payload.size());
+      }
+      step.ok = !step.sealed.empty();
+    }
+
+    static void
+    Run(CryptoHelper& session, CryptoStep& step) {
+      switch (step.kind) {
+      case Kind::Open:
+        Open(session, step.ciphertext.data(), step.ciphertext.size(), step);
+        break;
+      case Kind::SealRaw:
+      case Kind::SealView:
+        Seal(session, step);
+        break;
+      case Kind::Shared:
+        step.ok = true;
+        break;
+      }
+    }
+  };
+
+  // Sellos seguidos de una conexion con sus secuencias ya apartadas: se
+  // cifran en tramos repartidos entre workers y vuelven juntos, en orden
+  struct SealBatch {
+    std::vector<CryptoStep> steps;
+    std::atomic<size_t> left{ 0 };   // Tramos sin terminar
+    SteadyClock::time_point submitted;
+  };
+
+  struct HandshakeResult {
+    bool ok = false;
+    unsigned char key[32];
+    HandshakeMode mode = HandshakeMode::RSA;
+    std::vector<unsigned char> response;   // HybridPQ: va en el Welcome
+    bool bound = false;                    // Firma valida y clave fijada en este nodo
+    SteadyClock::time_point submitted;
+
+    ~HandshakeResult() {
+      OPENSSL_cleanse(key, sizeof(key));
+    }
+  };
+
+  struct BlobResult {
+    unsigned char type = FrameType::BlobStatus;  // BlobStatus o BlobData
+    std::string reply;                           // En claro, para SealControl
+    unsigned char state = BlobState::Failed;
+    size_t uploaded = 0;                         // Bytes escritos por un BlobPut
+    SteadyClock::time_point submitted;
+  };
+
+  // Una peticion de blob ya descifrada. Corre en el pool: hashea, escribe y
+  // espera al volcado del journal sin parar ningun loop
+  void
+  RunBlob(BlobStore* store, unsigned char request, const std::string& body, BlobResult& result) {
+    BlobStore::BlobId id{};
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(body.data());
+    if (request == FrameType::BlobPut) {
+      bool deduplicated = false;
+      if (store && !body.empty() && store->Put(data, body.size(), id, deduplicated)) {
+        result.state = deduplicated ? BlobState::Deduplicated : BlobState::Stored;
+        result.uploaded = deduplicated ? 0 : body.size();
+      }
+      else {
+        id = BlobStore::ComputeId(data, body.size());  // Para que el cliente sepa cual fallo
+      }
+    }
+    else if (body.size() >= id.size()) {
+      std::memcpy(id.data(), data, id.size());
+      if (!store) {
+        result.state = BlobState::Failed;
+      }
+      else if (request == FrameType::BlobRef) {
+        result.state = store->AddRef(id) ? BlobState::Deduplicated : BlobState::Missing;
+      }
+      else if (request == FrameType::BlobRelease) {
+        result.state = store->Release(id) ? BlobState::Released : BlobState::Missing;
+      }
+      else {
+        // [id 32][offset u64][len u32]
+        Cursor cursor{ data + id.size(), data + body.size() };
+        uint64_t offset = 0;
+        uint64_t len = 0;
+        uint64_t size = store->BlobSize(id);
+        std::vector<unsigned char> chunk;
+        if (size == 0) {
+          result.state = BlobState::Missing;
+        }
+        else if (cursor.Read(offset, 8) && cursor.Read(len, 4) && offset <= size &&
+                 store->Read(id, offset, std::min<size_t>(len, kMaxBlobRead), chunk)) {
+          result.type = FrameType::BlobData;
+          result.reply.assign(reinterpret_cast<const char*>(id.data()), id.size());
+          AppendU64(result.reply, size);
+          AppendU64(result.reply, offset);
+          result.reply.append(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+          return;
+        }
+      }
+    }
+    result.reply.assign(reinterpret_cast<const char*>(id.data()), id.size());
+    result.reply.push_back(static_cast<char>(result.state));
+  }
+}
+
+class
+Server::Core {
+public:
+  Core(Server& server, size_t index)
+    : m_server(server),
+      m_index(index),
+      m_inbox(kInboxDepth),
+      m_completions(kInboxDepth),
+      m_inboxBatch(kInboxBatch),
+      m_recvBuffer(kRecvChunk) {
+  }
+
+  ~Core() {
+    if (m_wakeSocket != INVALID_SOCKET) {
+      closesocket(m_wakeSocket);
+    }
+  }
+
+  // Tambien tras un Stop, si un reinicio en caliente falla y se sigue aqui
+  bool
+  Start() {
+    if (m_wakeSocket == INVALID_SOCKET && !OpenWakeSocket()) {
+      return false;
+    }
+    m_completions.SetNotifier([this]() { Wake(); });
+    m_stop.store(false, std::memory_order_release);
+    m_thread = std::thread(&Core::Run, this);
+    return true;
+  }
+
+  void
+  Stop() {
+    m_stop.store(true, std::memory_order_release);
+    Wake();
+    if (m_thread.joinable()) {
+      m_thread.join();
+    }
+  }
+
+  /**
+   * Unica entrada al nucleo desde otros hilos. Nunca espera: con la cola
+   * llena devuelve false sin tocar message y decide quien envia (al almacen
+   * offline, descartar o rechazar). Un nucleo que esperase aqui podria
+   * estar esperando a otro que a su vez espera por su cola.
+   */
+  bool
+  TryPost(CoreMessage&& message) {
+    message.posted = SteadyClock::now();
+    if (!m_inbox.TryPush(std::move(message))) {
+      return false;
+    }
+    Wake();
+    return true;
+  }
+
+  // Un aviso Stored no cupo: se relee el backlog de todas las conexiones
+  void
+  MissStored() {
+    m_storedMissed.store(true, std::memory_order_release);
+    Wake();
+  }
+
+  CompletionQueue&
+  Completions() { return m_completions; }
+
+  /**
+   * Congelado: no se lee de ningun socket, pero se siguen atendiendo el
+   * inbox, las completions, las escrituras y los acks. Al salir del loop
+   * congelado las conexiones no se cierran.
+   */
+  void
+  Freeze(bool frozen) {
+    m_quiet.store(false, std::memory_order_relaxed);
+    m_frozen.store(frozen, std::memory_order_release);
+    Wake();
+  }
+
+  /**
+   * Congelado y sin trabajo que pueda generar mensajes para otros nucleos.
+   */
+  bool
+  Quiet() const { return m_quiet.load(std::memory_order_acquire) && m_inbox.Empty(); }
+
+  /**
+   * Serializa cada conexion con sesion para el sucesor:
+   * [len usuario u8][usuario][len u32][sesion AEAD][len u32][entrada sin
+   * procesar][len u32][salida pendiente][n u16][n x (len u8, sala)]
+   * [storedSent u64][n u32][n x seq u64]. Las demas se cierran. Las
+   * conexiones siguen aqui hasta Release(): si el traspaso falla, Start()
+   * continua con ellas.
+   *
+   * Solo con el hilo del nucleo parado (Freeze + Stop).
+   */
+  void
+  Export(std::vector<std::string>& records, std::vector<SOCKET>& sockets) {
+    // Lo que llego entre la ultima vuelta y Stop, y los acks aplazados: el
+    // sucesor no sabe que se debian
+    DrainInbox();
+    m_completions.Drain();
+    for (uint64_t id : m_ackQueue) {
+      auto it = m_connections.find(id);
+      if (it == m_connections.end() || it->second.closing) {
+        continue;
+      }
+      it->second.ackQueued = false;
+      bool pending = false;
+      {
+        std::lock_guard<std::mutex> guard(it->second.reliable->lock);
+        pending = it->second.reliable->inbound.AckPending();
+      }
+      if (pending) {
+        SendAck(it->second);
+      }
+    }
+    m_ackQueue.clear();
+
+    for (auto& entry : m_connections) {
+      Connection& connection = entry.second;
+      std::string session;
+      if (connection.closing || !connection.session || connection.handshaking ||
+          connection.cryptoBusy || !connection.session->ExportSession(session)) {
+        Close(connection);  // El cliente reconecta y reanuda su sesion fiable
+        continue;
+      }
+      std::string record;
+      record.push_back(static_cast<char>(connection.user.size()));
+      record += connection.user;
+      AppendU32(record, static_cast<uint32_t>(session.size()));
+      record += session;
+      OPENSSL_cleanse(&session[0], session.size());
+      AppendU32(record, static_cast<uint32_t>(connection.in.size()));
+      record.append(reinterpret_cast<const char*>(connection.in.data()), connection.in.size());
+      std::string out;
+      connection.out.CopyPending(out);
+      AppendU32(record, static_cast<uint32_t>(out.size()));
+      record += out;
+      record.push_back(static_cast<char>(connection.rooms.size() >> 8));
+      record.push_back(static_cast<char>(connection.rooms.size()));
+      for (const auto& room : connection.rooms) {
+        record.push_back(static_cast<char>(room.first.size()));
+        record += room.first;
+      }
+      AppendU64(record, connection.storedSent);
+      AppendU32(record, static_cast<uint32_t>(connection.storedInFlight.size()));
+      for (uint64_t seq : connection.storedInFlight) {
+        AppendU64(record, seq);
+      }
+      records.push_back(std::move(record));
+      sockets.push_back(connection.socket);
+    }
+    Reap();
+  }
+
+  /**
+   * Tras un traspaso con exito: cierra la copia local de cada socket sin
+   * shutdown ni tramas (el sucesor tiene la suya) y olvida las conexiones.
+   */
+  void
+  Release() {
+    for (auto& entry : m_connections) {
+      closesocket(entry.second.socket);
+      m_buffers.Release(std::move(entry.second.in));
+      m_buffers.Release(entry.second.out.Release());
+    }
+    m_connections.clear();
+    m_ackQueue.clear();
+    m_open.store(0, std::memory_order_relaxed);
+  }
+
+  /**
+   * Conexion traspasada por el proceso anterior (formato de Export). Antes
+   * de Start(): el hilo del nucleo aun no existe.
+   */
+  bool
+  Import(SOCKET socket, const std::string& record) {
+    Connection* opened = Open(socket);
+    if (!opened) {
+      return false;
+    }
+    Connection& connection = *opened;
+    Cursor cursor{ reinterpret_cast<const unsigned char*>(record.data()),
+                   reinterpret_cast<const unsigned char*>(record.data()) + record.size() };
+    std::string user;
+    std::string session;
+    std::string in;
+    std::string out;
+    uint64_t rooms = 0;
+    connection.session = std::make_shared<CryptoHelper>();
+    bool ok = cursor.Read(user, 1) && !user.empty() && cursor.Read(session, 4) &&
+              connection.session->ImportSession(
+                reinterpret_cast<const unsigned char*>(session.data()), session.size()) &&
+              cursor.Read(in, 4) && cursor.Read(out, 4) && cursor.Read(rooms, 2);
+    if (!session.empty()) {
+      OPENSSL_cleanse(&session[0], session.size());
+    }
+    std::vector<std::string> joined(ok ? static_cast<size_t>(rooms) : 0);
+    for (std::string& room : joined) {
+      ok = ok && cursor.Read(room, 1);
+    }
+    uint64_t inFlight = 0;
+    ok = ok && cursor.Read(connection.storedSent, 8) && cursor.Read(inFlight, 4);
+    for (uint64_t i = 0; ok && i < inFlight; ++i) {
+      uint64_t seq = 0;
+      ok = cursor.Read(seq, 8);
+      connection.storedInFlight.push_back(seq);
+    }
+    if (!ok) {
+      connection.session.reset();
+      Close(connection);
+      Reap();
+      return false;
+    }
+
+    connection.user = user;
+    connection.reliable = m_server.m_sessions.Attach(user);
+    connection.in.assign(in.begin(), in.end());
+    if (!out.empty()) {
+      std::vector<unsigned char>& tail = connection.out.Tail();
+      tail.insert(tail.end(), out.begin(), out.end());
+      connection.out.Commit(out.size());
+    }
+    m_server.m_routes.Insert(user, connection.id);
+    // Las salas de este proceso son nuevas: cada una manda su RoomKey
+    for (const std::string& room : joined) {
+      OnJoin(connection, room);
+    }
+    PumpStored(connection);
+    Reap();
+    return true;
+  }
+
+  void
+  AddStats(Server::Stats& stats) const {
+    stats.connections += m_open.load(std::memory_order_relaxed);
+    stats.framesIn += m_framesIn.load(std::memory_order_relaxed);
+    stats.framesOut += m_framesOut.load(std::memory_order_relaxed);
+    stats.routed += m_routed.load(std::memory_order_relaxed);
+    stats.broadcasts += m_broadcasts.load(std::memory_order_relaxed);
+    stats.stored += m_stored.load(std::memory_order_relaxed);
+    stats.storedOut += m_storedOut.load(std::memory_order_relaxed);
+    stats.acks += m_acks.load(std::memory_order_relaxed);
+    stats.ackBytes += m_ackBytes.load(std::memory_order_relaxed);
+    stats.retransmitted += m_retransmitted.load(std::memory_order_relaxed);
+    stats.duplicates += m_duplicates.load(std::memory_order_relaxed);
+    stats.limited += m_limited.load(std::memory_order_relaxed);
+    stats.shedSignals += m_shedSignals.load(std::memory_order_relaxed);
+    stats.shedHandshakes += m_shedHandshakes.load(std::memory_order_relaxed);
+    stats.shedBulk += m_shedBulk.load(std::memory_order_relaxed);
+    stats.escalations += m_escalations.load(std::memory_order_relaxed);
+    stats.shedLevel = std::max(stats.shedLevel, m_shedLevel.load(std::memory_order_relaxed));
+    stats.sojournMicros = std::max(stats.sojournMicros, m_sojournMicros.load(std::memory_order_relaxed));
+    stats.forwarded += m_forwarded.load(std::memory_order_relaxed);
+    stats.redirected += m_redirected.load(std::memory_order_relaxed);
+    stats.migrated += m_migrated.load(std::memory_order_relaxed);
+    stats.blobRequests += m_blobRequests.load(std::memory_order_relaxed);
+    stats.blobDedupHits += m_blobDedupHits.load(std::memory_order_relaxed);
+    stats.blobBytesIn += m_blobBytesIn.load(std::memory_order_relaxed);
+    stats.inboxFull += m_inboxFull.load(std::memory_order_relaxed);
+    stats.sealBatches += m_sealBatches.load(std::memory_order_relaxed);
+    stats.dropped += m_dropped.load(std::memory_order_relaxed);
+    stats.bytesIn += m_bytesIn.load(std::memory_order_relaxed);
+    stats.bytesOut += m_bytesOut.load(std::memory_order_relaxed);
+  }
+
+private:
+  // Backlog de un usuario de otro nodo en los enlaces (MigrateOffline)
+  struct Migration {
+    uint64_t sent = 0;                   // Ultimo seq leido del almacen
+    std::map<uint64_t, bool> inFlight;   // seq -> ya lo confirmo el enlace
+  };
+
+  struct Connection {
+    uint64_t id = 0;
+    SOCKET socket = INVALID_SOCKET;
+    std::string user;
+    std::array<unsigned char, 32> challenge;  // Va en el ServerKey; el Hello lo firma
+    std::shared_ptr<CryptoHelper> session;  // Transporte cliente <-> servidor
+    bool handshaking = false;
+    bool cryptoBusy = false;                // Un paso en el scheduler
+    std::deque<CryptoStep> cryptoBacklog;   // Pasos detras de ese, en orden
+    bool closing = false;
+    std::vector<unsigned char> in;
+    WriteQueue out;
+    std::unordered_map<std::string, uint32_t> rooms;  // Sala -> epoch de la clave enviada
+    uint64_t storedSent = 0;                // Ultimo seq del backlog enviado
+    std::deque<uint64_t> storedInFlight;    // Enviados sin Ack
+    std::shared_ptr<ReliableSession> reliable;  // Secuencias del usuario, entre conexiones
+    uint64_t resumeBefore = 0;              // Reanudada: reenviar por debajo al primer ack
+    bool ackQueued = false;                 // En m_ackQueue
+    bool redirected = false;                // Usuario de otro nodo: se cierra tras Redirect
+    TokenBucket limit;                      // Tramas de esta conexion
+    std::shared_ptr<TokenBucket> address;   // Compartido por su IP; nulo = sin limite
+  };
+
+  // Socket UDP conectado a si mismo: despierta a WSAPoll desde otros hilos
+  bool
+  OpenWakeSocket() {
+    m_wakeSocket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (m_wakeSocket == INVALID_SOCKET) {
+      std::cerr << "Error creating wake socket: " << WSAGetLastError() << std::endl;
+      return false;
+    }
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    u_long nonBlocking = 1;
+    if (bind(m_wakeSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR ||
+        getsockname(m_wakeSocket, reinterpret_cast<sockaddr*>(&address), &length) == SOCKET_ERROR ||
+        connect(m_wakeSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == SOCKET_ERROR ||
+        ioctlsocket(m_wakeSocket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+      std::cerr << "Error configuring wake socket: " << WSAGetLastError() << std::endl;
+      return false;
+    }
+    return true;
+  }
+
+  void
+  Wake() {
+    if (!m_wakePending.exchange(true)) {
+      char signal = 1;
+      send(m_wakeSocket, &signal, 1, 0);
+    }
+  }
+
+  void
+  DrainWakeSocket() {
+    char scratch[64];
+    while (recv(m_wakeSocket, scratch, sizeof(scratch), 0) > 0) {
+    }
+  }
+
+  void
+  Run() {
+#ifdef _WIN32
+    SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (m_index % (sizeof(DWORD_PTR) * 8)));
+#endif
+    SecureRandom::Prime();
+    AlgorithmCache::ThreadHMAC();
+
+    std::vector<WSAPOLLFD> fds;
+    std::vector<uint64_t> ids;
+    while (!m_stop.load(std::memory_order_acquire)) {
+      bool frozen = m_frozen.load(std::memory_order_acquire);
+      fds.clear();
+      ids.clear();
+      WSAPOLLFD wake{};
+      wake.fd = m_wakeSocket;
+      wake.events = POLLRDNORM;
+      fds.push_back(wake);
+      for (const auto& entry : m_connections) {
+        // Congelado solo se escribe: lo no leido se queda en el socket
+        if (frozen && entry.second.out.Empty()) {
+          continue;
+        }
+        WSAPOLLFD fd{};
+        fd.fd = entry.second.socket;
+        fd.events = frozen ? 0 : POLLRDNORM;
+        if (!entry.second.out.Empty()) {
+          fd.events |= POLLWRNORM;
+        }
+        fds.push_back(fd);
+        ids.push_back(entry.first);
+      }
+
+      int timeout = m_ackQueue.empty() && !frozen ? 1000 : kAckPollMs;
+      int ready = WSAPoll(fds.data(), static_cast<ULONG>(fds.size()), timeout);
+      if (ready == SOCKET_ERROR) {
+        std::cerr << "WSAPoll failed: " << WSAGetLastError() << std::endl;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        continue;
+      }
+
+      // Ningun puntero de la tabla de rutas sobrevive a una vuelta del loop
+      m_server.m_routes.Quiescent(m_index);
+      RefreshTopology();
+
+      if (fds[0].revents) {
+        DrainWakeSocket();
+      }
+      // Se rearma antes de vaciar las colas: un Post posterior vuelve a avisar
+      m_wakePending.store(false);
+      size_t handled = DrainInbox();
+      handled += m_completions.Drain();
+      UpdateAdmission();
+      if (m_storedMissed.exchange(false, std::memory_order_acq_rel)) {
+        for (auto& entry : m_connections) {
+          if (entry.second.reliable) {
+            PumpStored(entry.second);
+          }
+        }
+      }
+
+      for (size_t i = 1; i < fds.size(); ++i) {
+        if (!fds[i].revents) {
+          continue;
+        }
+        auto it = m_connections.find(ids[i - 1]);
+        if (it == m_connections.end() || it->second.closing) {
+          continue;
+        }
+        if (!frozen && (fds[i].revents & (POLLRDNORM | POLLHUP | POLLERR | POLLNVAL))) {
+          Read(it->second);
+        }
+        if ((fds[i].revents & POLLWRNORM) && !it->second.closing) {
+          Flush(it->second);
+        }
+      }
+      FlushAcks();
+      CloseRedirected();
+      if (!frozen && m_index == 0 && std::chrono::steady_clock::now() >= m_nextSweep) {
+        m_nextSweep = std::chrono::steady_clock::now() + kSweepInterval;
+        SweepSessions();
+        MigrateOffline();
+        MigrateIdentities();
+        m_server.m_limiter.Sweep();
+      }
+      Reap();
+      m_quiet.store(frozen && handled == 0 && Idle(), std::memory_order_release);
+    }
+
+    // Congelado: las conexiones esperan a Export o a un nuevo Start
+    if (!m_frozen.load(std::memory_order_acquire)) {
+      for (auto& entry : m_connections) {
+        Close(entry.second);
+      }
+    }
+    Reap();
+  }
+
+  // Sin cripto ni handshakes en vuelo: nada que pueda acabar en Route
+  bool
+  Idle() const {
+    for (const auto& entry : m_connections) {
+      const Connection& connection = entry.second;
+      if (connection.handshaking || connection.cryptoBusy || !connection.cryptoBacklog.empty()) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  size_t
+  DrainInbox() {
+    size_t handled = 0;
+    size_t popped;
+    while ((popped = m_inbox.PopBatch(m_inboxBatch.data(), m_inboxBatch.size())) > 0) {
+      handled += popped;
+      // La espera del mas antiguo del lote basta: el resto llego despues
+      SteadyClock::time_point now = SteadyClock::now();
+      m_admission.Observe(now - m_inboxBatch[0].posted, now);
+      for (size_t i = 0; i < popped; ++i) {
+        Handle(m_inboxBatch[i]);
+        m_inboxBatch[i] = CoreMessage();
+      }
+    }
+    return handled;
+  }
+
+  void
+  Handle(CoreMessage& message) {
+    switch (message.kind) {
+    case CoreMessage::Kind::Adopt:
+      Adopt(message.socket);
+      break;
+    case CoreMessage::Kind::Deliver:
+      Deliver(message.connection, message.user, std::move(message.source),
+              std::move(message.payload));
+      break;
+    case CoreMessage::Kind::RoomDeliver:
+      DeliverRoom(message.user, *message.broadcast, message.begin, message.end);
+      break;
+    case CoreMessage::Kind::Signal:
+      DeliverSignal(message.connection, message.user, message.source, message.payload);
+      break;
+    case CoreMessage::Kind::Stored: {
+      auto it = m_connections.find(message.connection);
+      if (it != m_connections.end() && it->second.user == message.user) {
+        PumpStored(it->second);
+      }
+      break;
+    }
+    case CoreMessage::Kind::Forwarded:
+      if (message.remote == Cluster::Kind::Signal) {
+        RouteSignalLocal(message.user, message.source, message.payload);
+      }
+      else if (message.remote == Cluster::Kind::Room) {
+        PublishRemote(message.user, message.source, message.payload);
+      }
+      else if (message.remote == Cluster::Kind::Identity) {
+        if (!m_server.m_identities.Merge(message.payload)) {
+          Bump(m_dropped);
+        }
+      }
+      else {
+        RouteLocal(std::move(message.user), std::move(message.source), std::move(message.payload));
+      }
+      break;
+    }
+  }
+
+  // Socket aceptado o recibido de otro proceso -> conexion de este nucleo
+  Connection*
+  Open(SOCKET socket) {
+    u_long nonBlocking = 1;
+    int noDelay = 1;
+    if (ioctlsocket(socket, FIONBIO, &nonBlocking) == SOCKET_ERROR) {
+      closesocket(socket);
+      return nullptr;
+    }
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay),
+               sizeof(noDelay));
+
+    uint64_t id = (uint64_t(m_index) << kConnectionIdShift) | ++m_nextId;
+    Connection& connection = m_connections[id];
+    connection.id = id;
+    connection.socket = socket;
+    connection.in = m_buffers.Acquire();
+    connection.out.Adopt(m_buffers.Acquire());
+    connection.limit.Configure(m_server.m_limiter.GetLimits().connection);
+    std::string address;
+    if (PeerAddress(socket, address)) {
+      connection.address = m_server.m_limiter.Address(address);
+    }
+    Bump(m_open);
+    return &connection;
+  }
+
+  void
+  Adopt(SOCKET socket) {
+    Connection* connection = Open(socket);
+    if (!connection) {
+      return;
+    }
+    // [reto 32][DER]: el reto es de esta conexion, asi un Hello firmado no se reutiliza
+    const std::vector<unsigned char>& key = m_server.m_publicKey;
+    SecureRandom::Fill(connection->challenge.data(), connection->challenge.size());
+    std::vector<unsigned char> body(connection->challenge.begin(), connection->challenge.end());
+    body.insert(body.end(), key.begin(), key.end());
+    Queue(*connection, FrameType::ServerKey, body.data(), body.size());
+  }
+
+  void
+  Read(Connection& connection) {
+    for (int round = 0; round < kReadsPerWakeup; ++round) {
+      int received = recv(connection.socket, reinterpret_cast<char*>(m_recvBuffer.data()),
+                          static_cast<int>(m_recvBuffer.size()), 0);
+      if (received == 0 || (received == SOCKET_ERROR && !WouldBlock())) {
+        Close(connection);
+        return;
+      }
+      if (received == SOCKET_ERROR) {
+        break;
+      }
+      Bump(m_bytesIn, received);
+      connection.in.insert(connection.in.end(), m_recvBuffer.data(),
+                           m_recvBuffer.data() + received);
+      if (static_cast<size_t>(received) < m_recvBuffer.size()) {
+        break;
+      }
+    }
+
+    // Las tramas se procesan en el buffer de entrada, sin copiarlas. Los
+    // limites se cobran antes de descifrar nada; un reloj para toda la lectura
+    TokenBucket::Tick now = TokenBucket::Now();
+    size_t offset = 0;
+    while (!connection.closing) {
+      unsigned char type = 0;
+      const unsigned char* body = nullptr;
+      size_t bodyLen = 0;
+      size_t consumed = 0;
+      FrameCodec::Result result = FrameCodec::Next(connection.in.data() + offset,
+                                                   connection.in.size() - offset,
+                                                   type, body, bodyLen, consumed);
+      if (result == FrameCodec::Result::Invalid) {
+        Close(connection);
+        return;
+      }
+      if (result == FrameCodec::Result::Incomplete) {
+        break;
+      }
+      Bump(m_framesIn);
+      offset += consumed;
+      uint32_t cost = RateLimiter::Cost(bodyLen);
+      if (!connection.limit.TryTakeOwned(now, cost) ||
+          (connection.address && !connection.address->TryTake(now, cost))) {
+        Bump(m_limited);
+        continue;
+      }
+      AdmissionControl::Class traffic = Classify(type, bodyLen);
+      if (!m_admission.Admit(traffic)) {
+        Shed(connection, traffic);
+        continue;
+      }
+      HandleFrame(connection, type, body, bodyLen);
+    }
+    connection.in.erase(connection.in.begin(), connection.in.begin() + offset);
+  }
+
+  static AdmissionControl::Class
+  Classify(unsigned char type, size_t len) {
+    switch (type) {
+    case FrameType::Signal:
+      return AdmissionControl::Class::Signal;
+    case FrameType::Hello:
+      return AdmissionControl::Class::Handshake;
+    case FrameType::Send:
+    case FrameType::Publish:
+    case FrameType::BlobPut:
+      return len > kBulkFrame ? AdmissionControl::Class::Bulk : AdmissionControl::Class::Chat;
+    default:
+      return AdmissionControl::Class::Chat;
+    }
+  }
+
+  // Un Send grande descartado no recibe ack: el hueco en el SACK le dice al
+  // cliente que lo reenvie
+  void
+  Shed(Connection& connection, AdmissionControl::Class traffic) {
+    switch (traffic) {
+    case AdmissionControl::Class::Signal:
+      Bump(m_shedSignals);
+      break;
+    case AdmissionControl::Class::Handshake:
+      Bump(m_shedHandshakes);
+      Close(connection);  // Que reintente mas tarde, no que espere aqui
+      break;
+    case AdmissionControl::Class::Bulk:
+      Bump(m_shedBulk);
+      break;
+    case AdmissionControl::Class::Chat:
+      break;
+    }
+  }
+
+  // Espejo para GetStats() del estado del controlador, que es del nucleo
+  void
+  UpdateAdmission() {
+    m_admission.Tick(SteadyClock::now());
+    m_shedLevel.store(static_cast<uint64_t>(m_admission.Level()), std::memory_order_relaxed);
+    m_escalations.store(m_admission.Escalations(), std::memory_order_relaxed);
+    m_sojournMicros.store(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(m_admission.Sojourn()).count()),
+      std::memory_order_relaxed);
+  }
+
+  void
+  HandleFrame(Connection& connection, unsigned char type, const unsigned char* body, size_t len) {
+    switch (type) {
+    case FrameType::Hello:
+      OnHello(connection, body, len);
+      break;
+    case FrameType::Send:
+    case FrameType::Join:
+    case FrameType::Leave:
+    case FrameType::Publish:
+    case FrameType::Signal:
+    case FrameType::BlobPut:
+    case FrameType::BlobRef:
+    case FrameType::BlobRelease:
+    case FrameType::BlobRead:
+      OnSessionFrame(connection, type, body, len);
+      break;
+    case FrameType::Ack:
+      Bump(m_acks);
+      Bump(m_ackBytes, FrameCodec::kHeaderSize + len);
+      OnSessionFrame(connection, type, body, len);
+      break;
+    default:
+      Close(connection);  // Tipo que un cliente no puede enviar
+      break;
+    }
+  }
+
+  void
+  OnHello(Connection& connection, const unsigned char* body, size_t len) {
+    std::string user;
+    const unsigned char* rest = nullptr;
+    size_t restLen = 0;
+    const size_t signatureSize = IdentityRegistry::kSignatureSize;
+    IdentityRegistry::Key identityKey;
+    if (connection.handshaking || connection.session || len < signatureSize ||
+        !FrameCodec::SplitId(body, len - signatureSize, user, rest, restLen) || user.empty() ||
+        restLen < identityKey.size() + 1 ||
+        restLen < identityKey.size() + 1 + size_t(rest[identityKey.size()]) + 2) {
+      Close(connection);
+      return;
+    }
+    // La firma va al final y cubre el reto de esta conexion y todo lo anterior
+    std::vector<unsigned char> signedData(connection.challenge.begin(), connection.challenge.end());
+    signedData.insert(signedData.end(), body, body + len - signatureSize);
+    std::vector<unsigned char> signature(body + len - signatureSize, body + len);
+    std::memcpy(identityKey.data(), rest, identityKey.size());
+    rest += identityKey.size();
+    restLen -= identityKey.size();
+    std::vector<unsigned char> offered(rest + 1, rest + 1 + rest[0]);
+    rest += 1 + offered.size();
+    restLen -= 1 + offered.size();
+    size_t wrappedLen = (size_t(rest[0]) << 8) | rest[1];
+    if (restLen < 2 + wrappedLen) {
+      Close(connection);
+      return;
+    }
+    std::vector<unsigned char> wrappedKey(rest + 2, rest + 2 + wrappedLen);
+    std::vector<unsigned char> share(rest + 2 + wrappedLen, rest + restLen);
+    HandshakeMode mode = HybridKeyExchange::Negotiate(offered);
+    if (mode == HandshakeMode::HybridPQ && share.size() != HybridKeyExchange::kShareSize) {
+      Close(connection);
+      return;
+    }
+
+    // RSA, la firma y el encapsulado hibrido tardan: van al pool y vuelven por Completions()
+    connection.handshaking = true;
+    auto result = std::make_shared<HandshakeResult>();
+    result->submitted = SteadyClock::now();
+    result->mode = mode;
+    const CryptoHelper* identity = &m_server.m_identity;
+    IdentityRegistry* registry = &m_server.m_identities;
+    // Solo el nodo dueno fija claves; otro nodo solo contesta con Redirect
+    bool owner = RemoteOwner(user) == nullptr;
+    uint64_t id = connection.id;
+    bool queued = m_server.m_handshakes->Submit(
+      CryptoJobKind::Handshake,
+      [identity, registry, owner, user, identityKey, signedData, signature, wrappedKey, share,
+       offered, result]() {
+        unsigned char transportKey[32];
+        unsigned char hybridSecret[32];
+        result->ok = IdentityRegistry::Verify(identityKey, signedData.data(), signedData.size(),
+                                              signature.data());
+        if (result->ok && owner) {
+          result->bound = registry->Bind(user, identityKey);
+          result->ok = result->bound;
+        }
+        result->ok = result->ok && identity->UnwrapAESKey(wrappedKey, transportKey);
+        if (result->ok && result->mode == HandshakeMode::HybridPQ) {
+          HybridKeyExchange exchange;
+          result->ok = exchange.Encapsulate(share, result->response, hybridSecret);
+        }
+        result->ok = result->ok &&
+                     HybridKeyExchange::DeriveSessionKey(result->mode, transportKey, hybridSecret,
+                                                         offered, result->key);
+        OPENSSL_cleanse(transportKey, sizeof(transportKey));
+        OPENSSL_cleanse(hybridSecret, sizeof(hybridSecret));
+      },
+      [this, id, user, result]() { OnHandshakeDone(id, user, *result); },
+      m_completions);
+    if (!queued) {
+      Close(connection);  // Rafaga de handshakes: se rechaza en lugar de encolar sin limite
+    }
+  }
+
+  void
+  OnHandshakeDone(uint64_t id, const std::string& user, HandshakeResult& result) {
+    SteadyClock::time_point now = SteadyClock::now();
+    m_admission.Observe(now - result.submitted, now);
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing || !result.ok) {
+      OPENSSL_cleanse(result.key, sizeof(result.key));
+      if (it != m_connections.end()) {
+        Close(it->second);
+      }
+      return;
+    }
+
+    // Sin clave fijada aqui no se toca nada del usuario (el anillo pudo
+    // cambiar mientras tanto): que vuelva a conectar
+    const std::string* node = RemoteOwner(user);
+    if (!node && !result.bound) {
+      OPENSSL_cleanse(result.key, sizeof(result.key));
+      Close(it->second);
+      return;
+    }
+
+    Connection& connection = it->second;
+    connection.handshaking = false;
+    connection.session = std::make_shared<CryptoHelper>();
+    connection.session->SetSessionKey(result.key, false);
+    OPENSSL_cleanse(result.key, sizeof(result.key));
+    connection.user = user;
+    // El Welcome va siempre: sin el modo el cliente no tiene la clave para abrir un Redirect
+    std::vector<unsigned char> welcome(1, static_cast<unsigned char>(result.mode));
+    welcome.insert(welcome.end(), result.response.begin(), result.response.end());
+    Queue(connection, FrameType::Welcome, welcome.data(), welcome.size());
+    // Usuario de otro nodo: ni sesion fiable ni ruta aqui
+    if (node) {
+      Redirect(connection, *node);
+      return;
+    }
+    connection.reliable = m_server.m_sessions.Attach(user);
+    // Lo recibido de esta sesion: el cliente reenvia solo los Send que faltan
+    SendAck(connection);
+    {
+      std::lock_guard<std::mutex> guard(connection.reliable->lock);
+      if (connection.reliable->outbound.Count() > 0) {
+        connection.resumeBefore = connection.reliable->outbound.Next();
+      }
+    }
+    m_server.m_routes.Insert(user, id);
+    PumpStored(connection);
+  }
+
+  // Tramas cifradas con la sesion: todas empiezan por [len id][id] (destino o sala)
+  void
+  OnSessionFrame(Connection& connection, unsigned char type, const unsigned char* body,
+                 size_t len) {
+    if (!connection.session || connection.redirected) {
+      Bump(m_dropped);
+      return;
+    }
+
+    CryptoStep step;
+    step.kind = CryptoStep::Kind::Open;
+    step.frameType = type;
+    if (connection.cryptoBusy || len > kInlineCryptoLimit) {
+      step.ciphertext.assign(body, body + len);
+      EnqueueCrypto(connection, std::move(step));
+      return;
+    }
+    // Mensaje corto y nada por delante: descifrar aqui cuesta menos que el salto
+    CryptoStep::Open(*connection.session, body, len, step);
+    FinishCrypto(connection, step);
+  }
+
+  void
+  EnqueueCrypto(Connection& connection, CryptoStep&& step) {
+    connection.cryptoBacklog.push_back(std::move(step));
+    if (!connection.cryptoBusy) {
+      PumpCrypto(connection);
+    }
+  }
+
+  // Lanza el siguiente paso de la conexion; el resultado vuelve por Completions()
+  void
+  PumpCrypto(Connection& connection) {
+    // Ocupada tambien mientras se procesa aqui: un Deliver anidado va a la cola
+    connection.cryptoBusy = true;
+    while (!connection.cryptoBacklog.empty() && !connection.closing) {
+      if (SubmitSeals(connection)) {
+        return;
+      }
+      auto step = std::make_shared<CryptoStep>(std::move(connection.cryptoBacklog.front()));
+      connection.cryptoBacklog.pop_front();
+      if (step->kind == CryptoStep::Kind::Shared) {
+        FinishCrypto(connection, *step);  // Ya cifrada: solo esperaba su turno
+        continue;
+      }
+
+      std::shared_ptr<CryptoHelper> session = connection.session;
+      uint64_t id = connection.id;
+      step->submitted = SteadyClock::now();
+      bool queued = m_server.m_scheduler->Submit([this, id, session, step]() {
+        CryptoStep::Run(*session, *step);
+        m_completions.Post([this, id, step]() { OnCryptoDone(id, *step); });
+      });
+      if (queued) {
+        return;
+      }
+      // Scheduler saturado: se hace en el loop antes que perder el mensaje
+      CryptoStep::Run(*session, *step);
+      FinishCrypto(connection, *step);
+    }
+    connection.cryptoBusy = false;
+  }
+
+  // Varios sellos seguidos en cabeza (el backlog Stored al reconectar,
+  // Deliver acumulados detras de un paso lento): una tarea que deja tramos
+  // de kSealChunk en la deque de su worker, de donde los roban los workers
+  // libres. Las secuencias se apartan aqui, asi que el orden en el cable es
+  // el de la cola aunque los tramos terminen en cualquier orden
+  bool
+  SubmitSeals(Connection& connection) {
+    std::deque<CryptoStep>& backlog = connection.cryptoBacklog;
+    size_t count = 0;
+    while (count < backlog.size() && count < kSealBatchMax && backlog[count].IsSeal() &&
+           !backlog[count].reserved) {
+      ++count;
+    }
+    uint64_t first = 0;
+    if (count < kSealBatch || !connection.session->ReserveSequences(count, first)) {
+      return false;
+    }
+
+    auto batch = std::make_shared<SealBatch>();
+    batch->steps.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      batch->steps.push_back(std::move(backlog.front()));
+      backlog.pop_front();
+      batch->steps.back().reserved = true;
+      batch->steps.back().sendSequence = first + i;
+    }
+    batch->left.store((count + kSealChunk - 1) / kSealChunk, std::memory_order_relaxed);
+    batch->submitted = SteadyClock::now();
+
+    std::shared_ptr<CryptoHelper> session = connection.session;
+    uint64_t id = connection.id;
+    WorkStealingScheduler* scheduler = m_server.m_scheduler.get();
+    bool queued = scheduler->Submit([this, scheduler, id, session, batch]() {
+      for (size_t begin = kSealChunk; begin < batch->steps.size(); begin += kSealChunk) {
+        scheduler->Submit([this, id, session, batch, begin]() {
+          SealChunk(id, *session, batch, begin);
+        });
+      }
+      SealChunk(id, *session, batch, 0);
+    });
+    if (!queued) {
+      // Scheduler saturado: vuelven a la cola y salen uno a uno con su secuencia
+      for (auto step = batch->steps.rbegin(); step != batch->steps.rend(); ++step) {
+        backlog.push_front(std::move(*step));
+      }
+      return false;
+    }
+    Bump(m_sealBatches);
+    return true;
+  }
+
+  // En un worker; el ultimo tramo devuelve el lote al nucleo
+  void
+  SealChunk(uint64_t id, CryptoHelper& session, const std::shared_ptr<SealBatch>& batch,
+            size_t begin) {
+    size_t end = std::min(begin + kSealChunk, batch->steps.size());
+    for (size_t i = begin; i < end; ++i) {
+      CryptoStep::Seal(session, batch->steps[i]);
+    }
+    if (batch->left.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      m_completions.Post([this, id, batch]() { OnSealsDone(id, *batch); });
+    }
+  }
+
+  void
+  OnSealsDone(uint64_t id, SealBatch& batch) {
+    SteadyClock::time_point now = SteadyClock::now();
+    m_admission.Observe(now - batch.submitted, now);
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) {
+      Bump(m_dropped, batch.steps.size());
+      return;
+    }
+    for (CryptoStep& step : batch.steps) {
+      FinishCrypto(it->second, step);
+    }
+    PumpCrypto(it->second);
+  }
+
+  void
+  OnCryptoDone(uint64_t id, CryptoStep& step) {
+    SteadyClock::time_point now = SteadyClock::now();
+    m_admission.Observe(now - step.submitted, now);
+    auto it = m_connections.find(id);
+    if (it == m_connections.end()) {
+      Bump(m_dropped);
+      return;
+    }
+    FinishCrypto(it->second, step);
+    PumpCrypto(it->second);
+  }
+
+  void
+  FinishCrypto(Connection& connection, CryptoStep& step) {
+    if (!step.ok || connection.closing) {
+      Bump(m_dropped);
+      return;
+    }
+    switch (step.kind) {
+    case CryptoStep::Kind::Open:
+      OnOpened(connection, step);
+      break;
+    case CryptoStep::Kind::SealRaw:
+    case CryptoStep::Kind::SealView:
+      Queue(connection, step.frameType, step.sealed.data(), step.sealed.size());
+      if (step.frameType == FrameType::Stored) {
+        Bump(m_storedOut);
+      }
+      else if (step.frameType == FrameType::Ack) {
+        Bump(m_acks);
+        Bump(m_ackBytes, FrameCodec::kHeaderSize + step.sealed.size());
+      }
+      break;
+    case CryptoStep::Kind::Shared:
+      QueueShared(connection, step.frame);
+      Bump(m_routed);
+      break;
+    }
+  }
+
+  void
+  OnOpened(Connection& connection, CryptoStep& step) {
+    switch (step.frameType) {
+    case FrameType::Send:
+      OnSend(connection, step);
+      break;
+    case FrameType::Join:
+      OnJoin(connection, step.destination);
+      break;
+    case FrameType::Leave:
+      if (connection.rooms.erase(step.destination) == 0 ||
+          !m_server.m_rooms.Leave(step.destination, connection.id)) {
+        Bump(m_dropped);
+      }
+      break;
+    case FrameType::Publish:
+      OnPublish(connection, step.destination, step.payload);
+      break;
+    case FrameType::Signal:
+      RouteSignal(step.destination, connection.user, step.payload);
+      break;
+    case FrameType::Ack:
+      OnAck(connection, step.payload);
+      break;
+    case FrameType::BlobPut:
+    case FrameType::BlobRef:
+    case FrameType::BlobRelease:
+    case FrameType::BlobRead:
+      OnBlob(connection, step.frameType, std::move(step.payload));
+      break;
+    }
+    if (!step.payload.empty()) {
+      OPENSSL_cleanse(&step.payload[0], step.payload.size());
+    }
+  }
+
+  // Un Send repetido (reenvio tras reconectar que ya habia llegado) solo
+  // refresca el ack. Un Send que acaba en el almacen offline no se confirma
+  // hasta que esta en disco: lo confirma OnDurable
+  void
+  OnSend(Connection& connection, CryptoStep& step) {
+    std::shared_ptr<ReliableSession> session = connection.reliable;
+    uint64_t seq = step.seq;
+    bool fresh = false;
+    {
+      std::lock_guard<std::mutex> guard(session->lock);
+      if (session->storing.count(seq)) {
+        Bump(m_duplicates);  // Su ack sale con el volcado
+        return;
+      }
+      // Reservado: otra conexion del usuario no lo enruta dos veces
+      fresh = session->inbound.Accepts(seq);
+      if (fresh) {
+        session->storing.insert(seq);
+      }
+    }
+    bool held = false;
+    if (fresh) {
+      uint64_t id = connection.id;
+      CompletionQueue* completions = &m_completions;
+      held = Route(std::move(step.destination), std::string(connection.user),
+                   std::move(step.payload),
+                   [this, completions, id, session, seq](bool ok) {
+                     completions->Post([this, id, session, seq, ok]() {
+                       OnDurable(id, *session, seq, ok);
+                     });
+                   });
+    }
+    else {
+      Bump(m_duplicates);
+    }
+    if (held) {
+      return;
+    }
+
+    auto now = AckTracker::Clock::now();
+    bool due = false;
+    {
+      std::lock_guard<std::mutex> guard(session->lock);
+      session->storing.erase(seq);
+      session->inbound.Receive(seq, now);
+      due = session->inbound.AckDue(now);
+    }
+    NoteAck(connection, due);
+  }
+
+  // Un Send guardado offline ya esta en disco (o el volcado fallo: sin ack,
+  // el hueco en el SACK hace que el cliente lo reenvie)
+  void
+  OnDurable(uint64_t id, ReliableSession& session, uint64_t seq, bool ok) {
+    auto now = AckTracker::Clock::now();
+    bool due = false;
+    {
+      std::lock_guard<std::mutex> guard(session.lock);
+      session.storing.erase(seq);
+      if (!ok) {
+        return;
+      }
+      session.inbound.Receive(seq, now);
+      due = session.inbound.AckDue(now);
+    }
+    // Sin la conexion el ack sale al reconectar, justo despues del Welcome
+    auto it = m_connections.find(id);
+    if (it != m_connections.end() && !it->second.closing && it->second.reliable.get() == &session) {
+      NoteAck(it->second, due);
+    }
+  }
+
+  // BlobPut, BlobRef, BlobRelease y BlobRead van a la cola Bulk del pool de
+  // cripto: el disco y el fsync del journal no paran el loop. La respuesta
+  // lleva el id, asi que puede adelantar a otras de la misma conexion
+  void
+  OnBlob(Connection& connection, unsigned char type, std::string&& body) {
+    auto result = std::make_shared<BlobResult>();
+    result->submitted = SteadyClock::now();
+    std::shared_ptr<BlobStore> store = m_server.m_blobs;
+    auto request = std::make_shared<std::string>(std::move(body));
+    uint64_t id = connection.id;
+    bool queued = store && m_server.m_handshakes->Submit(
+      CryptoJobKind::Bulk,
+      [store, type, request, result]() { RunBlob(store.get(), type, *request, *result); },
+      [this, id, result]() { OnBlobDone(id, *result); },
+      m_completions);
+    if (!queued) {
+      // Sin almacen o con el pool lleno: Failed enseguida, el cliente reintenta
+      RunBlob(nullptr, type, *request, *result);
+      OnBlobDone(id, *result);
+    }
+  }
+
+  void
+  OnBlobDone(uint64_t id, BlobResult& result) {
+    SteadyClock::time_point now = SteadyClock::now();
+    m_admission.Observe(now - result.submitted, now);
+    Bump(m_blobRequests);
+    Bump(m_blobDedupHits, result.state == BlobState::Deduplicated ? 1 : 0);
+    Bump(m_blobBytesIn, result.uploaded);
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing) {
+      Bump(m_dropped);
+      return;
+    }
+    if (result.reply.size() <= kInlineCryptoLimit) {
+      SealControl(it->second, result.type, std::move(result.reply));
+      return;
+    }
+    // Un BlobData grande se cifra en el scheduler, como un Deliver grande
+    CryptoStep step;
+    step.kind = CryptoStep::Kind::SealRaw;
+    step.frameType = result.type;
+    step.payload = std::move(result.reply);
+    EnqueueCrypto(it->second, std::move(step));
+  }
+
+  // Ack: [flujo u8][acumulado u64][n u8][n x (first u64, last u64)]
+  void
+  OnAck(Connection& connection, const std::string& body) {
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(body.data());
+    uint64_t cumulative = 0;
+    if (body.empty() ||
+        !AckTracker::Decode(data + 1, body.size() - 1, cumulative, m_ackBlocks)) {
+      Bump(m_dropped);
+      return;
+    }
+    if (data[0] == kAckStored) {
+      OnStoredAck(connection, cumulative);
+      return;
+    }
+    if (data[0] != kAckSession) {
+      Bump(m_dropped);
+      return;
+    }
+
+    m_resend.clear();
+    {
+      std::lock_guard<std::mutex> guard(connection.reliable->lock);
+      RetransmitBuffer& outbound = connection.reliable->outbound;
+      outbound.OnAck(cumulative, m_ackBlocks);
+      if (connection.resumeBefore) {
+        outbound.Unacked(m_resend);
+      }
+    }
+    if (!connection.resumeBefore) {
+      return;
+    }
+    // Primer ack tras reanudar: se reenvia solo lo que no llego a la
+    // conexion anterior; lo enviado por esta ya esta en camino
+    uint64_t before = connection.resumeBefore;
+    connection.resumeBefore = 0;
+    for (const RetransmitBuffer::Pending& pending : m_resend) {
+      if (pending.seq >= before) {
+        break;
+      }
+      SealView(connection, FrameType::Deliver, pending.payload, pending.payload->data(),
+               pending.payload->size());
+      Bump(m_retransmitted);
+    }
+    m_resend.clear();
+  }
+
+  // Los acks se agrupan: uno cada kAckEvery Send o al vencer el plazo
+  void
+  NoteAck(Connection& connection, bool due) {
+    if (due) {
+      SendAck(connection);
+      return;
+    }
+    if (!connection.ackQueued) {
+      connection.ackQueued = true;
+      m_ackQueue.push_back(connection.id);
+    }
+  }
+
+  void
+  SendAck(Connection& connection) {
+    std::string plaintext(1, static_cast<char>(kAckSession));
+    {
+      std::lock_guard<std::mutex> guard(connection.reliable->lock);
+      connection.reliable->inbound.Encode(plaintext);
+    }
+    SealControl(connection, FrameType::Ack, std::move(plaintext));
+  }
+
+  void
+  FlushAcks() {
+    auto now = AckTracker::Clock::now();
+    size_t kept = 0;
+    for (uint64_t id : m_ackQueue) {
+      auto it = m_connections.find(id);
+      if (it == m_connections.end() || it->second.closing) {
+        continue;
+      }
+      Connection& connection = it->second;
+      bool pending = false;
+      bool due = false;
+      {
+        std::lock_guard<std::mutex> guard(connection.reliable->lock);
+        pending = connection.reliable->inbound.AckPending();
+        due = connection.reliable->inbound.AckDue(now);
+      }
+      if (pending && !due) {
+        m_ackQueue[kept++] = id;
+        continue;
+      }
+      connection.ackQueued = false;
+      if (pending) {
+        SendAck(connection);
+      }
+    }
+    m_ackQueue.resize(kept);
+  }
+
+  // Sesiones que no se reanudaron a tiempo: lo que quedaba sin ack pasa al
+  // almacen offline y sale como Stored en la proxima conexion
+  void
+  SweepSessions() {
+    m_server.m_sessions.Sweep([this](const std::string& user, ReliableSession& session) {
+      std::vector<RetransmitBuffer::Pending> pending;
+      session.outbound.Unacked(pending);
+      for (const RetransmitBuffer::Pending& entry : pending) {
+        const std::vector<unsigned char>& record = *entry.payload;
+        std::string source;
+        const unsigned char* payload = nullptr;
+        size_t payloadLen = 0;
+        if (record.size() < 8 ||
+            !FrameCodec::SplitId(record.data() + 8, record.size() - 8, source, payload, payloadLen)) {
+          Bump(m_dropped);
+          continue;
+        }
+        StoreOffline(user, source, std::string(reinterpret_cast<const char*>(payload), payloadLen));
+      }
+    });
+  }
+
+  void
+  OnJoin(Connection& connection, const std::string& room) {
+    RoomRegistry::RoomKey key;
+    if ((connection.rooms.size() >= kMaxRoomsPerConnection && !connection.rooms.count(room)) ||
+        !m_server.m_rooms.Join(room, connection.id, key)) {
+      Bump(m_dropped);
+      return;
+    }
+    SendRoomKey(connection, room, key);
+  }
+
+  void
+  OnPublish(Connection& connection, const std::string& room, const std::string& payload) {
+    auto broadcast = std::make_shared<RoomRegistry::Broadcast>();
+    if (!connection.rooms.count(room) ||
+        !m_server.m_rooms.Publish(room, connection.id, connection.user,
+                                  reinterpret_cast<const unsigned char*>(payload.data()),
+                                  payload.size(), *broadcast)) {
+      Bump(m_dropped);
+      return;
+    }
+    Bump(m_broadcasts);
+    FanOut(room, std::move(broadcast));
+    if (!m_topology) {
+      return;
+    }
+    for (const auto& link : m_topology->links) {
+      ForwardRemote(link.first, Cluster::Kind::Room, room, connection.user, payload);
+    }
+  }
+
+  // Publicacion de otro nodo: sin miembros aqui no hay nada que hacer
+  void
+  PublishRemote(const std::string& room, const std::string& source, const std::string& payload) {
+    auto broadcast = std::make_shared<RoomRegistry::Broadcast>();
+    if (!m_server.m_rooms.Publish(room, RoomRegistry::kRemotePublisher, source,
+                                  reinterpret_cast<const unsigned char*>(payload.data()),
+                                  payload.size(), *broadcast)) {
+      return;
+    }
+    Bump(m_broadcasts);
+    FanOut(room, std::move(broadcast));
+  }
+
+  // Los miembros van ordenados por id, y el id empieza por el nucleo dueno:
+  // cada tramo contiguo del mismo nucleo es un solo mensaje a ese nucleo
+  void
+  FanOut(const std::string& room, std::shared_ptr<const RoomRegistry::Broadcast> broadcast) {
+    const RoomRegistry::Members& members = *broadcast->members;
+    size_t begin = 0;
+    while (begin < members.size()) {
+      size_t owner = static_cast<size_t>(members[begin] >> kConnectionIdShift);
+      size_t end = begin + 1;
+      while (end < members.size() && end - begin < kRoomBatch &&
+             static_cast<size_t>(members[end] >> kConnectionIdShift) == owner) {
+        ++end;
+      }
+      if (owner == m_index) {
+        DeliverRoom(room, *broadcast, begin, end);
+      }
+      else if (owner < m_server.m_cores.size()) {
+        CoreMessage message;
+        message.kind = CoreMessage::Kind::RoomDeliver;
+        message.user = room;
+        message.broadcast = broadcast;
+        message.begin = begin;
+        message.end = end;
+        if (!m_server.m_cores[owner]->TryPost(std::move(message))) {
+          // Las salas no tienen almacen: ese tramo de miembros la pierde
+          Bump(m_inboxFull);
+          Bump(m_dropped, end - begin);
+        }
+      }
+      begin = end;
+    }
+  }
+
+  // Una referencia a la misma trama por miembro: ni copia ni cifrado por miembro
+  void
+  DeliverRoom(const std::string& room, const RoomRegistry::Broadcast& broadcast,
+              size_t begin, size_t end) {
+    const RoomRegistry::Members& members = *broadcast.members;
+    for (size_t i = begin; i < end; ++i) {
+      auto it = m_connections.find(members[i]);
+      if (it == m_connections.end() || it->second.closing) {
+        Bump(m_dropped);
+        continue;
+      }
+      Connection& connection = it->second;
+      auto joined = connection.rooms.find(room);
+      if (joined == connection.rooms.end()) {
+        Bump(m_dropped);  // Salio despues de la instantanea
+        continue;
+      }
+      // Sin la clave de este epoch la trama no se puede abrir: va delante
+      if (joined->second < broadcast.key.epoch) {
+        SendRoomKey(connection, room, broadcast.key);
+      }
+      if (connection.cryptoBusy) {
+        CryptoStep step;
+        step.kind = CryptoStep::Kind::Shared;
+        step.ok = true;
+        step.frame = broadcast.frame;
+        EnqueueCrypto(connection, std::move(step));
+        continue;
+      }
+      QueueShared(connection, broadcast.frame);
+      Bump(m_routed);
+    }
+  }
+
+  // RoomKey: [len sala][sala][epoch u32][clave], cifrada con la sesion
+  void
+  SendRoomKey(Connection& connection, const std::string& room, const RoomRegistry::RoomKey& key) {
+    connection.rooms[room] = key.epoch;
+    std::string plaintext;
+    plaintext.reserve(1 + room.size() + 4 + sizeof(key.key));
+    plaintext.push_back(static_cast<char>(room.size()));
+    plaintext += room;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      plaintext.push_back(static_cast<char>(key.epoch >> shift));
+    }
+    plaintext.append(reinterpret_cast<const char*>(key.key), sizeof(key.key));
+    SealControl(connection, FrameType::RoomKey, std::move(plaintext));
+  }
+
+  // Tramas de control cortas; la clave en claro se borra al cifrar
+  void
+  SealControl(Connection& connection, unsigned char type, std::string&& plaintext) {
+    CryptoStep step;
+    step.kind = CryptoStep::Kind::SealRaw;
+    step.frameType = type;
+    step.payload = std::move(plaintext);
+    if (connection.cryptoBusy) {
+      EnqueueCrypto(connection, std::move(step));
+      return;
+    }
+    CryptoStep::Seal(*connection.session, step);
+    FinishCrypto(connection, step);
+  }
+
+  // Cifra [data, data + len) sin copiarlo; owner lo mantiene vivo mientras
+  // el paso espera en el scheduler
+  void
+  SealView(Connection& connection, unsigned char type, std::shared_ptr<const void> owner,
+           const unsigned char* data, size_t len) {
+    CryptoStep step = CryptoStep::View(type, std::move(owner), data, len);
+    if (connection.cryptoBusy || len > kInlineCryptoLimit) {
+      EnqueueCrypto(connection, std::move(step));
+      return;
+    }
+    CryptoStep::Seal(*connection.session, step);
+    FinishCrypto(connection, step);
+  }
+
+  // @return true si acabo en el almacen offline con durable, que avisara
+  // desde el hilo de commit
+  bool
+  Route(std::string&& destination, std::string&& source, std::string&& payload,
+        const OfflineStore::Durable& durable = nullptr) {
+    const std::string* node = RemoteOwner(destination);
+    if (node) {
+      return ForwardRemote(*node, Cluster::Kind::Message, destination, source, payload, durable);
+    }
+    return RouteLocal(std::move(destination), std::move(source), std::move(payload), durable);
+  }
+
+  // Una lectura sin locks de la tabla y, si el destino es de otro nucleo, un mensaje
+  bool
+  RouteLocal(std::string&& destination, std::string&& source, std::string&& payload,
+             const OfflineStore::Durable& durable = nullptr) {
+    uint64_t id = 0;
+    if (!m_server.m_routes.Lookup(destination, id)) {
+      return StoreOffline(destination, source, payload, durable) && durable;
+    }
+    size_t owner = static_cast<size_t>(id >> kConnectionIdShift);
+    if (owner == m_index) {
+      Deliver(id, destination, std::move(source), std::move(payload));
+      return false;
+    }
+    CoreMessage message;
+    message.kind = CoreMessage::Kind::Deliver;
+    message.connection = id;
+    message.user = std::move(destination);
+    message.source = std::move(source);
+    message.payload = std::move(payload);
+    if (m_server.m_cores[owner]->TryPost(std::move(message))) {
+      return false;
+    }
+    // Nucleo destino saturado: al almacen, como sin conexion, en vez de esperarle
+    Bump(m_inboxFull);
+    return StoreOffline(message.user, message.source, message.payload, durable) && durable;
+  }
+
+  // Senales efimeras (escribiendo, presencia): sin secuencia, sin ack y sin
+  // almacen offline; si el destino no esta conectado se pierden
+  void
+  RouteSignal(const std::string& destination, const std::string& source,
+              const std::string& payload) {
+    const std::string* node = RemoteOwner(destination);
+    if (node) {
+      ForwardRemote(*node, Cluster::Kind::Signal, destination, source, payload);
+      return;
+    }
+    RouteSignalLocal(destination, source, payload);
+  }
+
+  void
+  RouteSignalLocal(const std::string& destination, const std::string& source,
+                   const std::string& payload) {
+    uint64_t id = 0;
+    if (!m_server.m_routes.Lookup(destination, id)) {
+      Bump(m_dropped);
+      return;
+    }
+    size_t owner = static_cast<size_t>(id >> kConnectionIdShift);
+    if (owner == m_index) {
+      DeliverSignal(id, destination, source, payload);
+      return;
+    }
+    CoreMessage message;
+    message.kind = CoreMessage::Kind::Signal;
+    message.connection = id;
+    message.user = destination;
+    message.source = source;
+    message.payload = payload;
+    if (!m_server.m_cores[owner]->TryPost(std::move(message))) {
+      Bump(m_inboxFull);
+      Bump(m_shedSignals);
+    }
+  }
+
+  void
+  DeliverSignal(uint64_t id, const std::string& destination, const std::string& source,
+                const std::string& payload) {
+    // El nucleo del destino tambien puede estar saturado
+    if (!m_admission.Admit(AdmissionControl::Class::Signal)) {
+      Bump(m_shedSignals);
+      return;
+    }
+    auto it = m_connections.find(id);
+    if (it == m_connections.end() || it->second.closing || !it->second.session ||
+        it->second.user != destination || source.size() > 255) {
+      Bump(m_dropped);
+      return;
+    }
+    std::string plaintext(1, static_cast<char>(source.size()));
+    plaintext += source;
+    plaintext += payload;
+    SealControl(it->second, FrameType::Signal, std::move(plaintext));
+  }
+
+  // Copia local de los miembros del cluster, renovada cuando cambia la
+  // version; los usuarios conectados que pasan a otro nodo reciben Redirect
+  void
+  RefreshTopology() {
+    Cluster* cluster = m_server.m_clusterActive.load(std::memory_order_acquire);
+    if (!cluster || (m_topology && cluster->Version() == m_topology->version)) {
+      return;
+    }
+    m_cluster = cluster;
+    m_topology = cluster->Current();
+    if (m_index == 0) {
+      MigrateIdentities();
+    }
+    for (auto& entry : m_connections) {
+      Connection& connection = entry.second;
+      if (!connection.session || connection.closing || connection.redirected) {
+        continue;
+      }
+      const std::string* node = RemoteOwner(connection.user);
+      if (node) {
+        Redirect(connection, *node);
+      }
+    }
+  }
+
+  // Nodo dueno de user si es otro; nulo si es este o no hay cluster
+  const std::string*
+  RemoteOwner(const std::string& user) const {
+    if (!m_topology) {
+      return nullptr;
+    }
+    const std::string& owner = m_topology->ring.Owner(user);
+    if (owner.empty() || owner == m_cluster->Self()) {
+      return nullptr;
+    }
+    return &owner;
+  }
+
+  // Con la cola del enlace llena el mensaje espera en el almacen de este
+  // nodo y MigrateOffline lo reintenta; una senal o una publicacion de sala
+  // se pierde
+  bool
+  ForwardRemote(const std::string& node, Cluster::Kind kind, const std::string& destination,
+                const std::string& source, const std::string& payload,
+                const OfflineStore::Durable& durable = nullptr) {
+    // Con durable el Send no se confirma al cliente hasta el ack del enlace
+    Cluster::Delivered delivered;
+    if (durable) {
+      delivered = [durable]() { durable(true); };
+    }
+    if (m_cluster->Forward(*m_topology, node, kind, destination, source, payload,
+                           std::move(delivered))) {
+      Bump(m_forwarded);
+      return static_cast<bool>(durable);
+    }
+    if (kind == Cluster::Kind::Message) {
+      return StoreOffline(destination, source, payload, durable) && durable;
+    }
+    Bump(m_dropped);
+    return false;
+  }
+
+  // El cliente se entera de su nodo ("host:puerto") y la conexion se cierra
+  // cuando la trama sale (CloseRedirected)
+  void
+  Redirect(Connection& connection, const std::string& node) {
+    auto it = m_topology->clients.find(node);
+    std::string address = it == m_topology->clients.end() ? std::string() : it->second;
+    connection.redirected = true;
+    m_redirecting.push_back(connection.id);
+    SealControl(connection, FrameType::Redirect, std::move(address));
+    Bump(m_redirected);
+  }
+
+  void
+  CloseRedirected() {
+    for (size_t i = 0; i < m_redirecting.size();) {
+      auto it = m_connections.find(m_redirecting[i]);
+      if (it != m_connections.end() && !it->second.closing &&
+          (it->second.cryptoBusy || !it->second.cryptoBacklog.empty() || !it->second.out.Empty())) {
+        ++i;
+        continue;
+      }
+      if (it != m_connections.end()) {
+        Close(it->second);
+      }
+      m_redirecting[i] = m_redirecting.back();
+      m_redirecting.pop_back();
+    }
+  }
+
+  // Backlog guardado aqui de usuarios que ahora son de otro nodo (cambio de
+  // miembros o enlace saturado): pasa a la cola del enlace y el registro se
+  // queda hasta que el ack del enlace cubre su lote (OnMigrated). Lo que
+  // esta en vuelo no se vuelve a leer en el siguiente barrido
+  void
+  MigrateOffline() {
+    OfflineStore* store = m_server.m_offline.get();
+    if (!store || !m_topology) {
+      return;
+    }
+    m_users.clear();
+    store->Users(m_users);
+    size_t budget = kMigrateBudget;
+    CompletionQueue* completions = &m_completions;
+    for (const std::string& user : m_users) {
+      const std::string* node = RemoteOwner(user);
+      uint64_t id = 0;
+      // Aun conectado aqui: espera a que su Redirect cierre la conexion
+      if (!node || m_server.m_routes.Lookup(user, id)) {
+        continue;
+      }
+      Migration& migration = m_migrations[user];
+      bool full = false;
+      while (budget > 0 && !full && migration.inFlight.size() < kStoredWindow) {
+        m_storedBatch.clear();
+        if (store->Read(user, migration.sent,
+                        std::min(budget, kStoredWindow - migration.inFlight.size()),
+                        kStoredWindowBytes, m_storedBatch) == 0) {
+          break;
+        }
+        for (const OfflineStore::Record& record : m_storedBatch) {
+          std::string source;
+          const unsigned char* payload = nullptr;
+          size_t payloadLen = 0;
+          if (record.len < 8 ||
+              !FrameCodec::SplitId(record.data + 8, record.len - 8, source, payload, payloadLen)) {
+            migration.sent = record.seq;   // Registro ilegible: se descarta con los demas
+            migration.inFlight[record.seq] = true;
+            Bump(m_dropped);
+            continue;
+          }
+          uint64_t seq = record.seq;
+          if (!m_cluster->Forward(*m_topology, *node, Cluster::Kind::Message, user, source,
+                                  std::string(reinterpret_cast<const char*>(payload), payloadLen),
+                                  [this, completions, user, seq]() {
+                                    completions->Post([this, user, seq]() {
+                                      OnMigrated(user, seq);
+                                    });
+                                  })) {
+            full = true;
+            break;
+          }
+          migration.sent = seq;
+          migration.inFlight[seq] = false;
+          --budget;
+          Bump(m_migrated);
+        }
+        m_storedBatch.clear();
+      }
+      ConfirmMigrated(user);
+      if (budget == 0) {
+        break;
+      }
+    }
+    m_users.clear();
+  }
+
+  // Ack del enlace para un mensaje migrado
+  void
+  OnMigrated(const std::string& user, uint64_t seq) {
+    auto it = m_migrations.find(user);
+    if (it == m_migrations.end()) {
+      return;
+    }
+    auto entry = it->second.inFlight.find(seq);
+    if (entry != it->second.inFlight.end()) {
+      entry->second = true;
+    }
+    ConfirmMigrated(user);
+  }
+
+  // El Ack del almacen es acumulado: solo el tramo inicial ya entregado
+  void
+  ConfirmMigrated(const std::string& user) {
+    auto it = m_migrations.find(user);
+    if (it == m_migrations.end()) {
+      return;
+    }
+    std::map<uint64_t, bool>& inFlight = it->second.inFlight;
+    uint64_t last = 0;
+    while (!inFlight.empty() && inFlight.begin()->second) {
+      last = inFlight.begin()->first;
+      inFlight.erase(inFlight.begin());
+    }
+    OfflineStore* store = m_server.m_offline.get();
+    if (last > 0 && store) {
+      store->Ack(user, last);
+    }
+    if (inFlight.empty()) {
+      m_migrations.erase(it);   // Lo que quede se lee desde lo confirmado
+    }
+  }
+
+  // Claves fijadas aqui de usuarios que ahora son de otro nodo: el dueno
+  // nuevo las fija (Merge) y no acepta otra clave en el primer Hello del
+  // usuario. Con el enlace saturado se repite todo en el siguiente barrido
+  void
+  MigrateIdentities() {
+    if (!m_topology) {
+      return;
+    }
+    if (m_pinsVersion != m_topology->version) {
+      m_pinsVersion = m_topology->version;
+      m_pins.clear();
+      m_server.m_identities.Users(m_pins);
+    }
+    std::unordered_map<std::string, std::vector<std::string>> owners;
+    size_t budget = kMigrateBudget;
+    while (!m_pins.empty() && budget > 0) {
+      const std::string* node = RemoteOwner(m_pins.back());
+      if (node) {
+        owners[*node].push_back(std::move(m_pins.back()));
+        --budget;
+      }
+      m_pins.pop_back();
+    }
+    for (const auto& owner : owners) {
+      std::string records;
+      m_server.m_identities.Export(owner.second, records);
+      if (!records.empty() &&
+          !m_cluster->Forward(*m_topology, owner.first, Cluster::Kind::Identity, std::string(),
+                              m_cluster->Self(), records)) {
+        m_pinsVersion = 0;
+      }
+    }
+  }
+
+  bool
+  StoreOffline(const std::string& destination, const std::string& source,
+               const std::string& payload, const OfflineStore::Durable& durable = nullptr) {
+    OfflineStore* store = m_server.m_offline.get();
+    if (!store || !store->Append(destination, source,
+                                 reinterpret_cast<const unsigned char*>(payload.data()),
+                                 payload.size(), durable)) {
+      Bump(m_dropped);
+      return false;
+    }
+    Bump(m_stored);
+
+    // Si el destinatario conecto entre la consulta y el Append, su drenaje
+    // pudo leer el backlog antes de este mensaje: se le avisa
+    uint64_t id = 0;
+    if (!m_server.m_routes.Lookup(destination, id)) {
+      return true;
+    }
+    size_t owner = static_cast<size_t>(id >> kConnectionIdShift);
+    if (owner == m_index) {
+      auto it = m_connections.find(id);
+      if (it != m_connections.end() && it->second.user == destination) {
+        PumpStored(it->second);
+      }
+      return true;
+    }
+    CoreMessage message;
+    message.kind = CoreMessage::Kind::Stored;
+    message.connection = id;
+    message.user = destination;
+    if (!m_server.m_cores[owner]->TryPost(std::move(message))) {
+      Bump(m_inboxFull);
+      m_server.m_cores[owner]->MissStored();
+    }
+    return true;
+  }
+
+  // Envia backlog guardado hasta llenar la ventana; cada Ack la vuelve a abrir
+  void
+  PumpStored(Connection& connection) {
+    OfflineStore* store = m_server.m_offline.get();
+    if (!store || !connection.session || connection.closing ||
+        connection.storedInFlight.size() >= kStoredWindow) {
+      return;
+    }
+    m_storedBatch.clear();
+    store->Read(connection.user, connection.storedSent,
+                kStoredWindow - connection.storedInFlight.size(), kStoredWindowBytes,
+                m_storedBatch);
+    // Un backlog largo va entero a la cola para que SubmitSeals lo reparta
+    bool batch = m_storedBatch.size() >= kSealBatch;
+    for (OfflineStore::Record& record : m_storedBatch) {
+      connection.storedSent = record.seq;
+      connection.storedInFlight.push_back(record.seq);
+      if (batch) {
+        connection.cryptoBacklog.push_back(CryptoStep::View(FrameType::Stored,
+                                                            std::move(record.segment),
+                                                            record.data, record.len));
+      }
+      else {
+        SealView(connection, FrameType::Stored, std::move(record.segment), record.data, record.len);
+      }
+    }
+    m_storedBatch.clear();
+    if (batch && !connection.cryptoBusy) {
+      PumpCrypto(connection);
+    }
+  }
+
+  void
+  OnStoredAck(Connection& connection, uint64_t seq) {
+    if (!m_server.m_offline) {
+      Bump(m_dropped);
+      return;
+    }
+    m_server.m_offline->Ack(connection.user, seq);
+    while (!connection.storedInFlight.empty() && connection.storedInFlight.front() <= seq) {
+      connection.storedInFlight.pop_front();
+    }
+    PumpStored(connection);
+  }
+
+  void
+  Deliver(uint64_t id, const std::string& destination, std::string&& source,
+          std::string&& payload) {
+    auto it = m_connections.find(id);
+    // La tabla guarda huellas: el dueno confirma que la conexion es del destinatario
+    if (it == m_connections.end() || it->second.closing || !it->second.session ||
+        it->second.user != destination || source.size() > 255) {
+      Bump(m_dropped);
+      return;
+    }
+
+    // [seq u64][len origen][origen][payload]: se cifra tal cual y queda en
+    // el buffer de reenvio de la sesion hasta que el cliente lo confirma
+    Connection& connection = it->second;
+    auto record = std::make_shared<std::vector<unsigned char>>(9 + source.size() + payload.size());
+    unsigned char* out = record->data();
+    out[8] = static_cast<unsigned char>(source.size());
+    std::copy(source.begin(), source.end(), out + 9);
+    std::copy(payload.begin(), payload.end(), out + 9 + source.size());
+    bool full = false;
+    {
+      std::lock_guard<std::mutex> guard(connection.reliable->lock);
+      RetransmitBuffer& outbound = connection.reliable->outbound;
+      full = outbound.Count() >= kMaxUnacked;
+      if (!full) {
+        uint64_t seq = outbound.Next();
+        for (int i = 0; i < 8; ++i) {
+          out[i] = static_cast<unsigned char>(seq >> (56 - 8 * i));
+        }
+        outbound.Push(record);
+      }
+    }
+    if (full) {
+      // El cliente no confirma: se corta y el mensaje espera en disco
+      Close(connection);
+      StoreOffline(destination, source, payload);
+      return;
+    }
+    if (!payload.empty()) {
+      OPENSSL_cleanse(&payload[0], payload.size());
+    }
+    Bump(m_routed);
+    SealView(connection, FrameType::Deliver, record, record->data(), record->size());
+  }
+
+  void
+  Queue(Connection& connection, unsigned char type, const unsigned char* body, size_t len) {
+    if (connection.out.Pending() + len > kMaxPendingOut) {
+      Close(connection);
+      return;
+    }
+    bool idle = connection.out.Empty();
+    std::vector<unsigned char>& tail = connection.out.Tail();
+    size_t before = tail.size();
+    FrameCodec::Append(type, body, len, tail);
+    connection.out.Commit(tail.size() - before);
+    Bump(m_framesOut);
+    if (idle) {
+      Flush(connection);  // Envio directo sin esperar a la siguiente vuelta de WSAPoll
+    }
+  }
+
+  void
+  QueueShared(Connection& connection, const WriteQueue::Shared& frame) {
+    if (connection.out.Pending() + frame->size() > kMaxPendingOut) {
+      Close(connection);
+      return;
+    }
+    bool idle = connection.out.Empty();
+    connection.out.AppendShared(frame);
+    Bump(m_framesOut);
+    if (idle) {
+      Flush(connection);
+    }
+  }
+
+  void
+  Flush(Connection& connection) {
+    size_t sent = 0;
+    bool ok = connection.out.Flush(connection.socket, sent);
+    Bump(m_bytesOut, sent);
+    if (!ok) {
+      Close(connection);
+    }
+  }
+
+  // El cierre se aplaza a Reap(): nunca se borra una conexion en uso
+  void
+  Close(Connection& connection) {
+    if (!connection.closing) {
+      connection.closing = true;
+      m_closing.push_back(connection.id);
+    }
+  }
+
+  void
+  Reap() {
+    for (uint64_t id : m_closing) {
+      auto it = m_connections.find(id);
+      if (it == m_connections.end()) {
+        continue;
+      }
+      Connection& connection = it->second;
+      closesocket(connection.socket);
+      if (connection.session) {
+        m_server.m_routes.Remove(connection.user, id);
+      }
+      if (connection.reliable) {
+        m_server.m_sessions.Detach(connection.reliable);
+      }
+      for (const auto& room : connection.rooms) {
+        m_server.m_rooms.Leave(room.first, id);
+      }
+      Bump(m_dropped, connection.cryptoBacklog.size());
+      m_buffers.Release(std::move(connection.in));
+      m_buffers.Release(connection.out.Release());
+      m_connections.erase(it);
+      m_open.store(m_open.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+    }
+    m_closing.clear();
+  }
+
+  Server& m_server;
+  size_t m_index;
+  MPSCQueue<CoreMessage> m_inbox;   // Muchos productores, consume solo el nucleo
+  CompletionQueue m_completions;
+  SOCKET m_wakeSocket = INVALID_SOCKET;
+  std::atomic<bool> m_wakePending{ false };
+  std::atomic<bool> m_stop{ false };
+  std::atomic<bool> m_frozen{ false };   // Reinicio en caliente en curso
+  std::atomic<bool> m_quiet{ false };    // Lo escribe el nucleo; lo lee HandOff
+  std::atomic<bool> m_storedMissed{ false };  // MissStored()
+  std::thread m_thread;
+
+  // Estado exclusivo del hilo del nucleo
+  std::unordered_map<uint64_t, Connection> m_connections;
+  std::vector<uint64_t> m_closing;
+  std::vector<CoreMessage> m_inboxBatch;
+  std::vector<OfflineStore::Record> m_storedBatch;
+  std::vector<uint64_t> m_ackQueue;         // Conexiones con un ack aplazado
+  std::vector<AckBlock> m_ackBlocks;
+  std::vector<RetransmitBuffer::Pending> m_resend;
+  std::vector<uint64_t> m_redirecting;      // Conexiones con un Redirect por salir
+  std::vector<std::string> m_users;
+  std::unordered_map<std::string, Migration> m_migrations;   // Nucleo 0: backlog en los enlaces
+  std::vector<std::string> m_pins;          // Usuarios fijados pendientes de MigrateIdentities
+  uint64_t m_pinsVersion = 0;               // Version del anillo de m_pins
+  Cluster* m_cluster = nullptr;
+  std::shared_ptr<const Cluster::Topology> m_topology;   // Nulo sin cluster
+  std::chrono::steady_clock::time_point m_nextSweep;
+  AdmissionControl m_admission;
+  BufferPool m_buffers;
+  std::vector<unsigned char> m_recvBuffer;
+  uint64_t m_nextId = 0;
+
+  // Un solo escritor (el nucleo); GetStats() los lee
+  std::atomic<uint64_t> m_open{ 0 };
+  std::atomic<uint64_t> m_framesIn{ 0 };
+  std::atomic<uint64_t> m_framesOut{ 0 };
+  std::atomic<uint64_t> m_routed{ 0 };
+  std::atomic<uint64_t> m_broadcasts{ 0 };
+  std::atomic<uint64_t> m_stored{ 0 };
+  std::atomic<uint64_t> m_storedOut{ 0 };
+  std::atomic<uint64_t> m_acks{ 0 };
+  std::atomic<uint64_t> m_ackBytes{ 0 };
+  std::atomic<uint64_t> m_retransmitted{ 0 };
+  std::atomic<uint64_t> m_duplicates{ 0 };
+  std::atomic<uint64_t> m_limited{ 0 };
+  std::atomic<uint64_t> m_shedSignals{ 0 };
+  std::atomic<uint64_t> m_shedHandshakes{ 0 };
+  std::atomic<uint64_t> m_shedBulk{ 0 };
+  std::atomic<uint64_t> m_escalations{ 0 };
+  std::atomic<uint64_t> m_shedLevel{ 0 };
+  std::atomic<uint64_t> m_sojournMicros{ 0 };
+  std::atomic<uint64_t> m_forwarded{ 0 };
+  std::atomic<uint64_t> m_redirected{ 0 };
+  std::atomic<uint64_t> m_migrated{ 0 };
+  std::atomic<uint64_t> m_blobRequests{ 0 };
+  std::atomic<uint64_t> m_blobDedupHits{ 0 };
+  std::atomic<uint64_t> m_blobBytesIn{ 0 };
+  std::atomic<uint64_t> m_inboxFull{ 0 };
+  std::atomic<uint64_t> m_sealBatches{ 0 };
+  std::atomic<uint64_t> m_dropped{ 0 };
+  std::atomic<uint64_t> m_bytesIn{ 0 };
+  std::atomic<uint64_t> m_bytesOut{ 0 };
+};
+
+Server::Server()
+  : m_routes(0), m_clusterActive(nullptr), m_running(false), m_accepting(false),
+    m_handedOff(false), m_accepted(0), m_refused(0) {
+}
+
+Server::Server(int port, size_t cores, const std::string& offlineDirectory,
+               const RateLimiter::Limits& limits, const std::string& takeoverEndpoint)
+  : m_routes(ResolveCores(cores)), m_offlineDirectory(offlineDirectory), m_limiter(limits),
+    m_clusterActive(nullptr), m_running(false), m_accepting(false), m_handedOff(false),
+    m_accepted(0), m_refused(0) {
+  AlgorithmCache::Initialize();
+  // La clave RSA antes del traspaso: el proceso viejo esta congelado mientras dura
+  m_identity.GenerateRSAKeys();
+  m_publicKey = m_identity.GetPublicKeyDER();
+  if (m_publicKey.empty()) {
+    std::cerr << "Server not started" << std::endl;
+    return;
+  }
+
+  cores = ResolveCores(cores);
+  m_handshakes.reset(new CryptoWorkerPool(std::max<size_t>(1, cores / 4)));
+  m_scheduler.reset(new WorkStealingScheduler(cores));
+  for (size_t i = 0; i < cores; ++i) {
+    m_cores.emplace_back(new Core(*this, i));
+  }
+  bool ready = takeoverEndpoint.empty() ? OpenOffline() && m_network.StartServer(port)
+                                        : TakeOver(takeoverEndpoint);
+  if (!ready) {
+    std::cerr << "Server not started" << std::endl;
+    return;
+  }
+  for (auto& core : m_cores) {
+    if (!core->Start()) {
+      Stop();
+      return;
+    }
+  }
+
+  m_running.store(true, std::memory_order_release);
+  m_accepting.store(true, std::memory_order_release);
+  m_acceptor = std::thread(&Server::AcceptLoop, this);
+}
+
+Server::~Server() {
+  Stop();
+}
+
+void
+Server::Stop() {
+  m_running.store(false, std::memory_order_release);
+  m_accepting.store(false, std::memory_order_release);
+  if (m_restarter.joinable()) {
+    m_restarter.join();
+  }
+  if (m_acceptor.joinable()) {
+    m_acceptor.join();
+  }
+  // Traspasado, el socket de escucha es del sucesor: sin shutdown
+  if (m_handedOff.load(std::memory_order_acquire)) {
+    m_network.ReleaseServer();
+  }
+  else {
+    m_network.StopServer();
+  }
+  m_restart.Close();
+  // Los enlaces antes que los nucleos: su hilo espera sitio en los inbox
+  if (m_cluster) {
+    m_cluster->Stop();
+  }
+  // Los nucleos antes que los pools: un loop vivo aun puede enviarles trabajo.
+  // Las completions que lleguen despues a un nucleo parado se descartan
+  for (auto& core : m_cores) {
+    core->Stop();
+  }
+  // Con los nucleos aun vivos: el cierre vuelca lo pendiente y sus avisos
+  // van a las completions de los nucleos
+  m_offline.reset();
+  m_blobs.reset();  // Se cierra con el ultimo trabajo del pool que lo usa
+  m_handshakes.reset();
+  m_scheduler.reset();
+}
+
+bool
+Server::OpenOffline() {
+  if (m_offlineDirectory.empty()) {
+    return true;
+  }
+  m_offline.reset(new OfflineStore(m_offlineDirectory));
+  m_blobs = std::make_shared<BlobStore>(
+    (std::filesystem::path(m_offlineDirectory) / kBlobDirectory).string());
+  m_blobs->StartBackgroundGC(kBlobGCInterval);
+  return m_offline->IsOpen() &&
+         m_identities.Open((std::filesystem::path(m_offlineDirectory) / kIdentityFile).string());
+}
+
+void
+Server::AcceptLoop() {
+  size_t next = 0;
+  while (m_accepting.load(std::memory_order_acquire)) {
+    // Con plazo: un reinicio en caliente para este bucle sin cerrar el socket
+    if (!m_network.WaitForClient(kRestartPollMs)) {
+      continue;
+    }
+    SOCKET socket = m_network.AcceptClient();
+    if (socket == INVALID_SOCKET) {
+      if (m_accepting.load(std::memory_order_acquire)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+      continue;
+    }
+    m_accepted.fetch_add(1, std::memory_order_relaxed);
+
+    // El siguiente nucleo con sitio; si no hay ninguno se rechaza: mejor que
+    // reintente que acumular conexiones que nadie atiende
+    CoreMessage message;
+    message.kind = CoreMessage::Kind::Adopt;
+    message.socket = socket;
+    bool adopted = false;
+    for (size_t tries = 0; !adopted && tries < m_cores.size(); ++tries) {
+      adopted = m_cores[next]->TryPost(std::move(message));
+      next = (next + 1) % m_cores.size();
+    }
+    if (!adopted) {
+      closesocket(socket);
+      m_refused.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+bool
+Server::EnableHotRestart(const std::string& endpoint) {
+  if (!IsRunning() || m_restarter.joinable() || !m_restart.Listen(endpoint)) {
+    return false;
+  }
+  m_restart.SetTimeout(kHandoffTimeoutMs);
+  m_restarter = std::thread(&Server::RestartLoop, this);
+  return true;
+}
+
+void
+Server::RestartLoop() {
+  while (m_running.load(std::memory_order_acquire)) {
+    if (m_restart.Accept(kRestartPollMs) && HandOff()) {
+      return;
+    }
+  }
+}
+
+// Orden: sin accepts, nucleos congelados hasta que no queda cripto en
+// vuelo, y el estado se serializa con los hilos de los nucleos parados. Lo
+// que estaba aqui no se suelta hasta que el sucesor responde Ready
+bool
+Server::HandOff() {
+  m_accepting.store(false, std::memory_order_release);
+  if (m_acceptor.joinable()) {
+    m_acceptor.join();
+  }
+  for (auto& core : m_cores) {
+    core->Freeze(true);
+  }
+  // Dos pasadas seguidas en reposo: un mensaje entre nucleos de la primera
+  // pasada ya esta en el inbox de su destino en la segunda
+  auto deadline = SteadyClock::now() + kQuietTimeout;
+  int quietRounds = 0;
+  while (quietRounds < 2 && SteadyClock::now() < deadline) {
+    bool quiet = true;
+    for (const auto& core : m_cores) {
+      quiet = quiet && core->Quiet();
+    }
+    quietRounds = quiet ? quietRounds + 1 : 0;
+    std::this_thread::sleep_for(std::chrono::milliseconds(kAckPollMs));
+  }
+  for (auto& core : m_cores) {
+    core->Stop();
+  }
+  // Un solo proceso escribe los segmentos. Se cierra antes de Export: los
+  // Send que esperaban el volcado ya tienen su ack en las completions
+  m_offline.reset();
+  // Los blobs tambien, pero un BlobPut aun en el pool tiene su referencia:
+  // se espera a que suelte el journal antes de que el sucesor lo abra
+  std::weak_ptr<BlobStore> blobs = m_blobs;
+  m_blobs.reset();
+  while (!blobs.expired()) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+
+  std::vector<std::string> records;
+  std::vector<SOCKET> sockets;
+  for (auto& core : m_cores) {
+    core->Export(records, sockets);
+  }
+  // Despues de Export: los Deliver que drenaron los nucleos ya estan en sus sesiones
+  std::string listener(1, static_cast<char>(kHandoffListener));
+  m_sessions.Export(listener);
+
+  bool ok = m_restart.Send(listener, std::vector<SOCKET>(1, m_network.ListenSocket()));
+  // Sin directorio offline las claves fijadas solo estan en memoria
+  std::string identities(1, static_cast<char>(kHandoffIdentities));
+  m_identities.Export(identities);
+  ok = ok && m_restart.Send(identities, std::vector<SOCKET>());
+  for (size_t begin = 0; ok && begin < sockets.size(); begin += HotRestart::kMaxSockets) {
+    size_t end = std::min(sockets.size(), begin + HotRestart::kMaxSockets);
+    std::string batch(1, static_cast<char>(kHandoffConnections));
+    for (size_t i = begin; i < end; ++i) {
+      AppendU32(batch, static_cast<uint32_t>(records[i].size()));
+      batch += records[i];
+    }
+    ok = m_restart.Send(batch, std::vector<SOCKET>(sockets.begin() + begin, sockets.begin() + end));
+    OPENSSL_cleanse(&batch[0], batch.size());
+  }
+  for (std::string& record : records) {
+    OPENSSL_cleanse(&record[0], record.size());
+  }
+  std::string reply;
+  std::vector<SOCKET> none;
+  ok = ok && m_restart.Send(std::string(1, static_cast<char>(kHandoffDone)), none) &&
+       m_restart.Receive(reply, none) && reply.size() == 1 && reply[0] == kHandoffReady;
+
+  if (!ok) {
+    // El sucesor no llego a usar nada: este proceso sigue como estaba
+    std::cerr << "Hot restart failed, resuming service" << std::endl;
+    for (SOCKET socket : none) {
+      closesocket(socket);
+    }
+    if (!OpenOffline()) {
+      std::cerr << "Error reopening offline store" << std::endl;
+    }
+    for (auto& core : m_cores) {
+      core->Freeze(false);
+      core->Start();
+    }
+    m_accepting.store(m_running.load(std::memory_order_acquire), std::memory_order_release);
+    m_acceptor = std::thread(&Server::AcceptLoop, this);
+    return false;
+  }
+
+  for (auto& core : m_cores) {
+    core->Release();
+  }
+  m_restart.Close();
+  std::cout << "Hot restart: " << sockets.size() << " connections handed off" << std::endl;
+  m_handedOff.store(true, std::memory_order_release);
+  m_running.store(false, std::memory_order_release);
+  return true;
+}
+
+// Lado del sucesor, antes de arrancar los nucleos. Nada se usa hasta Done:
+// si el traspaso se corta, el proceso viejo sigue con todo
+bool
+Server::TakeOver(const std::string& endpoint) {
+  HotRestart channel;
+  channel.SetTimeout(kHandoffTimeoutMs);
+  std::string message;
+  std::vector<SOCKET> sockets;
+  if (!channel.Connect(endpoint) || !channel.Receive(message, sockets) ||
+      message.empty() || message[0] != kHandoffListener || sockets.size() != 1 ||
+      sockets[0] == INVALID_SOCKET) {
+    for (SOCKET socket : sockets) {
+      closesocket(socket);
+    }
+    std::cerr << "Error taking over from " << endpoint << std::endl;
+    return false;
+  }
+  m_network.AdoptServer(sockets[0]);
+  // El viejo cerro el almacen antes de enviar nada. Se abre ya: entre Done y
+  // Ready no queda nada lento que agote el plazo del viejo
+  bool ok = m_sessions.Import(message.substr(1)) && OpenOffline();
+
+  std::vector<std::pair<SOCKET, std::string>> connections;
+  while (ok) {
+    ok = channel.Receive(message, sockets) && !message.empty();
+    if (!ok || message[0] == kHandoffDone) {
+      break;
+    }
+    if (message[0] == kHandoffIdentities) {
+      ok = sockets.empty() && m_identities.Import(message.substr(1));
+      if (!ok) {
+        break;
+      }
+      continue;
+    }
+    Cursor cursor{ reinterpret_cast<const unsigned char*>(message.data()) + 1,
+                   reinterpret_cast<const unsigned char*>(message.data()) + message.size() };
+    for (SOCKET socket : sockets) {
+      std::string record;
+      ok = ok && message[0] == kHandoffConnections && cursor.Read(record, 4);
+      connections.emplace_back(socket, std::move(record));
+    }
+    OPENSSL_cleanse(&message[0], message.size());
+    if (!ok) {
+      break;
+    }
+  }
+  ok = ok && channel.Send(std::string(1, static_cast<char>(kHandoffReady)), std::vector<SOCKET>());
+  if (!ok) {
+    // El socket de escucha sigue siendo del viejo: se cierra sin shutdown
+    for (auto& connection : connections) {
+      closesocket(connection.first);
+    }
+    m_network.ReleaseServer();
+    m_offline.reset();
+    m_blobs.reset();
+    std::cerr << "Error taking over from " << endpoint << std::endl;
+    return false;
+  }
+
+  size_t next = 0;
+  size_t imported = 0;
+  for (auto& connection : connections) {
+    if (connection.first != INVALID_SOCKET &&
+        m_cores[next]->Import(connection.first, connection.second)) {
+      ++imported;
+      next = (next + 1) % m_cores.size();
+    }
+    OPENSSL_cleanse(&connection.second[0], connection.second.size());
+  }
+  std::cout << "Hot restart: took over " << imported << " of " << connections.size()
+            << " connections" << std::endl;
+  return true;
+}
+
+size_t
+Server::ResolveCores(size_t cores) {
+  return cores == 0 ? std::max(1u, std::thread::hardware_concurrency()) : cores;
+}
+
+Server::Stats
+Server::GetStats() const {
+  Stats stats;
+  stats.accepted = m_accepted.load(std::memory_order_relaxed);
+  stats.refused = m_refused.load(std::memory_order_relaxed);
+  stats.routes = m_routes.Size();
+  stats.rooms = m_rooms.GetStats().rooms;
+  stats.sessions = m_sessions.Size();
+  if (m_scheduler) {
+    stats.stolenTasks = m_scheduler->GetStats().stolen;
+  }
+  for (const auto& core : m_cores) {
+    core->AddStats(stats);
+  }
+  Cluster* cluster = m_clusterActive.load(std::memory_order_acquire);
+  if (cluster) {
+    Cluster::Stats links = cluster->GetStats();
+    stats.fromCluster = links.received;
+    stats.linkBatches = links.batches;
+    stats.inboxFull += links.deferred;
+  }
+  return stats;
+}
+
+bool
+Server::EnableCluster(const std::string& self, const std::vector<ClusterNode>& nodes,
+                      const std::string& secret) {
+  if (!IsRunning() || m_cluster) {
+    return false;
+  }
+  m_cluster.reset(new Cluster(self, secret,
+    [this](Cluster::Kind kind, std::string&& destination, std::string&& source,
+           std::string&& payload) {
+      return OnClusterMessage(kind, std::move(destination), std::move(source), std::move(payload));
+    }));
+  if (!m_cluster->Start(nodes)) {
+    m_cluster.reset();
+    return false;
+  }
+  m_clusterActive.store(m_cluster.get(), std::memory_order_release);
+  return true;
+}
+
+bool
+Server::SetClusterNodes(const std::vector<ClusterNode>& nodes) {
+  Cluster* cluster = m_clusterActive.load(std::memory_order_acquire);
+  if (!cluster) {
+    return false;
+  }
+  cluster->SetNodes(nodes);
+  return true;
+}
+
+// Hilo de enlaces. Cada destinatario va siempre al mismo nucleo: sus
+// mensajes de un mismo nodo llegan en orden
+bool
+Server::OnClusterMessage(Cluster::Kind kind, std::string&& destination, std::string&& source,
+                         std::string&& payload) {
+  size_t core = std::hash<std::string>()(destination) % m_cores.size();
+  CoreMessage message;
+  message.kind = CoreMessage::Kind::Forwarded;
+  message.remote = kind;
+  message.user = std::move(destination);
+  message.source = std::move(source);
+  message.payload = std::move(payload);
+  if (m_cores[core]->TryPost(std::move(message))) {
+    return true;
+  }
+  // Nucleo lleno: el enlace se lo queda y deja de leer hasta que quepa
+  destination = std::move(message.user);
+  source = std::move(message.source);
+  payload = std::move(message.payload);
+  return false;
+}
@@ -0,0 +1,93 @@
+#include "SessionTable.h"
+
+SessionTable::SessionTable(std::chrono::milliseconds resumeWindow)
+  : m_resumeWindow(resumeWindow) {
+}
+
+std::shared_ptr<ReliableSession>
+SessionTable::Attach(const std::string& user) {
+  std::lock_guard<std::mutex> guard(m_lock);
+  std::shared_ptr<ReliableSession>& session = m_sessions[user];
+  if (!session) {
+    session = std::make_shared<ReliableSession>();
+  }
+  std::lock_guard<std::mutex> sessionGuard(session->lock);
+  ++session->attached;
+  return session;
+}
+
+void
+SessionTable::Detach(const std::shared_ptr<ReliableSession>& session) {
+  std::lock_guard<std::mutex> guard(session->lock);
+  if (--session->attached == 0) {
+    session->detachedAt = std::chrono::steady_clock::now();
+  }
+}
+
+size_t
+SessionTable::Sweep(const Expired& expired) {
+  auto deadline = std::chrono::steady_clock::now() - m_resumeWindow;
+  std::vector<std::pair<std::string, std::shared_ptr<ReliableSession>>> removed;
+  {
+    std::lock_guard<std::mutex> guard(m_lock);
+    for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+      ReliableSession& session = *it->second;
+      std::lock_guard<std::mutex> sessionGuard(session.lock);
+      if (session.attached > 0 || session.detachedAt > deadline) {
+        ++it;
+        continue;
+      }
+      removed.emplace_back(it->first, std::move(it->second));
+      it = m_sessions.erase(it);
+    }
+  }
+
+  // Fuera del lock de la tabla: el llamador puede escribir a disco
+  for (auto& entry : removed) {
+    std::lock_guard<std::mutex> sessionGuard(entry.second->lock);
+    expired(entry.first, *entry.second);
+  }
+  return removed.size();
+}
+
+size_t
+SessionTable::Size() const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  return m_sessions.size();
+}
+
+// [len usuario u8][usuario][entrada][salida] por sesion
+void
+SessionTable::Export(std::string& out) const {
+  std::lock_guard<std::mutex> guard(m_lock);
+  for (const auto& entry : m_sessions) {
+    std::lock_guard<std::mutex> sessionGuard(entry.second->lock);
+    out.push_back(static_cast<char>(entry.first.size()));
+    out += entry.first;
+    entry.second->inbound.Save(out);
+    entry.second->outbound.Save(out);
+  }
+}
+
+bool
+SessionTable::Import(const std::string& state) {
+  const unsigned char* data = reinterpret_cast<const unsigned char*>(state.data());
+  const unsigned char* end = data + state.size();
+  auto now = std::chrono::steady_clock::now();
+  std::lock_guard<std::mutex> guard(m_lock);
+  while (data < end) {
+    size_t userLen = *data++;
+    if (static_cast<size_t>(end - data) < userLen) {
+      return false;
+    }
+    std::string user(reinterpret_cast<const char*>(data), userLen);
+    data += userLen;
+    auto session = std::make_shared<ReliableSession>();
+    if (!session->inbound.Load(data, end) || !session->outbound.Load(data, end)) {
+      return false;
+    }
+    session->detachedAt = now;
+    m_sessions[user] = std::move(session);
+  }
+  return true;
+}
@@ -0,0 +1,254 @@
+#include "StreamCipher.h"
+#include "CryptoHelper.h"
+#include "SecureRandom.h"
+#include "AlgorithmCache.h"
+#include <algorithm>
+
+namespace {
+  const unsigned char kMagic[4] = { 'E', '2', 'S', '1' };
+
+  // Clave del flujo (32) || prefijo de nonce (7), derivados de la clave y el salt
+  bool
+  DeriveStreamKeys(const unsigned char key[32], const unsigned char* salt,
+                   unsigned char out[39]) {
+    return CryptoHelper::HKDFSHA256(key, 32, salt, 16, "E2EE-Stream", out, 39);
+  }
+
+  void
+  BuildNonce(const unsigned char prefix[7], uint32_t counter, bool last,
+             unsigned char nonce[12]) {
+    std::memcpy(nonce, prefix, 7);
+    nonce[7] = static_cast<unsigned char>(counter >> 24);
+    nonce[8] = static_cast<unsigned char>(counter >> 16);
+    nonce[9] = static_cast<unsigned char>(counter >> 8);
+    nonce[10] = static_cast<unsigned char>(counter);
+    nonce[11] = last ? 1 : 0;
+  }
+}
+
+StreamEncryptor::StreamEncryptor(const unsigned char key[32], size_t chunkSize)
+  : m_ctx(EVP_CIPHER_CTX_new()),
+    m_chunkSize(std::min(std::max<size_t>(chunkSize, 1), StreamFormat::kMaxChunkSize)) {
+  std::memcpy(m_header, kMagic, 4);
+  m_header[4] = static_cast<unsigned char>(m_chunkSize >> 24);
+  m_header[5] = static_cast<unsigned char>(m_chunkSize >> 16);
+  m_header[6] = static_cast<unsigned char>(m_chunkSize >> 8);
+  m_header[7] = static_cast<unsigned char>(m_chunkSize);
+
+  unsigned char derived[39];
+  m_ok = SecureRandom::Fill(m_header + 8, 16) &&
+         DeriveStreamKeys(key, m_header + 8, derived) &&
+         EVP_EncryptInit_ex(m_ctx, AlgorithmCache::AES256GCM(), nullptr, derived, nullptr) == 1;
+  std::memcpy(m_noncePrefix, derived + 32, 7);
+  OPENSSL_cleanse(derived, sizeof(derived));
+  m_pending.reserve(m_chunkSize);
+}
+
+StreamEncryptor::~StreamEncryptor() {
+  OPENSSL_cleanse(m_pending.data(), m_pending.size());
+  EVP_CIPHER_CTX_free(m_ctx);
+}
+
+bool
+StreamEncryptor::EmitHeader(std::vector<unsigned char>& out) {
+  if (!m_headerSent) {
+    out.insert(out.end(), m_header, m_header + StreamFormat::kHeaderSize);
+    m_headerSent = true;
+  }
+  return true;
+}
+
+bool
+StreamEncryptor::SealChunk(const unsigned char* data, size_t len, bool last,
+                           std::vector<unsigned char>& out) {
+  if (m_counter == UINT32_MAX) {
+    return false;  // Limite de bloques por flujo
+  }
+
+  unsigned char nonce[12];
+  BuildNonce(m_noncePrefix, m_counter, last, nonce);
+
+  size_t offset = out.size();
+  out.resize(offset + len + StreamFormat::kTagSize);
+  int outLen = 0;
+  bool ok =
+    EVP_EncryptInit_ex(m_ctx, nullptr, nullptr, nullptr, nonce) == 1 &&
+    EVP_EncryptUpdate(m_ctx, nullptr, &outLen, m_header,
+                      static_cast<int>(StreamFormat::kHeaderSize)) == 1 &&
+    EVP_EncryptUpdate(m_ctx, out.data() + offset, &outLen, data, static_cast<int>(len)) == 1 &&
+    EVP_EncryptFinal_ex(m_ctx, out.data() + offset + outLen, &outLen) == 1 &&
+    EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_GCM_GET_TAG, static_cast<int>(StreamFormat::kTagSize),
+                        out.data() + offset + len) == 1;
+  if (!ok) {
+    out.resize(offset);
+    return false;
+  }
+  ++m_counter;
+  return true;
+}
+
+bool
+StreamEncryptor::Update(const unsigned char* data, size_t len, std::vector<unsigned char>& out) {
+  if (!m_ok || m_finished) {
+    return false;
+  }
+  EmitHeader(out);
+
+  while (len > 0) {
+    // Un bloque pendiente completo solo se sella cuando sabemos que no es el ultimo
+    if (m_pending.size() == m_chunkSize) {
+      m_ok = SealChunk(m_pending.data(), m_pending.size(), false, out);
+      OPENSSL_cleanse(m_pending.data(), m_pending.size());
+      m_pending.clear();
+      if (!m_ok) {
+        return false;
+      }
+    }
+
+    // Camino rapido: bloques completos directamente desde la entrada, sin copiar
+    if (m_pending.empty() && len > m_chunkSize) {
+      m_ok = SealChunk(data, m_chunkSize, false, out);
+      if (!m_ok) {
+        return false;
+      }
+      data += m_chunkSize;
+      len -= m_chunkSize;
+      continue;
+    }
+
+    size_t take = std::min(len, m_chunkSize - m_pending.size());
+    m_pending.insert(m_pending.end(), data, data + take);
+    data += take;
+    len -= take;
+  }
+  return true;
+}
+
+bool
+StreamEncryptor::Finalize(std::vector<unsigned char>& out) {
+  if (!m_ok || m_finished) {
+    return false;
+  }
+  EmitHeader(out);
+
+  m_ok = SealChunk(m_pending.data(), m_pending.size(), true, out);
+  OPENSSL_cleanse(m_pending.data(), m_pending.size());
+  m_pending.clear();
+  m_finished = true;
+  return m_ok;
+}
+
+StreamDecryptor::StreamDecryptor(const unsigned char key[32])
+  : m_ctx(EVP_CIPHER_CTX_new()) {
+  std::memcpy(m_key, key, sizeof(m_key));
+}
+
+StreamDecryptor::~StreamDecryptor() {
+  OPENSSL_cleanse(m_key, sizeof(m_key));
+  OPENSSL_cleanse(m_pending.data(), m_pending.size());
+  EVP_CIPHER_CTX_free(m_ctx);
+}
+
+bool
+StreamDecryptor::OpenChunk(const unsigned char* record, size_t len, bool last,
+                           std::vector<unsigned char>& out) {
+  if (len < StreamFormat::kTagSize || m_counter == UINT32_MAX) {
+    return false;
+  }
+
+  unsigned char nonce[12];
+  BuildNonce(m_noncePrefix, m_counter, last, nonce);
+
+  size_t ctLen = len - StreamFormat::kTagSize;
+  size_t offset = out.size();
+  out.resize(offset + ctLen);
+  int outLen = 0;
+  bool ok =
+    EVP_DecryptInit_ex(m_ctx, nullptr, nullptr, nullptr, nonce) == 1 &&
+    EVP_DecryptUpdate(m_ctx, nullptr, &outLen, m_header,
+                      static_cast<int>(StreamFormat::kHeaderSize)) == 1 &&
+    EVP_DecryptUpdate(m_ctx, out.data() + offset, &outLen, record, static_cast<int>(ctLen)) == 1 &&
+    EVP_CIPHER_CTX_ctrl(m_ctx, EVP_CTRL_GCM_SET_TAG, static_cast<int>(StreamFormat::kTagSize),
+                        const_cast<unsigned char*>(record + ctLen)) == 1 &&
+    EVP_DecryptFinal_ex(m_ctx, out.data() + offset + outLen, &outLen) == 1;
+  if (!ok) {
+    OPENSSL_cleanse(out.data() + offset, ctLen);
+    out.resize(offset);
+    return false;
+  }
+  ++m_counter;
+  return true;
+}
+
+bool
+StreamDecryptor::Update(const unsigned char* data, size_t len, std::vector<unsigned char>& out) {
+  if (!m_ok || m_finished) {
+    return false;
+  }
+
+  // Cabecera
+  if (m_headerLen < StreamFormat::kHeaderSize) {
+    size_t take = std::min(len, StreamFormat::kHeaderSize - m_headerLen);
+    std::memcpy(m_header + m_headerLen, data, take);
+    m_headerLen += take;
+    data += take;
+    len -= take;
+    if (m_headerLen < StreamFormat::kHeaderSize) {
+      return true;
+    }
+
+    m_chunkSize = (size_t(m_header[4]) << 24) | (size_t(m_header[5]) << 16) |
+                  (size_t(m_header[6]) << 8) | size_t(m_header[7]);
+    unsigned char derived[39];
+    m_ok = std::memcmp(m_header, kMagic, 4) == 0 &&
+           m_chunkSize > 0 && m_chunkSize <= StreamFormat::kMaxChunkSize &&
+           DeriveStreamKeys(m_key, m_header + 8, derived) &&
+           EVP_DecryptInit_ex(m_ctx, AlgorithmCache::AES256GCM(), nullptr, derived, nullptr) == 1;
+    std::memcpy(m_noncePrefix, derived + 32, 7);
+    OPENSSL_cleanse(derived, sizeof(derived));
+    if (!m_ok) {
+      return false;
+    }
+    m_pending.reserve(m_chunkSize + StreamFormat::kTagSize);
+  }
+
+  const size_t recordSize = m_chunkSize + StreamFormat::kTagSize;
+  while (len > 0) {
+    // Hay mas bytes detras, asi que el registro pendiente no es el final
+    if (m_pending.size() == recordSize) {
+      m_ok = OpenChunk(m_pending.data(), recordSize, false, out);
+      m_pending.clear();
+      if (!m_ok) {
+        return false;
+      }
+    }
+
+    if (m_pending.empty() && len > recordSize) {
+      m_ok = OpenChunk(data, recordSize, false, out);
+      if (!m_ok) {
+        return false;
+      }
+      data += recordSize;
+      len -= recordSize;
+      continue;
+    }
+
+    size_t take = std::min(len, recordSize - m_pending.size());
+    m_pending.insert(m_pending.end(), data, data + take);
+    data += take;
+    len -= take;
+  }
+  return true;
+}
+
+bool
+StreamDecryptor::Finalize(std::vector<unsigned char>& out) {
+  if (!m_ok || m_finished || m_headerLen < StreamFormat::kHeaderSize) {
+    return false;
+  }
+
+  m_ok = OpenChunk(m_pending.data(), m_pending.size(), true, out);
+  m_pending.clear();
+  m_finished = true;
+  return m_ok;
+}
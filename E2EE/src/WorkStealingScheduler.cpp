@@ -0,0 +1,187 @@
+#include "WorkStealingScheduler.h"
+#include "AlgorithmCache.h"
+#include "SecureRandom.h"
+#include <algorithm>
+
+namespace {
+  // Worker que ejecuta el hilo actual (nullptr fuera de los schedulers)
+  thread_local const WorkStealingScheduler* t_scheduler = nullptr;
+  thread_local size_t t_worker = 0;
+
+  // Contador con un solo escritor: sin instruccion atomica de lectura-modificacion
+  void
+  Bump(std::atomic<uint64_t>& counter) {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+  }
+
+  // xorshift64: basta para elegir victima y no comparte estado entre hilos
+  uint64_t
+  NextRandom(uint64_t& state) {
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    return state;
+  }
+}
+
+WorkStealingScheduler::WorkStealingScheduler(size_t threads, size_t injectDepth)
+  : m_nextInbox(0),
+    m_sleeping(0),
+    m_stop(false),
+    m_submitted(0),
+    m_rejected(0) {
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  // Las deques y colas existen antes de arrancar cualquier hilo: se roban entre ellos
+  for (size_t i = 0; i < threads; ++i) {
+    m_workers.emplace_back(new Worker(injectDepth));
+    m_workers.back()->random = 0x9E3779B97F4A7C15ull * (i + 1);
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    m_workers[i]->thread = std::thread(&WorkStealingScheduler::WorkerLoop, this, i);
+  }
+}
+
+WorkStealingScheduler::~WorkStealingScheduler() {
+  {
+    std::lock_guard<std::mutex> guard(m_sleepLock);
+    m_stop = true;
+  }
+  m_wakeup.notify_all();
+  for (auto& worker : m_workers) {
+    worker->thread.join();
+  }
+
+  // Tareas que no llegaron a ejecutarse
+  Task* task = nullptr;
+  for (auto& worker : m_workers) {
+    while (worker->deque.Pop(task) || worker->inbox.TryPop(task)) {
+      delete task;
+    }
+  }
+}
+
+bool
+WorkStealingScheduler::Submit(Task task) {
+  Task* node = new Task(std::move(task));
+
+  if (InWorker()) {
+    Worker& self = *m_workers[t_worker];
+    self.deque.Push(node);
+    Bump(self.spawned);
+    WakeOne();
+    return true;
+  }
+
+  // Round-robin; si esa cola esta llena se prueba con las siguientes
+  size_t start = m_nextInbox.fetch_add(1, std::memory_order_relaxed);
+  for (size_t i = 0; i < m_workers.size(); ++i) {
+    Task* pending = node;
+    if (m_workers[(start + i) % m_workers.size()]->inbox.TryPush(std::move(pending))) {
+      m_submitted.fetch_add(1, std::memory_order_relaxed);
+      WakeOne();
+      return true;
+    }
+  }
+  delete node;
+  m_rejected.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+bool
+WorkStealingScheduler::InWorker() const {
+  return t_scheduler == this;
+}
+
+void
+WorkStealingScheduler::WakeOne() {
+  // Emparejado con la barrera del worker antes de dormir
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (m_sleeping.load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> guard(m_sleepLock);
+    m_wakeup.notify_one();
+  }
+}
+
+WorkStealingScheduler::Task*
+WorkStealingScheduler::FindTask(size_t index) {
+  Worker& self = *m_workers[index];
+  Task* task = nullptr;
+
+  // Primero lo que llego de fuera (latencia) y luego lo lanzado aqui
+  if (self.inbox.TryPop(task) || self.deque.Pop(task)) {
+    return task;
+  }
+
+  // Robo desde una victima al azar y recorriendo el resto a partir de ella
+  size_t count = m_workers.size();
+  size_t start = static_cast<size_t>(NextRandom(self.random) % count);
+  for (size_t i = 0; i < count; ++i) {
+    size_t victim = (start + i) % count;
+    if (victim == index) {
+      continue;
+    }
+    if (m_workers[victim]->inbox.TryPop(task) || m_workers[victim]->deque.Steal(task)) {
+      Bump(self.stolen);
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void
+WorkStealingScheduler::WorkerLoop(size_t index) {
+  const int kSpins = 64;
+  Worker& self = *m_workers[index];
+  t_scheduler = this;
+  t_worker = index;
+
+  // DRBG y contextos del hilo listos antes de la primera tarea
+  SecureRandom::Prime();
+  AlgorithmCache::ThreadHMAC();
+  AlgorithmCache::ThreadHKDF();
+
+  while (true) {
+    Task* task = nullptr;
+    for (int spin = 0; spin < kSpins && !task; ++spin) {
+      task = FindTask(index);
+      if (!task) {
+        std::this_thread::yield();
+      }
+    }
+
+    if (!task) {
+      std::unique_lock<std::mutex> lock(m_sleepLock);
+      m_sleeping.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      // Se comprueba de nuevo con el contador ya subido: Submit vera al durmiente
+      while (!m_stop && !(task = FindTask(index))) {
+        m_wakeup.wait(lock);
+      }
+      m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+      if (!task) {
+        break;  // m_stop
+      }
+    }
+
+    (*task)();
+    delete task;
+    Bump(self.executed);
+  }
+
+  t_scheduler = nullptr;
+}
+
+WorkStealingScheduler::Stats
+WorkStealingScheduler::GetStats() const {
+  Stats stats;
+  stats.submitted = m_submitted.load(std::memory_order_relaxed);
+  stats.rejected = m_rejected.load(std::memory_order_relaxed);
+  for (const auto& worker : m_workers) {
+    stats.spawned += worker->spawned.load(std::memory_order_relaxed);
+    stats.executed += worker->executed.load(std::memory_order_relaxed);
+    stats.stolen += worker->stolen.load(std::memory_order_relaxed);
+  }
+  return stats;
+}